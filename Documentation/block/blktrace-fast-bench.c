@@ -0,0 +1,179 @@
+/*
+ * blktrace-fast-bench.c
+ *
+ * Measure what block tracing costs per I/O: tracing off, full relay
+ * tracing, the fast mode recording every event, and the fast mode
+ * recording only completions slower than a threshold.  Each run issues
+ * the same sequence of 4k O_DIRECT reads; use a device that completes
+ * them without seek or media time, so the trace cost shows:
+ *
+ *	modprobe null_blk
+ *	./blktrace-fast-bench /dev/nullb0 [nr_ios] [threshold_us]
+ *
+ * Nothing reads the relay files during the relay run, so once its
+ * buffers are full events are counted as dropped, but each one is
+ * still formatted.  debugfs must be mounted on /sys/kernel/debug.
+ *
+ * Compile with
+ *	gcc -O2 -I/usr/src/linux/include blktrace-fast-bench.c \
+ *		-o blktrace-fast-bench -lrt
+ *
+ * This file is released under the GPL.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+
+#include <linux/fs.h>
+#include <linux/blktrace_api.h>
+
+#define DEBUGFS		"/sys/kernel/debug/block"
+#define IO_SIZE		4096
+#define NR_IOS		200000
+#define THRESHOLD_US	1000
+
+static char buf[IO_SIZE] __attribute__ ((aligned(IO_SIZE)));
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void write_file(const char *name, const char *dir, unsigned value)
+{
+	char path[256], val[16];
+	int fd, len;
+
+	snprintf(path, sizeof(path), "%s/%s/%s", DEBUGFS, dir, name);
+	len = snprintf(val, sizeof(val), "%u\n", value);
+	fd = open(path, O_WRONLY);
+	if (fd < 0 || write(fd, val, len) != len)
+		die(path);
+	close(fd);
+}
+
+/* empty the fast buffers, returning how many records they held */
+static unsigned long drain_fast(const char *dir)
+{
+	struct blk_fast_trace t[256];
+	unsigned long nr = 0;
+	char path[256];
+	ssize_t ret;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s/fast", DEBUGFS, dir);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		die(path);
+	while ((ret = read(fd, t, sizeof(t))) > 0)
+		nr += ret / sizeof(t[0]);
+	close(fd);
+	return nr;
+}
+
+/* returns nanoseconds per I/O */
+static double run(int fd, unsigned long long size, unsigned long nr_ios)
+{
+	unsigned long long off = 0;
+	unsigned long i;
+	double start;
+
+	start = now();
+	for (i = 0; i < nr_ios; i++) {
+		if (pread(fd, buf, IO_SIZE, off) != IO_SIZE)
+			die("pread");
+		off += IO_SIZE;
+		if (off + IO_SIZE > size)
+			off = 0;
+	}
+	return (now() - start) * 1e9 / nr_ios;
+}
+
+static void report(const char *mode, double ns, double base,
+		   unsigned long records)
+{
+	printf("%-10s %9.0f %9.0f %+8.1f%% %10lu\n", mode, 1e9 / ns, ns,
+	       base ? (ns - base) * 100 / base : 0.0, records);
+}
+
+int main(int argc, char **argv)
+{
+	struct blk_user_trace_setup buts;
+	unsigned long nr_ios = NR_IOS;
+	unsigned threshold = THRESHOLD_US;
+	unsigned long long size;
+	double off, ns;
+	int fd;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <device> [nr_ios] [threshold_us]\n",
+			argv[0]);
+		return 1;
+	}
+	if (argc > 2)
+		nr_ios = strtoul(argv[2], NULL, 0);
+	if (argc > 3)
+		threshold = strtoul(argv[3], NULL, 0);
+
+	fd = open(argv[1], O_RDONLY | O_DIRECT);
+	if (fd < 0)
+		die(argv[1]);
+	if (ioctl(fd, BLKGETSIZE64, &size) < 0)
+		die("BLKGETSIZE64");
+	if (size < IO_SIZE) {
+		fprintf(stderr, "%s: device too small\n", argv[1]);
+		return 1;
+	}
+
+	printf("%-10s %9s %9s %9s %10s\n", "mode", "ios/s", "ns/io",
+	       "overhead", "records");
+
+	/* warm up, then the baseline */
+	run(fd, size, nr_ios / 10);
+	off = run(fd, size, nr_ios);
+	report("off", off, 0, 0);
+
+	memset(&buts, 0, sizeof(buts));
+	buts.act_mask = 0xffff;
+	buts.buf_size = 512 * 1024;
+	buts.buf_nr = 4;
+	if (ioctl(fd, BLKTRACESETUP, &buts) < 0)
+		die("BLKTRACESETUP");
+	if (ioctl(fd, BLKTRACESTART) < 0)
+		die("BLKTRACESTART");
+
+	write_file("fast_mode", buts.name, Blktrace_relay);
+	ns = run(fd, size, nr_ios);
+	report("relay", ns, off, 0);
+
+	write_file("fast_mode", buts.name, Blktrace_fast);
+	drain_fast(buts.name);
+	ns = run(fd, size, nr_ios);
+	report("fast", ns, off, drain_fast(buts.name));
+
+	write_file("fast_threshold_us", buts.name, threshold);
+	write_file("fast_mode", buts.name, Blktrace_fast_slow);
+	ns = run(fd, size, nr_ios);
+	report("sampled", ns, off, drain_fast(buts.name));
+
+	ioctl(fd, BLKTRACESTOP);
+	ioctl(fd, BLKTRACETEARDOWN);
+	close(fd);
+	return 0;
+}
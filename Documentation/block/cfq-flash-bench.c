@@ -0,0 +1,224 @@
+/*
+ * cfq-flash-bench: fairness, throughput and latency of CFQ on a
+ * non-rotational device, with and without its flash mode
+ *
+ * Runs three processes against <dev> for <secs> seconds: two doing
+ * random 4k O_DIRECT reads, one at best-effort priority 0 and one at
+ * priority 7, and one writing 64k blocks through the page cache, which
+ * reach the device as async requests.  This is done with the CFQ
+ * flash_mode tunable of the device set to 0 and then to 1, and for each
+ * job the I/O per second and the average and worst time per I/O are
+ * printed.  The ratio of the two readers' rates shows how io priorities
+ * are honoured, their latency how long they wait behind each other and
+ * behind the writes.  The old flash_mode is restored at the end.
+ *
+ * The device must be non-rotational and use CFQ, and its contents are
+ * overwritten.  null_blk with a completion delay stands in for flash:
+ *
+ *	modprobe null_blk queue_mode=1 irqmode=2 completion_nsec=100000
+ *	echo cfq > /sys/block/nullb0/queue/scheduler
+ *	cfq-flash-bench [-s secs] /dev/nullb0
+ *
+ * Compile with
+ *	gcc -O2 -o cfq-flash-bench cfq-flash-bench.c
+ *
+ * This file is released under the GPL.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include <linux/fs.h>
+
+#define READ_SIZE		4096
+#define WRITE_SIZE		(64 << 10)
+#define WRITE_AREA		(1ULL << 30)
+#define IOPRIO_CLASS_BE		2
+#define IOPRIO_CLASS_SHIFT	13
+#define IOPRIO_WHO_PROCESS	1
+
+enum { READ_HIGH, READ_LOW, WRITE, NR_JOBS };
+
+static const char *job_names[NR_JOBS] = {
+	"read prio 0", "read prio 7", "buffered write",
+};
+static const int job_prios[NR_JOBS] = { 0, 7, 4 };
+
+struct result {
+	unsigned long ios;
+	double total;
+	double worst;
+};
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static void job(const char *dev, int nr, unsigned long long size,
+		double deadline, struct result *res)
+{
+	unsigned long long off = 0;
+	unsigned int seed = nr + 1;
+	void *buf;
+	double t;
+	int fd;
+
+	if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+		    IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT | job_prios[nr]))
+		die("ioprio_set");
+	if (posix_memalign(&buf, READ_SIZE, WRITE_SIZE))
+		_exit(1);
+	memset(buf, 0x5a, WRITE_SIZE);
+	fd = open(dev, nr == WRITE ? O_WRONLY : O_RDONLY | O_DIRECT);
+	if (fd < 0)
+		die(dev);
+
+	while ((t = now()) < deadline) {
+		if (nr == WRITE) {
+			if (pwrite(fd, buf, WRITE_SIZE, off) != WRITE_SIZE)
+				die("pwrite");
+			off = (off + WRITE_SIZE) % WRITE_AREA;
+		} else {
+			off = ((unsigned long long)rand_r(&seed) << 31 |
+			       rand_r(&seed)) % (size / READ_SIZE) * READ_SIZE;
+			if (pread(fd, buf, READ_SIZE, off) != READ_SIZE)
+				die("pread");
+		}
+		t = now() - t;
+		res->ios++;
+		res->total += t;
+		if (t > res->worst)
+			res->worst = t;
+	}
+	if (nr == WRITE)
+		fsync(fd);
+	_exit(0);
+}
+
+static void set_flash_mode(const char *path, const char *val)
+{
+	int fd = open(path, O_WRONLY);
+
+	if (fd < 0 || write(fd, val, strlen(val)) != (ssize_t)strlen(val))
+		die(path);
+	close(fd);
+}
+
+static void run(const char *dev, const char *tunable, int mode,
+		unsigned long long size, int secs, struct result *res)
+{
+	double deadline;
+	int i, status, failed = 0;
+
+	set_flash_mode(tunable, mode ? "1" : "0");
+	memset(res, 0, NR_JOBS * sizeof(*res));
+	fflush(stdout);
+	deadline = now() + secs;
+	for (i = 0; i < NR_JOBS; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0)
+			die("fork");
+		if (!pid)
+			job(dev, i, size, deadline, &res[i]);
+	}
+	for (i = 0; i < NR_JOBS; i++)
+		if (wait(&status) < 0 || !WIFEXITED(status) ||
+		    WEXITSTATUS(status))
+			failed = 1;
+	if (failed) {
+		fprintf(stderr, "a job failed\n");
+		exit(1);
+	}
+
+	printf("flash_mode=%d\n", mode);
+	for (i = 0; i < NR_JOBS; i++)
+		printf("  %-15s %10.0f %12.1f %12.1f\n", job_names[i],
+		       (double)res[i].ios / secs,
+		       res[i].ios ? res[i].total * 1e6 / res[i].ios : 0,
+		       res[i].worst * 1e6);
+	printf("  prio 0 / prio 7 reads: %.2f\n",
+	       res[READ_LOW].ios ?
+	       (double)res[READ_HIGH].ios / res[READ_LOW].ios : 0);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long size;
+	char tunable[256], old[16];
+	struct result *res;
+	int secs = 10, opt, fd;
+	ssize_t len;
+
+	while ((opt = getopt(argc, argv, "s:")) != -1) {
+		switch (opt) {
+		case 's':
+			secs = atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || secs <= 0)
+		goto usage;
+
+	fd = open(argv[optind], O_RDONLY);
+	if (fd < 0 || ioctl(fd, BLKGETSIZE64, &size))
+		die(argv[optind]);
+	close(fd);
+	if (size < WRITE_AREA) {
+		fprintf(stderr, "%s: device smaller than 1GB\n", argv[optind]);
+		return 1;
+	}
+
+	snprintf(tunable, sizeof(tunable),
+		 "/sys/block/%s/queue/iosched/flash_mode",
+		 basename(argv[optind]));
+	fd = open(tunable, O_RDONLY);
+	if (fd < 0) {
+		perror(tunable);
+		fprintf(stderr, "is the device using cfq?\n");
+		return 1;
+	}
+	len = read(fd, old, sizeof(old) - 1);
+	close(fd);
+	if (len <= 0)
+		die(tunable);
+	old[len] = '\0';
+
+	res = mmap(NULL, NR_JOBS * sizeof(*res), PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (res == MAP_FAILED)
+		die("mmap");
+
+	printf("%d secs per run\n", secs);
+	printf("  %-15s %10s %12s %12s\n", "", "ios/s", "avg us", "max us");
+	run(argv[optind], tunable, 0, size, secs, res);
+	run(argv[optind], tunable, 1, size, secs, res);
+	set_flash_mode(tunable, old);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-s secs] <dev>\n", argv[0]);
+	return 1;
+}
@@ -0,0 +1,162 @@
+/*
+ * io-poll-bench: latency of synchronous O_DIRECT reads with completion
+ * interrupts and with polling
+ *
+ * Issues <ios> 4k O_DIRECT reads of <dev>, one at a time, with the
+ * queue's io_poll attribute set to 0 and then to 1, and prints the reads
+ * per second, the average, median, 99th percentile and worst latency,
+ * and the cpu time used per read.  Without polling the reader sleeps
+ * until the completion wakes it; with polling it spins in the kernel and
+ * reaps its own completion, trading cpu time for latency.  The old
+ * io_poll setting is restored at the end.
+ *
+ * null_blk completes from a per-cpu timer in irqmode=2, which it can
+ * also poll:
+ *
+ *	modprobe null_blk irqmode=2 completion_nsec=10000
+ *	io-poll-bench /dev/nullb0 [ios]
+ *
+ * Reloading null_blk with complete_batch=0 and 1 shows what batched
+ * completion saves on the interrupt side.
+ *
+ * Compile with
+ *	gcc -O2 -o io-poll-bench io-poll-bench.c -lrt
+ *
+ * This file is released under the GPL.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+
+#include <linux/fs.h>
+
+#define IO_SIZE		4096
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpu_time(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+	       ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void set_io_poll(const char *path, const char *val)
+{
+	int fd = open(path, O_WRONLY);
+
+	if (fd < 0 || write(fd, val, strlen(val)) != (ssize_t)strlen(val))
+		die(path);
+	close(fd);
+}
+
+static void run(int fd, const char *attr, int poll, unsigned long long blocks,
+		unsigned long ios, double *lat)
+{
+	unsigned int seed = 1;
+	unsigned long i;
+	double t, start, cpu, total = 0;
+	void *buf;
+
+	if (posix_memalign(&buf, IO_SIZE, IO_SIZE))
+		die("posix_memalign");
+	set_io_poll(attr, poll ? "1" : "0");
+
+	cpu = cpu_time();
+	start = now();
+	for (i = 0; i < ios; i++) {
+		off_t off = ((unsigned long long)rand_r(&seed) << 31 |
+			     rand_r(&seed)) % blocks * IO_SIZE;
+
+		t = now();
+		if (pread(fd, buf, IO_SIZE, off) != IO_SIZE)
+			die("pread");
+		lat[i] = now() - t;
+		total += lat[i];
+	}
+	start = now() - start;
+	cpu = cpu_time() - cpu;
+
+	qsort(lat, ios, sizeof(*lat), cmp_double);
+	printf("%-8s %10.0f %8.1f %8.1f %8.1f %8.1f %10.1f\n",
+	       poll ? "poll" : "irq", ios / start, total * 1e6 / ios,
+	       lat[ios / 2] * 1e6, lat[ios * 99 / 100] * 1e6,
+	       lat[ios - 1] * 1e6, cpu * 1e6 / ios);
+	free(buf);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long size;
+	unsigned long ios = 100000;
+	char attr[256], old[16];
+	double *lat;
+	ssize_t len;
+	int fd, attr_fd;
+
+	if (argc > 2)
+		ios = strtoul(argv[2], NULL, 0);
+	if (argc < 2 || argc > 3 || !ios) {
+		fprintf(stderr, "usage: %s <dev> [ios]\n", argv[0]);
+		return 1;
+	}
+
+	fd = open(argv[1], O_RDONLY | O_DIRECT);
+	if (fd < 0 || ioctl(fd, BLKGETSIZE64, &size))
+		die(argv[1]);
+	if (size < IO_SIZE) {
+		fprintf(stderr, "%s: device too small\n", argv[1]);
+		return 1;
+	}
+	lat = malloc(ios * sizeof(*lat));
+	if (!lat)
+		die("malloc");
+
+	snprintf(attr, sizeof(attr), "/sys/block/%s/queue/io_poll",
+		 basename(argv[1]));
+	attr_fd = open(attr, O_RDONLY);
+	if (attr_fd < 0)
+		die(attr);
+	len = read(attr_fd, old, sizeof(old) - 1);
+	close(attr_fd);
+	if (len <= 0)
+		die(attr);
+	old[len] = '\0';
+
+	printf("%lu reads\n", ios);
+	printf("%-8s %10s %8s %8s %8s %8s %10s\n", "", "reads/s", "avg us",
+	       "50% us", "99% us", "max us", "cpu us/io");
+	run(fd, attr, 0, size / IO_SIZE, ios, lat);
+	run(fd, attr, 1, size / IO_SIZE, ios, lat);
+	set_io_poll(attr, old);
+	return 0;
+}
@@ -0,0 +1,144 @@
+/*
+ * mq-iops-bench: 4k random read IOPS with 1, 2, 4, ... threads
+ *
+ * Runs 1, 2, 4, ... <threads> threads that each issue random 4k O_DIRECT
+ * reads of <dev>, one at a time, for <secs> seconds, and prints the
+ * reads per second of all threads together.  On a device that costs
+ * next to nothing per I/O the rate is bounded by the submission path:
+ * with one queue lock it stops growing after a couple of threads, with
+ * per-cpu staging it should keep growing up to the number of cpus.
+ * Compare
+ *
+ *	modprobe brd rd_mq=0	and	modprobe brd rd_mq=1
+ *	mq-iops-bench /dev/ram0
+ *
+ * or null_blk with queue_mode=1 and queue_mode=2 on /dev/nullb0.
+ *
+ *	mq-iops-bench [-t threads] [-s secs] <dev>
+ *
+ * threads defaults to the number of cpus.
+ *
+ * Compile with
+ *	gcc -O2 -o mq-iops-bench mq-iops-bench.c -lpthread
+ *
+ * This file is released under the GPL.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+
+#include <linux/fs.h>
+
+#define IO_SIZE		4096
+#define MAX_THREADS	256
+
+struct worker {
+	pthread_t thread;
+	int fd;
+	unsigned int seed;
+	unsigned long count;
+} __attribute__ ((aligned(64)));
+
+static struct worker workers[MAX_THREADS];
+static unsigned long long blocks;
+static volatile int stop;
+
+static void *work(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long n = 0;
+	unsigned long long block;
+	void *buf;
+
+	if (posix_memalign(&buf, IO_SIZE, IO_SIZE)) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	while (!stop) {
+		block = ((unsigned long long)rand_r(&w->seed) << 31 |
+			 rand_r(&w->seed)) % blocks;
+		if (pread(w->fd, buf, IO_SIZE, block * IO_SIZE) != IO_SIZE) {
+			perror("pread");
+			exit(1);
+		}
+		n++;
+	}
+	w->count = n;
+	free(buf);
+	return NULL;
+}
+
+static void run(int threads, int secs)
+{
+	unsigned long total = 0;
+	int i;
+
+	stop = 0;
+	for (i = 0; i < threads; i++)
+		if (pthread_create(&workers[i].thread, NULL, work,
+				   &workers[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	sleep(secs);
+	stop = 1;
+	for (i = 0; i < threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		total += workers[i].count;
+	}
+	printf("%7d %12.0f %12.0f\n", threads, (double)total / secs,
+	       (double)total / secs / threads);
+}
+
+int main(int argc, char **argv)
+{
+	int threads = sysconf(_SC_NPROCESSORS_ONLN), secs = 5, opt, i, fd;
+	unsigned long long size;
+
+	while ((opt = getopt(argc, argv, "t:s:")) != -1) {
+		switch (opt) {
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 's':
+			secs = atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || threads <= 0 || threads > MAX_THREADS ||
+	    secs <= 0)
+		goto usage;
+
+	fd = open(argv[optind], O_RDONLY | O_DIRECT);
+	if (fd < 0 || ioctl(fd, BLKGETSIZE64, &size)) {
+		perror(argv[optind]);
+		return 1;
+	}
+	blocks = size / IO_SIZE;
+	if (!blocks) {
+		fprintf(stderr, "%s: device too small\n", argv[optind]);
+		return 1;
+	}
+	for (i = 0; i < MAX_THREADS; i++) {
+		workers[i].fd = fd;
+		workers[i].seed = i + 1;
+	}
+
+	printf("%7s %12s %12s\n", "threads", "reads/s", "per thread");
+	for (i = 1; i < threads; i *= 2)
+		run(i, secs);
+	run(threads, secs);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-t threads] [-s secs] <dev>\n", argv[0]);
+	return 1;
+}
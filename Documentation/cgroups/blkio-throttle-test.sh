@@ -0,0 +1,101 @@
+#!/bin/sh
+# Check that blkio throttling holds a background group to its limit and
+# that a foreground group's latency improves in exchange.
+#
+# A null_blk device with a 2ms completion time and a queue depth of 4
+# stands in for a slow flash card.  Four background readers saturate it,
+# first unthrottled and then limited to $LIMIT bytes per second, while a
+# foreground reader measures its average 4k read latency.  Needs root,
+# null_blk and the blkio cgroup subsystem.
+
+set -e
+
+LIMIT=${LIMIT:-1048576}
+WINDOW=${WINDOW:-5}
+CG=${CG:-/tmp/blkio-test}
+DEV=/dev/nullb0
+
+now_us() {
+	echo $((`date +%s%N` / 1000))
+}
+
+cleanup() {
+	kill $BG 2>/dev/null || true
+	wait 2>/dev/null || true
+	rmdir $CG/fg $CG/bg 2>/dev/null || true
+	umount $CG 2>/dev/null || true
+	rmdir $CG 2>/dev/null || true
+	rmmod null_blk 2>/dev/null || true
+}
+trap cleanup EXIT
+
+modprobe null_blk queue_mode=1 irqmode=2 completion_nsec=2000000 \
+	hw_queue_depth=4 nr_devices=1
+mkdir -p $CG
+mount -t cgroup -o blkio none $CG
+mkdir $CG/fg $CG/bg
+MAJMIN=`cat /sys/block/nullb0/dev`
+
+# background readers, each in its own endless loop
+start_bg() {
+	BG=
+	for i in 1 2 3 4; do
+		sh -c "echo \$\$ > $CG/bg/tasks
+		       while :; do
+				dd if=$DEV of=/dev/null bs=64k count=256 \
+					iflag=direct 2>/dev/null
+		       done" &
+		BG="$BG $!"
+	done
+	sleep 1
+}
+
+stop_bg() {
+	kill $BG
+	wait $BG 2>/dev/null || true
+	BG=
+}
+
+# average latency in us of 500 sequential 4k direct reads
+fg_latency() {
+	sh -c "echo \$\$ > $CG/fg/tasks
+	       t0=\`date +%s%N\`
+	       dd if=$DEV of=/dev/null bs=4k count=500 skip=1000 \
+			iflag=direct 2>/dev/null
+	       t1=\`date +%s%N\`
+	       echo \$(((t1 - t0) / 500000))"
+}
+
+# rate in bytes per second of the whole background group, from the
+# sectors the device read over $WINDOW seconds with only it running
+bg_rate() {
+	s0=`awk '{ print $3 }' /sys/block/nullb0/stat`
+	sleep $WINDOW
+	s1=`awk '{ print $3 }' /sys/block/nullb0/stat`
+	echo $(((s1 - s0) * 512 / WINDOW))
+}
+
+start_bg
+lat0=`fg_latency`
+stop_bg
+
+echo "$MAJMIN $LIMIT" > $CG/bg/blkio.throttle.read_bps_device
+start_bg
+lat1=`fg_latency`
+rate=`bg_rate`
+stop_bg
+
+echo "foreground latency: ${lat0}us unthrottled, ${lat1}us throttled"
+echo "background rate:    $rate B/s, limit $LIMIT B/s"
+
+status=0
+if [ $rate -gt $((LIMIT * 11 / 10)) ]; then
+	echo "FAIL: background group exceeds its limit"
+	status=1
+fi
+if [ $lat1 -ge $lat0 ]; then
+	echo "FAIL: foreground latency did not improve"
+	status=1
+fi
+[ $status -eq 0 ] && echo "PASS"
+exit $status
@@ -0,0 +1,180 @@
+/*
+ * cache-bench: random read throughput and hit ratio of a dm cache device
+ *
+ * Runs <rounds> rounds of <secs> seconds in which <threads> threads
+ * issue random 4k O_DIRECT reads of /dev/mapper/<name>, and prints the
+ * reads and megabytes per second of each round and, for a cache target,
+ * the share of its read hits taken from the deltas of `dmsetup status`.
+ * The first rounds promote the blocks read; once the working set, the
+ * size of the table line, is cached, the reads run at the speed of the
+ * cache device.  Run it on the origin device too for a baseline.
+ *
+ * A ram disk caches a loop device slowed down by the delay target:
+ *
+ *	modprobe brd rd_nr=1 rd_size=131072
+ *	dd if=/dev/zero of=/var/tmp/origin bs=1M count=1024
+ *	losetup /dev/loop0 /var/tmp/origin
+ *	echo "0 2097152 delay /dev/loop0 0 2" | dmsetup create slow
+ *	echo "0 196608 cache /dev/mapper/slow /dev/ram0 64 writeback lru 0" |
+ *		dmsetup create cached
+ *	cache-bench cached
+ *
+ * which caches the first 96MB of the origin in a 128MB cache.  A table
+ * line longer than the cache shows how the hit ratio falls off.
+ *
+ *	cache-bench [-r rounds] [-s secs] [-t threads] <name>
+ *
+ * Compile with
+ *	gcc -O2 -o cache-bench cache-bench.c -lpthread
+ *
+ * This file is released under the GPL.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+
+#include <linux/fs.h>
+
+#define IO_SIZE		4096
+#define MAX_THREADS	64
+
+struct worker {
+	pthread_t thread;
+	unsigned int seed;
+	unsigned long count;
+} __attribute__ ((aligned(64)));
+
+static struct worker workers[MAX_THREADS];
+static unsigned long long blocks;
+static volatile int stop;
+static int fd;
+
+static void *work(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long n = 0;
+	unsigned long long block;
+	void *buf;
+
+	if (posix_memalign(&buf, IO_SIZE, IO_SIZE)) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	while (!stop) {
+		block = ((unsigned long long)rand_r(&w->seed) << 31 |
+			 rand_r(&w->seed)) % blocks;
+		if (pread(fd, buf, IO_SIZE, block * IO_SIZE) != IO_SIZE) {
+			perror("pread");
+			exit(1);
+		}
+		n++;
+	}
+	w->count = n;
+	free(buf);
+	return NULL;
+}
+
+/* read hits and misses of a cache target, 0 if @name is not one */
+static int cache_stats(const char *name, unsigned long *hits,
+		       unsigned long *misses)
+{
+	char cmd[256], target[32];
+	FILE *f;
+	int n;
+
+	snprintf(cmd, sizeof(cmd), "dmsetup status %s", name);
+	f = popen(cmd, "r");
+	if (!f)
+		return 0;
+	n = fscanf(f, "%*u %*u %31s %*u %*u %*u %lu %lu",
+		   target, hits, misses);
+	pclose(f);
+	return n == 3 && !strcmp(target, "cache");
+}
+
+static void run(const char *name, int round, int threads, int secs)
+{
+	unsigned long total = 0, hits0, misses0, hits, misses;
+	int i, cache;
+
+	cache = cache_stats(name, &hits0, &misses0);
+	stop = 0;
+	for (i = 0; i < threads; i++)
+		if (pthread_create(&workers[i].thread, NULL, work,
+				   &workers[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	sleep(secs);
+	stop = 1;
+	for (i = 0; i < threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		total += workers[i].count;
+	}
+
+	printf("%6d %10.0f %10.1f", round, (double)total / secs,
+	       (double)total * IO_SIZE / secs / (1 << 20));
+	if (cache && cache_stats(name, &hits, &misses) &&
+	    hits + misses > hits0 + misses0)
+		printf(" %9.1f%%\n", 100.0 * (hits - hits0) /
+		       (hits + misses - hits0 - misses0));
+	else
+		printf(" %10s\n", "-");
+}
+
+int main(int argc, char **argv)
+{
+	int rounds = 5, secs = 10, threads = 4, opt, i;
+	unsigned long long size;
+	char path[256];
+
+	while ((opt = getopt(argc, argv, "r:s:t:")) != -1) {
+		switch (opt) {
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 's':
+			secs = atoi(optarg);
+			break;
+		case 't':
+			threads = atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || rounds <= 0 || secs <= 0 ||
+	    threads <= 0 || threads > MAX_THREADS)
+		goto usage;
+
+	snprintf(path, sizeof(path), "/dev/mapper/%s", argv[optind]);
+	fd = open(path, O_RDONLY | O_DIRECT);
+	if (fd < 0 || ioctl(fd, BLKGETSIZE64, &size)) {
+		perror(path);
+		return 1;
+	}
+	blocks = size / IO_SIZE;
+	if (!blocks) {
+		fprintf(stderr, "%s: device too small\n", path);
+		return 1;
+	}
+	for (i = 0; i < threads; i++)
+		workers[i].seed = i + 1;
+
+	printf("%s, %llu MB, %d threads\n", argv[optind], size >> 20, threads);
+	printf("%6s %10s %10s %10s\n", "round", "reads/s", "MB/s", "hits");
+	for (i = 1; i <= rounds; i++)
+		run(argv[optind], i, threads, secs);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-r rounds] [-s secs] [-t threads] <name>\n",
+		argv[0]);
+	return 1;
+}
@@ -0,0 +1,104 @@
+#!/bin/sh
+# Exercise the dm cache target: promotion, write back, reloading the
+# cache after removing the device, and reloading it after a crash.
+#
+# Two ram disks stand in for the origin and the cache.  The cache sits
+# on a linear device of its own, so a crash can be simulated by
+# swapping that for the error target: nothing written after that point,
+# including the table written on removal, reaches the cache.  Needs
+# root, brd and dmsetup.
+
+set -e
+
+BS=64				# 32k cache blocks
+ORIGIN=/dev/ram0
+CACHE=/dev/mapper/cdev
+CACHED=/dev/mapper/cached
+
+cleanup() {
+	dmsetup remove cached 2>/dev/null || true
+	dmsetup remove cdev 2>/dev/null || true
+	rmmod brd 2>/dev/null || true
+	rm -f /tmp/cache-test.$$
+}
+trap cleanup EXIT
+
+fail() {
+	echo "FAIL: $*"
+	exit 1
+}
+
+# status fields: blocks used dirty read-hits read-misses write-hits
+# write-misses promotions demotions write-backs
+field() {
+	dmsetup status cached | awk "{ print \$(3 + $1) }"
+}
+
+# md5 of $3 MB at MB offset $2 of device $1
+sum() {
+	dd if=$1 bs=1M skip=$2 count=$3 iflag=direct 2>/dev/null | md5sum
+}
+
+create() {
+	echo "0 `blockdev --getsize $ORIGIN` cache $ORIGIN $CACHE $BS $1 lru 0" |
+		dmsetup create cached
+}
+
+cdev_table() {
+	echo "0 32768 $1" | dmsetup load cdev
+	dmsetup resume cdev
+}
+
+modprobe brd rd_nr=2 rd_size=65536
+dd if=/dev/urandom of=$ORIGIN bs=1M count=64 2>/dev/null
+dd if=/dev/zero of=/dev/ram1 bs=1M count=16 2>/dev/null
+echo "0 32768 linear /dev/ram1 0" | dmsetup create cdev
+
+# promotion: the first read of 4MB promotes it, the second one hits
+create writeback
+dd if=$CACHED of=/dev/null bs=32k count=128 iflag=direct 2>/dev/null
+[ `field 8` -eq 128 ] || fail "promoted `field 8` blocks, expected 128"
+dd if=$CACHED of=/dev/null bs=32k count=128 iflag=direct 2>/dev/null
+[ `field 4` -eq 128 ] || fail "`field 4` read hits, expected 128"
+echo "promotion ok"
+
+# write back: dirty blocks reach the origin after about 5 seconds
+dd if=/dev/urandom of=/tmp/cache-test.$$ bs=1M count=2 2>/dev/null
+dd if=/tmp/cache-test.$$ of=$CACHED bs=1M seek=8 oflag=direct 2>/dev/null
+[ `field 3` -eq 64 ] || fail "`field 3` dirty blocks, expected 64"
+sleep 8
+[ `field 3` -eq 0 ] || fail "`field 3` blocks still dirty"
+[ "`sum $ORIGIN 8 2`" = "`md5sum < /tmp/cache-test.$$`" ] ||
+	fail "origin differs after write back"
+echo "write back ok"
+
+# dtr/reload: every cached block comes back, and hits
+used=`field 2`
+dmsetup remove cached
+create writeback
+[ `field 2` -eq $used ] || fail "reloaded `field 2` blocks, expected $used"
+dd if=$CACHED of=/dev/null bs=32k count=128 iflag=direct 2>/dev/null
+[ `field 4` -eq 128 ] || fail "`field 4` read hits after reload"
+[ `field 8` -eq 0 ] || fail "`field 8` promotions after reload"
+[ "`sum $CACHED 8 2`" = "`md5sum < /tmp/cache-test.$$`" ] ||
+	fail "data differs after reload"
+echo "reload ok"
+
+# crash: dirty blocks must survive, clean ones are dropped
+dd if=/dev/urandom of=/tmp/cache-test.$$ bs=1M count=1 2>/dev/null
+dd if=/tmp/cache-test.$$ of=$CACHED bs=1M seek=12 oflag=direct 2>/dev/null
+dmsetup suspend cdev
+cdev_table error
+dmsetup remove cached
+cdev_table "linear /dev/ram1 0"
+create writeback
+[ `field 3` -eq 32 ] || fail "`field 3` dirty blocks after crash, expected 32"
+[ `field 2` -eq 32 ] || fail "`field 2` blocks after crash, expected 32"
+[ "`sum $CACHED 12 1`" = "`md5sum < /tmp/cache-test.$$`" ] ||
+	fail "dirty data lost in crash"
+sleep 8
+[ "`sum $ORIGIN 12 1`" = "`md5sum < /tmp/cache-test.$$`" ] ||
+	fail "origin differs after crash and write back"
+echo "crash reload ok"
+
+echo "PASS"
@@ -0,0 +1,69 @@
+#!/bin/sh
+# dm-crypt throughput with 1, 2, 4, ... parallel writers and readers.
+#
+#	dm-crypt-bench.sh [max_jobs] [cipher]
+#
+# Puts a crypt target, with the given cipher (default
+# aes-cbc-essiv:sha256) and a random key, on a 512MB ram disk.  For each
+# number of jobs from 1 up to max_jobs (default: the number of cpus),
+# that many dd processes write their own slice of the device with
+# O_DIRECT, and then read it back.  The write and read throughput of
+# all jobs together is printed.  The ram disk costs next to nothing, so
+# this measures encryption; it stops growing with the jobs once every
+# cpu is busy, or from the first job on if all crypto runs on a single
+# thread.  Needs root, brd and dmsetup.
+
+set -e
+
+JOBS=${1:-`grep -c ^processor /proc/cpuinfo`}
+CIPHER=${2:-aes-cbc-essiv:sha256}
+MB=512
+DEV=/dev/mapper/crypt-bench
+
+cleanup() {
+	dmsetup remove crypt-bench 2>/dev/null || true
+	rmmod brd 2>/dev/null || true
+}
+trap cleanup EXIT
+
+now() {
+	date +%s.%N
+}
+
+# $1: jobs, $2: "write" or "read", prints MB/s
+run() {
+	slice=$((MB / $1))
+	start=`now`
+	i=0
+	while [ $i -lt $1 ]; do
+		if [ $2 = write ]; then
+			dd if=/dev/zero of=$DEV bs=1M count=$slice \
+				seek=$((i * slice)) oflag=direct 2>/dev/null &
+		else
+			dd if=$DEV of=/dev/null bs=1M count=$slice \
+				skip=$((i * slice)) iflag=direct 2>/dev/null &
+		fi
+		i=$((i + 1))
+	done
+	wait
+	echo "$start `now` $((slice * $1))" |
+		awk '{ printf "%10.1f", $3 / ($2 - $1) }'
+}
+
+modprobe brd rd_nr=1 rd_size=$((MB * 1024))
+KEY=`dd if=/dev/urandom bs=32 count=1 2>/dev/null | od -An -tx1 | tr -d ' \n'`
+echo "0 $((MB * 2048)) crypt $CIPHER $KEY 0 /dev/ram0 0" |
+	dmsetup create crypt-bench
+
+echo "$CIPHER, $MB MB"
+printf "%6s %10s %10s\n" jobs "write MB/s" "read MB/s"
+n=1
+while :; do
+	[ $n -gt $JOBS ] && n=$JOBS
+	printf "%6d" $n
+	run $n write
+	run $n read
+	echo
+	[ $n -eq $JOBS ] && break
+	n=$((n * 2))
+done
@@ -0,0 +1,184 @@
+/*
+ * aio-bench: buffered asynchronous reads at increasing queue depths
+ *
+ * Issues <ios> random 4k buffered (not O_DIRECT) reads of <file> with
+ * io_submit(), keeping 1, 2, 4, ... 64 of them in flight, and drops
+ * the cached pages of the file before each depth.  Prints the reads per
+ * second, and the average and worst time io_submit() took.  When
+ * io_submit() reads uncached data itself, the depth does not help and
+ * submission takes as long as the read; when the reads are passed to
+ * the aio worker threads, submission stays short and throughput grows
+ * with the depth as far as the device allows.  How many reads ran
+ * inline and how many in the workers is taken from /proc/self/aio.
+ *
+ *	aio-bench <file> [ios]
+ *
+ * <file> should be much larger than the reads cover, on a disk, or on
+ * a loop device backed by one.
+ *
+ * Compile with
+ *	gcc -O2 -o aio-bench aio-bench.c
+ *
+ * This file is released under the GPL.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+
+#include <linux/aio_abi.h>
+
+#define IO_SIZE		4096
+#define MAX_DEPTH	64
+
+static char bufs[MAX_DEPTH][IO_SIZE];
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static int io_setup(unsigned nr, aio_context_t *ctx)
+{
+	return syscall(__NR_io_setup, nr, ctx);
+}
+
+static int io_destroy(aio_context_t ctx)
+{
+	return syscall(__NR_io_destroy, ctx);
+}
+
+static int io_submit(aio_context_t ctx, long nr, struct iocb **iocbs)
+{
+	return syscall(__NR_io_submit, ctx, nr, iocbs);
+}
+
+static int io_getevents(aio_context_t ctx, long min_nr, long nr,
+			struct io_event *events)
+{
+	return syscall(__NR_io_getevents, ctx, min_nr, nr, events, NULL);
+}
+
+static void submit(aio_context_t ctx, struct iocb *iocb, int fd,
+		   off_t blocks, double *total, double *worst)
+{
+	struct iocb *p = iocb;
+	double t;
+
+	iocb->aio_fildes = fd;
+	iocb->aio_lio_opcode = IOCB_CMD_PREAD;
+	iocb->aio_nbytes = IO_SIZE;
+	iocb->aio_offset = (off_t)(random() % blocks) * IO_SIZE;
+
+	t = now();
+	if (io_submit(ctx, 1, &p) != 1)
+		die("io_submit");
+	t = now() - t;
+	*total += t;
+	if (t > *worst)
+		*worst = t;
+}
+
+/* reads run inline and by the aio workers in the only context */
+static void aio_stats(unsigned long *inline_nr, unsigned long *worker_nr)
+{
+	FILE *f = fopen("/proc/self/aio", "r");
+
+	*inline_nr = *worker_nr = 0;
+	if (!f)
+		return;
+	if (fscanf(f, "%*x %*u inline %lu %*u %*u worker %lu",
+		   inline_nr, worker_nr) != 2)
+		*inline_nr = *worker_nr = 0;
+	fclose(f);
+}
+
+static void run(int fd, off_t blocks, int depth, unsigned long ios)
+{
+	struct iocb iocbs[MAX_DEPTH];
+	struct io_event events[MAX_DEPTH];
+	unsigned long submitted = 0, done = 0, inline_nr, worker_nr;
+	double t, total = 0, worst = 0;
+	aio_context_t ctx = 0;
+	int i, n;
+
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	if (io_setup(depth, &ctx))
+		die("io_setup");
+	memset(iocbs, 0, sizeof(iocbs));
+	for (i = 0; i < depth; i++)
+		iocbs[i].aio_buf = (unsigned long)bufs[i];
+
+	t = now();
+	for (i = 0; i < depth && submitted < ios; i++, submitted++)
+		submit(ctx, &iocbs[i], fd, blocks, &total, &worst);
+	while (done < ios) {
+		n = io_getevents(ctx, 1, depth, events);
+		if (n < 0)
+			die("io_getevents");
+		for (i = 0; i < n; i++) {
+			struct iocb *iocb = (struct iocb *)(unsigned long)
+				events[i].obj;
+
+			if (events[i].res != IO_SIZE) {
+				fprintf(stderr, "read returned %lld\n",
+					(long long)events[i].res);
+				exit(1);
+			}
+			done++;
+			if (submitted < ios) {
+				submit(ctx, iocb, fd, blocks, &total, &worst);
+				submitted++;
+			}
+		}
+	}
+	t = now() - t;
+	aio_stats(&inline_nr, &worker_nr);
+	io_destroy(ctx);
+
+	printf("%6d %10.0f %12.1f %12.1f %10lu %10lu\n", depth, ios / t,
+	       total * 1e6 / ios, worst * 1e6, inline_nr, worker_nr);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long ios = 10000;
+	struct stat st;
+	int fd, depth;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <file> [ios]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 2)
+		ios = strtoul(argv[2], NULL, 0);
+
+	fd = open(argv[1], O_RDONLY);
+	if (fd < 0 || fstat(fd, &st))
+		die(argv[1]);
+	if (st.st_size < IO_SIZE) {
+		fprintf(stderr, "%s: file too small\n", argv[1]);
+		return 1;
+	}
+
+	printf("%6s %10s %12s %12s %10s %10s\n", "depth", "reads/s",
+	       "submit avg", "submit max", "inline", "worker");
+	for (depth = 1; depth <= MAX_DEPTH; depth *= 2)
+		run(fd, st.st_size / IO_SIZE, depth, ios);
+	return 0;
+}
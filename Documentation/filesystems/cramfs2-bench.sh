@@ -0,0 +1,100 @@
+#!/bin/sh
+# Cold read throughput of cramfs2 images against cramfs.
+#
+#	cramfs2-bench.sh <dir> [readers]
+#
+# Builds images of <dir> with mkcramfs, if it is installed, and with
+# mkcramfs2 using zlib and LZO at a few block sizes.  Each image is
+# mounted through a loop device and every file in it is read once with
+# the page cache dropped beforehand, first by a single reader and then
+# split between <readers> (default 4) parallel readers.  Prints the
+# image size and the read throughput of each.
+#
+# Needs root.  mkcramfs2 is built from scripts/cramfs2/mkcramfs2.c, with
+# -DWITH_LZO for the LZO images, and looked up in $PATH unless
+# $MKCRAMFS2 is set.  The images are kept in $TMPDIR, which should not
+# be a tmpfs, or the loop devices would read from memory.
+
+set -e
+
+SRC=$1
+READERS=${2:-4}
+MKCRAMFS2=${MKCRAMFS2:-mkcramfs2}
+WORK=${TMPDIR:-/var/tmp}/cramfs2-bench.$$
+MNT=$WORK/mnt
+
+if [ -z "$SRC" ] || [ ! -d "$SRC" ]; then
+	echo "usage: $0 <dir> [readers]" >&2
+	exit 1
+fi
+
+cleanup() {
+	umount $MNT 2>/dev/null || true
+	rm -rf $WORK
+}
+trap cleanup EXIT
+mkdir -p $MNT
+
+now() {
+	date +%s.%N
+}
+
+drop_caches() {
+	sync
+	echo 3 > /proc/sys/vm/drop_caches
+}
+
+# read the files listed in $WORK/list, reader $1 of $2
+reader() {
+	awk -v i=$1 -v n=$2 'NR % n == i' $WORK/list |
+		(cd $MNT && xargs -d '\n' cat) > /dev/null
+}
+
+# time reading every file with $1 readers, print MB/s
+read_all() {
+	drop_caches
+	start=$(now)
+	i=0
+	while [ $i -lt $1 ]; do
+		reader $i $1 &
+		i=$((i + 1))
+	done
+	wait
+	end=$(now)
+	echo "$start $end $BYTES" |
+		awk '{ printf "%10.1f", $3 / ($2 - $1) / 1048576 }'
+}
+
+# $1: fs type, $2: image, $3: description
+bench() {
+	mount -t $1 -o loop,ro $2 $MNT
+	size=$(stat -c %s $2)
+	printf "%-22s %10d" "$3" $((size / 1024))
+	read_all 1
+	read_all $READERS
+	echo
+	umount $MNT
+}
+
+(cd "$SRC" && find . -type f) > $WORK/list
+BYTES=$(cd "$SRC" && find . -type f -printf '%s\n' |
+	awk '{ s += $1 } END { print s }')
+echo "$(wc -l < $WORK/list) files, $((BYTES / 1048576)) MB"
+printf "%-22s %10s %10s %10s\n" "image" "KB" "1 MB/s" "$READERS MB/s"
+
+if command -v mkcramfs > /dev/null; then
+	mkcramfs "$SRC" $WORK/cramfs.img > /dev/null
+	bench cramfs $WORK/cramfs.img "cramfs"
+fi
+
+for comp in zlib lzo; do
+	for bs in 32768 131072 1048576; do
+		img=$WORK/cramfs2-$comp-$bs.img
+		if ! $MKCRAMFS2 -c $comp -b $bs "$SRC" $img > /dev/null 2>&1
+		then
+			echo "cramfs2 $comp $((bs / 1024))k: mkcramfs2 failed"
+			continue
+		fi
+		bench cramfs2 $img "cramfs2 $comp $((bs / 1024))k"
+	done
+done
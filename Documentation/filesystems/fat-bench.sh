@@ -0,0 +1,93 @@
+#!/bin/sh
+# statfs and large file write times on a big, fragmented FAT32 volume.
+#
+#	fat-bench.sh <image> [size_mb] [fill_pct] [file_mb]
+#
+# Creates a sparse FAT32 image of size_mb (default 16384) megabytes,
+# fills fill_pct (default 50) percent of it with 1 MB files and deletes
+# every other one, so that the free space is scattered over the FAT as
+# on a card that has been in use for a while.  It then remounts the
+# image with the page cache dropped and times the first statfs(), and
+# the writing of a file_mb (default 256) megabyte file and its number
+# of extents, once right after mounting and once after giving the
+# background scan of the FAT time to finish.
+#
+# Needs root, mkfs.vfat and filefrag.  Pass a block device instead of
+# an image file to measure a real card; everything on it is lost.
+
+set -e
+
+IMG=$1
+SIZE=${2:-16384}
+FILL=${3:-50}
+FILE=${4:-256}
+MNT=/tmp/fat-bench.$$
+
+if [ -z "$IMG" ]; then
+	echo "usage: $0 <image> [size_mb] [fill_pct] [file_mb]" >&2
+	exit 1
+fi
+
+cleanup() {
+	umount $MNT 2>/dev/null || true
+	rmdir $MNT 2>/dev/null || true
+}
+trap cleanup EXIT
+mkdir -p $MNT
+
+now() {
+	date +%s.%N
+}
+
+elapsed() {
+	echo "$1 $(now)" | awk '{ printf "%.3f", $2 - $1 }'
+}
+
+OPT=
+if [ ! -b "$IMG" ]; then
+	rm -f "$IMG"
+	truncate -s ${SIZE}M "$IMG"
+	OPT=loop
+fi
+
+mkfs.vfat -F 32 "$IMG" > /dev/null
+mount -t vfat ${OPT:+-o $OPT} "$IMG" $MNT
+
+echo "filling $FILL% of $SIZE MB"
+mkdir $MNT/fill
+n=$((SIZE * FILL / 100))
+i=0
+while [ $i -lt $n ]; do
+	dd if=/dev/zero of=$MNT/fill/$i bs=1M count=1 2>/dev/null
+	i=$((i + 1))
+done
+i=0
+while [ $i -lt $n ]; do
+	rm $MNT/fill/$i
+	i=$((i + 2))
+done
+
+# $1: label, $2: seconds to wait after mounting
+run() {
+	umount $MNT
+	sync
+	echo 3 > /proc/sys/vm/drop_caches
+	mount -t vfat ${OPT:+-o $OPT} "$IMG" $MNT
+	sleep $2
+
+	start=$(now)
+	stat -f -c %f $MNT > /dev/null
+	statfs=$(elapsed $start)
+
+	start=$(now)
+	dd if=/dev/zero of=$MNT/big bs=1M count=$FILE conv=fsync 2>/dev/null
+	write=$(elapsed $start)
+	extents=$(filefrag $MNT/big | awk '{ print $2 }')
+	rm $MNT/big
+
+	printf "%-16s %10s %10s %10s\n" "$1" $statfs $write $extents
+}
+
+printf "%-16s %10s %10s %10s\n" "" "statfs s" "write s" "extents"
+run "after mount" 0
+run "after scan" 30
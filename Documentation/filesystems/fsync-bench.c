@@ -0,0 +1,244 @@
+/*
+ * fsync-bench: concurrent small synchronous writes on a jbd2 file system
+ *
+ * Starts <threads> threads that each write <bytes> to the next part of
+ * a 1 MB file of their own in <dir> and fsync() it, over and over for
+ * <secs> seconds.
+ * Prints the fsyncs per second of all threads together and the average
+ * and worst fsync latency, and then how many commits the journal made
+ * and how they are spread over the commit time and batch size buckets
+ * of /proc/fs/jbd2/<dev>/histogram during the run.  Running it with 1,
+ * 2, 4, ... threads, and with the min_batch_time= and max_batch_time=
+ * mount options, shows how well synchronous writes are batched.
+ *
+ *	fsync-bench [-t threads] [-s secs] [-b bytes] <dir>
+ *
+ * Compile with
+ *	gcc -O2 -o fsync-bench fsync-bench.c -lpthread
+ *
+ * This file is released under the GPL.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/time.h>
+
+#define PROC_JBD2	"/proc/fs/jbd2"
+#define BUCKETS		12
+#define MAX_THREADS	256
+#define FILE_SIZE	(1 << 20)
+
+struct worker {
+	pthread_t thread;
+	int fd;
+	unsigned long fsyncs;
+	double total, worst;
+};
+
+struct histogram {
+	char label[BUCKETS][2][16];
+	unsigned long commits[BUCKETS], batches[BUCKETS];
+};
+
+static struct worker workers[MAX_THREADS];
+static size_t bytes = 4096;
+static double deadline;
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void *work(void *arg)
+{
+	struct worker *w = arg;
+	char *buf = malloc(bytes);
+	off_t off = 0;
+	double t, d;
+
+	if (!buf)
+		return NULL;
+	memset(buf, 0x5a, bytes);
+	while ((t = now()) < deadline) {
+		if (pwrite(w->fd, buf, bytes, off) != (ssize_t)bytes ||
+		    fsync(w->fd)) {
+			perror("write");
+			exit(1);
+		}
+		d = now() - t;
+		w->fsyncs++;
+		w->total += d;
+		if (d > w->worst)
+			w->worst = d;
+		off += bytes;
+		if (off + bytes > FILE_SIZE)
+			off = 0;
+	}
+	free(buf);
+	return NULL;
+}
+
+/* find /proc/fs/jbd2/<dev>-<inode>/histogram for the device of @dir */
+static int find_histogram(const char *dir, char *path, size_t len)
+{
+	char link[PATH_MAX], target[PATH_MAX], *name;
+	struct dirent *de;
+	struct stat st;
+	ssize_t n;
+	size_t nlen;
+	DIR *d;
+
+	if (stat(dir, &st))
+		return -1;
+	snprintf(link, sizeof(link), "/sys/dev/block/%u:%u",
+		 major(st.st_dev), minor(st.st_dev));
+	n = readlink(link, target, sizeof(target) - 1);
+	if (n < 0)
+		return -1;
+	target[n] = '\0';
+	name = strrchr(target, '/');
+	name = name ? name + 1 : target;
+	nlen = strlen(name);
+
+	d = opendir(PROC_JBD2);
+	if (!d)
+		return -1;
+	while ((de = readdir(d)))
+		if (!strncmp(de->d_name, name, nlen) &&
+		    de->d_name[nlen] == '-') {
+			snprintf(path, len, "%s/%s/histogram", PROC_JBD2,
+				 de->d_name);
+			closedir(d);
+			return 0;
+		}
+	closedir(d);
+	return -1;
+}
+
+/*
+ * The rows are fixed width: a 12 character bucket, the commits in 11,
+ * three spaces, another 12 character bucket and the commits in 11.
+ */
+static int read_histogram(const char *path, struct histogram *h)
+{
+	char line[128];
+	int i = 0;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	while (fgets(line, sizeof(line), f) && i < BUCKETS) {
+		if (strlen(line) < 49)
+			continue;
+		if (sscanf(line + 12, "%lu", &h->commits[i]) != 1 ||
+		    sscanf(line + 38, "%lu", &h->batches[i]) != 1)
+			continue;
+		memcpy(h->label[i][0], line, 12);
+		h->label[i][0][12] = '\0';
+		memcpy(h->label[i][1], line + 26, 12);
+		h->label[i][1][12] = '\0';
+		i++;
+	}
+	fclose(f);
+	return i == BUCKETS ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+	struct histogram before, after;
+	unsigned long fsyncs = 0, commits = 0;
+	int threads = 4, secs = 10, opt, i, hist;
+	double total = 0, worst = 0, t;
+	char path[PATH_MAX];
+
+	while ((opt = getopt(argc, argv, "t:s:b:")) != -1) {
+		switch (opt) {
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 's':
+			secs = atoi(optarg);
+			break;
+		case 'b':
+			bytes = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || threads <= 0 || threads > MAX_THREADS ||
+	    secs <= 0 || !bytes || bytes > FILE_SIZE)
+		goto usage;
+
+	hist = !find_histogram(argv[optind], path, sizeof(path)) &&
+		!read_histogram(path, &before);
+	if (!hist)
+		fprintf(stderr, "no jbd2 histogram for %s\n", argv[optind]);
+
+	for (i = 0; i < threads; i++) {
+		char name[PATH_MAX];
+
+		snprintf(name, sizeof(name), "%s/fsync-bench.%d",
+			 argv[optind], i);
+		workers[i].fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (workers[i].fd < 0) {
+			perror(name);
+			return 1;
+		}
+		unlink(name);
+	}
+
+	t = now();
+	deadline = t + secs;
+	for (i = 0; i < threads; i++)
+		if (pthread_create(&workers[i].thread, NULL, work,
+				   &workers[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	for (i = 0; i < threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		fsyncs += workers[i].fsyncs;
+		total += workers[i].total;
+		if (workers[i].worst > worst)
+			worst = workers[i].worst;
+		close(workers[i].fd);
+	}
+	t = now() - t;
+
+	printf("%d threads: %.0f fsyncs/s, latency avg %.0fus max %.0fus\n",
+	       threads, fsyncs / t, fsyncs ? total * 1e6 / fsyncs : 0.0,
+	       worst * 1e6);
+
+	if (!hist || read_histogram(path, &after))
+		return 0;
+	for (i = 0; i < BUCKETS; i++)
+		commits += after.commits[i] - before.commits[i];
+	printf("%lu commits, %.1f fsyncs per commit\n\n", commits,
+	       commits ? (double)fsyncs / commits : 0.0);
+	printf("%12s %10s   %12s %10s\n", "commit time", "commits",
+	       "sync handles", "commits");
+	for (i = 0; i < BUCKETS; i++)
+		printf("%s %10lu   %s %10lu\n", after.label[i][0],
+		       after.commits[i] - before.commits[i], after.label[i][1],
+		       after.batches[i] - before.batches[i]);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-t threads] [-s secs] [-b bytes] <dir>\n",
+		argv[0]);
+	return 1;
+}
@@ -0,0 +1,440 @@
+/*
+ * fuse-bench: passthrough FUSE throughput, copying against splicing
+ *
+ * Mounts a minimal FUSE filesystem on <mnt> that holds a single file,
+ * "data", passed through to <backing>.  The filesystem talks to
+ * /dev/fuse directly, with <threads> threads that each read requests
+ * from a device file of their own, cloned with FUSE_DEV_IOC_CLONE.
+ * It then writes <mb> megabytes to mnt/data and reads them back, and
+ * prints the throughput of both.
+ *
+ * This is done twice.  The first time the threads read requests and
+ * write replies with read() and writev(), copying all the data.  The
+ * second time requests are spliced out of the device into a pipe, the
+ * data of WRITE requests is spliced from the pipe into <backing>, and
+ * READ replies are spliced from <backing> into a pipe and from there
+ * into the device with SPLICE_F_MOVE, so that the page cache pages of
+ * <backing> move into the page cache of mnt/data.
+ *
+ *	fuse-bench [-t threads] [-m mb] <mnt> <backing>
+ *
+ * Put <backing> on tmpfs to measure FUSE rather than the disk under it.
+ * Needs root, to mount and to grow the pipes.
+ *
+ * Compile with
+ *	gcc -O2 -I/usr/src/linux/include -o fuse-bench fuse-bench.c -lpthread
+ *
+ * This file is released under the GPL.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+
+#include <linux/fuse.h>
+
+#ifndef F_SETPIPE_SZ
+#define F_SETPIPE_SZ	(1024 + 7)
+#endif
+
+#define MAX_THREADS	64
+#define MAX_WRITE	(128 * 1024)
+#define BUF_SIZE	(MAX_WRITE + 4096)
+#define PIPE_SIZE	(256 * 1024)
+#define IO_SIZE		(1024 * 1024)
+#define FILE_ID		2
+
+struct worker {
+	pthread_t thread;
+	int fd;
+	int req[2];
+	int rep[2];
+	char buf[BUF_SIZE];
+	char data[MAX_WRITE];	/* READs are at most 32 pages */
+};
+
+static struct worker workers[MAX_THREADS];
+static int backing;
+static int use_splice;
+static char io_buf[IO_SIZE];
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static void reply(struct worker *w, struct fuse_in_header *in, int error,
+		  void *arg, size_t len)
+{
+	struct fuse_out_header out;
+	struct iovec iov[2];
+
+	out.len = sizeof(out) + len;
+	out.error = error;
+	out.unique = in->unique;
+	iov[0].iov_base = &out;
+	iov[0].iov_len = sizeof(out);
+	iov[1].iov_base = arg;
+	iov[1].iov_len = len;
+	if (writev(w->fd, iov, 2) < 0 && errno != ENOENT)
+		perror("reply");
+}
+
+static void fill_attr(struct fuse_attr *attr, unsigned long long ino)
+{
+	struct stat st;
+
+	memset(attr, 0, sizeof(*attr));
+	attr->ino = ino;
+	if (ino == FUSE_ROOT_ID) {
+		attr->mode = S_IFDIR | 0755;
+		attr->nlink = 2;
+		return;
+	}
+	fstat(backing, &st);
+	attr->mode = S_IFREG | 0644;
+	attr->nlink = 1;
+	attr->size = st.st_size;
+	attr->blocks = st.st_blocks;
+	attr->blksize = 4096;
+}
+
+static void do_read(struct worker *w, struct fuse_in_header *in,
+		    struct fuse_read_in *arg)
+{
+	struct fuse_out_header out;
+	loff_t off = arg->offset;
+	struct stat st;
+	ssize_t len, n;
+
+	if (!use_splice) {
+		len = pread(backing, w->data, arg->size, arg->offset);
+		if (len < 0)
+			reply(w, in, -errno, NULL, 0);
+		else
+			reply(w, in, 0, w->data, len);
+		return;
+	}
+
+	fstat(backing, &st);
+	len = arg->size;
+	if (arg->offset >= st.st_size)
+		len = 0;
+	else if (arg->offset + len > st.st_size)
+		len = st.st_size - arg->offset;
+
+	out.len = sizeof(out) + len;
+	out.error = 0;
+	out.unique = in->unique;
+	if (write(w->rep[1], &out, sizeof(out)) != sizeof(out))
+		die("write to pipe");
+	for (n = len; n > 0; n -= len) {
+		len = splice(backing, &off, w->rep[1], NULL, n, 0);
+		if (len <= 0)
+			die("splice from backing file");
+	}
+	if (splice(w->rep[0], NULL, w->fd, NULL, out.len, SPLICE_F_MOVE) < 0)
+		perror("splice reply");
+}
+
+/* in splice mode the data is still in the pipe */
+static void do_write(struct worker *w, struct fuse_in_header *in,
+		     struct fuse_write_in *arg, void *data)
+{
+	struct fuse_write_out out;
+	loff_t off = arg->offset;
+	ssize_t len, n;
+
+	memset(&out, 0, sizeof(out));
+	if (!use_splice) {
+		len = pwrite(backing, data, arg->size, arg->offset);
+		if (len < 0) {
+			reply(w, in, -errno, NULL, 0);
+			return;
+		}
+		out.size = len;
+		reply(w, in, 0, &out, sizeof(out));
+		return;
+	}
+
+	for (n = arg->size; n > 0; n -= len) {
+		len = splice(w->req[0], NULL, backing, &off, n, SPLICE_F_MOVE);
+		if (len <= 0)
+			die("splice to backing file");
+	}
+	out.size = arg->size;
+	reply(w, in, 0, &out, sizeof(out));
+}
+
+static void handle(struct worker *w, struct fuse_in_header *in, void *arg)
+{
+	union {
+		struct fuse_init_out init;
+		struct fuse_entry_out entry;
+		struct fuse_attr_out attr;
+		struct fuse_open_out open;
+		struct fuse_statfs_out statfs;
+	} out;
+
+	memset(&out, 0, sizeof(out));
+	switch (in->opcode) {
+	case FUSE_INIT: {
+		struct fuse_init_in *init = arg;
+
+		out.init.major = FUSE_KERNEL_VERSION;
+		out.init.minor = FUSE_KERNEL_MINOR_VERSION;
+		out.init.max_readahead = init->max_readahead;
+		out.init.flags = FUSE_ASYNC_READ | FUSE_BIG_WRITES;
+		out.init.max_write = MAX_WRITE;
+		reply(w, in, 0, &out.init, sizeof(out.init));
+		break;
+	}
+	case FUSE_LOOKUP:
+		if (in->nodeid != FUSE_ROOT_ID || strcmp(arg, "data")) {
+			reply(w, in, -ENOENT, NULL, 0);
+			break;
+		}
+		out.entry.nodeid = FILE_ID;
+		out.entry.generation = 1;
+		fill_attr(&out.entry.attr, FILE_ID);
+		reply(w, in, 0, &out.entry, sizeof(out.entry));
+		break;
+	case FUSE_GETATTR:
+		fill_attr(&out.attr.attr, in->nodeid);
+		reply(w, in, 0, &out.attr, sizeof(out.attr));
+		break;
+	case FUSE_SETATTR: {
+		struct fuse_setattr_in *setattr = arg;
+
+		if ((setattr->valid & FATTR_SIZE) &&
+		    ftruncate(backing, setattr->size)) {
+			reply(w, in, -errno, NULL, 0);
+			break;
+		}
+		fill_attr(&out.attr.attr, in->nodeid);
+		reply(w, in, 0, &out.attr, sizeof(out.attr));
+		break;
+	}
+	case FUSE_OPEN:
+	case FUSE_OPENDIR:
+		reply(w, in, 0, &out.open, sizeof(out.open));
+		break;
+	case FUSE_READ:
+		do_read(w, in, arg);
+		break;
+	case FUSE_WRITE:
+		do_write(w, in, arg, (struct fuse_write_in *)arg + 1);
+		break;
+	case FUSE_STATFS:
+		out.statfs.st.bsize = 4096;
+		out.statfs.st.namelen = 255;
+		reply(w, in, 0, &out.statfs, sizeof(out.statfs));
+		break;
+	case FUSE_READDIR:
+		/* an empty listing is enough here */
+		reply(w, in, 0, NULL, 0);
+		break;
+	case FUSE_FLUSH:
+	case FUSE_RELEASE:
+	case FUSE_RELEASEDIR:
+	case FUSE_FSYNC:
+	case FUSE_DESTROY:
+		reply(w, in, 0, NULL, 0);
+		break;
+	case FUSE_FORGET:
+	case FUSE_INTERRUPT:
+		break;
+	default:
+		reply(w, in, -ENOSYS, NULL, 0);
+		break;
+	}
+}
+
+static void *serve(void *arg)
+{
+	struct worker *w = arg;
+	struct fuse_in_header *in = (struct fuse_in_header *)w->buf;
+	ssize_t len, rest;
+
+	for (;;) {
+		if (!use_splice) {
+			len = read(w->fd, w->buf, BUF_SIZE);
+			if (len < 0 && errno == ENODEV)
+				break;
+			if (len < (ssize_t)sizeof(*in)) {
+				if (len < 0 && (errno == EINTR || errno == ENOENT))
+					continue;
+				die("read request");
+			}
+			handle(w, in, in + 1);
+			continue;
+		}
+
+		len = splice(w->fd, NULL, w->req[1], NULL, PIPE_SIZE, 0);
+		if (len < 0 && errno == ENODEV)
+			break;
+		if (len < (ssize_t)sizeof(*in)) {
+			if (len < 0 && (errno == EINTR || errno == ENOENT))
+				continue;
+			die("splice request");
+		}
+		/* the header and arguments, leaving WRITE data in the pipe */
+		rest = len;
+		if (read(w->req[0], w->buf, sizeof(*in)) != sizeof(*in))
+			die("read from pipe");
+		rest -= sizeof(*in);
+		if (in->opcode == FUSE_WRITE)
+			rest = sizeof(struct fuse_write_in);
+		if (read(w->req[0], in + 1, rest) != rest)
+			die("read from pipe");
+		handle(w, in, in + 1);
+	}
+	return NULL;
+}
+
+static void start(const char *mnt, int threads)
+{
+	char opts[128];
+	int i;
+
+	workers[0].fd = open("/dev/fuse", O_RDWR);
+	if (workers[0].fd < 0)
+		die("/dev/fuse");
+	snprintf(opts, sizeof(opts),
+		 "fd=%d,rootmode=40000,user_id=0,group_id=0,allow_other",
+		 workers[0].fd);
+	if (mount("fuse-bench", mnt, "fuse", MS_NOSUID | MS_NODEV, opts))
+		die("mount");
+
+	for (i = 0; i < threads; i++) {
+		struct worker *w = &workers[i];
+		__u32 fd = workers[0].fd;
+
+		if (i) {
+			w->fd = open("/dev/fuse", O_RDWR);
+			if (w->fd < 0 || ioctl(w->fd, FUSE_DEV_IOC_CLONE, &fd))
+				die("FUSE_DEV_IOC_CLONE");
+		}
+		if (use_splice) {
+			if (pipe(w->req) || pipe(w->rep))
+				die("pipe");
+			if (fcntl(w->req[1], F_SETPIPE_SZ, PIPE_SIZE) < 0 ||
+			    fcntl(w->rep[1], F_SETPIPE_SZ, PIPE_SIZE) < 0)
+				die("F_SETPIPE_SZ");
+		}
+		if (pthread_create(&w->thread, NULL, serve, w))
+			die("pthread_create");
+	}
+}
+
+static void stop(const char *mnt, int threads)
+{
+	int i;
+
+	if (umount(mnt))
+		die("umount");
+	for (i = 0; i < threads; i++) {
+		struct worker *w = &workers[i];
+
+		pthread_join(w->thread, NULL);
+		close(w->fd);
+		if (use_splice) {
+			close(w->req[0]);
+			close(w->req[1]);
+			close(w->rep[0]);
+			close(w->rep[1]);
+		}
+	}
+}
+
+/* returns MB/s */
+static double transfer(const char *path, unsigned long mb, int writing)
+{
+	unsigned long i;
+	double t;
+	int fd;
+
+	fd = open(path, writing ? O_WRONLY | O_TRUNC : O_RDONLY);
+	if (fd < 0)
+		die(path);
+	t = now();
+	for (i = 0; i < mb; i++) {
+		ssize_t n = writing ? write(fd, io_buf, IO_SIZE) :
+				      read(fd, io_buf, IO_SIZE);
+
+		if (n != IO_SIZE)
+			die(writing ? "write" : "read");
+	}
+	if (writing && fsync(fd))
+		die("fsync");
+	t = now() - t;
+	close(fd);
+	return mb / t;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long mb = 256;
+	int threads = 4, opt;
+	char path[4096];
+	double w, r;
+
+	while ((opt = getopt(argc, argv, "t:m:")) != -1) {
+		switch (opt) {
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 'm':
+			mb = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 2 || threads <= 0 || threads > MAX_THREADS ||
+	    !mb)
+		goto usage;
+
+	backing = open(argv[optind + 1], O_RDWR | O_CREAT, 0644);
+	if (backing < 0)
+		die(argv[optind + 1]);
+	snprintf(path, sizeof(path), "%s/data", argv[optind]);
+	memset(io_buf, 0x5a, IO_SIZE);
+
+	printf("%d threads, %lu MB\n", threads, mb);
+	printf("%-8s %10s %10s\n", "", "write MB/s", "read MB/s");
+	for (use_splice = 0; use_splice < 2; use_splice++) {
+		start(argv[optind], threads);
+		w = transfer(path, mb, 1);
+		/* reopening drops the cached pages of mnt/data */
+		r = transfer(path, mb, 0);
+		stop(argv[optind], threads);
+		printf("%-8s %10.1f %10.1f\n", use_splice ? "splice" : "copy",
+		       w, r);
+	}
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-t threads] [-m mb] <mnt> <backing>\n",
+		argv[0]);
+	return 1;
+}
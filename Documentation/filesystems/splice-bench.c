@@ -0,0 +1,170 @@
+/*
+ * splice-bench: file to pipe to socket splice throughput by pipe size
+ *
+ * Sends <file> over a loopback TCP connection with splice(), from the
+ * file into a pipe and from the pipe into the socket, <passes> times,
+ * while a second thread reads and discards the data at the other end.
+ * This is repeated with the pipe resized by F_SETPIPE_SZ to 16, 32, 64,
+ * 128 and 256 pages, printing the throughput and the average bytes
+ * moved per splice() call for each.  The file is read once beforehand,
+ * so that it comes from the page cache.
+ *
+ *	splice-bench <file> [passes]
+ *
+ * Rings larger than /proc/sys/fs/pipe-max-size need CAP_SYS_RESOURCE.
+ *
+ * Compile with
+ *	gcc -O2 -o splice-bench splice-bench.c -lpthread
+ *
+ * This file is released under the GPL.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifndef F_SETPIPE_SZ
+#define F_SETPIPE_SZ	(1024 + 7)
+#define F_GETPIPE_SZ	(1024 + 8)
+#endif
+
+#define BUF_SIZE	(1 << 20)
+
+static char buf[BUF_SIZE];
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static void *receiver(void *arg)
+{
+	int fd = *(int *)arg;
+
+	while (read(fd, buf, BUF_SIZE) > 0)
+		;
+	return NULL;
+}
+
+/* returns the number of splice() calls */
+static unsigned long send_file(int in, off_t size, int pipefd[2], int out,
+			       size_t chunk)
+{
+	unsigned long calls = 0;
+	loff_t off = 0;
+	ssize_t n, m;
+
+	while (off < size) {
+		n = splice(in, &off, pipefd[1], NULL, chunk,
+			   SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (n <= 0)
+			die("splice from file");
+		calls++;
+		while (n > 0) {
+			m = splice(pipefd[0], NULL, out, NULL, n,
+				   SPLICE_F_MOVE | SPLICE_F_MORE);
+			if (m <= 0)
+				die("splice to socket");
+			calls++;
+			n -= m;
+		}
+	}
+	return calls;
+}
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int in, lfd, out, rfd, pipefd[2], passes = 10, pages, i;
+	long page = sysconf(_SC_PAGESIZE);
+	unsigned long calls;
+	pthread_t thread;
+	struct stat st;
+	ssize_t size;
+	double t;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <file> [passes]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 2)
+		passes = atoi(argv[2]);
+
+	in = open(argv[1], O_RDONLY);
+	if (in < 0 || fstat(in, &st))
+		die(argv[1]);
+	if (!st.st_size) {
+		fprintf(stderr, "%s: empty file\n", argv[1]);
+		return 1;
+	}
+	while (read(in, buf, BUF_SIZE) > 0)
+		;
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0)
+		die("socket");
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(lfd, 1) ||
+	    getsockname(lfd, (struct sockaddr *)&addr, &len))
+		die("listen");
+	out = socket(AF_INET, SOCK_STREAM, 0);
+	if (out < 0 || connect(out, (struct sockaddr *)&addr, sizeof(addr)))
+		die("connect");
+	rfd = accept(lfd, NULL, NULL);
+	if (rfd < 0)
+		die("accept");
+	if (pthread_create(&thread, NULL, receiver, &rfd))
+		die("pthread_create");
+
+	printf("%lld bytes x %d passes\n", (long long)st.st_size, passes);
+	printf("%6s %8s %10s %12s\n", "pages", "bytes", "MB/s", "bytes/call");
+	for (pages = 16; pages <= 256; pages *= 2) {
+		if (pipe(pipefd))
+			die("pipe");
+		size = fcntl(pipefd[1], F_SETPIPE_SZ, pages * page);
+		if (size < 0) {
+			perror("F_SETPIPE_SZ");
+			close(pipefd[0]);
+			close(pipefd[1]);
+			break;
+		}
+
+		calls = 0;
+		t = now();
+		for (i = 0; i < passes; i++)
+			calls += send_file(in, st.st_size, pipefd, out, size);
+		t = now() - t;
+		printf("%6d %8zd %10.1f %12.0f\n", pages, size,
+		       (double)st.st_size * passes / t / 1048576,
+		       (double)st.st_size * passes * 2 / calls);
+
+		close(pipefd[0]);
+		close(pipefd[1]);
+	}
+
+	shutdown(out, SHUT_WR);
+	pthread_join(thread, NULL);
+	return 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * stat-bench: parallel stat() of deep paths that share their leading
+ * directories
+ *
+ * Creates <dir>/a/b/c/d/e/f/g/h with one file per thread in it, then
+ * runs 1, 2, 4, ... <threads> threads that stat() their own file by its
+ * full path for <secs> seconds, and prints the stat() calls per second
+ * of all threads together.  Every call walks the same eight leading
+ * directories, so when the walk takes a reference on each of them the
+ * dentry counts bounce between cpus and the rate per thread drops as
+ * threads are added.  The files are removed again at the end.
+ *
+ *	stat-bench [-t threads] [-s secs] <dir>
+ *
+ * threads defaults to the number of cpus.  Use a directory on ext2,
+ * ext3 or tmpfs to exercise the RCU walk.
+ *
+ * Compile with
+ *	gcc -O2 -o stat-bench stat-bench.c -lpthread
+ *
+ * This file is released under the GPL.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define MAX_THREADS	256
+#define PREFIX		"/a/b/c/d/e/f/g/h"
+
+struct worker {
+	pthread_t thread;
+	char path[4096];
+	unsigned long count;
+} __attribute__ ((aligned(64)));
+
+static struct worker workers[MAX_THREADS];
+static volatile int stop;
+
+static void *work(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long n = 0;
+	struct stat st;
+
+	while (!stop) {
+		if (stat(w->path, &st)) {
+			perror(w->path);
+			exit(1);
+		}
+		n++;
+	}
+	w->count = n;
+	return NULL;
+}
+
+static void run(int threads, int secs)
+{
+	unsigned long total = 0;
+	int i;
+
+	stop = 0;
+	for (i = 0; i < threads; i++)
+		if (pthread_create(&workers[i].thread, NULL, work,
+				   &workers[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	sleep(secs);
+	stop = 1;
+	for (i = 0; i < threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		total += workers[i].count;
+	}
+	printf("%7d %12.0f %12.0f\n", threads, (double)total / secs,
+	       (double)total / secs / threads);
+}
+
+/* mkdir each directory of PREFIX under @dir */
+static void make_prefix(const char *dir)
+{
+	char path[4096];
+	const char *p = PREFIX;
+	int len;
+
+	do {
+		p = strchr(p + 1, '/');
+		len = p ? p - PREFIX : (int)strlen(PREFIX);
+		snprintf(path, sizeof(path), "%s%.*s", dir, len, PREFIX);
+		if (mkdir(path, 0755) && access(path, X_OK)) {
+			perror(path);
+			exit(1);
+		}
+	} while (p);
+}
+
+static void remove_prefix(const char *dir)
+{
+	char path[4096];
+	size_t len = strlen(dir);
+
+	snprintf(path, sizeof(path), "%s%s", dir, PREFIX);
+	while (strlen(path) > len) {
+		rmdir(path);
+		*strrchr(path, '/') = '\0';
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int threads = sysconf(_SC_NPROCESSORS_ONLN), secs = 5, opt, i, fd;
+
+	while ((opt = getopt(argc, argv, "t:s:")) != -1) {
+		switch (opt) {
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 's':
+			secs = atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || threads <= 0 || threads > MAX_THREADS ||
+	    secs <= 0)
+		goto usage;
+
+	make_prefix(argv[optind]);
+	for (i = 0; i < threads; i++) {
+		snprintf(workers[i].path, sizeof(workers[i].path),
+			 "%s%s/file%d", argv[optind], PREFIX, i);
+		fd = open(workers[i].path, O_WRONLY | O_CREAT, 0644);
+		if (fd < 0) {
+			perror(workers[i].path);
+			return 1;
+		}
+		close(fd);
+	}
+
+	printf("%7s %12s %12s\n", "threads", "stats/s", "per thread");
+	for (i = 1; i < threads; i *= 2)
+		run(i, secs);
+	run(threads, secs);
+
+	for (i = 0; i < threads; i++)
+		unlink(workers[i].path);
+	remove_prefix(argv[optind]);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-t threads] [-s secs] <dir>\n", argv[0]);
+	return 1;
+}
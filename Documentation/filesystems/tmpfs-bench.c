@@ -0,0 +1,139 @@
+/*
+ * tmpfs-bench: parallel create, write and unlink on a tmpfs mount
+ *
+ * Runs 1, 2, 4, ... <procs> processes that each create a file of their
+ * own in <dir>, write <kb> kilobytes to it and unlink it again, as often
+ * as they can for <secs> seconds, and prints the files per second of
+ * all processes together.  Every file charges an inode and its blocks
+ * to the mount and uncharges them again, so on a mount with a size or
+ * nr_inodes limit this measures how well that accounting scales:
+ *
+ *	mount -t tmpfs -o size=256m,nr_inodes=10k tmpfs /mnt
+ *	tmpfs-bench [-p procs] [-s secs] [-k kb] /mnt
+ *
+ * procs defaults to the number of cpus.
+ *
+ * Compile with
+ *	gcc -O2 -o tmpfs-bench tmpfs-bench.c
+ *
+ * This file is released under the GPL.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void worker(const char *dir, int id, size_t len, double deadline,
+		   unsigned long *count)
+{
+	char path[4096], *buf;
+	unsigned long n = 0;
+	int fd;
+
+	buf = malloc(len);
+	if (!buf)
+		_exit(1);
+	memset(buf, 0x5a, len);
+	snprintf(path, sizeof(path), "%s/tmpfs-bench.%d", dir, id);
+	while (now() < deadline) {
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0 || write(fd, buf, len) != (ssize_t)len) {
+			perror(path);
+			_exit(1);
+		}
+		close(fd);
+		unlink(path);
+		n++;
+	}
+	*count = n;
+	_exit(0);
+}
+
+static void run(const char *dir, int procs, int secs, size_t len,
+		unsigned long *counts)
+{
+	unsigned long total = 0;
+	double deadline;
+	int i, status, failed = 0;
+
+	fflush(stdout);
+	deadline = now() + secs;
+	for (i = 0; i < procs; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0) {
+			perror("fork");
+			exit(1);
+		}
+		if (!pid)
+			worker(dir, i, len, deadline, &counts[i]);
+	}
+	for (i = 0; i < procs; i++)
+		if (wait(&status) < 0 || !WIFEXITED(status) ||
+		    WEXITSTATUS(status))
+			failed = 1;
+	if (failed) {
+		fprintf(stderr, "a process failed\n");
+		exit(1);
+	}
+	for (i = 0; i < procs; i++)
+		total += counts[i];
+	printf("%6d %12.0f %12.0f\n", procs, (double)total / secs,
+	       (double)total / secs / procs);
+}
+
+int main(int argc, char **argv)
+{
+	int procs = sysconf(_SC_NPROCESSORS_ONLN), secs = 5, kb = 4, opt, n;
+	unsigned long *counts;
+
+	while ((opt = getopt(argc, argv, "p:s:k:")) != -1) {
+		switch (opt) {
+		case 'p':
+			procs = atoi(optarg);
+			break;
+		case 's':
+			secs = atoi(optarg);
+			break;
+		case 'k':
+			kb = atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || procs <= 0 || secs <= 0 || kb <= 0)
+		goto usage;
+
+	counts = mmap(NULL, procs * sizeof(*counts), PROT_READ | PROT_WRITE,
+		      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (counts == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	printf("%d KB files, %d secs per run\n", kb, secs);
+	printf("%6s %12s %12s\n", "procs", "files/s", "per proc");
+	for (n = 1; n < procs; n *= 2)
+		run(argv[optind], n, secs, (size_t)kb << 10, counts);
+	run(argv[optind], procs, secs, (size_t)kb << 10, counts);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-p procs] [-s secs] [-k kb] <dir>\n",
+		argv[0]);
+	return 1;
+}
@@ -0,0 +1,70 @@
+#!/bin/sh
+# RAID5 sequential write throughput with 0, 1, 2, 4, ... stripe workers.
+#
+#	md-raid5-bench.sh [disks] [chunk_kb] [max_workers]
+#
+# Builds a RAID5 array of <disks> (default 4) 256MB ram disks with
+# <chunk_kb> (default 64) chunks and writes it end to end with O_DIRECT,
+# once for every value of stripe_workers from 0 up to max_workers
+# (default: the number of cpus).  With 0 the array's md thread computes
+# all parity itself, so throughput is bound by one cpu; with more
+# workers it should grow until the cpus or memory bandwidth run out.
+# The ram disks cost next to nothing, so this measures stripe handling.
+# Needs root, brd and mdadm, and /dev/md0 must be unused.
+
+set -e
+
+DISKS=${1:-4}
+CHUNK=${2:-64}
+WORKERS=${3:-`grep -c ^processor /proc/cpuinfo`}
+MB=256
+MD=/dev/md0
+SYSFS=/sys/block/md0/md
+
+cleanup() {
+	mdadm --stop $MD >/dev/null 2>&1 || true
+	rmmod brd 2>/dev/null || true
+}
+trap cleanup EXIT
+
+now() {
+	date +%s.%N
+}
+
+# $1: workers, prints MB/s
+run() {
+	echo $1 > $SYSFS/stripe_workers
+	size=$((MB * (DISKS - 1)))
+	start=`now`
+	dd if=/dev/zero of=$MD bs=$((CHUNK * (DISKS - 1)))k \
+		count=$((size * 1024 / (CHUNK * (DISKS - 1)))) \
+		oflag=direct 2>/dev/null
+	echo "$start `now` $size" |
+		awk '{ printf "%10.1f\n", $3 / ($2 - $1) }'
+}
+
+modprobe brd rd_nr=$DISKS rd_size=$((MB * 1024))
+DEVS=
+i=0
+while [ $i -lt $DISKS ]; do
+	DEVS="$DEVS /dev/ram$i"
+	i=$((i + 1))
+done
+mdadm --create $MD --run --level=5 --raid-devices=$DISKS \
+	--chunk=$CHUNK --assume-clean $DEVS >/dev/null 2>&1
+echo 4096 > $SYSFS/stripe_cache_size
+
+echo "$DISKS disks, $CHUNK KB chunks, $((MB * (DISKS - 1))) MB"
+printf "%8s %10s\n" workers "write MB/s"
+n=0
+while :; do
+	printf "%8d" $n
+	run $n
+	[ $n -eq $WORKERS ] && break
+	if [ $n -eq 0 ]; then
+		n=1
+	else
+		n=$((n * 2))
+	fi
+	[ $n -gt $WORKERS ] && n=$WORKERS
+done
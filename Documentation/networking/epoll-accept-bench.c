@@ -0,0 +1,193 @@
+/*
+ * epoll-accept-bench: thundering herd of epoll sets on a listening socket
+ *
+ * Starts <threads> threads that each wait in epoll_wait() on an epoll
+ * set of their own, all of them watching the same non-blocking listening
+ * socket on the loopback interface, and accept() whatever connection
+ * they are woken for.  <conns> connections are then made one at a time,
+ * each once the previous one has been accepted, so every connection
+ * finds all the threads asleep.
+ *
+ * This is done once with the socket added to the sets plainly and once
+ * with EPOLLEXCLUSIVE.  For each it prints the rate of connections, and
+ * per connection the returns from epoll_wait(), the ones of those whose
+ * accept() found nothing, the voluntary context switches of the process
+ * and its cpu time.  Without the flag every thread is woken for each
+ * connection, although those that find the event already gone by the
+ * time they run go back to sleep inside epoll_wait(), so the herd shows
+ * in the context switches and cpu time.  With the flag one thread
+ * should be woken.
+ *
+ *	epoll-accept-bench [-t threads] [-c conns]
+ *
+ * Compile with
+ *	gcc -O2 -o epoll-accept-bench epoll-accept-bench.c -lpthread
+ *
+ * This file is released under the GPL.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE	(1 << 28)
+#endif
+
+#define MAX_THREADS	256
+
+static int listen_fd;
+static unsigned int events;
+static volatile int stop;
+static volatile unsigned long accepted, wakeups, wasted;
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static void *worker(void *arg)
+{
+	struct epoll_event ev;
+	int epfd, fd;
+
+	epfd = epoll_create(1);
+	if (epfd < 0)
+		die("epoll_create");
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.fd = listen_fd;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev))
+		die("epoll_ctl");
+
+	while (!stop) {
+		if (epoll_wait(epfd, &ev, 1, 100) <= 0)
+			continue;
+		__sync_fetch_and_add(&wakeups, 1);
+		fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0) {
+			if (errno != EAGAIN)
+				die("accept");
+			__sync_fetch_and_add(&wasted, 1);
+			continue;
+		}
+		close(fd);
+		__sync_fetch_and_add(&accepted, 1);
+	}
+	close(epfd);
+	return NULL;
+}
+
+static void run(const char *name, unsigned int ev, int threads,
+		unsigned long conns, struct sockaddr_in *addr)
+{
+	pthread_t tids[MAX_THREADS];
+	struct rusage before, after;
+	unsigned long i;
+	double t, cpu;
+	int fd, j;
+
+	events = ev;
+	stop = 0;
+	accepted = wakeups = wasted = 0;
+	for (j = 0; j < threads; j++)
+		if (pthread_create(&tids[j], NULL, worker, NULL))
+			die("pthread_create");
+	/* let every thread get to sleep in epoll_wait() */
+	usleep(100000);
+
+	getrusage(RUSAGE_SELF, &before);
+	t = now();
+	for (i = 0; i < conns; i++) {
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0)
+			die("socket");
+		if (connect(fd, (struct sockaddr *)addr, sizeof(*addr)))
+			die("connect");
+		while (accepted <= i)
+			sched_yield();
+		close(fd);
+	}
+	t = now() - t;
+	getrusage(RUSAGE_SELF, &after);
+
+	stop = 1;
+	for (j = 0; j < threads; j++)
+		pthread_join(tids[j], NULL);
+
+	cpu = after.ru_utime.tv_sec - before.ru_utime.tv_sec +
+		after.ru_stime.tv_sec - before.ru_stime.tv_sec +
+		(after.ru_utime.tv_usec - before.ru_utime.tv_usec +
+		 after.ru_stime.tv_usec - before.ru_stime.tv_usec) / 1e6;
+	printf("%-16s %10.0f %10.2f %10.2f %10.2f %10.1f\n", name, conns / t,
+	       (double)wakeups / conns, (double)wasted / conns,
+	       (double)(after.ru_nvcsw - before.ru_nvcsw) / conns,
+	       cpu * 1e6 / conns);
+}
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	unsigned long conns = 10000;
+	int threads = 8, opt;
+
+	while ((opt = getopt(argc, argv, "t:c:")) != -1) {
+		switch (opt) {
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 'c':
+			conns = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (threads <= 0 || threads > MAX_THREADS || !conns)
+		goto usage;
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (listen_fd < 0)
+		die("socket");
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(listen_fd, 1024) ||
+	    getsockname(listen_fd, (struct sockaddr *)&addr, &len))
+		die("listen");
+	if (fcntl(listen_fd, F_SETFL, O_NONBLOCK))
+		die("fcntl");
+
+	printf("%d threads, %lu connections\n", threads, conns);
+	printf("%-16s %10s %10s %10s %10s %10s\n", "", "conns/s", "wakeups",
+	       "wasted", "csw", "cpu us");
+	run("shared", EPOLLIN, threads, conns, &addr);
+	run("EPOLLEXCLUSIVE", EPOLLIN | EPOLLEXCLUSIVE, threads, conns, &addr);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-t threads] [-c conns]\n", argv[0]);
+	return 1;
+}
@@ -0,0 +1,173 @@
+/*
+ * faultaround-bench: cost of starting a program with and without
+ * fault-around
+ *
+ * Runs a command repeatedly, once for each fault_around_bytes value
+ * given (default: 4096, which turns fault-around off, and 65536), and
+ * reports the average minor faults and elapsed time per start, and the
+ * pages fault-around mapped besides the faulting ones.  The command
+ * is run once beforehand so that its libraries are in the page cache;
+ * a cold start measures the disk instead.
+ *
+ *	faultaround-bench [-n runs] [-b bytes]... -- command [args]
+ *
+ * The command's output is discarded.  Run as root, so that
+ * /proc/sys/vm/fault_around_bytes can be written; it is restored at
+ * the end.
+ *
+ * Compile with
+ *	gcc -O2 -o faultaround-bench faultaround-bench.c
+ *
+ * This file is released under the GPL.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define SYSCTL	"/proc/sys/vm/fault_around_bytes"
+#define MAX_SIZES	16
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static unsigned long vmstat(const char *name)
+{
+	char line[128];
+	unsigned long val = 0;
+	size_t len = strlen(name);
+	FILE *f;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return 0;
+	while (fgets(line, sizeof(line), f))
+		if (!strncmp(line, name, len) && line[len] == ' ') {
+			val = strtoul(line + len + 1, NULL, 10);
+			break;
+		}
+	fclose(f);
+	return val;
+}
+
+static long read_sysctl(void)
+{
+	FILE *f = fopen(SYSCTL, "r");
+	long val = -1;
+
+	if (f) {
+		if (fscanf(f, "%ld", &val) != 1)
+			val = -1;
+		fclose(f);
+	}
+	return val;
+}
+
+static void write_sysctl(long val)
+{
+	FILE *f = fopen(SYSCTL, "w");
+
+	if (!f || fprintf(f, "%ld\n", val) < 0 || fclose(f)) {
+		perror(SYSCTL);
+		exit(1);
+	}
+}
+
+/* start the command once, returning its minor faults */
+static long run(char **cmd)
+{
+	struct rusage ru;
+	int status, fd;
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		exit(1);
+	}
+	if (!pid) {
+		fd = open("/dev/null", O_RDWR);
+		dup2(fd, 1);
+		dup2(fd, 2);
+		execvp(cmd[0], cmd);
+		_exit(127);
+	}
+	if (wait4(pid, &status, 0, &ru) < 0) {
+		perror("wait4");
+		exit(1);
+	}
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 127) {
+		fprintf(stderr, "cannot run %s\n", cmd[0]);
+		exit(1);
+	}
+	return ru.ru_minflt;
+}
+
+int main(int argc, char **argv)
+{
+	long sizes[MAX_SIZES], old;
+	int nr_sizes = 0, runs = 100, opt, i, j;
+
+	while ((opt = getopt(argc, argv, "n:b:")) != -1) {
+		switch (opt) {
+		case 'n':
+			runs = atoi(optarg);
+			break;
+		case 'b':
+			if (nr_sizes < MAX_SIZES)
+				sizes[nr_sizes++] = atol(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind >= argc || runs <= 0)
+		goto usage;
+	if (!nr_sizes) {
+		sizes[nr_sizes++] = 4096;
+		sizes[nr_sizes++] = 65536;
+	}
+
+	old = read_sysctl();
+	if (old < 0) {
+		perror(SYSCTL);
+		return 1;
+	}
+	run(argv + optind);
+
+	printf("%10s %12s %12s %12s\n", "bytes", "minflt/run", "usecs/run",
+	       "around/run");
+	for (i = 0; i < nr_sizes; i++) {
+		unsigned long around;
+		long faults = 0;
+		double t;
+
+		write_sysctl(sizes[i]);
+		around = vmstat("pgfault_around_mapped");
+		t = now();
+		for (j = 0; j < runs; j++)
+			faults += run(argv + optind);
+		t = now() - t;
+		around = vmstat("pgfault_around_mapped") - around;
+		printf("%10ld %12.1f %12.0f %12.1f\n", sizes[i],
+		       (double)faults / runs, t * 1e6 / runs,
+		       (double)around / runs);
+	}
+	write_sysctl(old);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-n runs] [-b bytes]... -- command [args]\n",
+		argv[0]);
+	return 1;
+}
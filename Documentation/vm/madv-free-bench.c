@@ -0,0 +1,133 @@
+/*
+ * madv-free-bench: cost of giving memory back with MADV_DONTNEED and
+ * MADV_FREE
+ *
+ * Does what a malloc implementation does with a freed chunk it wants to
+ * give back to the kernel but is likely to hand out again: writes to
+ * every page of a <kb> kilobyte anonymous chunk, madvise()s it away and
+ * writes to it again, <loops> times.  This is run with MADV_DONTNEED
+ * and with MADV_FREE, printing the loops per second, the minor faults
+ * per loop, and the pglazyfree and pglazyfreed counters of /proc/vmstat.
+ *
+ * MADV_DONTNEED zaps the pages, so every loop faults in zeroed pages
+ * again.  MADV_FREE leaves them mapped, so without memory pressure no
+ * page is allocated or cleared.  Where the dirty bit is kept in software,
+ * as on ARM, the first write to each page still takes a fault, but one
+ * that only marks the pte dirty again.  pglazyfreed stays 0 unless
+ * reclaim discarded some of the pages in the meantime.  MADV_FREE needs
+ * swap to be configured, otherwise it behaves like MADV_DONTNEED.
+ *
+ *	madv-free-bench [kb] [loops]
+ *
+ * Compile with
+ *	gcc -O2 -o madv-free-bench madv-free-bench.c
+ *
+ * This file is released under the GPL.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#ifndef MADV_FREE
+#define MADV_FREE	8
+#endif
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static unsigned long vmstat(const char *name)
+{
+	char line[128];
+	unsigned long val = 0;
+	size_t len = strlen(name);
+	FILE *f;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return 0;
+	while (fgets(line, sizeof(line), f))
+		if (!strncmp(line, name, len) && line[len] == ' ') {
+			val = strtoul(line + len + 1, NULL, 10);
+			break;
+		}
+	fclose(f);
+	return val;
+}
+
+static long minflt(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_minflt;
+}
+
+static void run(const char *name, int advice, size_t len,
+		unsigned long loops)
+{
+	long page = sysconf(_SC_PAGESIZE), faults;
+	unsigned long i, freed, discarded;
+	size_t off;
+	char *p;
+	double t;
+
+	p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	for (off = 0; off < len; off += page)
+		p[off] = 1;
+
+	freed = vmstat("pglazyfree");
+	discarded = vmstat("pglazyfreed");
+	faults = minflt();
+	t = now();
+	for (i = 0; i < loops; i++) {
+		if (madvise(p, len, advice)) {
+			perror(name);
+			exit(1);
+		}
+		for (off = 0; off < len; off += page)
+			p[off] = i;
+	}
+	t = now() - t;
+	faults = minflt() - faults;
+
+	printf("%-14s %12.0f %12.1f %12lu %12lu\n", name, loops / t,
+	       (double)faults / loops, vmstat("pglazyfree") - freed,
+	       vmstat("pglazyfreed") - discarded);
+	munmap(p, len);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long kb = 256, loops = 100000;
+
+	if (argc > 1)
+		kb = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		loops = strtoul(argv[2], NULL, 0);
+	if (!kb || !loops) {
+		fprintf(stderr, "usage: %s [kb] [loops]\n", argv[0]);
+		return 1;
+	}
+
+	printf("%lu KB chunk, %lu loops\n", kb, loops);
+	printf("%-14s %12s %12s %12s %12s\n", "", "loops/s", "faults/loop",
+	       "pglazyfree", "pglazyfreed");
+	run("MADV_DONTNEED", MADV_DONTNEED, kb << 10, loops);
+	run("MADV_FREE", MADV_FREE, kb << 10, loops);
+	return 0;
+}
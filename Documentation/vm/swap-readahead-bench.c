@@ -0,0 +1,193 @@
+/*
+ * swap-readahead-bench: slot based against VMA based swap readahead
+ *
+ * Writes to the pages of an anonymous heap of <heap_mb> megabytes in
+ * random order, so that reclaim gives them swap slots that are not in
+ * virtual address order, as happens once swap has been in use for a
+ * while.  A child process then touches <pressure_mb> megabytes to push
+ * the heap out to swap, and the heap is read back sequentially.  This
+ * is done once with vm.swap_vma_readahead set to 0 and once with it set
+ * to 1, printing the time the sequential read took, the pages swapped
+ * in, and the swap_ra and swap_ra_hit counters of /proc/vmstat.
+ *
+ *	swap-readahead-bench [heap_mb] [pressure_mb]
+ *
+ * The heap defaults to half of RAM and the pressure to all of it, so
+ * swap needs room for about one and a half times RAM.  Run as root so
+ * that the sysctl can be written; it is restored at the end.
+ *
+ * Compile with
+ *	gcc -O2 -o swap-readahead-bench swap-readahead-bench.c
+ *
+ * This file is released under the GPL.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#define SYSCTL	"/proc/sys/vm/swap_vma_readahead"
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static unsigned long vmstat(const char *name)
+{
+	char line[128];
+	unsigned long val = 0;
+	size_t len = strlen(name);
+	FILE *f;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return 0;
+	while (fgets(line, sizeof(line), f))
+		if (!strncmp(line, name, len) && line[len] == ' ') {
+			val = strtoul(line + len + 1, NULL, 10);
+			break;
+		}
+	fclose(f);
+	return val;
+}
+
+static long read_sysctl(void)
+{
+	FILE *f = fopen(SYSCTL, "r");
+	long val = -1;
+
+	if (f) {
+		if (fscanf(f, "%ld", &val) != 1)
+			val = -1;
+		fclose(f);
+	}
+	return val;
+}
+
+static void write_sysctl(long val)
+{
+	FILE *f = fopen(SYSCTL, "w");
+
+	if (!f || fprintf(f, "%ld\n", val) < 0 || fclose(f)) {
+		perror(SYSCTL);
+		exit(1);
+	}
+}
+
+static void *map(size_t len)
+{
+	void *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	return p;
+}
+
+/* touch @len bytes in a child, pushing the parent's memory out */
+static void pressure(size_t len, long page)
+{
+	size_t off;
+	char *p;
+	int status;
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		exit(1);
+	}
+	if (!pid) {
+		p = map(len);
+		for (off = 0; off < len; off += page)
+			p[off] = 1;
+		_exit(0);
+	}
+	waitpid(pid, &status, 0);
+}
+
+static void run(long mode, size_t heap, size_t press, long page)
+{
+	unsigned long nr = heap / page, i, j, tmp, *order;
+	unsigned long swpin, ra, hit;
+	volatile char *v;
+	char *p;
+	double t;
+
+	write_sysctl(mode);
+
+	order = malloc(nr * sizeof(*order));
+	if (!order) {
+		perror("malloc");
+		exit(1);
+	}
+	for (i = 0; i < nr; i++)
+		order[i] = i;
+	for (i = nr - 1; i > 0; i--) {
+		j = random() % (i + 1);
+		tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+
+	p = map(heap);
+	for (i = 0; i < nr; i++)
+		p[order[i] * page] = order[i];
+	free(order);
+
+	pressure(press, page);
+
+	swpin = vmstat("pswpin");
+	ra = vmstat("swap_ra");
+	hit = vmstat("swap_ra_hit");
+	t = now();
+	for (i = 0, v = p; i < nr; i++)
+		(void)v[i * page];
+	t = now() - t;
+	printf("%18ld %10.3f %10lu %10lu %10lu\n", mode, t,
+	       vmstat("pswpin") - swpin, vmstat("swap_ra") - ra,
+	       vmstat("swap_ra_hit") - hit);
+
+	munmap(p, heap);
+}
+
+int main(int argc, char **argv)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	unsigned long ram_mb, heap_mb, press_mb;
+	long old;
+
+	ram_mb = sysconf(_SC_PHYS_PAGES) / ((1 << 20) / page);
+	heap_mb = argc > 1 ? strtoul(argv[1], NULL, 0) : ram_mb / 2;
+	press_mb = argc > 2 ? strtoul(argv[2], NULL, 0) : ram_mb;
+	if (!heap_mb) {
+		fprintf(stderr, "usage: %s [heap_mb] [pressure_mb]\n", argv[0]);
+		return 1;
+	}
+
+	old = read_sysctl();
+	if (old < 0) {
+		perror(SYSCTL);
+		return 1;
+	}
+
+	printf("heap %lu MB, pressure %lu MB, RAM %lu MB\n", heap_mb,
+	       press_mb, ram_mb);
+	printf("%18s %10s %10s %10s %10s\n", "swap_vma_readahead", "secs",
+	       "pswpin", "swap_ra", "swap_ra_hit");
+	run(0, heap_mb << 20, press_mb << 20, page);
+	run(1, heap_mb << 20, press_mb << 20, page);
+
+	write_sysctl(old);
+	return 0;
+}
@@ -0,0 +1,132 @@
+/*
+ * swap-stress: parallel anonymous memory stress for the swap paths
+ *
+ * Forks <procs> processes that each map <mb> megabytes of anonymous
+ * memory and write to every page of it <passes> times.  Once their
+ * total exceeds free memory, every pass swaps pages out and back in
+ * from all cpus at once, which is what the per-cpu swap slot caches
+ * are meant to speed up.  Reports the time taken, the rate at which
+ * memory was touched and the pswpin/pswpout deltas from /proc/vmstat.
+ * Run it with procs from 1 up to the number of cpus, on a fast swap
+ * device such as a ram disk:
+ *
+ *	swap-stress [-p procs] [-m mb] [-n passes]
+ *
+ * Compile with
+ *	gcc -O2 -o swap-stress swap-stress.c
+ *
+ * This file is released under the GPL.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static unsigned long vmstat(const char *name)
+{
+	char line[128];
+	unsigned long val = 0;
+	size_t len = strlen(name);
+	FILE *f;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return 0;
+	while (fgets(line, sizeof(line), f))
+		if (!strncmp(line, name, len) && line[len] == ' ') {
+			val = strtoul(line + len + 1, NULL, 10);
+			break;
+		}
+	fclose(f);
+	return val;
+}
+
+static void worker(size_t len, int passes)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	char *p;
+	size_t off;
+	int i;
+
+	p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	for (i = 0; i < passes; i++)
+		for (off = 0; off < len; off += page)
+			p[off] += i + 1;
+	exit(0);
+}
+
+int main(int argc, char **argv)
+{
+	int procs = 4, passes = 4, opt, i, status, failed = 0;
+	unsigned long mb = 0, swpin, swpout;
+	double t;
+
+	while ((opt = getopt(argc, argv, "p:m:n:")) != -1) {
+		switch (opt) {
+		case 'p':
+			procs = atoi(optarg);
+			break;
+		case 'm':
+			mb = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			passes = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-p procs] [-m mb] [-n passes]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (procs <= 0 || passes <= 0)
+		return 1;
+	/* by default, one and a half times RAM in all */
+	if (!mb)
+		mb = sysconf(_SC_PHYS_PAGES) / (1048576 / sysconf(_SC_PAGESIZE))
+			* 3 / 2 / procs;
+
+	swpin = vmstat("pswpin");
+	swpout = vmstat("pswpout");
+	t = now();
+	for (i = 0; i < procs; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0) {
+			perror("fork");
+			return 1;
+		}
+		if (!pid)
+			worker(mb << 20, passes);
+	}
+	for (i = 0; i < procs; i++)
+		if (wait(&status) < 0 || !WIFEXITED(status) ||
+		    WEXITSTATUS(status))
+			failed++;
+	t = now() - t;
+
+	printf("%d procs x %lu MB x %d passes: %.2f secs, %.1f MB/s, "
+	       "pswpin %lu, pswpout %lu\n", procs, mb, passes, t,
+	       procs * mb * passes / t, vmstat("pswpin") - swpin,
+	       vmstat("pswpout") - swpout);
+	if (failed)
+		fprintf(stderr, "%d processes failed\n", failed);
+	return !!failed;
+}
@@ -0,0 +1,168 @@
+/*
+ * workingset-bench: does a streaming reader push out the working set?
+ *
+ * Creates a working set file and a larger streaming file in <dir>, then
+ * alternates between re-reading the whole working set and reading the
+ * next chunk of the streaming file, which is read only once.  Each round
+ * prints how long the working set read took and how many of its pages
+ * had to come back from disk, together with the workingset_refault and
+ * workingset_activate counters of /proc/vmstat.
+ *
+ * Without refault distance detection the streaming pages age the
+ * working set out of the inactive list round after round.  With it the
+ * working set refaults once, is activated, and then stays cached.
+ *
+ * The working set defaults to a third of RAM and the streaming file to
+ * twice RAM, so <dir> needs room for both.  Run as root so that the page
+ * cache can be dropped first.
+ *
+ * Compile with
+ *	gcc -O2 -o workingset-bench workingset-bench.c
+ *
+ * This file is released under the GPL.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#define CHUNK	(1 << 20)
+
+static char buf[CHUNK];
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static unsigned long vmstat(const char *name)
+{
+	char line[128];
+	unsigned long val = 0;
+	size_t len = strlen(name);
+	FILE *f;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return 0;
+	while (fgets(line, sizeof(line), f))
+		if (!strncmp(line, name, len) && line[len] == ' ') {
+			val = strtoul(line + len + 1, NULL, 10);
+			break;
+		}
+	fclose(f);
+	return val;
+}
+
+static int create(const char *path, unsigned long mb)
+{
+	unsigned long i;
+	int fd;
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(path);
+		exit(1);
+	}
+	memset(buf, 0x5a, CHUNK);
+	for (i = 0; i < mb; i++)
+		if (write(fd, buf, CHUNK) != CHUNK) {
+			perror("write");
+			exit(1);
+		}
+	fsync(fd);
+	return fd;
+}
+
+/* pages of the first @mb megabytes of @fd not in the page cache */
+static unsigned long missing(int fd, unsigned long mb)
+{
+	size_t len = (size_t)mb * CHUNK;
+	long page = sysconf(_SC_PAGESIZE);
+	unsigned char *vec;
+	unsigned long i, nr = 0;
+	void *p;
+
+	p = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		return 0;
+	vec = malloc(len / page);
+	if (vec && !mincore(p, len, vec))
+		for (i = 0; i < len / page; i++)
+			nr += !(vec[i] & 1);
+	free(vec);
+	munmap(p, len);
+	return nr;
+}
+
+static void read_mb(int fd, off_t start, unsigned long mb)
+{
+	unsigned long i;
+
+	for (i = 0; i < mb; i++)
+		if (pread(fd, buf, CHUNK, start + (off_t)i * CHUNK) != CHUNK) {
+			perror("read");
+			exit(1);
+		}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long ram_mb, ws_mb, stream_mb, rounds = 10, chunk_mb, i;
+	unsigned long refault, activate;
+	char path[4096];
+	int ws, stream, fd;
+	double t;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <dir> [ws_mb] [stream_mb] [rounds]\n",
+			argv[0]);
+		return 1;
+	}
+	ram_mb = sysconf(_SC_PHYS_PAGES) / (CHUNK / sysconf(_SC_PAGESIZE));
+	ws_mb = argc > 2 ? strtoul(argv[2], NULL, 0) : ram_mb / 3;
+	stream_mb = argc > 3 ? strtoul(argv[3], NULL, 0) : ram_mb * 2;
+	if (argc > 4)
+		rounds = strtoul(argv[4], NULL, 0);
+	chunk_mb = stream_mb / rounds;
+
+	snprintf(path, sizeof(path), "%s/workingset", argv[1]);
+	ws = create(path, ws_mb);
+	snprintf(path, sizeof(path), "%s/stream", argv[1]);
+	stream = create(path, stream_mb);
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0 || write(fd, "3\n", 2) != 2)
+		fprintf(stderr, "cannot drop caches, results are skewed\n");
+	if (fd >= 0)
+		close(fd);
+
+	printf("working set %lu MB, streaming %lu MB per round, RAM %lu MB\n",
+	       ws_mb, chunk_mb, ram_mb);
+	printf("%5s %10s %10s %10s %10s\n", "round", "ws secs", "ws missing",
+	       "refaults", "activated");
+
+	for (i = 0; i < rounds; i++) {
+		unsigned long miss = missing(ws, ws_mb);
+
+		refault = vmstat("workingset_refault");
+		activate = vmstat("workingset_activate");
+		t = now();
+		read_mb(ws, 0, ws_mb);
+		t = now() - t;
+		read_mb(stream, (off_t)i * chunk_mb * CHUNK, chunk_mb);
+		printf("%5lu %10.3f %10lu %10lu %10lu\n", i, t, miss,
+		       vmstat("workingset_refault") - refault,
+		       vmstat("workingset_activate") - activate);
+	}
+	return 0;
+}
@@ -442,6 +442,25 @@ void blk_run_queue(struct request_queue *q)
 }
 EXPORT_SYMBOL(blk_run_queue);
 
+/**
+ * blk_poll - reap completed requests without waiting for the interrupt
+ * @q: the request queue to poll
+ *
+ * Description:
+ *    Calls the driver's poll_fn, if polling is enabled on @q, so that a
+ *    task waiting on its own I/O may spin instead of sleeping.  Returns
+ *    the number of requests ended, 0 if there was nothing to reap or @q
+ *    cannot be polled.
+ */
+int blk_poll(struct request_queue *q)
+{
+	if (!q->poll_fn || !blk_queue_poll(q))
+		return 0;
+
+	return q->poll_fn(q);
+}
+EXPORT_SYMBOL(blk_poll);
+
 void blk_put_queue(struct request_queue *q)
 {
 	kobject_put(&q->kobj);
@@ -455,6 +474,7 @@ void blk_cleanup_queue(struct request_queue *q)
 	 * are done before moving on. Going into this function, we should
 	 * not have processes doing IO to this device.
 	 */
+	blk_throtl_drain(q);
 	blk_sync_queue(q);
 
 	mutex_lock(&q->sysfs_lock);
@@ -468,7 +488,7 @@ void blk_cleanup_queue(struct request_queue *q)
 }
 EXPORT_SYMBOL(blk_cleanup_queue);
 
-static int blk_init_free_list(struct request_queue *q)
+int blk_init_free_list(struct request_queue *q)
 {
 	struct request_list *rl = &q->rq;
 
@@ -511,6 +531,12 @@ struct request_queue *blk_alloc_queue_node(gfp_t gfp_mask, int node_id)
 		return NULL;
 	}
 
+	if (blk_throtl_init(q)) {
+		bdi_destroy(&q->backing_dev_info);
+		kmem_cache_free(blk_requestq_cachep, q);
+		return NULL;
+	}
+
 	init_timer(&q->unplug_timer);
 	setup_timer(&q->timeout, blk_rq_timed_out_timer, (unsigned long) q);
 	INIT_LIST_HEAD(&q->timeout_list);
@@ -1457,6 +1483,9 @@ end_io:
 			goto end_io;
 		}
 
+		if (blk_throtl_bio(q, bio))
+			break;
+
 		ret = q->make_request_fn(q, bio);
 	} while (ret);
 }
@@ -0,0 +1,299 @@
+/*
+ * Multi-queue request submission for fast devices
+ *
+ * A queue set up with blk_init_queue_mq() does not send bios through
+ * __make_request() and the single queue_lock.  Instead every cpu builds
+ * requests on its own staging list, back merging contiguous bios, and
+ * hands the list to the driver's queue_rqs_fn in one go once it holds
+ * unplug_thresh requests, when a sync bio arrives, or when the queue is
+ * unplugged.  There is no elevator: each cpu's requests are started in
+ * the order they were submitted, and queue_rqs_fn may run on several
+ * cpus at once.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/blktrace_api.h>
+#include <linux/percpu.h>
+#include <linux/genhd.h>
+
+#include "blk.h"
+
+/*
+ * Per-cpu staging queue.  The lock is only ever contended by an unplug
+ * running on another cpu.
+ */
+struct blk_mq_ctx {
+	spinlock_t		lock;
+	struct list_head	rq_list;
+	unsigned int		nr_staged;
+};
+
+static void blk_mq_dispatch(struct request_queue *q, struct list_head *list)
+{
+	struct request *rq;
+
+	if (list_empty(list))
+		return;
+
+	list_for_each_entry(rq, list, queuelist)
+		blk_add_trace_rq(q, rq, BLK_TA_ISSUE);
+
+	q->queue_rqs_fn(q, list);
+}
+
+/*
+ * Take everything staged on @ctx.  Called with ctx->lock held.
+ */
+static void blk_mq_take_staged(struct blk_mq_ctx *ctx, struct list_head *list)
+{
+	list_splice_init(&ctx->rq_list, list);
+	ctx->nr_staged = 0;
+}
+
+static void blk_mq_unplug(struct request_queue *q)
+{
+	struct blk_mq_ctx *ctx;
+	LIST_HEAD(list);
+	int cpu;
+
+	del_timer(&q->unplug_timer);
+
+	for_each_possible_cpu(cpu) {
+		ctx = per_cpu_ptr(q->mq_ctx, cpu);
+
+		spin_lock_irq(&ctx->lock);
+		blk_mq_take_staged(ctx, &list);
+		spin_unlock_irq(&ctx->lock);
+
+		blk_mq_dispatch(q, &list);
+	}
+}
+
+static void blk_mq_account_merge(struct request *rq)
+{
+	struct hd_struct *part;
+	int cpu;
+
+	if (!rq->rq_disk)
+		return;
+
+	cpu = part_stat_lock();
+	part = disk_map_sector_rcu(rq->rq_disk, rq->sector);
+	part_stat_inc(cpu, part, merges[rq_data_dir(rq)]);
+	part_stat_unlock();
+}
+
+static int blk_mq_attempt_merge(struct request_queue *q, struct request *rq,
+				struct bio *bio)
+{
+	if (!rq_mergeable(rq) || bio_data_dir(bio) != rq_data_dir(rq))
+		return 0;
+	if (bio_discard(bio) != bio_discard(rq->bio))
+		return 0;
+	if (rq->rq_disk != bio->bi_bdev->bd_disk || rq->special)
+		return 0;
+	if (bio_integrity(bio) != blk_integrity_rq(rq))
+		return 0;
+	if (rq->sector + rq->nr_sectors != bio->bi_sector)
+		return 0;
+	if (!ll_back_merge_fn(q, rq, bio))
+		return 0;
+
+	blk_add_trace_bio(q, bio, BLK_TA_BACKMERGE);
+
+	rq->biotail->bi_next = bio;
+	rq->biotail = bio;
+	rq->nr_sectors = rq->hard_nr_sectors += bio_sectors(bio);
+	rq->ioprio = ioprio_best(rq->ioprio, bio_prio(bio));
+	if (!blk_rq_cpu_valid(rq))
+		rq->cpu = bio->bi_comp_cpu;
+	blk_mq_account_merge(rq);
+	return 1;
+}
+
+static int blk_mq_make_request(struct request_queue *q, struct bio *bio)
+{
+	const int sync = bio_sync(bio);
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	LIST_HEAD(list);
+	int err;
+
+	blk_queue_bounce(q, &bio);
+
+	/*
+	 * Requests staged on different cpus are started in no particular
+	 * order, so there is nothing a barrier could be ordered against.
+	 */
+	if (unlikely(bio_barrier(bio))) {
+		err = -EOPNOTSUPP;
+		goto end_io;
+	}
+
+	if (unlikely(bio_discard(bio)) && !q->prepare_discard_fn) {
+		err = -EOPNOTSUPP;
+		goto end_io;
+	}
+
+	local_irq_disable();
+	ctx = per_cpu_ptr(q->mq_ctx, smp_processor_id());
+	spin_lock(&ctx->lock);
+
+	if (!blk_queue_nomerges(q) && !list_empty(&ctx->rq_list)) {
+		rq = list_entry(ctx->rq_list.prev, struct request, queuelist);
+		if (blk_mq_attempt_merge(q, rq, bio))
+			goto out;
+	}
+
+	spin_unlock_irq(&ctx->lock);
+
+	/*
+	 * This might sleep but can not fail.  We may come back on another
+	 * cpu, and the request is then staged there instead.
+	 */
+	rq = mempool_alloc(q->rq.rq_pool, GFP_NOIO);
+	blk_rq_init(q, rq);
+	init_request_from_bio(rq, bio);
+	blk_add_trace_generic(q, bio, bio_data_dir(bio), BLK_TA_GETRQ);
+
+	local_irq_disable();
+	ctx = per_cpu_ptr(q->mq_ctx, smp_processor_id());
+	spin_lock(&ctx->lock);
+
+	if (test_bit(QUEUE_FLAG_SAME_COMP, &q->queue_flags) ||
+	    bio_flagged(bio, BIO_CPU_AFFINE))
+		rq->cpu = blk_cpu_to_group(smp_processor_id());
+
+	/*
+	 * The unplug timer is shared by all cpus, only arm it when this
+	 * cpu starts staging.
+	 */
+	if (list_empty(&ctx->rq_list) && !timer_pending(&q->unplug_timer))
+		mod_timer(&q->unplug_timer, jiffies + q->unplug_delay);
+
+	list_add_tail(&rq->queuelist, &ctx->rq_list);
+	ctx->nr_staged++;
+	blk_add_trace_rq(q, rq, BLK_TA_INSERT);
+out:
+	if (sync || ctx->nr_staged >= q->unplug_thresh)
+		blk_mq_take_staged(ctx, &list);
+	spin_unlock_irq(&ctx->lock);
+
+	blk_mq_dispatch(q, &list);
+	return 0;
+
+end_io:
+	bio_endio(bio, err);
+	return 0;
+}
+
+/**
+ * blk_mq_end_request - complete a request of a multi-queue device
+ * @rq:		the request being completed
+ * @error:	%0 for success, < %0 for error
+ *
+ * Description:
+ *     Ends all the bios of @rq and frees it.  Partial completion is not
+ *     supported.  May be called from any context, no locks are needed.
+ **/
+void blk_mq_end_request(struct request *rq, int error)
+{
+	struct request_queue *q = rq->q;
+	struct bio *bio = rq->bio;
+	struct bio *next;
+
+	blk_add_trace_rq(q, rq, BLK_TA_COMPLETE);
+
+	if (rq->rq_disk && blk_fs_request(rq)) {
+		unsigned long duration = jiffies - rq->start_time;
+		const int rw = rq_data_dir(rq);
+		struct hd_struct *part;
+		int cpu;
+
+		cpu = part_stat_lock();
+		part = disk_map_sector_rcu(rq->rq_disk, rq->sector);
+
+		part_stat_inc(cpu, part, ios[rw]);
+		part_stat_add(cpu, part, sectors[rw], rq->hard_nr_sectors);
+		part_stat_add(cpu, part, ticks[rw], duration);
+
+		part_stat_unlock();
+	}
+
+	while (bio) {
+		next = bio->bi_next;
+		bio->bi_next = NULL;
+		bio_endio(bio, error);
+		bio = next;
+	}
+
+	mempool_free(rq, q->rq.rq_pool);
+}
+EXPORT_SYMBOL(blk_mq_end_request);
+
+/**
+ * blk_init_queue_mq - prepare a multi-queue request queue
+ * @qfn:  The function to be called with a batch of requests to start.
+ *
+ * Description:
+ *    For devices fast enough that the single queue_lock of a request
+ *    queue is the bottleneck.  Requests are built and merged on per-cpu
+ *    staging lists without any global lock and passed to @qfn as a list
+ *    linked through rq->queuelist.  @qfn must take every request off the
+ *    list, and end each one with blk_mq_end_request(), from any context.
+ *    @qfn may be called on several cpus at the same time.
+ *
+ *    The queue does not support barriers, has no elevator and does not
+ *    maintain the in-flight counts of the disk statistics.  unplug_thresh
+ *    is the number of requests a cpu stages before starting them.
+ *
+ * Note:
+ *    blk_init_queue_mq() must be paired with a blk_cleanup_queue() call
+ *    when the block device is deactivated (such as at module unload).
+ **/
+struct request_queue *blk_init_queue_mq(queue_rqs_fn *qfn)
+{
+	return blk_init_queue_mq_node(qfn, -1);
+}
+EXPORT_SYMBOL(blk_init_queue_mq);
+
+struct request_queue *blk_init_queue_mq_node(queue_rqs_fn *qfn, int node_id)
+{
+	struct request_queue *q = blk_alloc_queue_node(GFP_KERNEL, node_id);
+	struct blk_mq_ctx *ctx;
+	int cpu;
+
+	if (!q)
+		return NULL;
+
+	q->node = node_id;
+	if (blk_init_free_list(q))
+		goto fail;
+
+	q->mq_ctx = alloc_percpu(struct blk_mq_ctx);
+	if (!q->mq_ctx)
+		goto fail;
+
+	for_each_possible_cpu(cpu) {
+		ctx = per_cpu_ptr(q->mq_ctx, cpu);
+		spin_lock_init(&ctx->lock);
+		INIT_LIST_HEAD(&ctx->rq_list);
+	}
+
+	/* only protects queue settings, never taken for io */
+	q->queue_lock		= &q->__queue_lock;
+	q->queue_rqs_fn		= qfn;
+	q->queue_flags		= 1 << QUEUE_FLAG_CLUSTER;
+
+	blk_queue_make_request(q, blk_mq_make_request);
+	q->unplug_fn		= blk_mq_unplug;
+
+	return q;
+
+fail:
+	blk_put_queue(q);
+	return NULL;
+}
+EXPORT_SYMBOL(blk_init_queue_mq_node);
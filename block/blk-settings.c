@@ -77,6 +77,25 @@ void blk_queue_softirq_done(struct request_queue *q, softirq_done_fn *fn)
 }
 EXPORT_SYMBOL(blk_queue_softirq_done);
 
+/**
+ * blk_queue_poll_fn - set a queue's completion polling function
+ * @q:  the request queue for the device
+ * @fn: reaps completed requests, returns how many
+ *
+ * Description:
+ *    For devices fast enough that a synchronous submitter is better off
+ *    spinning for its I/O than sleeping until the interrupt.  @fn is
+ *    called from process context, repeatedly, and must end the requests
+ *    that have completed, with interrupts still enabled.  The device
+ *    must keep raising its interrupts: polling only reaps completions
+ *    sooner, and is off until enabled through the io_poll attribute.
+ **/
+void blk_queue_poll_fn(struct request_queue *q, poll_fn *fn)
+{
+	q->poll_fn = fn;
+}
+EXPORT_SYMBOL(blk_queue_poll_fn);
+
 void blk_queue_rq_timeout(struct request_queue *q, unsigned int timeout)
 {
 	q->rq_timeout = timeout;
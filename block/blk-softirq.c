@@ -101,18 +101,18 @@ static struct notifier_block __cpuinitdata blk_cpu_notifier = {
 	.notifier_call	= blk_cpu_notify,
 };
 
-void __blk_complete_request(struct request *req)
+/*
+ * Queue a request for completion on the cpu selected for it.  Called
+ * with interrupts disabled.  Returns 1 if it was added to this cpu's
+ * list, so the caller has to raise the softirq.
+ */
+static int blk_queue_completion(struct request *req, int cpu, int group_cpu)
 {
 	struct request_queue *q = req->q;
-	unsigned long flags;
-	int ccpu, cpu, group_cpu;
+	int ccpu;
 
 	BUG_ON(!q->softirq_done_fn);
 
-	local_irq_save(flags);
-	cpu = smp_processor_id();
-	group_cpu = blk_cpu_to_group(cpu);
-
 	/*
 	 * Select completion CPU
 	 */
@@ -121,22 +121,30 @@ void __blk_complete_request(struct request *req)
 	else
 		ccpu = cpu;
 
-	if (ccpu == cpu || ccpu == group_cpu) {
-		struct list_head *list;
-do_local:
-		list = &__get_cpu_var(blk_cpu_done);
-		list_add_tail(&req->csd.list, list);
-
-		/*
-		 * if the list only contains our just added request,
-		 * signal a raise of the softirq. If there are already
-		 * entries there, someone already raised the irq but it
-		 * hasn't run yet.
-		 */
-		if (list->next == &req->csd.list)
-			raise_softirq_irqoff(BLOCK_SOFTIRQ);
-	} else if (raise_blk_irq(ccpu, req))
-		goto do_local;
+	if (ccpu != cpu && ccpu != group_cpu && !raise_blk_irq(ccpu, req))
+		return 0;
+
+	list_add_tail(&req->csd.list, &__get_cpu_var(blk_cpu_done));
+	return 1;
+}
+
+void __blk_complete_request(struct request *req)
+{
+	unsigned long flags;
+	int cpu;
+
+	local_irq_save(flags);
+	cpu = smp_processor_id();
+
+	/*
+	 * if the list only contains our just added request,
+	 * signal a raise of the softirq. If there are already
+	 * entries there, someone already raised the irq but it
+	 * hasn't run yet.
+	 */
+	if (blk_queue_completion(req, cpu, blk_cpu_to_group(cpu)) &&
+	    __get_cpu_var(blk_cpu_done).next == &req->csd.list)
+		raise_softirq_irqoff(BLOCK_SOFTIRQ);
 
 	local_irq_restore(flags);
 }
@@ -161,6 +169,48 @@ void blk_complete_request(struct request *req)
 }
 EXPORT_SYMBOL(blk_complete_request);
 
+/**
+ * blk_complete_request_list - end I/O on a batch of requests
+ * @list:     requests linked through their queuelist
+ *
+ * Description:
+ *     Like blk_complete_request() for every request on @list, for drivers
+ *     that reap several completions at once.  Interrupts are disabled and
+ *     the softirq raised only once for the whole batch, and the requests
+ *     completing on this cpu are ended by a single run of the softirq.
+ *     @list is empty on return.
+ **/
+void blk_complete_request_list(struct list_head *list)
+{
+	struct list_head *done;
+	unsigned long flags;
+	int cpu, group_cpu, was_empty, queued = 0;
+
+	local_irq_save(flags);
+	cpu = smp_processor_id();
+	group_cpu = blk_cpu_to_group(cpu);
+	done = &__get_cpu_var(blk_cpu_done);
+	was_empty = list_empty(done);
+
+	while (!list_empty(list)) {
+		struct request *req;
+
+		req = list_entry(list->next, struct request, queuelist);
+		list_del_init(&req->queuelist);
+
+		if (unlikely(blk_should_fake_timeout(req->q)))
+			continue;
+		if (!blk_mark_rq_complete(req))
+			queued |= blk_queue_completion(req, cpu, group_cpu);
+	}
+
+	if (queued && was_empty)
+		raise_softirq_irqoff(BLOCK_SOFTIRQ);
+
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(blk_complete_request_list);
+
 __init int blk_softirq_init(void)
 {
 	int i;
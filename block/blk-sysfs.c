@@ -181,6 +181,43 @@ queue_rq_affinity_store(struct request_queue *q, const char *page, size_t count)
 	return ret;
 }
 
+static ssize_t queue_poll_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(blk_queue_poll(q), page);
+}
+
+static ssize_t
+queue_poll_store(struct request_queue *q, const char *page, size_t count)
+{
+	unsigned long val;
+	ssize_t ret;
+
+	if (!q->poll_fn)
+		return -EINVAL;
+
+	ret = queue_var_store(&val, page, count);
+	if (ret < 0)
+		return ret;
+
+	/*
+	 * The other flags of a live queue change under its queue_lock.
+	 * Bio based queues may have none, so update the flag atomically.
+	 */
+	if (q->queue_lock) {
+		spin_lock_irq(q->queue_lock);
+		if (val)
+			queue_flag_set(QUEUE_FLAG_POLL, q);
+		else
+			queue_flag_clear(QUEUE_FLAG_POLL, q);
+		spin_unlock_irq(q->queue_lock);
+	} else if (val)
+		set_bit(QUEUE_FLAG_POLL, &q->queue_flags);
+	else
+		clear_bit(QUEUE_FLAG_POLL, &q->queue_flags);
+
+	return ret;
+}
+
 static struct queue_sysfs_entry queue_requests_entry = {
 	.attr = {.name = "nr_requests", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_requests_show,
@@ -227,6 +264,12 @@ static struct queue_sysfs_entry queue_rq_affinity_entry = {
 	.store = queue_rq_affinity_store,
 };
 
+static struct queue_sysfs_entry queue_poll_entry = {
+	.attr = {.name = "io_poll", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_poll_show,
+	.store = queue_poll_store,
+};
+
 static struct attribute *default_attrs[] = {
 	&queue_requests_entry.attr,
 	&queue_ra_entry.attr,
@@ -236,6 +279,7 @@ static struct attribute *default_attrs[] = {
 	&queue_hw_sector_size_entry.attr,
 	&queue_nomerges_entry.attr,
 	&queue_rq_affinity_entry.attr,
+	&queue_poll_entry.attr,
 	NULL,
 };
 
@@ -305,10 +349,14 @@ static void blk_release_queue(struct kobject *kobj)
 	struct request_list *rl = &q->rq;
 
 	blk_sync_queue(q);
+	blk_throtl_exit(q);
 
 	if (rl->rq_pool)
 		mempool_destroy(rl->rq_pool);
 
+	if (q->mq_ctx)
+		free_percpu(q->mq_ctx);
+
 	if (q->queue_tags)
 		__blk_queue_free_tags(q);
 
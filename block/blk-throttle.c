@@ -0,0 +1,531 @@
+/*
+ * Block device bandwidth and IOPS throttling per cgroup
+ *
+ * This file is released under the GPL.
+ *
+ * The tasks of a "blkio" cgroup can be limited to a number of bytes and
+ * of bios per second, for reads and writes separately, on each device.
+ * Bios over a limit are held back where they are submitted, in
+ * generic_make_request(), and released from the kthrotld workqueue as
+ * the group's token buckets refill.  So the limits hold whatever the elevator, and
+ * for stacked devices such as dm-crypt which have none at all.
+ */
+
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+#include <linux/cgroup.h>
+#include <linux/seq_file.h>
+#include <linux/rcupdate.h>
+#include <linux/math64.h>
+#include <linux/workqueue.h>
+
+#include "blk.h"
+
+/* the buckets hold at most this many jiffies worth of tokens */
+#define THROTL_BURST	max(HZ / 10, 1)
+
+#define THROTL_IOPS	2	/* cftype private: bit 0 is the direction */
+
+struct blkio_cgroup {
+	struct cgroup_subsys_state css;
+	struct list_head rules;		/* rcu, changed under cgroup_lock() */
+};
+
+struct throtl_fifo {
+	struct bio *head;
+	struct bio *tail;
+};
+
+/*
+ * The limits of a cgroup on one device, 0 meaning none, and below them,
+ * under the lock of that device's throtl_data, the token buckets and
+ * the bios held back.  Tokens are counted in 1/HZ bytes or bios, so
+ * that each jiffy adds exactly the rate; a bio may go whenever the
+ * buckets are not in debt, and leaves them in debt by its size.
+ */
+struct throtl_rule {
+	struct list_head list;		/* in blkio_cgroup->rules */
+	struct blkio_cgroup *blkcg;
+	dev_t dev;
+	unsigned long bps[2];
+	unsigned long iops[2];
+
+	struct list_head node;		/* in throtl_data->active */
+	s64 bytes[2];
+	s64 ios[2];
+	unsigned long last[2];		/* jiffies of the last refill */
+	struct throtl_fifo queued[2];
+	unsigned nr_queued;
+};
+
+struct throtl_data {
+	struct request_queue *q;
+	spinlock_t lock;
+	struct list_head active;	/* rules with bios held back */
+	struct timer_list timer;
+	struct work_struct work;
+	int dead;			/* queue going away, hold nothing */
+};
+
+/*
+ * Released bios are resubmitted from a workqueue of our own: resubmission
+ * may sleep for a free request, and must not hold up kblockd's unplugging
+ * of other queues meanwhile.
+ */
+static struct workqueue_struct *kthrotld_workqueue;
+
+struct cgroup_subsys blkio_subsys;
+
+static inline struct blkio_cgroup *cgroup_to_blkio(struct cgroup *cgroup)
+{
+	return container_of(cgroup_subsys_state(cgroup, blkio_subsys_id),
+			    struct blkio_cgroup, css);
+}
+
+static inline struct blkio_cgroup *task_blkio(struct task_struct *task)
+{
+	return container_of(task_subsys_state(task, blkio_subsys_id),
+			    struct blkio_cgroup, css);
+}
+
+static struct throtl_rule *throtl_find_rule(struct blkio_cgroup *blkcg,
+					    dev_t dev)
+{
+	struct throtl_rule *tr;
+
+	list_for_each_entry_rcu(tr, &blkcg->rules, list)
+		if (tr->dev == dev)
+			return tr;
+
+	return NULL;
+}
+
+static void throtl_fifo_add(struct throtl_fifo *fifo, struct bio *bio)
+{
+	bio->bi_next = NULL;
+	if (fifo->tail)
+		fifo->tail->bi_next = bio;
+	else
+		fifo->head = bio;
+	fifo->tail = bio;
+}
+
+static struct bio *throtl_fifo_pop(struct throtl_fifo *fifo)
+{
+	struct bio *bio = fifo->head;
+
+	if (bio) {
+		fifo->head = bio->bi_next;
+		if (!fifo->head)
+			fifo->tail = NULL;
+		bio->bi_next = NULL;
+	}
+
+	return bio;
+}
+
+static void throtl_refill(struct throtl_rule *tr, int rw)
+{
+	unsigned long elapsed = min_t(unsigned long, jiffies - tr->last[rw],
+				      THROTL_BURST);
+
+	tr->last[rw] = jiffies;
+	if (tr->bps[rw])
+		tr->bytes[rw] = min_t(s64, tr->bytes[rw] +
+				      (s64)elapsed * tr->bps[rw],
+				      (s64)THROTL_BURST * tr->bps[rw]);
+	if (tr->iops[rw])
+		tr->ios[rw] = min_t(s64, tr->ios[rw] +
+				    (s64)elapsed * tr->iops[rw],
+				    (s64)THROTL_BURST * tr->iops[rw]);
+}
+
+/*
+ * Jiffies until the buckets of direction rw are out of debt.
+ */
+static unsigned long throtl_wait(struct throtl_rule *tr, int rw)
+{
+	unsigned long wait = 0, w;
+
+	throtl_refill(tr, rw);
+	if (tr->bps[rw] && tr->bytes[rw] < 0)
+		wait = div64_u64(-tr->bytes[rw] + tr->bps[rw] - 1,
+				 tr->bps[rw]);
+	if (tr->iops[rw] && tr->ios[rw] < 0) {
+		w = div64_u64(-tr->ios[rw] + tr->iops[rw] - 1, tr->iops[rw]);
+		wait = max(wait, w);
+	}
+
+	return wait;
+}
+
+static void throtl_charge(struct throtl_rule *tr, int rw, struct bio *bio)
+{
+	if (tr->bps[rw])
+		tr->bytes[rw] -= (s64)bio->bi_size * HZ;
+	if (tr->iops[rw])
+		tr->ios[rw] -= HZ;
+}
+
+static void throtl_schedule(struct throtl_data *td, unsigned long delay)
+{
+	unsigned long expires = jiffies + delay;
+
+	if (td->dead)
+		return;
+	if (!timer_pending(&td->timer) ||
+	    time_before(expires, td->timer.expires))
+		mod_timer(&td->timer, expires);
+}
+
+/*
+ * Take the bios that may go now, or all of them if @all, off the
+ * rules of @td.  Called with td->lock held.
+ */
+static struct bio *throtl_dispatch(struct throtl_data *td, int all)
+{
+	struct throtl_rule *tr, *tmp;
+	struct throtl_fifo bios = { NULL, NULL };
+	unsigned long wait, next = ULONG_MAX;
+	struct bio *bio;
+	int rw;
+
+	list_for_each_entry_safe(tr, tmp, &td->active, node) {
+		for (rw = READ; rw <= WRITE; rw++) {
+			while (tr->queued[rw].head) {
+				wait = throtl_wait(tr, rw);
+				if (wait && !all) {
+					next = min(next, wait);
+					break;
+				}
+
+				bio = throtl_fifo_pop(&tr->queued[rw]);
+				throtl_charge(tr, rw, bio);
+				set_bit(BIO_THROTTLED, &bio->bi_flags);
+				throtl_fifo_add(&bios, bio);
+				tr->nr_queued--;
+			}
+		}
+
+		if (!tr->nr_queued) {
+			list_del_init(&tr->node);
+			css_put(&tr->blkcg->css);
+		}
+	}
+
+	if (next != ULONG_MAX)
+		throtl_schedule(td, next);
+
+	return bios.head;
+}
+
+static void throtl_submit(struct throtl_data *td, struct bio *bio)
+{
+	struct bio *next;
+
+	if (!bio)
+		return;
+
+	while (bio) {
+		next = bio->bi_next;
+		bio->bi_next = NULL;
+		generic_make_request(bio);
+		bio = next;
+	}
+
+	blk_unplug(td->q);
+}
+
+static void throtl_work(struct work_struct *work)
+{
+	struct throtl_data *td = container_of(work, struct throtl_data, work);
+	struct bio *bio;
+
+	spin_lock_irq(&td->lock);
+	bio = throtl_dispatch(td, 0);
+	spin_unlock_irq(&td->lock);
+
+	throtl_submit(td, bio);
+}
+
+static void throtl_timer(unsigned long data)
+{
+	struct throtl_data *td = (struct throtl_data *)data;
+
+	queue_work(kthrotld_workqueue, &td->work);
+}
+
+/*
+ * Called from __generic_make_request() for each device a bio passes.
+ * Returns 1 if the bio was held back, to be resubmitted later.
+ */
+int blk_throtl_bio(struct request_queue *q, struct bio *bio)
+{
+	struct throtl_data *td = q->td;
+	struct blkio_cgroup *blkcg;
+	struct throtl_rule *tr;
+	int rw = bio_data_dir(bio);
+	unsigned long flags;
+	int held = 0;
+
+	/* it was held back once, and has just been released */
+	if (bio_flagged(bio, BIO_THROTTLED)) {
+		clear_bit(BIO_THROTTLED, &bio->bi_flags);
+		return 0;
+	}
+
+	if (!td || td->dead)
+		return 0;
+
+	rcu_read_lock();
+	blkcg = task_blkio(current);
+	tr = throtl_find_rule(blkcg, disk_devt(bio->bi_bdev->bd_disk));
+	if (!tr || (!tr->bps[rw] && !tr->iops[rw]))
+		goto out;
+
+	spin_lock_irqsave(&td->lock, flags);
+	/* blk_throtl_exit() may have drained the queue since we looked */
+	if (td->dead)
+		goto out_unlock;
+	if (!tr->queued[rw].head && !throtl_wait(tr, rw)) {
+		throtl_charge(tr, rw, bio);
+	} else {
+		if (!tr->nr_queued++) {
+			css_get(&blkcg->css);
+			list_add_tail(&tr->node, &td->active);
+		}
+		if (!tr->queued[rw].head)
+			throtl_schedule(td, max(throtl_wait(tr, rw), 1UL));
+		throtl_fifo_add(&tr->queued[rw], bio);
+		held = 1;
+	}
+out_unlock:
+	spin_unlock_irqrestore(&td->lock, flags);
+out:
+	rcu_read_unlock();
+	return held;
+}
+
+/*
+ * Release every bio held back on @q, whatever the limits.
+ */
+void blk_throtl_drain(struct request_queue *q)
+{
+	struct throtl_data *td = q->td;
+	struct bio *bio;
+
+	if (!td)
+		return;
+
+	spin_lock_irq(&td->lock);
+	bio = throtl_dispatch(td, 1);
+	spin_unlock_irq(&td->lock);
+
+	throtl_submit(td, bio);
+}
+
+int blk_throtl_init(struct request_queue *q)
+{
+	struct throtl_data *td;
+
+	td = kzalloc_node(sizeof(*td), GFP_KERNEL, q->node);
+	if (!td)
+		return -ENOMEM;
+
+	td->q = q;
+	spin_lock_init(&td->lock);
+	INIT_LIST_HEAD(&td->active);
+	setup_timer(&td->timer, throtl_timer, (unsigned long)td);
+	INIT_WORK(&td->work, throtl_work);
+
+	q->td = td;
+	return 0;
+}
+
+void blk_throtl_exit(struct request_queue *q)
+{
+	struct throtl_data *td = q->td;
+
+	if (!td)
+		return;
+
+	/*
+	 * Once dead, neither blk_throtl_bio() nor a running work item
+	 * re-arms the timer, and with the timer gone nothing queues the
+	 * work again.
+	 */
+	spin_lock_irq(&td->lock);
+	td->dead = 1;
+	spin_unlock_irq(&td->lock);
+	del_timer_sync(&td->timer);
+	cancel_work_sync(&td->work);
+	blk_throtl_drain(q);
+
+	q->td = NULL;
+	kfree(td);
+}
+
+static int __init throtl_setup(void)
+{
+	kthrotld_workqueue = create_workqueue("kthrotld");
+	if (!kthrotld_workqueue)
+		panic("Failed to create kthrotld\n");
+	return 0;
+}
+subsys_initcall(throtl_setup);
+
+/*
+ * The cgroup interface: one file per limit, each line of which is
+ * "<major>:<minor> <limit>" for a whole disk.  Writing a limit of 0
+ * removes it.
+ */
+static struct cgroup_subsys_state *blkio_create(struct cgroup_subsys *ss,
+						struct cgroup *cgroup)
+{
+	struct blkio_cgroup *blkcg;
+
+	blkcg = kzalloc(sizeof(*blkcg), GFP_KERNEL);
+	if (!blkcg)
+		return ERR_PTR(-ENOMEM);
+
+	INIT_LIST_HEAD(&blkcg->rules);
+	return &blkcg->css;
+}
+
+/*
+ * No bios are held back for a cgroup being destroyed, they pin it,
+ * and cgroup_diput() has waited for readers of the rules to finish.
+ */
+static void blkio_destroy(struct cgroup_subsys *ss, struct cgroup *cgroup)
+{
+	struct blkio_cgroup *blkcg = cgroup_to_blkio(cgroup);
+	struct throtl_rule *tr, *tmp;
+
+	list_for_each_entry_safe(tr, tmp, &blkcg->rules, list) {
+		list_del(&tr->list);
+		kfree(tr);
+	}
+	kfree(blkcg);
+}
+
+static unsigned long *throtl_limit(struct throtl_rule *tr, int private)
+{
+	int rw = private & 1;
+
+	return private & THROTL_IOPS ? &tr->iops[rw] : &tr->bps[rw];
+}
+
+static int blkio_read_limits(struct cgroup *cgroup, struct cftype *cft,
+			     struct seq_file *m)
+{
+	struct blkio_cgroup *blkcg = cgroup_to_blkio(cgroup);
+	struct throtl_rule *tr;
+	unsigned long limit;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(tr, &blkcg->rules, list) {
+		limit = *throtl_limit(tr, cft->private);
+		if (limit)
+			seq_printf(m, "%u:%u %lu\n", MAJOR(tr->dev),
+				   MINOR(tr->dev), limit);
+	}
+	rcu_read_unlock();
+
+	return 0;
+}
+
+static int blkio_update_limit(struct blkio_cgroup *blkcg, int private,
+			      const char *buffer)
+{
+	struct throtl_rule *tr;
+	unsigned int major, minor;
+	unsigned long limit;
+	dev_t dev;
+
+	if (sscanf(buffer, "%u:%u %lu", &major, &minor, &limit) != 3)
+		return -EINVAL;
+
+	dev = MKDEV(major, minor);
+	if (MAJOR(dev) != major || MINOR(dev) != minor)
+		return -EINVAL;
+
+	/* keep the buckets within an s64 */
+	if (limit > LLONG_MAX / (4 * HZ))
+		return -EINVAL;
+
+	tr = throtl_find_rule(blkcg, dev);
+	if (!tr) {
+		if (!limit)
+			return 0;
+
+		tr = kzalloc(sizeof(*tr), GFP_KERNEL);
+		if (!tr)
+			return -ENOMEM;
+		tr->blkcg = blkcg;
+		tr->dev = dev;
+		INIT_LIST_HEAD(&tr->node);
+		tr->last[READ] = tr->last[WRITE] = jiffies;
+		list_add_tail_rcu(&tr->list, &blkcg->rules);
+	}
+
+	/*
+	 * Rules stay until the cgroup goes, as bios may be held back on
+	 * them; one without limits just lets everything through.
+	 */
+	*throtl_limit(tr, private) = limit;
+	return 0;
+}
+
+static int blkio_write_limit(struct cgroup *cgroup, struct cftype *cft,
+			     const char *buffer)
+{
+	int retval;
+
+	if (!cgroup_lock_live_group(cgroup))
+		return -ENODEV;
+	retval = blkio_update_limit(cgroup_to_blkio(cgroup), cft->private,
+				    buffer);
+	cgroup_unlock();
+	return retval;
+}
+
+static struct cftype blkio_files[] = {
+	{
+		.name = "throttle.read_bps_device",
+		.read_seq_string = blkio_read_limits,
+		.write_string = blkio_write_limit,
+		.private = READ,
+	},
+	{
+		.name = "throttle.write_bps_device",
+		.read_seq_string = blkio_read_limits,
+		.write_string = blkio_write_limit,
+		.private = WRITE,
+	},
+	{
+		.name = "throttle.read_iops_device",
+		.read_seq_string = blkio_read_limits,
+		.write_string = blkio_write_limit,
+		.private = THROTL_IOPS | READ,
+	},
+	{
+		.name = "throttle.write_iops_device",
+		.read_seq_string = blkio_read_limits,
+		.write_string = blkio_write_limit,
+		.private = THROTL_IOPS | WRITE,
+	},
+};
+
+static int blkio_populate(struct cgroup_subsys *ss, struct cgroup *cgroup)
+{
+	return cgroup_add_files(cgroup, ss, blkio_files,
+				ARRAY_SIZE(blkio_files));
+}
+
+struct cgroup_subsys blkio_subsys = {
+	.name = "blkio",
+	.create = blkio_create,
+	.destroy = blkio_destroy,
+	.populate = blkio_populate,
+	.subsys_id = blkio_subsys_id,
+};
@@ -10,6 +10,7 @@
 extern struct kmem_cache *blk_requestq_cachep;
 extern struct kobj_type blk_queue_ktype;
 
+int blk_init_free_list(struct request_queue *q);
 void init_request_from_bio(struct request *req, struct bio *bio);
 void blk_rq_bio_prep(struct request_queue *q, struct request *rq,
 			struct bio *bio);
@@ -57,6 +58,24 @@ static inline int blk_should_fake_timeout(struct request_queue *q)
 
 struct io_context *current_io_context(gfp_t gfp_flags, int node);
 
+#ifdef CONFIG_BLK_DEV_THROTTLING
+int blk_throtl_init(struct request_queue *q);
+void blk_throtl_exit(struct request_queue *q);
+void blk_throtl_drain(struct request_queue *q);
+int blk_throtl_bio(struct request_queue *q, struct bio *bio);
+#else
+static inline int blk_throtl_init(struct request_queue *q)
+{
+	return 0;
+}
+static inline void blk_throtl_exit(struct request_queue *q) { }
+static inline void blk_throtl_drain(struct request_queue *q) { }
+static inline int blk_throtl_bio(struct request_queue *q, struct bio *bio)
+{
+	return 0;
+}
+#endif
+
 int ll_back_merge_fn(struct request_queue *q, struct request *req,
 		     struct bio *bio);
 int ll_front_merge_fn(struct request_queue *q, struct request *req, 
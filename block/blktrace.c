@@ -23,6 +23,8 @@
 #include <linux/mutex.h>
 #include <linux/debugfs.h>
 #include <linux/time.h>
+#include <linux/ring_buffer.h>
+#include <linux/math64.h>
 #include <asm/uaccess.h>
 
 static unsigned int blktrace_seq __read_mostly = 1;
@@ -115,6 +117,47 @@ static u32 ddir_act[2] __read_mostly = { BLK_TC_ACT(BLK_TC_READ), BLK_TC_ACT(BLK
 #define MASK_TC_BIT(rw, __name) ( (rw & (1 << BIO_RW_ ## __name)) << \
 	  (ilog2(BLK_TC_ ## __name) + BLK_TC_SHIFT - BIO_RW_ ## __name) )
 
+/*
+ * Record an event in the fast mode: a fixed size record written to the
+ * per-cpu ring buffer, without notes.  Only an event that crosses into
+ * the next buffer page takes the per-cpu buffer lock.  The time is the
+ * one the ring buffer keeps with each event.
+ *
+ * The caller has seen fast_mode set.  The buffer was published before
+ * it, pairing with the smp_wmb() in blk_fast_mode_write().
+ */
+static void blk_add_fast_trace(struct blk_trace *bt, sector_t sector,
+			       int bytes, u32 what, pid_t pid, int error,
+			       u32 latency)
+{
+	struct ring_buffer *buffer;
+	struct ring_buffer_event *event;
+	struct blk_fast_trace *t;
+	unsigned long flags;
+
+	smp_rmb();
+	buffer = ACCESS_ONCE(bt->fast_buffer);
+	if (unlikely(!buffer))
+		return;
+
+	event = ring_buffer_lock_reserve(buffer, sizeof(*t), &flags);
+	if (!event)
+		return;
+
+	t = ring_buffer_event_data(event);
+	t->time = 0;
+	t->sector = sector;
+	t->bytes = bytes;
+	t->action = what;
+	t->pid = pid;
+	t->latency = latency;
+	t->cpu = raw_smp_processor_id();
+	t->error = error;
+	t->device = bt->dev;
+
+	ring_buffer_unlock_commit(buffer, event, flags);
+}
+
 /*
  * The worker for the various blk_add_trace*() types. Fills out a
  * blk_io_trace structure and places it in a per-cpu subbuffer.
@@ -143,6 +186,12 @@ void __blk_add_trace(struct blk_trace *bt, sector_t sector, int bytes,
 	if (unlikely(act_log_check(bt, what, sector, pid)))
 		return;
 
+	if (bt->fast_mode) {
+		if (bt->fast_mode == Blktrace_fast)
+			blk_add_fast_trace(bt, sector, bytes, what, pid, error, 0);
+		return;
+	}
+
 	/*
 	 * A word about the locking here - we disable interrupts to reserve
 	 * some space in the relay per-cpu buffer, to prevent an irq
@@ -179,6 +228,61 @@ void __blk_add_trace(struct blk_trace *bt, sector_t sector, int bytes,
 
 EXPORT_SYMBOL_GPL(__blk_add_trace);
 
+/*
+ * blk_add_trace_rq() in the fast modes.  Requests are stamped when
+ * issued so that their completion can carry the latency, and in the
+ * slow mode only completions over the threshold are recorded.
+ */
+void __blk_add_trace_rq_fast(struct blk_trace *bt, struct request *rq,
+			     u32 what)
+{
+	int rw = rq->cmd_flags & 0x03;
+	u32 latency = 0;
+	u64 now;
+
+	if (unlikely(bt->trace_state != Blktrace_running))
+		return;
+
+	if (what == BLK_TA_ISSUE) {
+		rq->trace_issue = ktime_to_ns(ktime_get());
+	} else if (what == BLK_TA_COMPLETE && rq->trace_issue) {
+		now = ktime_to_ns(ktime_get());
+		latency = min_t(u64, div_u64(now - rq->trace_issue, 1000),
+				UINT_MAX);
+	}
+
+	if (bt->fast_mode == Blktrace_fast_slow &&
+	    (what != BLK_TA_COMPLETE || !rq->trace_issue ||
+	     latency < bt->fast_threshold))
+		return;
+
+	if (blk_discard_rq(rq))
+		rw |= (1 << BIO_RW_DISCARD);
+
+	what |= ddir_act[rw & WRITE];
+	what |= MASK_TC_BIT(rw, BARRIER);
+	what |= MASK_TC_BIT(rw, SYNC);
+	what |= MASK_TC_BIT(rw, AHEAD);
+	what |= MASK_TC_BIT(rw, META);
+	what |= MASK_TC_BIT(rw, DISCARD);
+
+	if (blk_pc_request(rq)) {
+		what |= BLK_TC_ACT(BLK_TC_PC);
+		if (act_log_check(bt, what, 0, current->pid))
+			return;
+		blk_add_fast_trace(bt, 0, rq->data_len, what, current->pid,
+				   rq->errors, latency);
+	} else {
+		what |= BLK_TC_ACT(BLK_TC_FS);
+		if (act_log_check(bt, what, rq->hard_sector, current->pid))
+			return;
+		blk_add_fast_trace(bt, rq->hard_sector,
+				   rq->hard_nr_sectors << 9, what,
+				   current->pid, rq->errors, latency);
+	}
+}
+EXPORT_SYMBOL_GPL(__blk_add_trace_rq_fast);
+
 static struct dentry *blk_tree_root;
 static DEFINE_MUTEX(blk_tree_mutex);
 static unsigned int root_users;
@@ -231,6 +335,11 @@ err:
 static void blk_trace_cleanup(struct blk_trace *bt)
 {
 	relay_close(bt->rchan);
+	debugfs_remove(bt->fast_threshold_file);
+	debugfs_remove(bt->fast_mode_file);
+	debugfs_remove(bt->fast_file);
+	if (bt->fast_buffer)
+		ring_buffer_free(bt->fast_buffer);
 	debugfs_remove(bt->msg_file);
 	debugfs_remove(bt->dropped_file);
 	blk_remove_tree(bt->dir);
@@ -317,6 +426,134 @@ static const struct file_operations blk_msg_fops = {
 	.write =	blk_msg_write,
 };
 
+static int blk_fast_open(struct inode *inode, struct file *filp)
+{
+	filp->private_data = inode->i_private;
+
+	return 0;
+}
+
+/*
+ * Take the oldest fast record off the per-cpu buffers.
+ */
+static int blk_fast_consume(struct blk_trace *bt, struct blk_fast_trace *t)
+{
+	struct ring_buffer_event *event;
+	int cpu, next_cpu = -1;
+	u64 ts, next_ts = 0;
+
+	for_each_possible_cpu(cpu) {
+		if (!ring_buffer_peek(bt->fast_buffer, cpu, &ts))
+			continue;
+		if (next_cpu < 0 || ts < next_ts) {
+			next_cpu = cpu;
+			next_ts = ts;
+		}
+	}
+
+	if (next_cpu < 0)
+		return 0;
+
+	event = ring_buffer_consume(bt->fast_buffer, next_cpu, &ts);
+	if (!event)
+		return 0;
+
+	memcpy(t, ring_buffer_event_data(event), sizeof(*t));
+	t->time = ts;
+	return 1;
+}
+
+/*
+ * Reads return whole records, and 0 once the buffers are empty.
+ */
+static ssize_t blk_fast_read(struct file *filp, char __user *buffer,
+			     size_t count, loff_t *ppos)
+{
+	struct blk_trace *bt = filp->private_data;
+	struct blk_fast_trace t;
+	ssize_t ret = 0;
+
+	mutex_lock(&bt->fast_mutex);
+	if (!bt->fast_buffer)
+		goto out;
+
+	while (count - ret >= sizeof(t) && blk_fast_consume(bt, &t)) {
+		if (copy_to_user(buffer + ret, &t, sizeof(t))) {
+			if (!ret)
+				ret = -EFAULT;
+			break;
+		}
+		ret += sizeof(t);
+	}
+out:
+	mutex_unlock(&bt->fast_mutex);
+	return ret;
+}
+
+static const struct file_operations blk_fast_fops = {
+	.owner =	THIS_MODULE,
+	.open =		blk_fast_open,
+	.read =		blk_fast_read,
+};
+
+static ssize_t blk_fast_mode_read(struct file *filp, char __user *buffer,
+				  size_t count, loff_t *ppos)
+{
+	struct blk_trace *bt = filp->private_data;
+	char buf[16];
+
+	snprintf(buf, sizeof(buf), "%d\n", bt->fast_mode);
+
+	return simple_read_from_buffer(buffer, count, ppos, buf, strlen(buf));
+}
+
+/*
+ * The ring buffer is only allocated when a fast mode is first chosen,
+ * and kept until the trace is torn down.  It overwrites the oldest
+ * records when full, so it always holds the latest ones.
+ */
+static ssize_t blk_fast_mode_write(struct file *filp,
+				   const char __user *buffer,
+				   size_t count, loff_t *ppos)
+{
+	struct blk_trace *bt = filp->private_data;
+	char buf[16];
+	long mode;
+	int ret = count;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, buffer, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	if (strict_strtol(strstrip(buf), 10, &mode) ||
+	    mode < Blktrace_relay || mode > Blktrace_fast_slow)
+		return -EINVAL;
+
+	mutex_lock(&bt->fast_mutex);
+	if (mode && !bt->fast_buffer) {
+		bt->fast_buffer = ring_buffer_alloc(bt->fast_size,
+						    RB_FL_OVERWRITE);
+		if (!bt->fast_buffer) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		smp_wmb();
+	}
+	bt->fast_mode = mode;
+out:
+	mutex_unlock(&bt->fast_mutex);
+	return ret;
+}
+
+static const struct file_operations blk_fast_mode_fops = {
+	.owner =	THIS_MODULE,
+	.open =		blk_fast_open,
+	.read =		blk_fast_mode_read,
+	.write =	blk_fast_mode_write,
+};
+
 /*
  * Keep track of how many times we encountered a full subbuffer, to aid
  * the user space app in telling how many lost events there were.
@@ -401,6 +638,8 @@ int do_blk_trace_setup(struct request_queue *q, char *name, dev_t dev,
 	bt->dir = dir;
 	bt->dev = dev;
 	atomic_set(&bt->dropped, 0);
+	mutex_init(&bt->fast_mutex);
+	bt->fast_size = (unsigned long)buts->buf_size * buts->buf_nr;
 
 	ret = -EIO;
 	bt->dropped_file = debugfs_create_file("dropped", 0444, dir, bt, &blk_dropped_fops);
@@ -411,6 +650,21 @@ int do_blk_trace_setup(struct request_queue *q, char *name, dev_t dev,
 	if (!bt->msg_file)
 		goto err;
 
+	bt->fast_file = debugfs_create_file("fast", 0444, dir, bt,
+					    &blk_fast_fops);
+	if (!bt->fast_file)
+		goto err;
+
+	bt->fast_mode_file = debugfs_create_file("fast_mode", 0644, dir, bt,
+						 &blk_fast_mode_fops);
+	if (!bt->fast_mode_file)
+		goto err;
+
+	bt->fast_threshold_file = debugfs_create_u32("fast_threshold_us", 0644,
+						     dir, &bt->fast_threshold);
+	if (!bt->fast_threshold_file)
+		goto err;
+
 	bt->rchan = relay_open("trace", dir, buts->buf_size,
 				buts->buf_nr, &blk_relay_callbacks, bt);
 	if (!bt->rchan)
@@ -440,6 +694,12 @@ err:
 	if (dir)
 		blk_remove_tree(dir);
 	if (bt) {
+		if (bt->fast_threshold_file)
+			debugfs_remove(bt->fast_threshold_file);
+		if (bt->fast_mode_file)
+			debugfs_remove(bt->fast_mode_file);
+		if (bt->fast_file)
+			debugfs_remove(bt->fast_file);
 		if (bt->msg_file)
 			debugfs_remove(bt->msg_file);
 		if (bt->dropped_file)
@@ -12,6 +12,7 @@
 #include <linux/rbtree.h>
 #include <linux/ioprio.h>
 #include <linux/blktrace_api.h>
+#include <linux/ktime.h>
 
 /*
  * tunables
@@ -27,6 +28,8 @@ static const int cfq_slice_sync = HZ / 10;
 static int cfq_slice_async = HZ / 25;
 static const int cfq_slice_async_rq = 2;
 static int cfq_slice_idle = HZ / 125;
+/* use service time accounting on non-rotational devices */
+static const int cfq_flash_mode = 1;
 
 /*
  * offset from end of service tree
@@ -41,6 +44,13 @@ static int cfq_slice_idle = HZ / 125;
 #define CFQ_SLICE_SCALE		(5)
 #define CFQ_HW_QUEUE_MIN	(5)
 
+/*
+ * flash mode: longest service time sample, and largest lead in service
+ * a queue can build up over the others, both in usecs
+ */
+#define CFQ_FLASH_MAX_SVC	(USEC_PER_SEC / 10)
+#define CFQ_FLASH_MAX_LAG	(USEC_PER_SEC)
+
 #define RQ_CIC(rq)		\
 	((struct cfq_io_context *) (rq)->elevator_private)
 #define RQ_CFQQ(rq)		(struct cfq_queue *) ((rq)->elevator_private2)
@@ -114,6 +124,16 @@ struct cfq_data {
 	sector_t last_position;
 	unsigned long last_end_request;
 
+	/*
+	 * flash mode: device time used per completed request, in usecs,
+	 * and the service time of the most recently started queue
+	 */
+	ktime_t svc_last;
+	unsigned long svc_samples;
+	unsigned long svc_total;
+	unsigned long svc_mean;
+	u64 min_vservice;
+
 	/*
 	 * tunables, see top of file
 	 */
@@ -124,6 +144,7 @@ struct cfq_data {
 	unsigned int cfq_slice[2];
 	unsigned int cfq_slice_async_rq;
 	unsigned int cfq_slice_idle;
+	unsigned int cfq_flash_mode;
 
 	struct list_head cic_list;
 };
@@ -155,6 +176,8 @@ struct cfq_queue {
 
 	unsigned long slice_end;
 	long slice_resid;
+	/* device time charged in flash mode, scaled by io prio */
+	u64 vservice;
 
 	/* pending metadata requests */
 	int meta_pending;
@@ -306,6 +329,32 @@ static inline int cfq_slice_used(struct cfq_queue *cfqq)
 	return 1;
 }
 
+/*
+ * Flash mode: on devices without a seek penalty, don't idle, keep
+ * reads and writes in flight together and share the device by the
+ * time it spends on each queue's requests instead of by slice time.
+ */
+static inline int cfq_flash(struct cfq_data *cfqd)
+{
+	return cfqd->cfq_flash_mode && blk_queue_nonrot(cfqd->queue);
+}
+
+/*
+ * Requests to keep in the driver in flash mode: as many as the device
+ * completes within one idle window, the latency a rotational disk
+ * would have spent idling for the next sync request.
+ */
+static int cfq_flash_depth(struct cfq_data *cfqd)
+{
+	unsigned int window = jiffies_to_usecs(max(cfqd->cfq_slice_idle, 1U));
+	unsigned int depth = cfqd->cfq_quantum;
+
+	if (sample_valid(cfqd->svc_samples) && cfqd->svc_mean)
+		depth = max_t(unsigned int, depth, window / cfqd->svc_mean);
+
+	return min_t(unsigned int, depth, cfqd->queue->nr_requests);
+}
+
 /*
  * Lifted from AS - choose which of rq1 and rq2 that is best served now.
  * We choose the request that is closest to the head right now. Distance
@@ -482,6 +531,21 @@ static void cfq_service_tree_add(struct cfq_data *cfqd,
 			rb_key += __cfqq->rb_key;
 		} else
 			rb_key += jiffies;
+	} else if (!add_front && cfq_flash(cfqd)) {
+		/*
+		 * queue by how far ahead of the active queue this one is in
+		 * device time. a queue that was idle gets no credit for it.
+		 */
+		u64 lag = 0;
+
+		if (cfqq->vservice < cfqd->min_vservice)
+			cfqq->vservice = cfqd->min_vservice;
+		else
+			lag = cfqq->vservice - cfqd->min_vservice;
+
+		lag = min_t(u64, lag, CFQ_FLASH_MAX_LAG);
+		rb_key = usecs_to_jiffies(lag) + jiffies;
+		cfqq->slice_resid = 0;
 	} else if (!add_front) {
 		rb_key = cfq_slice_offset(cfqd, cfqq) + jiffies;
 		rb_key += cfqq->slice_resid;
@@ -658,6 +722,9 @@ static void cfq_activate_request(struct request_queue *q, struct request *rq)
 {
 	struct cfq_data *cfqd = q->elevator->elevator_data;
 
+	if (!cfqd->rq_in_driver && cfq_flash(cfqd))
+		cfqd->svc_last = ktime_get();
+
 	cfqd->rq_in_driver++;
 	cfq_log_cfqq(cfqd, RQ_CFQQ(rq), "activate rq, drv=%d",
 						cfqd->rq_in_driver);
@@ -769,6 +836,9 @@ static void __cfq_set_active_queue(struct cfq_data *cfqd,
 		cfq_clear_cfqq_fifo_expire(cfqq);
 		cfq_mark_cfqq_slice_new(cfqq);
 		cfq_clear_cfqq_queue_new(cfqq);
+
+		if (cfqq->vservice > cfqd->min_vservice)
+			cfqd->min_vservice = cfqq->vservice;
 	}
 
 	cfqd->active_queue = cfqq;
@@ -886,6 +956,9 @@ static void cfq_arm_slice_timer(struct cfq_data *cfqd)
 	if (blk_queue_nonrot(cfqd->queue) && cfqd->hw_tag)
 		return;
 
+	if (cfq_flash(cfqd))
+		return;
+
 	WARN_ON(!RB_EMPTY_ROOT(&cfqq->sort_list));
 	WARN_ON(cfq_cfqq_slice_new(cfqq));
 
@@ -1015,9 +1088,11 @@ static struct cfq_queue *cfq_select_queue(struct cfq_data *cfqd)
 	 * No requests pending. If the active queue still has requests in
 	 * flight or is idling for a new request, allow either of these
 	 * conditions to happen (or time out) before selecting a new queue.
+	 * In flash mode, let the next queue dispatch alongside them.
 	 */
 	if (timer_pending(&cfqd->idle_slice_timer) ||
-	    (cfqq->dispatched && cfq_cfqq_idle_window(cfqq))) {
+	    (cfqq->dispatched && cfq_cfqq_idle_window(cfqq) &&
+	     !cfq_flash(cfqd))) {
 		cfqq = NULL;
 		goto keep_queue;
 	}
@@ -1133,6 +1208,8 @@ static int cfq_dispatch_requests(struct request_queue *q, int force)
 		int max_dispatch;
 
 		max_dispatch = cfqd->cfq_quantum;
+		if (cfq_flash(cfqd))
+			max_dispatch = cfq_flash_depth(cfqd);
 		if (cfq_class_idle(cfqq))
 			max_dispatch = 1;
 
@@ -1143,7 +1220,8 @@ static int cfq_dispatch_requests(struct request_queue *q, int force)
 				break;
 		}
 
-		if (cfqd->sync_flight && !cfq_cfqq_sync(cfqq))
+		if (cfqd->sync_flight && !cfq_cfqq_sync(cfqq) &&
+		    !cfq_flash(cfqd))
 			break;
 
 		cfq_clear_cfqq_must_dispatch(cfqq);
@@ -1914,6 +1992,34 @@ static void cfq_update_hw_tag(struct cfq_data *cfqd)
 	cfqd->rq_in_driver_peak = 0;
 }
 
+/*
+ * Flash mode: the device time a request used is the time since the
+ * previous completion, or since the device went busy.  With several
+ * requests in flight that is the device's time per request at this
+ * depth, which is what the queue is charged, scaled by its io prio.
+ */
+static void cfq_update_service_time(struct cfq_data *cfqd,
+				    struct cfq_queue *cfqq)
+{
+	ktime_t now = ktime_get();
+	unsigned long svc;
+	s64 delta;
+
+	delta = ktime_us_delta(now, cfqd->svc_last);
+	cfqd->svc_last = now;
+	if (delta < 0)
+		delta = 0;
+	svc = min_t(s64, delta, CFQ_FLASH_MAX_SVC);
+
+	cfqd->svc_samples = (7*cfqd->svc_samples + 256) / 8;
+	cfqd->svc_total = (7*cfqd->svc_total + 256*svc) / 8;
+	cfqd->svc_mean = (cfqd->svc_total + 128) / cfqd->svc_samples;
+
+	if (!cfq_class_rt(cfqq) && !cfq_class_idle(cfqq))
+		cfqq->vservice += div_u64((u64)svc * cfqd->cfq_slice[1],
+					  cfq_prio_to_slice(cfqd, cfqq));
+}
+
 static void cfq_completed_request(struct request_queue *q, struct request *rq)
 {
 	struct cfq_queue *cfqq = RQ_CFQQ(rq);
@@ -1926,6 +2032,9 @@ static void cfq_completed_request(struct request_queue *q, struct request *rq)
 
 	cfq_update_hw_tag(cfqd);
 
+	if (cfq_flash(cfqd))
+		cfq_update_service_time(cfqd, cfqq);
+
 	WARN_ON(!cfqd->rq_in_driver);
 	WARN_ON(!cfqq->dispatched);
 	cfqd->rq_in_driver--;
@@ -2236,6 +2345,7 @@ static void *cfq_init_queue(struct request_queue *q)
 	cfqd->cfq_slice[1] = cfq_slice_sync;
 	cfqd->cfq_slice_async_rq = cfq_slice_async_rq;
 	cfqd->cfq_slice_idle = cfq_slice_idle;
+	cfqd->cfq_flash_mode = cfq_flash_mode;
 	cfqd->hw_tag = 1;
 
 	return cfqd;
@@ -2305,6 +2415,7 @@ SHOW_FUNCTION(cfq_slice_idle_show, cfqd->cfq_slice_idle, 1);
 SHOW_FUNCTION(cfq_slice_sync_show, cfqd->cfq_slice[1], 1);
 SHOW_FUNCTION(cfq_slice_async_show, cfqd->cfq_slice[0], 1);
 SHOW_FUNCTION(cfq_slice_async_rq_show, cfqd->cfq_slice_async_rq, 0);
+SHOW_FUNCTION(cfq_flash_mode_show, cfqd->cfq_flash_mode, 0);
 #undef SHOW_FUNCTION
 
 #define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
@@ -2336,6 +2447,7 @@ STORE_FUNCTION(cfq_slice_sync_store, &cfqd->cfq_slice[1], 1, UINT_MAX, 1);
 STORE_FUNCTION(cfq_slice_async_store, &cfqd->cfq_slice[0], 1, UINT_MAX, 1);
 STORE_FUNCTION(cfq_slice_async_rq_store, &cfqd->cfq_slice_async_rq, 1,
 		UINT_MAX, 0);
+STORE_FUNCTION(cfq_flash_mode_store, &cfqd->cfq_flash_mode, 0, 1, 0);
 #undef STORE_FUNCTION
 
 #define CFQ_ATTR(name) \
@@ -2351,6 +2463,7 @@ static struct elv_fs_entry cfq_attrs[] = {
 	CFQ_ATTR(slice_async),
 	CFQ_ATTR(slice_async_rq),
 	CFQ_ATTR(slice_idle),
+	CFQ_ATTR(flash_mode),
 	__ATTR_NULL
 };
 
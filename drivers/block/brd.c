@@ -317,6 +317,44 @@ out:
 	return 0;
 }
 
+static int brd_do_request(struct request *rq)
+{
+	struct brd_device *brd = rq->rq_disk->private_data;
+	int rw = rq_data_dir(rq);
+	struct req_iterator iter;
+	struct bio_vec *bvec;
+	sector_t sector;
+	int err = 0;
+
+	sector = rq->sector;
+	if (sector + rq->nr_sectors > get_capacity(rq->rq_disk))
+		return -EIO;
+
+	rq_for_each_segment(bvec, rq, iter) {
+		unsigned int len = bvec->bv_len;
+		err = brd_do_bvec(brd, bvec->bv_page, len,
+					bvec->bv_offset, rw, sector);
+		if (err)
+			break;
+		sector += len >> SECTOR_SHIFT;
+	}
+
+	return err;
+}
+
+/*
+ * Multi-queue mode: start a batch of requests staged on one cpu.
+ */
+static void brd_queue_rqs(struct request_queue *q, struct list_head *list)
+{
+	struct request *rq, *next;
+
+	list_for_each_entry_safe(rq, next, list, queuelist) {
+		list_del_init(&rq->queuelist);
+		blk_mq_end_request(rq, brd_do_request(rq));
+	}
+}
+
 #ifdef CONFIG_BLK_DEV_XIP
 static int brd_direct_access (struct block_device *bdev, sector_t sector,
 			void **kaddr, unsigned long *pfn)
@@ -388,12 +426,15 @@ static int rd_nr;
 int rd_size = CONFIG_BLK_DEV_RAM_SIZE;
 static int max_part;
 static int part_shift;
+static int rd_mq;
 module_param(rd_nr, int, 0);
 MODULE_PARM_DESC(rd_nr, "Maximum number of brd devices");
 module_param(rd_size, int, 0);
 MODULE_PARM_DESC(rd_size, "Size of each RAM disk in kbytes.");
 module_param(max_part, int, 0);
 MODULE_PARM_DESC(max_part, "Maximum number of partitions per RAM disk");
+module_param(rd_mq, bool, 0);
+MODULE_PARM_DESC(rd_mq, "Submit through per-cpu multi-queue staging");
 MODULE_LICENSE("GPL");
 MODULE_ALIAS_BLOCKDEV_MAJOR(RAMDISK_MAJOR);
 MODULE_ALIAS("rd");
@@ -432,10 +473,14 @@ static struct brd_device *brd_alloc(int i)
 	spin_lock_init(&brd->brd_lock);
 	INIT_RADIX_TREE(&brd->brd_pages, GFP_ATOMIC);
 
-	brd->brd_queue = blk_alloc_queue(GFP_KERNEL);
+	if (rd_mq)
+		brd->brd_queue = blk_init_queue_mq(brd_queue_rqs);
+	else
+		brd->brd_queue = blk_alloc_queue(GFP_KERNEL);
 	if (!brd->brd_queue)
 		goto out_free_dev;
-	blk_queue_make_request(brd->brd_queue, brd_make_request);
+	if (!rd_mq)
+		blk_queue_make_request(brd->brd_queue, brd_make_request);
 	blk_queue_max_sectors(brd->brd_queue, 1024);
 	blk_queue_bounce_limit(brd->brd_queue, BLK_BOUNCE_ANY);
 
@@ -75,6 +75,7 @@
 #include <linux/gfp.h>
 #include <linux/kthread.h>
 #include <linux/splice.h>
+#include <linux/mempool.h>
 
 #include <asm/uaccess.h>
 
@@ -83,6 +84,22 @@ static DEFINE_MUTEX(loop_devices_mutex);
 
 static int max_part;
 static int part_shift;
+static int direct_io;
+
+/*
+ * Bios and completion state for direct I/O to the device underneath
+ */
+#define LOOP_DIO_POOL_SIZE	16
+
+struct loop_dio {
+	struct loop_device *lo;
+	struct bio *bio;
+	atomic_t pending;
+	int error;
+};
+
+static struct bio_set *loop_bio_set;
+static mempool_t *loop_dio_pool;
 
 /*
  * Transfer functions
@@ -479,9 +496,239 @@ static int do_bio_filebacked(struct loop_device *lo, struct bio *bio)
 		ret = lo_send(lo, bio, pos);
 	else
 		ret = lo_receive(lo, bio, lo->lo_blocksize, pos);
+
+	/*
+	 * In direct I/O mode the page cache of the backing file must not
+	 * keep anything that later direct reads or writes would bypass.
+	 */
+	if (lo->lo_flags & LO_FLAGS_DIRECT_IO) {
+		struct address_space *mapping = lo->lo_backing_file->f_mapping;
+		loff_t end = pos + bio->bi_size - 1;
+
+		if (bio_rw(bio) == WRITE) {
+			int err = filemap_write_and_wait_range(mapping, pos, end);
+			if (!ret)
+				ret = err;
+		}
+		invalidate_mapping_pages(mapping, pos >> PAGE_CACHE_SHIFT,
+					 end >> PAGE_CACHE_SHIFT);
+	}
 	return ret;
 }
 
+/*
+ * Direct I/O mode: rather than going through the page cache of the
+ * backing file, map the file with bmap and send the data straight to
+ * the device underneath, like O_DIRECT does.  Bios are completed from
+ * the completion of the device's bios, so the loop thread does not wait
+ * and any number of them can be in flight.
+ *
+ * Only used with no transfer function, and for a block device or a file
+ * on a block based filesystem that supports direct I/O.  The file is
+ * flagged S_SWAPFILE meanwhile so that its blocks cannot be truncated
+ * away or written through the page cache behind our back.
+ */
+static int loop_direct_io_ok(struct loop_device *lo, struct file *file)
+{
+	struct address_space *mapping = file->f_mapping;
+	struct inode *inode = mapping->host;
+
+	if (lo->transfer != transfer_none)
+		return 0;
+	if (S_ISBLK(inode->i_mode))
+		return 1;
+	return S_ISREG(inode->i_mode) && inode->i_sb->s_bdev &&
+		(lo->lo_flags & LO_FLAGS_USE_AOPS) &&
+		mapping->a_ops->bmap && mapping->a_ops->direct_IO;
+}
+
+static void loop_enable_direct_io(struct loop_device *lo)
+{
+	struct address_space *mapping = lo->lo_backing_file->f_mapping;
+	struct inode *inode = mapping->host;
+
+	if (!loop_direct_io_ok(lo, lo->lo_backing_file))
+		return;
+
+	if (S_ISREG(inode->i_mode)) {
+		mutex_lock(&inode->i_mutex);
+		if (IS_SWAPFILE(inode)) {
+			mutex_unlock(&inode->i_mutex);
+			return;
+		}
+		inode->i_flags |= S_SWAPFILE;
+		mutex_unlock(&inode->i_mutex);
+	}
+
+	filemap_write_and_wait(mapping);
+	invalidate_inode_pages2(mapping);
+	lo->lo_flags |= LO_FLAGS_DIRECT_IO;
+}
+
+static void loop_disable_direct_io(struct loop_device *lo)
+{
+	struct inode *inode = lo->lo_backing_file->f_mapping->host;
+
+	if (!(lo->lo_flags & LO_FLAGS_DIRECT_IO))
+		return;
+
+	lo->lo_flags &= ~LO_FLAGS_DIRECT_IO;
+	if (S_ISREG(inode->i_mode)) {
+		mutex_lock(&inode->i_mutex);
+		inode->i_flags &= ~S_SWAPFILE;
+		mutex_unlock(&inode->i_mutex);
+	}
+}
+
+static void loop_dio_put(struct loop_dio *dio)
+{
+	struct loop_device *lo = dio->lo;
+
+	if (atomic_dec_and_test(&dio->pending)) {
+		bio_endio(dio->bio, dio->error);
+		mempool_free(dio, loop_dio_pool);
+		if (atomic_dec_and_test(&lo->lo_dio_pending))
+			wake_up(&lo->lo_event);
+	}
+}
+
+/*
+ * Wait for the direct I/O still in flight below the loop device, which
+ * targets the blocks of the current backing file.  Only called from
+ * the loop thread, so no more can be started meanwhile.
+ */
+static void loop_wait_direct_io(struct loop_device *lo)
+{
+	blk_run_address_space(lo->lo_backing_file->f_mapping);
+	wait_event(lo->lo_event, !atomic_read(&lo->lo_dio_pending));
+}
+
+static void loop_dio_endio(struct bio *clone, int error)
+{
+	struct loop_dio *dio = clone->bi_private;
+
+	if (unlikely(!bio_flagged(clone, BIO_UPTODATE) && !error))
+		error = -EIO;
+	if (unlikely(error))
+		dio->error = error;
+
+	bio_put(clone);
+	loop_dio_put(dio);
+}
+
+static void loop_dio_submit(struct loop_dio *dio, struct bio *clone)
+{
+	atomic_inc(&dio->pending);
+	clone->bi_private = dio;
+	generic_make_request(clone);
+}
+
+/*
+ * Returns -EAGAIN if the bio has to go through the page cache after
+ * all: because it isn't aligned to the device's sector size, or it
+ * touches a hole or lies beyond the end of the file.
+ *
+ * All of that is checked before the first clone is allocated.  Each
+ * clone is then sent as soon as it is complete, so that the loop
+ * thread never holds more than one of them from loop_bio_set: waiting
+ * for a second one could only be ended by its own clones.
+ */
+static int lo_direct_io(struct loop_device *lo, struct bio *bio)
+{
+	struct inode *inode = lo->lo_backing_file->f_mapping->host;
+	struct bio *clone = NULL;
+	struct block_device *bdev;
+	unsigned int blkbits, mask;
+	sector_t block, next_sector = 0;
+	struct loop_dio *dio;
+	struct bio_vec *bvec;
+	loff_t pos;
+	int i;
+
+	if (lo->transfer != transfer_none || bio_barrier(bio))
+		return -EAGAIN;
+
+	if (S_ISBLK(inode->i_mode)) {
+		bdev = inode->i_bdev;
+		blkbits = 9;
+	} else {
+		bdev = inode->i_sb->s_bdev;
+		blkbits = inode->i_blkbits;
+	}
+	mask = bdev_hardsect_size(bdev) - 1;
+
+	pos = ((loff_t) bio->bi_sector << 9) + lo->lo_offset;
+	if ((pos & mask) || pos + bio->bi_size > i_size_read(inode))
+		return -EAGAIN;
+
+	bio_for_each_segment(bvec, bio, i)
+		if ((bvec->bv_offset | bvec->bv_len) & mask)
+			return -EAGAIN;
+
+	if (!S_ISBLK(inode->i_mode))
+		for (block = pos >> blkbits;
+		     block <= (pos + bio->bi_size - 1) >> blkbits; block++)
+			if (!bmap(inode, block))
+				return -EAGAIN;
+
+	dio = mempool_alloc(loop_dio_pool, GFP_NOIO);
+	dio->lo = lo;
+	dio->bio = bio;
+	dio->error = 0;
+	/* held until every clone has been sent */
+	atomic_set(&dio->pending, 1);
+	atomic_inc(&lo->lo_dio_pending);
+
+	bio_for_each_segment(bvec, bio, i) {
+		unsigned int offset = bvec->bv_offset;
+		unsigned int left = bvec->bv_len;
+
+		while (left) {
+			unsigned int blkoff = pos & ((1 << blkbits) - 1);
+			unsigned int len = min(left, (1U << blkbits) - blkoff);
+			sector_t sector;
+
+			if (S_ISBLK(inode->i_mode))
+				sector = pos >> 9;
+			else {
+				sector = bmap(inode, pos >> blkbits);
+				sector = (sector << (blkbits - 9)) + (blkoff >> 9);
+			}
+
+			if (!clone || sector != next_sector ||
+			    bio_add_page(clone, bvec->bv_page, len, offset) < len) {
+				if (clone)
+					loop_dio_submit(dio, clone);
+				clone = bio_alloc_bioset(GFP_NOIO,
+						bio->bi_vcnt - i, loop_bio_set);
+				clone->bi_sector = sector;
+				clone->bi_bdev = bdev;
+				clone->bi_rw = bio_data_dir(bio) |
+					(bio->bi_rw & (1 << BIO_RW_SYNC));
+				clone->bi_end_io = loop_dio_endio;
+
+				/* an empty bio takes at least one page */
+				if (bio_add_page(clone, bvec->bv_page, len,
+						 offset) < len) {
+					bio_put(clone);
+					dio->error = -EIO;
+					goto out;
+				}
+			}
+
+			next_sector = sector + (len >> 9);
+			pos += len;
+			offset += len;
+			left -= len;
+		}
+	}
+	if (clone)
+		loop_dio_submit(dio, clone);
+out:
+	loop_dio_put(dio);
+	return 0;
+}
+
 /*
  * Add bio to back of pending list
  */
@@ -550,6 +797,7 @@ static void loop_unplug(struct request_queue *q)
 
 struct switch_request {
 	struct file *file;
+	int direct_io;
 	struct completion wait;
 };
 
@@ -561,8 +809,14 @@ static inline void loop_handle_bio(struct loop_device *lo, struct bio *bio)
 		do_loop_switch(lo, bio->bi_private);
 		bio_put(bio);
 	} else {
-		int ret = do_bio_filebacked(lo, bio);
-		bio_endio(bio, ret);
+		int ret = -EAGAIN;
+
+		if (lo->lo_flags & LO_FLAGS_DIRECT_IO)
+			ret = lo_direct_io(lo, bio);
+		if (ret == -EAGAIN) {
+			ret = do_bio_filebacked(lo, bio);
+			bio_endio(bio, ret);
+		}
 	}
 }
 
@@ -598,17 +852,28 @@ static int loop_thread(void *data)
 
 		BUG_ON(!bio);
 		loop_handle_bio(lo, bio);
+
+		/*
+		 * Direct I/O is still queued below us: start it once
+		 * there is nothing more to add to it.
+		 */
+		if ((lo->lo_flags & LO_FLAGS_DIRECT_IO) && !lo->lo_bio)
+			blk_run_address_space(lo->lo_backing_file->f_mapping);
 	}
 
+	loop_wait_direct_io(lo);
 	return 0;
 }
 
 /*
- * loop_switch performs the hard work of switching a backing store.
+ * loop_switch performs the hard work of switching a backing store, or
+ * turning direct I/O on or off.
  * First it needs to flush existing IO, it does this by sending a magic
- * BIO down the pipe. The completion of this BIO does the actual switch.
+ * BIO down the pipe. The completion of this BIO does the actual switch,
+ * once any direct I/O still in flight has completed as well.
  */
-static int loop_switch(struct loop_device *lo, struct file *file)
+static int loop_switch(struct loop_device *lo, struct file *file,
+		       int direct_io)
 {
 	struct switch_request w;
 	struct bio *bio = bio_alloc(GFP_KERNEL, 0);
@@ -616,6 +881,7 @@ static int loop_switch(struct loop_device *lo, struct file *file)
 		return -ENOMEM;
 	init_completion(&w.wait);
 	w.file = file;
+	w.direct_io = direct_io;
 	bio->bi_private = &w;
 	bio->bi_bdev = NULL;
 	loop_make_request(lo->lo_queue, bio);
@@ -632,12 +898,16 @@ static void do_loop_switch(struct loop_device *lo, struct switch_request *p)
 	struct file *old_file = lo->lo_backing_file;
 	struct address_space *mapping = file->f_mapping;
 
+	loop_wait_direct_io(lo);
+	loop_disable_direct_io(lo);
 	mapping_set_gfp_mask(old_file->f_mapping, lo->old_gfp_mask);
 	lo->lo_backing_file = file;
 	lo->lo_blocksize = S_ISBLK(mapping->host->i_mode) ?
 		mapping->host->i_bdev->bd_block_size : PAGE_SIZE;
 	lo->old_gfp_mask = mapping_gfp_mask(mapping);
 	mapping_set_gfp_mask(mapping, lo->old_gfp_mask & ~(__GFP_IO|__GFP_FS));
+	if (p->direct_io)
+		loop_enable_direct_io(lo);
 	complete(&p->wait);
 }
 
@@ -688,7 +958,7 @@ static int loop_change_fd(struct loop_device *lo, struct block_device *bdev,
 		goto out_putf;
 
 	/* and ... switch */
-	error = loop_switch(lo, file);
+	error = loop_switch(lo, file, lo->lo_flags & LO_FLAGS_DIRECT_IO);
 	if (error)
 		goto out_putf;
 
@@ -814,6 +1084,9 @@ static int loop_set_fd(struct loop_device *lo, fmode_t mode,
 
 	set_blocksize(bdev, lo_blocksize);
 
+	if (direct_io)
+		loop_enable_direct_io(lo);
+
 	lo->lo_thread = kthread_create(loop_thread, lo, "loop%d",
 						lo->lo_number);
 	if (IS_ERR(lo->lo_thread)) {
@@ -827,6 +1100,7 @@ static int loop_set_fd(struct loop_device *lo, fmode_t mode,
 	return 0;
 
 out_clr:
+	loop_disable_direct_io(lo);
 	lo->lo_thread = NULL;
 	lo->lo_device = NULL;
 	lo->lo_backing_file = NULL;
@@ -901,6 +1175,7 @@ static int loop_clr_fd(struct loop_device *lo, struct block_device *bdev)
 
 	kthread_stop(lo->lo_thread);
 
+	loop_disable_direct_io(lo);
 	lo->lo_backing_file = NULL;
 
 	loop_release_xfer(lo);
@@ -995,6 +1270,18 @@ loop_set_status(struct loop_device *lo, const struct loop_info64 *info)
 		lo->lo_key_owner = current->uid;
 	}	
 
+	/* A transfer function may have been set up, which rules it out */
+	if ((info->lo_flags & LO_FLAGS_DIRECT_IO) ||
+	    (lo->lo_flags & LO_FLAGS_DIRECT_IO)) {
+		err = loop_switch(lo, lo->lo_backing_file,
+				  info->lo_flags & LO_FLAGS_DIRECT_IO);
+		if (err)
+			return err;
+		if ((info->lo_flags & LO_FLAGS_DIRECT_IO) &&
+		    !(lo->lo_flags & LO_FLAGS_DIRECT_IO))
+			return -EINVAL;
+	}
+
 	return 0;
 }
 
@@ -1371,6 +1658,8 @@ module_param(max_loop, int, 0);
 MODULE_PARM_DESC(max_loop, "Maximum number of loop devices");
 module_param(max_part, int, 0);
 MODULE_PARM_DESC(max_part, "Maximum number of partitions per loop device");
+module_param(direct_io, bool, 0);
+MODULE_PARM_DESC(direct_io, "Bypass the page cache of backing files when possible");
 MODULE_LICENSE("GPL");
 MODULE_ALIAS_BLOCKDEV_MAJOR(LOOP_MAJOR);
 
@@ -1431,6 +1720,7 @@ static struct loop_device *loop_alloc(int i)
 	lo->lo_number		= i;
 	lo->lo_thread		= NULL;
 	init_waitqueue_head(&lo->lo_event);
+	atomic_set(&lo->lo_dio_pending, 0);
 	spin_lock_init(&lo->lo_lock);
 	disk->major		= LOOP_MAJOR;
 	disk->first_minor	= i << part_shift;
@@ -1529,8 +1819,21 @@ static int __init loop_init(void)
 		range = 1UL << (MINORBITS - part_shift);
 	}
 
-	if (register_blkdev(LOOP_MAJOR, "loop"))
+	loop_bio_set = bioset_create(LOOP_DIO_POOL_SIZE, 0);
+	if (!loop_bio_set)
+		return -ENOMEM;
+	loop_dio_pool = mempool_create_kmalloc_pool(LOOP_DIO_POOL_SIZE,
+						    sizeof(struct loop_dio));
+	if (!loop_dio_pool) {
+		bioset_free(loop_bio_set);
+		return -ENOMEM;
+	}
+
+	if (register_blkdev(LOOP_MAJOR, "loop")) {
+		mempool_destroy(loop_dio_pool);
+		bioset_free(loop_bio_set);
 		return -EIO;
+	}
 
 	for (i = 0; i < nr; i++) {
 		lo = loop_alloc(i);
@@ -1557,6 +1860,8 @@ Enomem:
 		loop_free(lo);
 
 	unregister_blkdev(LOOP_MAJOR, "loop");
+	mempool_destroy(loop_dio_pool);
+	bioset_free(loop_bio_set);
 	return -ENOMEM;
 }
 
@@ -1572,6 +1877,8 @@ static void __exit loop_exit(void)
 
 	blk_unregister_region(MKDEV(LOOP_MAJOR, 0), range);
 	unregister_blkdev(LOOP_MAJOR, "loop");
+	mempool_destroy(loop_dio_pool);
+	bioset_free(loop_bio_set);
 }
 
 module_init(loop_init);
@@ -0,0 +1,456 @@
+/*
+ * Null block device driver
+ *
+ * Completes every I/O without transferring any data, so that the cost
+ * of the block layer itself -- blk-core, the I/O schedulers, the
+ * multi-queue staging path and blk-softirq -- can be measured apart
+ * from any device.  See Documentation/block/null_blk.txt.
+ *
+ * This file is released under the GPL.
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/init.h>
+#include <linux/fs.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/genhd.h>
+#include <linux/hrtimer.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+
+enum {
+	NULL_Q_BIO		= 0,
+	NULL_Q_RQ		= 1,
+	NULL_Q_MQ		= 2,
+};
+
+enum {
+	NULL_IRQ_NONE		= 0,
+	NULL_IRQ_SOFTIRQ	= 1,
+	NULL_IRQ_TIMER		= 2,
+};
+
+struct nullb {
+	struct list_head list;
+	unsigned int index;
+	struct request_queue *q;
+	struct gendisk *disk;
+
+	/* request mode: queue lock, and requests started but not ended */
+	spinlock_t lock;
+	unsigned int queue_depth;
+};
+
+/*
+ * Requests and bios of one cpu waiting for the completion timer.  They
+ * are all ended when it expires, completion_nsec after the first one
+ * was queued, or by null_poll() once that time has passed.
+ */
+struct completion_queue {
+	spinlock_t lock;
+	struct list_head rq_list;
+	struct bio *bio_head;
+	struct bio *bio_tail;
+	struct hrtimer timer;
+	ktime_t due;
+};
+
+static DEFINE_PER_CPU(struct completion_queue, completion_queues);
+
+static LIST_HEAD(nullb_list);
+static int null_major;
+
+static int queue_mode = NULL_Q_MQ;
+module_param(queue_mode, int, S_IRUGO);
+MODULE_PARM_DESC(queue_mode, "Submission path: 0=bio, 1=request, 2=multi-queue");
+
+static int irqmode = NULL_IRQ_SOFTIRQ;
+module_param(irqmode, int, S_IRUGO);
+MODULE_PARM_DESC(irqmode, "Completion: 0=inline, 1=softirq, 2=timer");
+
+static unsigned long completion_nsec = 10000;
+module_param(completion_nsec, ulong, S_IRUGO);
+MODULE_PARM_DESC(completion_nsec, "Completion latency in timer mode, in ns");
+
+static int hw_queue_depth = 64;
+module_param(hw_queue_depth, int, S_IRUGO);
+MODULE_PARM_DESC(hw_queue_depth, "Requests in flight in request mode");
+
+static int bs = 512;
+module_param(bs, int, S_IRUGO);
+MODULE_PARM_DESC(bs, "Logical block size in bytes");
+
+static int gb = 250;
+module_param(gb, int, S_IRUGO);
+MODULE_PARM_DESC(gb, "Size of each device in GB");
+
+static int nr_devices = 2;
+module_param(nr_devices, int, S_IRUGO);
+MODULE_PARM_DESC(nr_devices, "Number of devices");
+
+static int rq_affinity;
+module_param(rq_affinity, bool, S_IRUGO);
+MODULE_PARM_DESC(rq_affinity, "Complete requests on the submitting cpu");
+
+static int complete_batch = 1;
+module_param(complete_batch, bool, S_IRUGO);
+MODULE_PARM_DESC(complete_batch, "Hand softirq completions over in batches");
+
+/*
+ * End a request outside of the request function.
+ */
+static void null_end_rq(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+	struct nullb *nullb = q->queuedata;
+	unsigned long flags;
+
+	if (queue_mode == NULL_Q_MQ) {
+		blk_mq_end_request(rq, 0);
+		return;
+	}
+
+	spin_lock_irqsave(&nullb->lock, flags);
+	__blk_end_request(rq, 0, blk_rq_bytes(rq));
+	nullb->queue_depth--;
+	if (blk_queue_stopped(q))
+		blk_start_queue(q);
+	spin_unlock_irqrestore(&nullb->lock, flags);
+}
+
+/*
+ * Take everything queued to @cq.  Called with cq->lock held.
+ */
+static struct bio *null_take_cq(struct completion_queue *cq,
+				struct list_head *list)
+{
+	struct bio *bio = cq->bio_head;
+
+	list_splice_init(&cq->rq_list, list);
+	cq->bio_head = cq->bio_tail = NULL;
+	return bio;
+}
+
+/*
+ * End the requests and bios taken from a completion queue, returns how
+ * many there were.
+ */
+static int null_end_cq(struct list_head *list, struct bio *bio)
+{
+	struct request *rq, *next;
+	int nr = 0;
+
+	list_for_each_entry_safe(rq, next, list, queuelist) {
+		list_del_init(&rq->queuelist);
+		null_end_rq(rq);
+		nr++;
+	}
+
+	while (bio) {
+		struct bio *next_bio = bio->bi_next;
+
+		bio->bi_next = NULL;
+		bio_endio(bio, 0);
+		bio = next_bio;
+		nr++;
+	}
+
+	return nr;
+}
+
+static enum hrtimer_restart null_timer_fn(struct hrtimer *timer)
+{
+	struct completion_queue *cq;
+	struct bio *bio;
+	unsigned long flags;
+	LIST_HEAD(list);
+
+	cq = container_of(timer, struct completion_queue, timer);
+
+	spin_lock_irqsave(&cq->lock, flags);
+	bio = null_take_cq(cq, &list);
+	spin_unlock_irqrestore(&cq->lock, flags);
+
+	null_end_cq(&list, bio);
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * Poll function of the timer mode: end whatever is due on any cpu
+ * without waiting for its timer to fire.  A timer whose handler is
+ * already running is left alone, the handler ends its entries.
+ */
+static int null_poll(struct request_queue *q)
+{
+	struct completion_queue *cq;
+	struct bio *bio;
+	ktime_t now = ktime_get();
+	int cpu, nr = 0;
+
+	for_each_online_cpu(cpu) {
+		LIST_HEAD(list);
+
+		cq = &per_cpu(completion_queues, cpu);
+		if (list_empty(&cq->rq_list) && !cq->bio_head)
+			continue;
+
+		spin_lock_irq(&cq->lock);
+		if ((list_empty(&cq->rq_list) && !cq->bio_head) ||
+		    ktime_to_ns(cq->due) > ktime_to_ns(now) ||
+		    hrtimer_try_to_cancel(&cq->timer) < 0) {
+			spin_unlock_irq(&cq->lock);
+			continue;
+		}
+		bio = null_take_cq(cq, &list);
+		spin_unlock_irq(&cq->lock);
+
+		nr += null_end_cq(&list, bio);
+	}
+
+	return nr;
+}
+
+/*
+ * Queue a request or a bio to this cpu's completion timer.
+ */
+static void null_end_timer(struct request *rq, struct bio *bio)
+{
+	struct completion_queue *cq;
+	unsigned long flags;
+
+	cq = &per_cpu(completion_queues, get_cpu());
+	spin_lock_irqsave(&cq->lock, flags);
+
+	if (list_empty(&cq->rq_list) && !cq->bio_head) {
+		cq->due = ktime_add_ns(ktime_get(), completion_nsec);
+		hrtimer_start(&cq->timer, cq->due, HRTIMER_MODE_ABS);
+	}
+
+	if (rq)
+		list_add_tail(&rq->queuelist, &cq->rq_list);
+	else {
+		if (cq->bio_tail)
+			cq->bio_tail->bi_next = bio;
+		else
+			cq->bio_head = bio;
+		cq->bio_tail = bio;
+	}
+
+	spin_unlock_irqrestore(&cq->lock, flags);
+	put_cpu();
+}
+
+static void null_softirq_done_fn(struct request *rq)
+{
+	null_end_rq(rq);
+}
+
+static int null_make_request(struct request_queue *q, struct bio *bio)
+{
+	/*
+	 * There is no request to steer to a cpu, so the softirq mode
+	 * completes bios inline.
+	 */
+	if (irqmode == NULL_IRQ_TIMER)
+		null_end_timer(NULL, bio);
+	else
+		bio_endio(bio, 0);
+
+	return 0;
+}
+
+static void null_request_fn(struct request_queue *q)
+{
+	struct nullb *nullb = q->queuedata;
+	struct request *rq;
+	LIST_HEAD(done);
+
+	while ((rq = elv_next_request(q)) != NULL) {
+		if (irqmode != NULL_IRQ_NONE) {
+			if (nullb->queue_depth >= hw_queue_depth) {
+				blk_stop_queue(q);
+				break;
+			}
+			nullb->queue_depth++;
+		}
+
+		blkdev_dequeue_request(rq);
+
+		switch (irqmode) {
+		case NULL_IRQ_NONE:
+			__blk_end_request(rq, 0, blk_rq_bytes(rq));
+			break;
+		case NULL_IRQ_SOFTIRQ:
+			if (complete_batch)
+				list_add_tail(&rq->queuelist, &done);
+			else
+				blk_complete_request(rq);
+			break;
+		case NULL_IRQ_TIMER:
+			null_end_timer(rq, NULL);
+			break;
+		}
+	}
+
+	if (!list_empty(&done))
+		blk_complete_request_list(&done);
+}
+
+static void null_queue_rqs(struct request_queue *q, struct list_head *list)
+{
+	struct request *rq, *next;
+
+	if (irqmode == NULL_IRQ_SOFTIRQ && complete_batch) {
+		blk_complete_request_list(list);
+		return;
+	}
+
+	list_for_each_entry_safe(rq, next, list, queuelist) {
+		list_del_init(&rq->queuelist);
+
+		switch (irqmode) {
+		case NULL_IRQ_NONE:
+			blk_mq_end_request(rq, 0);
+			break;
+		case NULL_IRQ_SOFTIRQ:
+			blk_complete_request(rq);
+			break;
+		case NULL_IRQ_TIMER:
+			null_end_timer(rq, NULL);
+			break;
+		}
+	}
+}
+
+static struct block_device_operations null_fops = {
+	.owner =	THIS_MODULE,
+};
+
+static int null_add_dev(int index)
+{
+	struct nullb *nullb;
+	struct gendisk *disk;
+
+	nullb = kzalloc(sizeof(*nullb), GFP_KERNEL);
+	if (!nullb)
+		goto out;
+	nullb->index = index;
+	spin_lock_init(&nullb->lock);
+
+	switch (queue_mode) {
+	case NULL_Q_BIO:
+		nullb->q = blk_alloc_queue(GFP_KERNEL);
+		if (nullb->q)
+			blk_queue_make_request(nullb->q, null_make_request);
+		break;
+	case NULL_Q_RQ:
+		nullb->q = blk_init_queue(null_request_fn, &nullb->lock);
+		break;
+	case NULL_Q_MQ:
+		nullb->q = blk_init_queue_mq(null_queue_rqs);
+		break;
+	}
+	if (!nullb->q)
+		goto out_free_dev;
+
+	nullb->q->queuedata = nullb;
+	blk_queue_softirq_done(nullb->q, null_softirq_done_fn);
+	if (irqmode == NULL_IRQ_TIMER)
+		blk_queue_poll_fn(nullb->q, null_poll);
+	blk_queue_hardsect_size(nullb->q, bs);
+	blk_queue_bounce_limit(nullb->q, BLK_BOUNCE_ANY);
+	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, nullb->q);
+	if (rq_affinity)
+		queue_flag_set_unlocked(QUEUE_FLAG_SAME_COMP, nullb->q);
+
+	disk = nullb->disk = alloc_disk(1);
+	if (!disk)
+		goto out_free_queue;
+	disk->major		= null_major;
+	disk->first_minor	= index;
+	disk->fops		= &null_fops;
+	disk->private_data	= nullb;
+	disk->queue		= nullb->q;
+	disk->flags |= GENHD_FL_SUPPRESS_PARTITION_INFO;
+	sprintf(disk->disk_name, "nullb%d", index);
+	set_capacity(disk, (sector_t)gb << (30 - 9));
+
+	list_add_tail(&nullb->list, &nullb_list);
+	add_disk(disk);
+	return 0;
+
+out_free_queue:
+	blk_cleanup_queue(nullb->q);
+out_free_dev:
+	kfree(nullb);
+out:
+	return -ENOMEM;
+}
+
+static void null_del_dev(struct nullb *nullb)
+{
+	list_del(&nullb->list);
+	del_gendisk(nullb->disk);
+	put_disk(nullb->disk);
+	blk_cleanup_queue(nullb->q);
+	kfree(nullb);
+}
+
+static int __init null_init(void)
+{
+	struct completion_queue *cq;
+	struct nullb *nullb, *next;
+	int i;
+
+	if (queue_mode < NULL_Q_BIO || queue_mode > NULL_Q_MQ ||
+	    irqmode < NULL_IRQ_NONE || irqmode > NULL_IRQ_TIMER ||
+	    hw_queue_depth < 1 || nr_devices < 1 || gb < 1 ||
+	    bs < 512 || bs > PAGE_SIZE || (bs & (bs - 1)))
+		return -EINVAL;
+
+	for_each_possible_cpu(i) {
+		cq = &per_cpu(completion_queues, i);
+		spin_lock_init(&cq->lock);
+		INIT_LIST_HEAD(&cq->rq_list);
+		hrtimer_init(&cq->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+		cq->timer.function = null_timer_fn;
+	}
+
+	null_major = register_blkdev(0, "nullb");
+	if (null_major < 0)
+		return null_major;
+
+	for (i = 0; i < nr_devices; i++) {
+		if (null_add_dev(i))
+			goto out_free;
+	}
+
+	return 0;
+
+out_free:
+	list_for_each_entry_safe(nullb, next, &nullb_list, list)
+		null_del_dev(nullb);
+	unregister_blkdev(null_major, "nullb");
+	return -ENOMEM;
+}
+
+static void __exit null_exit(void)
+{
+	struct nullb *nullb, *next;
+	int cpu;
+
+	list_for_each_entry_safe(nullb, next, &nullb_list, list)
+		null_del_dev(nullb);
+	unregister_blkdev(null_major, "nullb");
+
+	for_each_possible_cpu(cpu)
+		hrtimer_cancel(&per_cpu(completion_queues, cpu).timer);
+}
+
+module_init(null_init);
+module_exit(null_exit);
+
+MODULE_DESCRIPTION("Null block device for block layer measurements");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,261 @@
+/*
+ * This file is released under the GPL.
+ *
+ * Frequency cache policy: an origin block is only promoted once it
+ * has missed promote_threshold times, and the cached block with the
+ * fewest recent hits makes room for it.
+ *
+ * Cached blocks sit on one of FREQ_LEVELS lists by the log2 of their
+ * hit count, least recently used first within a list.  Every
+ * nr_cblocks hits the counts are halved so that blocks which were hot
+ * a long time ago drift back down.  Misses are counted in a table of
+ * recently missed origin blocks indexed by hash; colliding blocks
+ * simply replace each other.
+ */
+
+#include <linux/device-mapper.h>
+#include <linux/module.h>
+#include <linux/vmalloc.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
+
+#include "dm-cache-policy.h"
+
+#define DM_MSG_PREFIX "cache freq"
+
+#define FREQ_LEVELS		16
+#define FREQ_MIN_MISSES		256
+#define FREQ_DEFAULT_THRESHOLD	2
+
+struct freq_entry {
+	struct list_head list;
+	unsigned hits;
+};
+
+struct freq_miss {
+	sector_t oblock;
+	unsigned misses;
+};
+
+struct freq_policy {
+	struct list_head levels[FREQ_LEVELS];
+	struct freq_entry *entries;	/* one per cache block */
+	unsigned nr_cblocks;
+	unsigned hits;			/* since the counts were last halved */
+
+	struct freq_miss *misses;
+	unsigned miss_bits;
+
+	unsigned promote_threshold;
+};
+
+static unsigned freq_level(unsigned hits)
+{
+	return hits ? min_t(unsigned, ilog2(hits), FREQ_LEVELS - 1) : 0;
+}
+
+static int freq_create(struct dm_cache_policy *p, unsigned nr_cblocks,
+		       unsigned argc, char **argv, char **error)
+{
+	struct freq_policy *fp;
+	unsigned threshold = FREQ_DEFAULT_THRESHOLD;
+	unsigned long nr_misses;
+	unsigned i;
+
+	if (argc > 1) {
+		*error = "freq: too many arguments";
+		return -EINVAL;
+	}
+
+	if (argc && (sscanf(argv[0], "%u", &threshold) != 1 || !threshold)) {
+		*error = "freq: invalid promote threshold";
+		return -EINVAL;
+	}
+
+	fp = kzalloc(sizeof(*fp), GFP_KERNEL);
+	if (!fp) {
+		*error = "freq: cannot allocate policy";
+		return -ENOMEM;
+	}
+
+	fp->entries = vmalloc(nr_cblocks * sizeof(*fp->entries));
+	if (!fp->entries)
+		goto bad;
+
+	nr_misses = roundup_pow_of_two(max_t(unsigned, nr_cblocks,
+						   FREQ_MIN_MISSES));
+	fp->misses = vmalloc(nr_misses * sizeof(*fp->misses));
+	if (!fp->misses)
+		goto bad;
+	memset(fp->misses, 0, nr_misses * sizeof(*fp->misses));
+	fp->miss_bits = ilog2(nr_misses);
+
+	for (i = 0; i < FREQ_LEVELS; i++)
+		INIT_LIST_HEAD(fp->levels + i);
+	for (i = 0; i < nr_cblocks; i++) {
+		INIT_LIST_HEAD(&fp->entries[i].list);
+		fp->entries[i].hits = 0;
+	}
+	fp->nr_cblocks = nr_cblocks;
+	fp->promote_threshold = threshold;
+
+	p->context = fp;
+	return 0;
+
+bad:
+	vfree(fp->entries);
+	kfree(fp);
+	*error = "freq: cannot allocate block tables";
+	return -ENOMEM;
+}
+
+static void freq_destroy(struct dm_cache_policy *p)
+{
+	struct freq_policy *fp = p->context;
+
+	vfree(fp->misses);
+	vfree(fp->entries);
+	kfree(fp);
+	p->context = NULL;
+}
+
+static int freq_promote(struct dm_cache_policy *p, sector_t oblock)
+{
+	struct freq_policy *fp = p->context;
+	struct freq_miss *m;
+
+	m = fp->misses + hash_long((unsigned long)oblock, fp->miss_bits);
+	if (m->oblock != oblock || !m->misses) {
+		m->oblock = oblock;
+		m->misses = 0;
+	}
+
+	if (++m->misses < fp->promote_threshold)
+		return 0;
+
+	m->misses = 0;
+	return 1;
+}
+
+/*
+ * Halve every hit count, moving each level's blocks down one level
+ * (or keeping them on level 0) in their current order.
+ */
+static void freq_age(struct freq_policy *fp)
+{
+	unsigned i;
+
+	for (i = 0; i < fp->nr_cblocks; i++)
+		fp->entries[i].hits >>= 1;
+
+	for (i = 1; i < FREQ_LEVELS; i++)
+		list_splice_tail_init(fp->levels + i, fp->levels + i - 1);
+
+	fp->hits = 0;
+}
+
+static void freq_hit(struct dm_cache_policy *p, unsigned cblock)
+{
+	struct freq_policy *fp = p->context;
+	struct freq_entry *e = fp->entries + cblock;
+
+	if (list_empty(&e->list))
+		return;
+
+	e->hits++;
+	list_move_tail(&e->list, fp->levels + freq_level(e->hits));
+
+	if (++fp->hits >= fp->nr_cblocks)
+		freq_age(fp);
+}
+
+static void freq_insert(struct dm_cache_policy *p, unsigned cblock)
+{
+	struct freq_policy *fp = p->context;
+	struct freq_entry *e = fp->entries + cblock;
+
+	/* a promoted block has earned the hits it took to promote it */
+	e->hits = fp->promote_threshold;
+	list_move_tail(&e->list, fp->levels + freq_level(e->hits));
+}
+
+static void freq_remove(struct dm_cache_policy *p, unsigned cblock)
+{
+	struct freq_policy *fp = p->context;
+
+	list_del_init(&fp->entries[cblock].list);
+}
+
+static int freq_victim(struct dm_cache_policy *p, dm_cache_evictable_fn fn,
+		       void *context, unsigned *cblock)
+{
+	struct freq_policy *fp = p->context;
+	struct freq_entry *e;
+	unsigned i;
+
+	for (i = 0; i < FREQ_LEVELS; i++) {
+		list_for_each_entry(e, fp->levels + i, list) {
+			if (fn(context, e - fp->entries)) {
+				*cblock = e - fp->entries;
+				return 0;
+			}
+		}
+	}
+
+	return -ENOSPC;
+}
+
+static int freq_status(struct dm_cache_policy *p, status_type_t type,
+		       char *result, unsigned int maxlen)
+{
+	struct freq_policy *fp = p->context;
+	unsigned sz = 0;
+
+	switch (type) {
+	case STATUSTYPE_INFO:
+		break;
+	case STATUSTYPE_TABLE:
+		DMEMIT("%u ", fp->promote_threshold);
+		break;
+	}
+
+	return sz;
+}
+
+static struct dm_cache_policy_type freq_policy_type = {
+	.name = "freq",
+	.module = THIS_MODULE,
+	.table_args = 1,
+	.create = freq_create,
+	.destroy = freq_destroy,
+	.promote = freq_promote,
+	.hit = freq_hit,
+	.insert = freq_insert,
+	.remove = freq_remove,
+	.victim = freq_victim,
+	.status = freq_status,
+};
+
+static int __init dm_cache_freq_init(void)
+{
+	int r = dm_cache_register_policy(&freq_policy_type);
+
+	if (r < 0)
+		DMERR("register failed %d", r);
+
+	return r;
+}
+
+static void __exit dm_cache_freq_exit(void)
+{
+	int r = dm_cache_unregister_policy(&freq_policy_type);
+
+	if (r < 0)
+		DMERR("unregister failed %d", r);
+}
+
+module_init(dm_cache_freq_init);
+module_exit(dm_cache_freq_exit);
+
+MODULE_DESCRIPTION(DM_NAME " frequency based cache policy");
+MODULE_LICENSE("GPL");
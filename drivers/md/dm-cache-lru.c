@@ -0,0 +1,141 @@
+/*
+ * This file is released under the GPL.
+ *
+ * Least recently used cache policy: every miss is promoted and the
+ * block that has gone unused longest makes room for it.
+ */
+
+#include <linux/device-mapper.h>
+#include <linux/module.h>
+#include <linux/vmalloc.h>
+
+#include "dm-cache-policy.h"
+
+#define DM_MSG_PREFIX "cache lru"
+
+struct lru_policy {
+	struct list_head lru;		/* least recently used first */
+	struct list_head *entries;	/* one per cache block */
+};
+
+static int lru_create(struct dm_cache_policy *p, unsigned nr_cblocks,
+		      unsigned argc, char **argv, char **error)
+{
+	struct lru_policy *lp;
+	unsigned i;
+
+	if (argc) {
+		*error = "lru: takes no arguments";
+		return -EINVAL;
+	}
+
+	lp = kmalloc(sizeof(*lp), GFP_KERNEL);
+	if (!lp) {
+		*error = "lru: cannot allocate policy";
+		return -ENOMEM;
+	}
+
+	lp->entries = vmalloc(nr_cblocks * sizeof(*lp->entries));
+	if (!lp->entries) {
+		kfree(lp);
+		*error = "lru: cannot allocate block list";
+		return -ENOMEM;
+	}
+
+	INIT_LIST_HEAD(&lp->lru);
+	for (i = 0; i < nr_cblocks; i++)
+		INIT_LIST_HEAD(lp->entries + i);
+
+	p->context = lp;
+	return 0;
+}
+
+static void lru_destroy(struct dm_cache_policy *p)
+{
+	struct lru_policy *lp = p->context;
+
+	vfree(lp->entries);
+	kfree(lp);
+	p->context = NULL;
+}
+
+static int lru_promote(struct dm_cache_policy *p, sector_t oblock)
+{
+	return 1;
+}
+
+static void lru_hit(struct dm_cache_policy *p, unsigned cblock)
+{
+	struct lru_policy *lp = p->context;
+	struct list_head *e = lp->entries + cblock;
+
+	if (!list_empty(e))
+		list_move_tail(e, &lp->lru);
+}
+
+static void lru_insert(struct dm_cache_policy *p, unsigned cblock)
+{
+	struct lru_policy *lp = p->context;
+
+	list_move_tail(lp->entries + cblock, &lp->lru);
+}
+
+static void lru_remove(struct dm_cache_policy *p, unsigned cblock)
+{
+	struct lru_policy *lp = p->context;
+
+	list_del_init(lp->entries + cblock);
+}
+
+static int lru_victim(struct dm_cache_policy *p, dm_cache_evictable_fn fn,
+		      void *context, unsigned *cblock)
+{
+	struct lru_policy *lp = p->context;
+	struct list_head *e;
+
+	list_for_each(e, &lp->lru) {
+		if (fn(context, e - lp->entries)) {
+			*cblock = e - lp->entries;
+			return 0;
+		}
+	}
+
+	return -ENOSPC;
+}
+
+static struct dm_cache_policy_type lru_policy_type = {
+	.name = "lru",
+	.module = THIS_MODULE,
+	.table_args = 0,
+	.create = lru_create,
+	.destroy = lru_destroy,
+	.promote = lru_promote,
+	.hit = lru_hit,
+	.insert = lru_insert,
+	.remove = lru_remove,
+	.victim = lru_victim,
+};
+
+static int __init dm_cache_lru_init(void)
+{
+	int r = dm_cache_register_policy(&lru_policy_type);
+
+	if (r < 0)
+		DMERR("register failed %d", r);
+
+	return r;
+}
+
+static void __exit dm_cache_lru_exit(void)
+{
+	int r = dm_cache_unregister_policy(&lru_policy_type);
+
+	if (r < 0)
+		DMERR("unregister failed %d", r);
+}
+
+module_init(dm_cache_lru_init);
+module_exit(dm_cache_lru_exit);
+
+MODULE_DESCRIPTION(DM_NAME " least recently used cache policy");
+MODULE_LICENSE("GPL");
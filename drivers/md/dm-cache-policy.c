@@ -0,0 +1,150 @@
+/*
+ * This file is released under the GPL.
+ *
+ * Cache policy registration.
+ */
+
+#include <linux/device-mapper.h>
+#include <linux/module.h>
+
+#include "dm-cache-policy.h"
+
+#include <linux/slab.h>
+
+struct policy_internal {
+	struct dm_cache_policy_type type;
+
+	struct list_head list;
+	long use;
+};
+
+#define type_to_pi(__type) container_of((__type), struct policy_internal, type)
+
+static LIST_HEAD(_policies);
+static DECLARE_RWSEM(_policy_lock);
+
+static struct policy_internal *__find_policy_type(const char *name)
+{
+	struct policy_internal *pi;
+
+	list_for_each_entry(pi, &_policies, list) {
+		if (!strcmp(name, pi->type.name))
+			return pi;
+	}
+
+	return NULL;
+}
+
+static struct policy_internal *get_policy(const char *name)
+{
+	struct policy_internal *pi;
+
+	down_read(&_policy_lock);
+	pi = __find_policy_type(name);
+	if (pi) {
+		if ((pi->use == 0) && !try_module_get(pi->type.module))
+			pi = NULL;
+		else
+			pi->use++;
+	}
+	up_read(&_policy_lock);
+
+	return pi;
+}
+
+struct dm_cache_policy_type *dm_cache_get_policy(const char *name)
+{
+	struct policy_internal *pi;
+
+	if (!name)
+		return NULL;
+
+	pi = get_policy(name);
+	if (!pi) {
+		request_module("dm-cache-%s", name);
+		pi = get_policy(name);
+	}
+
+	return pi ? &pi->type : NULL;
+}
+
+void dm_cache_put_policy(struct dm_cache_policy_type *type)
+{
+	struct policy_internal *pi;
+
+	if (!type)
+		return;
+
+	down_read(&_policy_lock);
+	pi = __find_policy_type(type->name);
+	if (!pi)
+		goto out;
+
+	if (--pi->use == 0)
+		module_put(pi->type.module);
+
+	BUG_ON(pi->use < 0);
+
+out:
+	up_read(&_policy_lock);
+}
+
+static struct policy_internal *_alloc_policy(struct dm_cache_policy_type *type)
+{
+	struct policy_internal *pi = kzalloc(sizeof(*pi), GFP_KERNEL);
+
+	if (pi)
+		pi->type = *type;
+
+	return pi;
+}
+
+int dm_cache_register_policy(struct dm_cache_policy_type *type)
+{
+	int r = 0;
+	struct policy_internal *pi = _alloc_policy(type);
+
+	if (!pi)
+		return -ENOMEM;
+
+	down_write(&_policy_lock);
+
+	if (__find_policy_type(type->name)) {
+		kfree(pi);
+		r = -EEXIST;
+	} else
+		list_add(&pi->list, &_policies);
+
+	up_write(&_policy_lock);
+
+	return r;
+}
+
+int dm_cache_unregister_policy(struct dm_cache_policy_type *type)
+{
+	struct policy_internal *pi;
+
+	down_write(&_policy_lock);
+
+	pi = __find_policy_type(type->name);
+	if (!pi) {
+		up_write(&_policy_lock);
+		return -EINVAL;
+	}
+
+	if (pi->use) {
+		up_write(&_policy_lock);
+		return -ETXTBSY;
+	}
+
+	list_del(&pi->list);
+
+	up_write(&_policy_lock);
+
+	kfree(pi);
+
+	return 0;
+}
+
+EXPORT_SYMBOL_GPL(dm_cache_register_policy);
+EXPORT_SYMBOL_GPL(dm_cache_unregister_policy);
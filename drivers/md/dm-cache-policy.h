@@ -0,0 +1,87 @@
+/*
+ * This file is released under the GPL.
+ *
+ * Cache promotion policy registration.
+ */
+
+#ifndef	DM_CACHE_POLICY_H
+#define	DM_CACHE_POLICY_H
+
+#include <linux/device-mapper.h>
+
+/*
+ * A policy decides which origin blocks are worth a place on the cache
+ * device and which cached block gives up its place for them.  Cache
+ * blocks are named by their index, 0 to nr_cblocks - 1.
+ *
+ * All methods but create and destroy are called with the cache's
+ * spinlock held and interrupts disabled, so they must not sleep.
+ */
+struct dm_cache_policy_type;
+struct dm_cache_policy {
+	struct dm_cache_policy_type *type;
+	void *context;
+};
+
+/* Tells the policy whether it may take a cached block away */
+typedef int (*dm_cache_evictable_fn) (void *context, unsigned cblock);
+
+/* Information about a cache policy type */
+struct dm_cache_policy_type {
+	char *name;
+	struct module *module;
+
+	unsigned int table_args;
+
+	/*
+	 * Constructs a policy object for a cache of nr_cblocks blocks,
+	 * takes custom arguments.
+	 */
+	int (*create) (struct dm_cache_policy *p, unsigned nr_cblocks,
+		       unsigned argc, char **argv, char **error);
+	void (*destroy) (struct dm_cache_policy *p);
+
+	/*
+	 * An origin block that is not cached was accessed.  Return
+	 * non-zero if it should be promoted to the cache.
+	 */
+	int (*promote) (struct dm_cache_policy *p, sector_t oblock);
+
+	/*
+	 * A cache block was accessed.
+	 */
+	void (*hit) (struct dm_cache_policy *p, unsigned cblock);
+
+	/*
+	 * A cache block started or stopped holding an origin block.
+	 */
+	void (*insert) (struct dm_cache_policy *p, unsigned cblock);
+	void (*remove) (struct dm_cache_policy *p, unsigned cblock);
+
+	/*
+	 * Choose the cached block to give up its place, among those
+	 * evictable() allows.  Returns 0 and sets *cblock, or -ENOSPC.
+	 */
+	int (*victim) (struct dm_cache_policy *p, dm_cache_evictable_fn fn,
+		       void *context, unsigned *cblock);
+
+	/*
+	 * Table arguments or statistics of the policy.  Optional.
+	 */
+	int (*status) (struct dm_cache_policy *p, status_type_t type,
+		       char *result, unsigned int maxlen);
+};
+
+/* Register a cache policy */
+int dm_cache_register_policy(struct dm_cache_policy_type *type);
+
+/* Unregister a cache policy */
+int dm_cache_unregister_policy(struct dm_cache_policy_type *type);
+
+/* Returns a registered cache policy type */
+struct dm_cache_policy_type *dm_cache_get_policy(const char *name);
+
+/* Releases a cache policy type */
+void dm_cache_put_policy(struct dm_cache_policy_type *type);
+
+#endif
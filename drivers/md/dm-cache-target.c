@@ -0,0 +1,1362 @@
+/*
+ * This file is released under the GPL.
+ *
+ * A target that keeps copies of the hot blocks of a slow origin device
+ * on a fast cache device.
+ *
+ * Both devices are divided into blocks of a fixed size.  A pluggable
+ * policy (see dm-cache-policy.h) decides which origin blocks are
+ * promoted to the cache and which cached block makes room for them;
+ * promotions and the write back of dirty blocks are copies made by
+ * kcopyd.  In write-through mode writes go to both devices.  In
+ * write-back mode writes to cached blocks only go to the cache, and
+ * the dirty blocks are copied back to the origin in the background.
+ *
+ * The cache device starts with a superblock, followed by a table with
+ * one entry per cache block recording which origin block it holds and
+ * whether that is dirty.  A block becoming dirty or clean is written
+ * to the table before any data depends on it, the rest of the table
+ * only when the target is destroyed.  So after a clean shutdown the
+ * whole cache is reloaded, and after a crash only the dirty blocks.
+ */
+
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mempool.h>
+#include <linux/workqueue.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/dm-io.h>
+#include <linux/dm-kcopyd.h>
+
+#include <linux/device-mapper.h>
+
+#include "dm-cache-policy.h"
+
+#define DM_MSG_PREFIX "cache"
+
+#define CACHE_MAGIC		0x43414348
+#define CACHE_VERSION		1
+#define CACHE_CLEAN		1	/* superblock flag */
+
+/* metadata: superblock in the first 4k, then the block table */
+#define SUPER_SECTORS		8
+#define ENTRIES_PER_SECTOR	((1 << SECTOR_SHIFT) / sizeof(struct disk_mapping))
+
+#define MIN_BLOCK_SIZE		8
+
+/*
+ * The in-core tables take about 80 bytes per cache block, all of it
+ * vmalloc space, of which 32-bit machines have little more than 128MB.
+ * Bigger caches must use bigger blocks.
+ */
+#define MAX_CBLOCKS		(1 << 18)
+#define MIN_IOS			256
+#define MAX_MIGRATIONS		32
+#define CACHE_KCOPYD_PAGES	256
+#define CACHE_IO_PAGES		16
+#define TRACKED_HASH_SIZE	64
+
+/* dirty blocks are written back once this old, or when half are dirty */
+#define WRITEBACK_DELAY		(5 * HZ)
+
+struct disk_super {
+	__le32 magic;
+	__le32 version;
+	__le32 flags;
+	__le32 block_size;
+	__le32 nr_cblocks;
+} __attribute__ ((packed));
+
+/* table entry flags */
+#define M_VALID			1
+#define M_DIRTY			2
+
+struct disk_mapping {
+	__le64 oblock;
+	__le32 flags;
+	__le32 padding;
+} __attribute__ ((packed));
+
+/* cache block flags */
+#define CB_VALID		1
+#define CB_DIRTY		2
+#define CB_MIGRATING		4	/* being copied or its entry written */
+
+struct cache_block {
+	struct hlist_node hlist;	/* by origin block */
+	struct list_head list;		/* free or dirty list */
+	sector_t oblock;
+	unsigned flags;
+	unsigned io_count;		/* bios in flight to it */
+	unsigned long dirty_since;
+};
+
+struct cache_c {
+	struct dm_target *ti;
+	struct dm_dev *origin;
+	struct dm_dev *cache;
+
+	sector_t block_size;
+	unsigned block_shift;
+	sector_t nr_oblocks;
+	unsigned nr_cblocks;
+	sector_t table_sectors;
+	sector_t data_start;		/* first data sector on the cache */
+	int writeback;
+
+	/*
+	 * Protects everything below up to the statistics, and is held
+	 * for every call into the policy.
+	 */
+	spinlock_t lock;
+	struct cache_block *blocks;
+	struct hlist_head *buckets;
+	unsigned hash_bits;
+	struct list_head free;
+	unsigned nr_free;
+	struct list_head dirty;		/* oldest first */
+	unsigned nr_dirty;
+
+	struct list_head deferred;	/* bios for the worker */
+	struct list_head waiting;	/* bios waiting for a migration */
+	struct list_head completed;	/* migrations kcopyd finished */
+	unsigned nr_migrations;
+	int suspended;			/* start no more write backs */
+
+	/* origin writes in flight, so we don't promote under them */
+	struct hlist_head tracked[TRACKED_HASH_SIZE];
+
+	unsigned long read_hits;
+	unsigned long read_misses;
+	unsigned long write_hits;
+	unsigned long write_misses;
+	unsigned long promotions;
+	unsigned long demotions;
+	unsigned long writebacks;
+
+	struct dm_cache_policy policy;
+
+	/* superblock and table, only touched by the worker once running */
+	void *meta;
+	struct disk_mapping *table;
+
+	wait_queue_head_t migration_wait;
+	struct workqueue_struct *wq;
+	struct work_struct worker;
+	struct delayed_work waker;
+
+	mempool_t *io_pool;
+	mempool_t *migration_pool;
+	struct dm_io_client *io_client;
+	struct dm_kcopyd_client *kcopyd_client;
+};
+
+/*
+ * Every bio gets one of these in map(), freed in end_io().
+ */
+struct cache_io {
+	struct list_head list;		/* deferred or waiting */
+	struct hlist_node hlist;	/* tracked origin write */
+	struct bio *bio;
+	sector_t oblock;
+	struct cache_block *cb;		/* the cache block it went to */
+	int promote;
+	int accounted;
+};
+
+struct migration {
+	struct list_head list;
+	struct cache_c *cc;
+	struct cache_block *cb;
+	int writeback;
+	int err;
+};
+
+static struct kmem_cache *_io_cache;
+static struct kmem_cache *_migration_cache;
+
+/*-----------------------------------------------------------------
+ * Block lookup
+ *---------------------------------------------------------------*/
+static unsigned cblock_index(struct cache_c *cc, struct cache_block *cb)
+{
+	return cb - cc->blocks;
+}
+
+static sector_t cblock_sector(struct cache_c *cc, struct cache_block *cb)
+{
+	return cc->data_start +
+	       ((sector_t)cblock_index(cc, cb) << cc->block_shift);
+}
+
+static struct hlist_head *oblock_bucket(struct cache_c *cc, sector_t oblock)
+{
+	return cc->buckets + hash_long((unsigned long)oblock, cc->hash_bits);
+}
+
+static struct cache_block *lookup_block(struct cache_c *cc, sector_t oblock)
+{
+	struct cache_block *cb;
+	struct hlist_node *hn;
+
+	hlist_for_each_entry(cb, hn, oblock_bucket(cc, oblock), hlist)
+		if (cb->oblock == oblock)
+			return cb;
+
+	return NULL;
+}
+
+static void insert_block(struct cache_c *cc, struct cache_block *cb,
+			 sector_t oblock)
+{
+	cb->oblock = oblock;
+	hlist_add_head(&cb->hlist, oblock_bucket(cc, oblock));
+}
+
+static void free_block(struct cache_c *cc, struct cache_block *cb)
+{
+	hlist_del_init(&cb->hlist);
+	cb->flags = 0;
+	list_add(&cb->list, &cc->free);
+	cc->nr_free++;
+}
+
+static int block_evictable(void *context, unsigned cblock)
+{
+	struct cache_c *cc = context;
+	struct cache_block *cb = cc->blocks + cblock;
+
+	return !(cb->flags & (CB_DIRTY | CB_MIGRATING)) && !cb->io_count;
+}
+
+/*
+ * Find a block to promote into: a free one, or one the policy gives up.
+ */
+static struct cache_block *alloc_block(struct cache_c *cc)
+{
+	struct cache_block *cb;
+	unsigned cblock;
+
+	if (!list_empty(&cc->free)) {
+		cb = list_entry(cc->free.next, struct cache_block, list);
+		list_del_init(&cb->list);
+		cc->nr_free--;
+		return cb;
+	}
+
+	if (cc->policy.type->victim(&cc->policy, block_evictable, cc, &cblock))
+		return NULL;
+
+	cb = cc->blocks + cblock;
+	cc->policy.type->remove(&cc->policy, cblock);
+	hlist_del_init(&cb->hlist);
+	cb->flags = 0;
+	cc->table[cblock].flags = 0;
+	cc->demotions++;
+	return cb;
+}
+
+static struct hlist_head *tracked_bucket(struct cache_c *cc, sector_t oblock)
+{
+	return cc->tracked + hash_long((unsigned long)oblock,
+				       ilog2(TRACKED_HASH_SIZE));
+}
+
+static int origin_write_in_flight(struct cache_c *cc, sector_t oblock)
+{
+	struct cache_io *io;
+	struct hlist_node *hn;
+
+	hlist_for_each_entry(io, hn, tracked_bucket(cc, oblock), hlist)
+		if (io->oblock == oblock)
+			return 1;
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------
+ * Metadata
+ *---------------------------------------------------------------*/
+static int meta_io(struct cache_c *cc, sector_t sector, sector_t count,
+		   int rw)
+{
+	struct dm_io_region where = {
+		.bdev = cc->cache->bdev,
+		.sector = sector,
+		.count = count,
+	};
+	struct dm_io_request io_req = {
+		.bi_rw = rw,
+		.mem.type = DM_IO_VMA,
+		.mem.ptr.vma = cc->meta + (sector << SECTOR_SHIFT),
+		.client = cc->io_client,
+		.notify.fn = NULL,
+	};
+
+	return dm_io(&io_req, 1, &where, NULL);
+}
+
+static void set_mapping(struct cache_c *cc, struct cache_block *cb,
+			unsigned flags)
+{
+	struct disk_mapping *dm = cc->table + cblock_index(cc, cb);
+
+	dm->oblock = cpu_to_le64(cb->oblock);
+	dm->flags = cpu_to_le32(flags);
+}
+
+/*
+ * Write the table sector holding the entry of block cb.
+ */
+static int write_mapping(struct cache_c *cc, struct cache_block *cb)
+{
+	return meta_io(cc, SUPER_SECTORS +
+		       cblock_index(cc, cb) / ENTRIES_PER_SECTOR, 1, WRITE);
+}
+
+static int write_metadata(struct cache_c *cc, int clean)
+{
+	struct disk_super *ds = cc->meta;
+	int r;
+
+	r = meta_io(cc, SUPER_SECTORS, cc->table_sectors, WRITE);
+	if (r)
+		return r;
+
+	ds->magic = cpu_to_le32(CACHE_MAGIC);
+	ds->version = cpu_to_le32(CACHE_VERSION);
+	ds->flags = cpu_to_le32(clean ? CACHE_CLEAN : 0);
+	ds->block_size = cpu_to_le32(cc->block_size);
+	ds->nr_cblocks = cpu_to_le32(cc->nr_cblocks);
+
+	return meta_io(cc, 0, 1, WRITE);
+}
+
+/*
+ * Reload the blocks that are still valid: all of them after a clean
+ * shutdown, only the dirty ones otherwise.  Then mark the cache in use
+ * so that a crash is noticed next time.
+ */
+static int load_metadata(struct cache_c *cc, char **error)
+{
+	struct disk_super *ds = cc->meta;
+	struct disk_mapping *dm;
+	struct cache_block *cb;
+	unsigned i, flags;
+	sector_t oblock;
+	int clean, r;
+
+	r = meta_io(cc, 0, 1, READ);
+	if (r) {
+		*error = "Cannot read superblock";
+		return r;
+	}
+
+	if (le32_to_cpu(ds->magic) != CACHE_MAGIC) {
+		memset(cc->table, 0, cc->table_sectors << SECTOR_SHIFT);
+		goto out;
+	}
+
+	if (le32_to_cpu(ds->version) != CACHE_VERSION ||
+	    le32_to_cpu(ds->block_size) != cc->block_size ||
+	    le32_to_cpu(ds->nr_cblocks) != cc->nr_cblocks) {
+		*error = "Cache device has a different block size or size";
+		return -EINVAL;
+	}
+
+	r = meta_io(cc, SUPER_SECTORS, cc->table_sectors, READ);
+	if (r) {
+		*error = "Cannot read block table";
+		return r;
+	}
+
+	clean = le32_to_cpu(ds->flags) & CACHE_CLEAN;
+	if (!clean)
+		DMWARN("Cache was not shut down cleanly, keeping dirty blocks only");
+
+	for (i = 0; i < cc->nr_cblocks; i++) {
+		dm = cc->table + i;
+		flags = le32_to_cpu(dm->flags);
+		oblock = le64_to_cpu(dm->oblock);
+
+		if (!(flags & M_VALID) || (!clean && !(flags & M_DIRTY)))
+			goto drop;
+
+		if (oblock >= cc->nr_oblocks || lookup_block(cc, oblock)) {
+			if (flags & M_DIRTY)
+				DMERR("Dropping dirty block %llu beyond origin",
+				      (unsigned long long)oblock);
+			goto drop;
+		}
+
+		cb = cc->blocks + i;
+		list_del_init(&cb->list);
+		cc->nr_free--;
+		insert_block(cc, cb, oblock);
+		cb->flags = CB_VALID;
+		if (flags & M_DIRTY) {
+			cb->flags |= CB_DIRTY;
+			cb->dirty_since = jiffies;
+			list_add_tail(&cb->list, &cc->dirty);
+			cc->nr_dirty++;
+		}
+		cc->policy.type->insert(&cc->policy, i);
+		continue;
+drop:
+		dm->flags = 0;
+	}
+
+out:
+	r = write_metadata(cc, 0);
+	if (r)
+		*error = "Cannot write metadata";
+	return r;
+}
+
+/*-----------------------------------------------------------------
+ * Remapping
+ *---------------------------------------------------------------*/
+static void wake_worker(struct cache_c *cc)
+{
+	queue_work(cc->wq, &cc->worker);
+}
+
+static void account_io(struct cache_c *cc, struct cache_io *io,
+		       struct cache_block *cb)
+{
+	int rw = bio_data_dir(io->bio);
+
+	if (io->accounted)
+		return;
+	io->accounted = 1;
+
+	if (cb) {
+		if (rw == READ)
+			cc->read_hits++;
+		else
+			cc->write_hits++;
+		cc->policy.type->hit(&cc->policy, cblock_index(cc, cb));
+	} else if (rw == READ)
+		cc->read_misses++;
+	else
+		cc->write_misses++;
+}
+
+static void remap_to_cache(struct cache_c *cc, struct cache_io *io,
+			   struct cache_block *cb)
+{
+	struct bio *bio = io->bio;
+	sector_t offset = bio->bi_sector - cc->ti->begin;
+
+	io->cb = cb;
+	cb->io_count++;
+
+	bio->bi_bdev = cc->cache->bdev;
+	bio->bi_sector = cblock_sector(cc, cb) +
+			 (offset & (cc->block_size - 1));
+}
+
+static void remap_to_origin(struct cache_c *cc, struct cache_io *io)
+{
+	struct bio *bio = io->bio;
+
+	if (bio_data_dir(bio) == WRITE)
+		hlist_add_head(&io->hlist, tracked_bucket(cc, io->oblock));
+
+	bio->bi_bdev = cc->origin->bdev;
+	bio->bi_sector -= cc->ti->begin;
+}
+
+static int full_block_write(struct cache_c *cc, struct bio *bio)
+{
+	return bio_data_dir(bio) == WRITE &&
+	       bio_sectors(bio) == cc->block_size;
+}
+
+/*
+ * Remap what can be remapped without sleeping, defer the rest to the
+ * worker.  Called with cc->lock held.
+ */
+static int map_io(struct cache_c *cc, struct cache_io *io)
+{
+	struct bio *bio = io->bio;
+	struct cache_block *cb = lookup_block(cc, io->oblock);
+
+	if (cb) {
+		if (cb->flags & CB_MIGRATING)
+			goto defer;
+		if (bio_data_dir(bio) == WRITE && !(cb->flags & CB_DIRTY))
+			goto defer;
+
+		account_io(cc, io, cb);
+		remap_to_cache(cc, io, cb);
+		return DM_MAPIO_REMAPPED;
+	}
+
+	io->promote = cc->policy.type->promote(&cc->policy, io->oblock);
+	if (io->promote &&
+	    (bio_data_dir(bio) == READ ||
+	     (cc->writeback && full_block_write(cc, bio))))
+		goto defer;
+
+	account_io(cc, io, NULL);
+	remap_to_origin(cc, io);
+	return DM_MAPIO_REMAPPED;
+
+defer:
+	list_add_tail(&io->list, &cc->deferred);
+	return DM_MAPIO_SUBMITTED;
+}
+
+/*-----------------------------------------------------------------
+ * Migrations: promotion and write back
+ *---------------------------------------------------------------*/
+static void migration_done(int read_err, unsigned long write_err,
+			   void *context)
+{
+	struct migration *m = context;
+	struct cache_c *cc = m->cc;
+	unsigned long flags;
+
+	m->err = read_err || write_err;
+
+	spin_lock_irqsave(&cc->lock, flags);
+	list_add_tail(&m->list, &cc->completed);
+	spin_unlock_irqrestore(&cc->lock, flags);
+
+	wake_worker(cc);
+}
+
+/*
+ * Copy block cb from the origin to the cache, or back for write back.
+ * cb is marked migrating and counted in nr_migrations by the caller.
+ */
+static void start_migration(struct cache_c *cc, struct cache_block *cb,
+			    int writeback)
+{
+	struct migration *m = mempool_alloc(cc->migration_pool, GFP_NOIO);
+	struct dm_io_region origin, cache;
+	int r;
+
+	m->cc = cc;
+	m->cb = cb;
+	m->writeback = writeback;
+	m->err = 0;
+
+	origin.bdev = cc->origin->bdev;
+	origin.sector = cb->oblock << cc->block_shift;
+	origin.count = min(cc->block_size, cc->ti->len - origin.sector);
+
+	cache.bdev = cc->cache->bdev;
+	cache.sector = cblock_sector(cc, cb);
+	cache.count = origin.count;
+
+	if (writeback)
+		r = dm_kcopyd_copy(cc->kcopyd_client, &cache, 1, &origin, 0,
+				   migration_done, m);
+	else
+		r = dm_kcopyd_copy(cc->kcopyd_client, &origin, 1, &cache, 0,
+				   migration_done, m);
+	if (r < 0)
+		migration_done(1, 0, m);
+}
+
+static void complete_migration(struct cache_c *cc, struct migration *m)
+{
+	struct cache_block *cb = m->cb;
+	int writeback = m->writeback;
+	int err = m->err;
+
+	mempool_free(m, cc->migration_pool);
+
+	if (writeback && !err) {
+		set_mapping(cc, cb, M_VALID);
+		err = write_mapping(cc, cb);
+		if (err)
+			set_mapping(cc, cb, M_VALID | M_DIRTY);
+	}
+
+	spin_lock_irq(&cc->lock);
+	if (writeback) {
+		if (err) {
+			DMERR_LIMIT("Write back of block %llu failed",
+				    (unsigned long long)cb->oblock);
+			cb->dirty_since = jiffies;
+			list_add_tail(&cb->list, &cc->dirty);
+		} else {
+			cb->flags &= ~CB_DIRTY;
+			cc->nr_dirty--;
+			cc->writebacks++;
+		}
+	} else {
+		if (err) {
+			DMERR_LIMIT("Promotion of block %llu failed",
+				    (unsigned long long)cb->oblock);
+			free_block(cc, cb);
+		} else {
+			cb->flags |= CB_VALID;
+			set_mapping(cc, cb, M_VALID);
+			cc->policy.type->insert(&cc->policy, cblock_index(cc, cb));
+			cc->promotions++;
+		}
+	}
+	cb->flags &= ~CB_MIGRATING;
+	list_splice_tail_init(&cc->waiting, &cc->deferred);
+	if (!--cc->nr_migrations)
+		wake_up(&cc->migration_wait);
+	spin_unlock_irq(&cc->lock);
+}
+
+/*
+ * Copy back the dirty blocks that have been dirty for a while, or all
+ * we can while more than half of the cache is dirty.
+ */
+static void start_writebacks(struct cache_c *cc)
+{
+	struct cache_block *cb, *tmp;
+	LIST_HEAD(list);
+
+	spin_lock_irq(&cc->lock);
+	if (cc->suspended) {
+		spin_unlock_irq(&cc->lock);
+		return;
+	}
+
+	list_for_each_entry_safe(cb, tmp, &cc->dirty, list) {
+		if (cc->nr_migrations >= MAX_MIGRATIONS)
+			break;
+		if (cc->nr_dirty <= cc->nr_cblocks / 2 &&
+		    time_before(jiffies, cb->dirty_since + WRITEBACK_DELAY))
+			break;
+		if (cb->io_count)
+			continue;
+
+		cb->flags |= CB_MIGRATING;
+		cc->nr_migrations++;
+		list_move_tail(&cb->list, &list);
+	}
+	spin_unlock_irq(&cc->lock);
+
+	list_for_each_entry_safe(cb, tmp, &list, list) {
+		list_del_init(&cb->list);
+		start_migration(cc, cb, 1);
+	}
+}
+
+/*-----------------------------------------------------------------
+ * The worker
+ *---------------------------------------------------------------*/
+static void writethrough_endio(unsigned long error, void *context)
+{
+	struct bio *bio = context;
+
+	bio_endio(bio, error ? -EIO : 0);
+}
+
+/*
+ * Write a bio for a clean cached block to both devices.
+ */
+static void writethrough(struct cache_c *cc, struct cache_io *io)
+{
+	struct bio *bio = io->bio;
+	sector_t offset = bio->bi_sector - cc->ti->begin;
+	struct dm_io_region where[2];
+	struct dm_io_request io_req = {
+		.bi_rw = WRITE,
+		.mem.type = DM_IO_BVEC,
+		.mem.ptr.bvec = bio->bi_io_vec + bio->bi_idx,
+		.notify.fn = writethrough_endio,
+		.notify.context = bio,
+		.client = cc->io_client,
+	};
+
+	where[0].bdev = cc->origin->bdev;
+	where[0].sector = offset;
+	where[0].count = bio_sectors(bio);
+
+	where[1].bdev = cc->cache->bdev;
+	where[1].sector = cblock_sector(cc, io->cb) +
+			  (offset & (cc->block_size - 1));
+	where[1].count = bio_sectors(bio);
+
+	dm_io(&io_req, 2, where, NULL);
+}
+
+/*
+ * Write the data of a bio to the cache block it is promoted to, and
+ * wait for it.
+ */
+static int write_new_block(struct cache_c *cc, struct cache_io *io,
+			   struct cache_block *cb)
+{
+	struct bio *bio = io->bio;
+	sector_t offset = bio->bi_sector - cc->ti->begin;
+	struct dm_io_region where = {
+		.bdev = cc->cache->bdev,
+		.sector = cblock_sector(cc, cb) +
+			  (offset & (cc->block_size - 1)),
+		.count = bio_sectors(bio),
+	};
+	struct dm_io_request io_req = {
+		.bi_rw = WRITE,
+		.mem.type = DM_IO_BVEC,
+		.mem.ptr.bvec = bio->bi_io_vec + bio->bi_idx,
+		.client = cc->io_client,
+		.notify.fn = NULL,
+	};
+
+	return dm_io(&io_req, 1, &where, NULL);
+}
+
+/*
+ * The first write to a block in write-back mode: record the block as
+ * dirty on the cache device.  The caller has set CB_DIRTY and
+ * CB_MIGRATING, so other bios for it wait.
+ *
+ * A block that already caches @io's origin block holds valid data, so
+ * the mapping is written first and the bio is then sent to the cache.
+ * A @new block still holds whatever it cached before, and a crash
+ * between the two writes must not leave that marked dirty for the new
+ * origin block: the data is written first and the bio completed only
+ * once the mapping is on disk as well.
+ */
+static void write_dirty(struct cache_c *cc, struct cache_io *io,
+			struct cache_block *cb, int new)
+{
+	int r = 0;
+
+	if (new)
+		r = write_new_block(cc, io, cb);
+	if (!r) {
+		set_mapping(cc, cb, M_VALID | M_DIRTY);
+		r = write_mapping(cc, cb);
+	}
+
+	spin_lock_irq(&cc->lock);
+	cb->flags &= ~CB_MIGRATING;
+	list_splice_tail_init(&cc->waiting, &cc->deferred);
+	if (r) {
+		if (new) {
+			cc->table[cblock_index(cc, cb)].flags = 0;
+			free_block(cc, cb);
+		} else {
+			set_mapping(cc, cb, M_VALID);
+			cb->flags &= ~CB_DIRTY;
+		}
+	} else {
+		cb->dirty_since = jiffies;
+		list_add_tail(&cb->list, &cc->dirty);
+		cc->nr_dirty++;
+		if (new)
+			cc->policy.type->insert(&cc->policy,
+						cblock_index(cc, cb));
+		else
+			remap_to_cache(cc, io, cb);
+	}
+	spin_unlock_irq(&cc->lock);
+
+	if (r)
+		bio_endio(io->bio, -EIO);
+	else if (new)
+		bio_endio(io->bio, 0);
+	else
+		generic_make_request(io->bio);
+}
+
+/*
+ * Start a promotion for a deferred bio that missed.  Called with
+ * cc->lock held, which it drops; returns 0, with the lock still held,
+ * if the bio should just go to the origin.
+ */
+static int promote(struct cache_c *cc, struct cache_io *io)
+{
+	struct cache_block *cb;
+
+	io->promote = 0;
+	if (origin_write_in_flight(cc, io->oblock))
+		return 0;
+
+	cb = alloc_block(cc);
+	if (!cb)
+		return 0;
+
+	account_io(cc, io, NULL);
+	insert_block(cc, cb, io->oblock);
+
+	if (bio_data_dir(io->bio) == READ) {
+		cb->flags = CB_MIGRATING;
+		cc->nr_migrations++;
+		list_add_tail(&io->list, &cc->waiting);
+		spin_unlock_irq(&cc->lock);
+
+		start_migration(cc, cb, 0);
+		return 1;
+	}
+
+	/* the write covers the whole block, nothing to copy */
+	cb->flags = CB_VALID | CB_DIRTY | CB_MIGRATING;
+	cc->promotions++;
+	spin_unlock_irq(&cc->lock);
+
+	write_dirty(cc, io, cb, 1);
+	return 1;
+}
+
+static void process_io(struct cache_c *cc, struct cache_io *io)
+{
+	struct bio *bio = io->bio;
+	struct cache_block *cb;
+
+	spin_lock_irq(&cc->lock);
+	cb = lookup_block(cc, io->oblock);
+
+	if (cb && (cb->flags & CB_MIGRATING)) {
+		list_add_tail(&io->list, &cc->waiting);
+		spin_unlock_irq(&cc->lock);
+		return;
+	}
+
+	if (cb) {
+		account_io(cc, io, cb);
+		if (bio_data_dir(bio) == READ || (cb->flags & CB_DIRTY)) {
+			remap_to_cache(cc, io, cb);
+			spin_unlock_irq(&cc->lock);
+			generic_make_request(bio);
+		} else if (cc->writeback) {
+			cb->flags |= CB_DIRTY | CB_MIGRATING;
+			spin_unlock_irq(&cc->lock);
+			write_dirty(cc, io, cb, 0);
+		} else {
+			io->cb = cb;
+			cb->io_count++;
+			spin_unlock_irq(&cc->lock);
+			writethrough(cc, io);
+		}
+		return;
+	}
+
+	if (io->promote && promote(cc, io))
+		return;
+
+	account_io(cc, io, NULL);
+	remap_to_origin(cc, io);
+	spin_unlock_irq(&cc->lock);
+	generic_make_request(bio);
+}
+
+static void do_worker(struct work_struct *work)
+{
+	struct cache_c *cc = container_of(work, struct cache_c, worker);
+	struct migration *m;
+	struct cache_io *io;
+
+	spin_lock_irq(&cc->lock);
+	while (!list_empty(&cc->completed)) {
+		m = list_entry(cc->completed.next, struct migration, list);
+		list_del(&m->list);
+		spin_unlock_irq(&cc->lock);
+		complete_migration(cc, m);
+		spin_lock_irq(&cc->lock);
+	}
+
+	while (!list_empty(&cc->deferred)) {
+		io = list_entry(cc->deferred.next, struct cache_io, list);
+		list_del(&io->list);
+		spin_unlock_irq(&cc->lock);
+		process_io(cc, io);
+		spin_lock_irq(&cc->lock);
+	}
+	spin_unlock_irq(&cc->lock);
+
+	start_writebacks(cc);
+}
+
+static void do_waker(struct work_struct *work)
+{
+	struct cache_c *cc = container_of(work, struct cache_c, waker.work);
+
+	wake_worker(cc);
+	queue_delayed_work(cc->wq, &cc->waker, HZ);
+}
+
+static unsigned nr_migrations(struct cache_c *cc)
+{
+	unsigned nr;
+
+	spin_lock_irq(&cc->lock);
+	nr = cc->nr_migrations;
+	spin_unlock_irq(&cc->lock);
+
+	return nr;
+}
+
+/*
+ * Let the worker and kcopyd finish what they are doing.
+ */
+static void cache_quiesce(struct cache_c *cc)
+{
+	spin_lock_irq(&cc->lock);
+	cc->suspended = 1;
+	spin_unlock_irq(&cc->lock);
+
+	cancel_delayed_work_sync(&cc->waker);
+	flush_workqueue(cc->wq);
+	wait_event(cc->migration_wait, !nr_migrations(cc));
+	flush_workqueue(cc->wq);
+}
+
+/*-----------------------------------------------------------------
+ * Target methods
+ *---------------------------------------------------------------*/
+static int calc_geometry(struct cache_c *cc, sector_t cache_sectors)
+{
+	sector_t nr, table_sectors;
+
+	if (cache_sectors < SUPER_SECTORS + 2 * cc->block_size)
+		return -ENOSPC;
+
+	/* size the table for the most blocks there could be */
+	nr = (cache_sectors - SUPER_SECTORS) >> cc->block_shift;
+	table_sectors = dm_div_up(nr, ENTRIES_PER_SECTOR);
+	cc->data_start = dm_round_up(SUPER_SECTORS + table_sectors,
+				     cc->block_size);
+	if (cc->data_start >= cache_sectors)
+		return -ENOSPC;
+
+	nr = (cache_sectors - cc->data_start) >> cc->block_shift;
+	if (!nr)
+		return -ENOSPC;
+	if (nr > MAX_CBLOCKS)
+		return -E2BIG;
+
+	cc->nr_cblocks = nr;
+	cc->table_sectors = dm_div_up(nr, ENTRIES_PER_SECTOR);
+	return 0;
+}
+
+static int alloc_blocks(struct cache_c *cc)
+{
+	unsigned i, nr_buckets;
+
+	cc->blocks = vmalloc(cc->nr_cblocks * sizeof(*cc->blocks));
+	if (!cc->blocks)
+		return -ENOMEM;
+
+	nr_buckets = roundup_pow_of_two(max_t(unsigned, cc->nr_cblocks, 64));
+	cc->hash_bits = ilog2(nr_buckets);
+	cc->buckets = vmalloc(nr_buckets * sizeof(*cc->buckets));
+	if (!cc->buckets)
+		return -ENOMEM;
+	for (i = 0; i < nr_buckets; i++)
+		INIT_HLIST_HEAD(cc->buckets + i);
+
+	for (i = 0; i < cc->nr_cblocks; i++) {
+		struct cache_block *cb = cc->blocks + i;
+
+		INIT_HLIST_NODE(&cb->hlist);
+		cb->flags = 0;
+		cb->io_count = 0;
+		list_add_tail(&cb->list, &cc->free);
+	}
+	cc->nr_free = cc->nr_cblocks;
+
+	cc->meta = vmalloc((SUPER_SECTORS + cc->table_sectors) << SECTOR_SHIFT);
+	if (!cc->meta)
+		return -ENOMEM;
+	memset(cc->meta, 0, SUPER_SECTORS << SECTOR_SHIFT);
+	cc->table = cc->meta + (SUPER_SECTORS << SECTOR_SHIFT);
+
+	return 0;
+}
+
+static void free_blocks(struct cache_c *cc)
+{
+	vfree(cc->meta);
+	vfree(cc->buckets);
+	vfree(cc->blocks);
+}
+
+static int create_policy(struct cache_c *cc, unsigned argc, char **argv,
+			 unsigned *args_used)
+{
+	struct dm_target *ti = cc->ti;
+	struct dm_cache_policy_type *type;
+	unsigned nr_args;
+	int r;
+
+	if (argc < 2) {
+		ti->error = "Policy name and argument count required";
+		return -EINVAL;
+	}
+
+	if (sscanf(argv[1], "%u", &nr_args) != 1 || nr_args > argc - 2) {
+		ti->error = "Invalid number of policy arguments";
+		return -EINVAL;
+	}
+
+	type = dm_cache_get_policy(argv[0]);
+	if (!type) {
+		ti->error = "Unknown cache policy";
+		return -EINVAL;
+	}
+
+	cc->policy.type = type;
+	r = type->create(&cc->policy, cc->nr_cblocks, nr_args, argv + 2,
+			 &ti->error);
+	if (r) {
+		cc->policy.type = NULL;
+		dm_cache_put_policy(type);
+		return r;
+	}
+
+	*args_used = 2 + nr_args;
+	return 0;
+}
+
+static void destroy_policy(struct cache_c *cc)
+{
+	struct dm_cache_policy_type *type = cc->policy.type;
+
+	if (!type)
+		return;
+
+	type->destroy(&cc->policy);
+	dm_cache_put_policy(type);
+}
+
+/*
+ * Construct a cache mapping:
+ *   <origin dev> <cache dev> <block size> <writethrough|writeback>
+ *   <policy> <#policy args> [<policy args>]*
+ */
+static int cache_ctr(struct dm_target *ti, unsigned int argc, char **argv)
+{
+	struct cache_c *cc;
+	unsigned long long block_size;
+	sector_t cache_sectors;
+	unsigned args_used;
+	int i, r = -EINVAL;
+
+	if (argc < 6) {
+		ti->error = "Not enough arguments";
+		return -EINVAL;
+	}
+
+	cc = kzalloc(sizeof(*cc), GFP_KERNEL);
+	if (!cc) {
+		ti->error = "Cannot allocate cache context";
+		return -ENOMEM;
+	}
+	cc->ti = ti;
+	cc->suspended = 1;
+	spin_lock_init(&cc->lock);
+	INIT_LIST_HEAD(&cc->free);
+	INIT_LIST_HEAD(&cc->dirty);
+	INIT_LIST_HEAD(&cc->deferred);
+	INIT_LIST_HEAD(&cc->waiting);
+	INIT_LIST_HEAD(&cc->completed);
+	for (i = 0; i < TRACKED_HASH_SIZE; i++)
+		INIT_HLIST_HEAD(cc->tracked + i);
+	init_waitqueue_head(&cc->migration_wait);
+	INIT_WORK(&cc->worker, do_worker);
+	INIT_DELAYED_WORK(&cc->waker, do_waker);
+
+	if (sscanf(argv[2], "%llu", &block_size) != 1 ||
+	    block_size < MIN_BLOCK_SIZE || block_size > (1 << 20) ||
+	    !is_power_of_2(block_size)) {
+		ti->error = "Invalid block size";
+		goto bad;
+	}
+	cc->block_size = block_size;
+	cc->block_shift = ilog2(block_size);
+	cc->nr_oblocks = dm_div_up(ti->len, cc->block_size);
+
+	if (!strcmp(argv[3], "writeback"))
+		cc->writeback = 1;
+	else if (strcmp(argv[3], "writethrough")) {
+		ti->error = "Mode must be writethrough or writeback";
+		goto bad;
+	}
+
+	if (dm_get_device(ti, argv[0], 0, ti->len,
+			  dm_table_get_mode(ti->table), &cc->origin)) {
+		ti->error = "Cannot get origin device";
+		goto bad;
+	}
+
+	if (dm_get_device(ti, argv[1], 0, 0,
+			  dm_table_get_mode(ti->table), &cc->cache)) {
+		ti->error = "Cannot get cache device";
+		goto bad_cache_dev;
+	}
+
+	cache_sectors = i_size_read(cc->cache->bdev->bd_inode) >> SECTOR_SHIFT;
+	r = calc_geometry(cc, cache_sectors);
+	if (r) {
+		ti->error = r == -E2BIG ?
+			"Too many cache blocks, use a bigger block size" :
+			"Cache device too small";
+		goto bad_blocks;
+	}
+
+	r = alloc_blocks(cc);
+	if (r) {
+		ti->error = "Cannot allocate block tables";
+		goto bad_blocks;
+	}
+
+	r = create_policy(cc, argc - 4, argv + 4, &args_used);
+	if (r)
+		goto bad_blocks;
+	if (4 + args_used != argc) {
+		ti->error = "Too many arguments";
+		r = -EINVAL;
+		goto bad_io_client;
+	}
+
+	cc->io_client = dm_io_client_create(CACHE_IO_PAGES);
+	if (IS_ERR(cc->io_client)) {
+		ti->error = "Cannot create dm-io client";
+		r = PTR_ERR(cc->io_client);
+		goto bad_io_client;
+	}
+
+	r = dm_kcopyd_client_create(CACHE_KCOPYD_PAGES, &cc->kcopyd_client);
+	if (r) {
+		ti->error = "Cannot create kcopyd client";
+		goto bad_kcopyd;
+	}
+
+	r = -ENOMEM;
+	cc->io_pool = mempool_create_slab_pool(MIN_IOS, _io_cache);
+	if (!cc->io_pool) {
+		ti->error = "Cannot allocate io mempool";
+		goto bad_io_pool;
+	}
+
+	cc->migration_pool = mempool_create_slab_pool(MAX_MIGRATIONS,
+						      _migration_cache);
+	if (!cc->migration_pool) {
+		ti->error = "Cannot allocate migration mempool";
+		goto bad_migration_pool;
+	}
+
+	cc->wq = create_singlethread_workqueue("kcached");
+	if (!cc->wq) {
+		ti->error = "Cannot create workqueue";
+		goto bad_wq;
+	}
+
+	r = load_metadata(cc, &ti->error);
+	if (r)
+		goto bad_metadata;
+
+	ti->split_io = cc->block_size;
+	ti->private = cc;
+	return 0;
+
+bad_metadata:
+	destroy_workqueue(cc->wq);
+bad_wq:
+	mempool_destroy(cc->migration_pool);
+bad_migration_pool:
+	mempool_destroy(cc->io_pool);
+bad_io_pool:
+	dm_kcopyd_client_destroy(cc->kcopyd_client);
+bad_kcopyd:
+	dm_io_client_destroy(cc->io_client);
+bad_io_client:
+	destroy_policy(cc);
+bad_blocks:
+	free_blocks(cc);
+	dm_put_device(ti, cc->cache);
+bad_cache_dev:
+	dm_put_device(ti, cc->origin);
+bad:
+	kfree(cc);
+	return r;
+}
+
+static void cache_dtr(struct dm_target *ti)
+{
+	struct cache_c *cc = ti->private;
+
+	cache_quiesce(cc);
+	if (write_metadata(cc, 1))
+		DMERR("Cannot write metadata, cache will be cold next time");
+
+	destroy_workqueue(cc->wq);
+	mempool_destroy(cc->migration_pool);
+	mempool_destroy(cc->io_pool);
+	dm_kcopyd_client_destroy(cc->kcopyd_client);
+	dm_io_client_destroy(cc->io_client);
+	destroy_policy(cc);
+	free_blocks(cc);
+	dm_put_device(ti, cc->cache);
+	dm_put_device(ti, cc->origin);
+	kfree(cc);
+}
+
+static int cache_map(struct dm_target *ti, struct bio *bio,
+		     union map_info *map_context)
+{
+	struct cache_c *cc = ti->private;
+	struct cache_io *io;
+	int r;
+
+	io = mempool_alloc(cc->io_pool, GFP_NOIO);
+	io->bio = bio;
+	io->oblock = (bio->bi_sector - ti->begin) >> cc->block_shift;
+	io->cb = NULL;
+	io->promote = 0;
+	io->accounted = 0;
+	INIT_HLIST_NODE(&io->hlist);
+	map_context->ptr = io;
+
+	spin_lock_irq(&cc->lock);
+	r = map_io(cc, io);
+	spin_unlock_irq(&cc->lock);
+
+	if (r == DM_MAPIO_SUBMITTED)
+		wake_worker(cc);
+
+	return r;
+}
+
+static int cache_end_io(struct dm_target *ti, struct bio *bio,
+			int error, union map_info *map_context)
+{
+	struct cache_c *cc = ti->private;
+	struct cache_io *io = map_context->ptr;
+	unsigned long flags;
+
+	spin_lock_irqsave(&cc->lock, flags);
+	if (io->cb)
+		io->cb->io_count--;
+	if (!hlist_unhashed(&io->hlist))
+		hlist_del(&io->hlist);
+	spin_unlock_irqrestore(&cc->lock, flags);
+
+	mempool_free(io, cc->io_pool);
+	return error;
+}
+
+static void cache_postsuspend(struct dm_target *ti)
+{
+	cache_quiesce(ti->private);
+}
+
+static void cache_resume(struct dm_target *ti)
+{
+	struct cache_c *cc = ti->private;
+
+	spin_lock_irq(&cc->lock);
+	cc->suspended = 0;
+	spin_unlock_irq(&cc->lock);
+
+	queue_delayed_work(cc->wq, &cc->waker, HZ);
+}
+
+static int cache_status(struct dm_target *ti, status_type_t type,
+			char *result, unsigned int maxlen)
+{
+	struct cache_c *cc = ti->private;
+	struct dm_cache_policy_type *pt = cc->policy.type;
+	unsigned long long hits, misses;
+	unsigned ratio = 0;
+	unsigned int sz = 0;
+
+	switch (type) {
+	case STATUSTYPE_INFO:
+		spin_lock_irq(&cc->lock);
+		hits = cc->read_hits + cc->write_hits;
+		misses = cc->read_misses + cc->write_misses;
+		if (hits + misses)
+			ratio = div64_u64(hits * 1000, hits + misses);
+		DMEMIT("%u %u %u %lu %lu %lu %lu %lu %lu %lu %u.%u%%",
+		       cc->nr_cblocks, cc->nr_cblocks - cc->nr_free,
+		       cc->nr_dirty, cc->read_hits, cc->read_misses,
+		       cc->write_hits, cc->write_misses, cc->promotions,
+		       cc->demotions, cc->writebacks,
+		       ratio / 10, ratio % 10);
+		spin_unlock_irq(&cc->lock);
+		break;
+
+	case STATUSTYPE_TABLE:
+		DMEMIT("%s %s %llu %s %s %u ", cc->origin->name,
+		       cc->cache->name, (unsigned long long)cc->block_size,
+		       cc->writeback ? "writeback" : "writethrough",
+		       pt->name, pt->table_args);
+		if (pt->status)
+			sz += pt->status(&cc->policy, type, result + sz,
+					 maxlen - sz);
+		break;
+	}
+
+	return 0;
+}
+
+static struct target_type cache_target = {
+	.name        = "cache",
+	.version     = {1, 0, 0},
+	.module      = THIS_MODULE,
+	.ctr         = cache_ctr,
+	.dtr         = cache_dtr,
+	.map         = cache_map,
+	.end_io      = cache_end_io,
+	.postsuspend = cache_postsuspend,
+	.resume      = cache_resume,
+	.status      = cache_status,
+};
+
+static int __init dm_cache_init(void)
+{
+	int r;
+
+	_io_cache = KMEM_CACHE(cache_io, 0);
+	if (!_io_cache)
+		return -ENOMEM;
+
+	_migration_cache = KMEM_CACHE(migration, 0);
+	if (!_migration_cache) {
+		r = -ENOMEM;
+		goto bad_migration_cache;
+	}
+
+	r = dm_register_target(&cache_target);
+	if (r < 0) {
+		DMERR("register failed %d", r);
+		goto bad_register;
+	}
+
+	return 0;
+
+bad_register:
+	kmem_cache_destroy(_migration_cache);
+bad_migration_cache:
+	kmem_cache_destroy(_io_cache);
+	return r;
+}
+
+static void __exit dm_cache_exit(void)
+{
+	int r = dm_unregister_target(&cache_target);
+
+	if (r < 0)
+		DMERR("unregister failed %d", r);
+
+	kmem_cache_destroy(_migration_cache);
+	kmem_cache_destroy(_io_cache);
+}
+
+module_init(dm_cache_init);
+module_exit(dm_cache_exit);
+
+MODULE_DESCRIPTION(DM_NAME " cache target");
+MODULE_LICENSE("GPL");
@@ -18,6 +18,8 @@
 #include <linux/crypto.h>
 #include <linux/workqueue.h>
 #include <linux/backing-dev.h>
+#include <linux/percpu.h>
+#include <linux/cpumask.h>
 #include <asm/atomic.h>
 #include <linux/scatterlist.h>
 #include <asm/page.h>
@@ -57,6 +59,9 @@ struct dm_crypt_io {
 	int error;
 	sector_t sector;
 	struct dm_crypt_io *base_io;
+
+	/* cpu that submitted the bio, then the one converting it */
+	int cpu;
 };
 
 struct dm_crypt_request {
@@ -66,6 +71,16 @@ struct dm_crypt_request {
 
 struct crypt_config;
 
+/*
+ * per cpu state of the kcryptd workers
+ */
+struct crypt_cpu {
+	/* request cached between blocks by this cpu's worker */
+	struct ablkcipher_request *req;
+	/* ios queued to or being converted by this cpu's worker */
+	atomic_t queued;
+};
+
 struct crypt_iv_operations {
 	int (*ctr)(struct crypt_config *cc, struct dm_target *ti,
 		   const char *opts);
@@ -121,7 +136,7 @@ struct crypt_config {
 	 * correctly aligned.
 	 */
 	unsigned int dmreq_start;
-	struct ablkcipher_request *req;
+	struct crypt_cpu *cpu;
 
 	char cipher[CRYPTO_MAX_ALG_NAME];
 	char chainmode[CRYPTO_MAX_ALG_NAME];
@@ -135,6 +150,12 @@ struct crypt_config {
 #define MIN_POOL_PAGES 32
 #define MIN_BIO_PAGES  8
 
+/*
+ * A cpu's kcryptd worker is considered busy once this many ios are
+ * queued to it; new work then goes to the least loaded cpu instead.
+ */
+#define KCRYPTD_CPU_BACKLOG 2
+
 static struct kmem_cache *_crypt_io_pool;
 
 static void clone_init(struct dm_crypt_io *, struct bio *);
@@ -388,15 +409,28 @@ static int crypt_convert_block(struct crypt_config *cc,
 
 static void kcryptd_async_done(struct crypto_async_request *async_req,
 			       int error);
-static void crypt_alloc_req(struct crypt_config *cc,
-			    struct convert_context *ctx)
+
+/*
+ * Only called from the kcryptd workers, which are bound to their cpu,
+ * so each worker has the cached request of its cpu to itself.
+ */
+static struct crypt_cpu *this_crypt_cpu(struct crypt_config *cc)
 {
-	if (!cc->req)
-		cc->req = mempool_alloc(cc->req_pool, GFP_NOIO);
-	ablkcipher_request_set_tfm(cc->req, cc->tfm);
-	ablkcipher_request_set_callback(cc->req, CRYPTO_TFM_REQ_MAY_BACKLOG |
+	return per_cpu_ptr(cc->cpu, smp_processor_id());
+}
+
+static struct ablkcipher_request *crypt_alloc_req(struct crypt_config *cc,
+						  struct convert_context *ctx)
+{
+	struct crypt_cpu *cs = this_crypt_cpu(cc);
+
+	if (!cs->req)
+		cs->req = mempool_alloc(cc->req_pool, GFP_NOIO);
+	ablkcipher_request_set_tfm(cs->req, cc->tfm);
+	ablkcipher_request_set_callback(cs->req, CRYPTO_TFM_REQ_MAY_BACKLOG |
 					     CRYPTO_TFM_REQ_MAY_SLEEP,
 					     kcryptd_async_done, ctx);
+	return cs->req;
 }
 
 /*
@@ -405,6 +439,7 @@ static void crypt_alloc_req(struct crypt_config *cc,
 static int crypt_convert(struct crypt_config *cc,
 			 struct convert_context *ctx)
 {
+	struct ablkcipher_request *req;
 	int r;
 
 	atomic_set(&ctx->pending, 1);
@@ -412,11 +447,11 @@ static int crypt_convert(struct crypt_config *cc,
 	while(ctx->idx_in < ctx->bio_in->bi_vcnt &&
 	      ctx->idx_out < ctx->bio_out->bi_vcnt) {
 
-		crypt_alloc_req(cc, ctx);
+		req = crypt_alloc_req(cc, ctx);
 
 		atomic_inc(&ctx->pending);
 
-		r = crypt_convert_block(cc, ctx, cc->req);
+		r = crypt_convert_block(cc, ctx, req);
 
 		switch (r) {
 		/* async */
@@ -425,7 +460,7 @@ static int crypt_convert(struct crypt_config *cc,
 			INIT_COMPLETION(ctx->restart);
 			/* fall through*/
 		case -EINPROGRESS:
-			cc->req = NULL;
+			this_crypt_cpu(cc)->req = NULL;
 			ctx->sector++;
 			continue;
 
@@ -535,6 +570,7 @@ static struct dm_crypt_io *crypt_io_alloc(struct dm_target *ti,
 	io->sector = sector;
 	io->error = 0;
 	io->base_io = NULL;
+	io->cpu = raw_smp_processor_id();
 	atomic_set(&io->pending, 0);
 
 	return io;
@@ -574,7 +610,11 @@ static void crypt_dec_pending(struct dm_crypt_io *io)
  * Needed because it would be very unwise to do decryption in an
  * interrupt context.
  *
- * kcryptd performs the actual encryption or decryption.
+ * kcryptd performs the actual encryption or decryption.  It has a
+ * worker on every cpu; an io is converted on the cpu that submitted
+ * it, where its data is likely to be cache hot, unless that worker is
+ * already backlogged.  Each io is converted by a single worker, so the
+ * blocks of a bio are still processed and completed in order.
  *
  * kcryptd_io performs the IO submission.
  *
@@ -767,6 +807,7 @@ static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
 		if (unlikely(!crypt_finished && remaining)) {
 			new_io = crypt_io_alloc(io->target, io->base_bio,
 						sector);
+			new_io->cpu = io->cpu;
 			crypt_inc_pending(new_io);
 			crypt_convert_init(cc, &new_io->ctx, NULL,
 					   io->base_bio, sector);
@@ -844,19 +885,53 @@ static void kcryptd_async_done(struct crypto_async_request *async_req,
 static void kcryptd_crypt(struct work_struct *work)
 {
 	struct dm_crypt_io *io = container_of(work, struct dm_crypt_io, work);
+	struct crypt_config *cc = io->target->private;
+	struct crypt_cpu *cs = per_cpu_ptr(cc->cpu, io->cpu);
 
+	/* io may be freed once converted */
 	if (bio_data_dir(io->base_bio) == READ)
 		kcryptd_crypt_read_convert(io);
 	else
 		kcryptd_crypt_write_convert(io);
+
+	atomic_dec(&cs->queued);
+}
+
+/*
+ * Choose the cpu to convert an io submitted on CPU: that one, unless
+ * its worker is backlogged and another cpu's is less loaded.
+ */
+static int kcryptd_select_cpu(struct crypt_config *cc, int cpu)
+{
+	int best, i, queued;
+
+	if (!cpu_online(cpu))
+		cpu = any_online_cpu(cpu_online_map);
+
+	best = atomic_read(&per_cpu_ptr(cc->cpu, cpu)->queued);
+	if (best < KCRYPTD_CPU_BACKLOG)
+		return cpu;
+
+	for_each_online_cpu(i) {
+		queued = atomic_read(&per_cpu_ptr(cc->cpu, i)->queued);
+		if (queued < best) {
+			best = queued;
+			cpu = i;
+		}
+	}
+
+	return cpu;
 }
 
 static void kcryptd_queue_crypt(struct dm_crypt_io *io)
 {
 	struct crypt_config *cc = io->target->private;
 
+	io->cpu = kcryptd_select_cpu(cc, io->cpu);
+	atomic_inc(&per_cpu_ptr(cc->cpu, io->cpu)->queued);
+
 	INIT_WORK(&io->work, kcryptd_crypt);
-	queue_work(cc->crypt_queue, &io->work);
+	queue_work_on(io->cpu, cc->crypt_queue, &io->work);
 }
 
 /*
@@ -1052,7 +1127,12 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 		ti->error = "Cannot allocate crypt request mempool";
 		goto bad_req_pool;
 	}
-	cc->req = NULL;
+
+	cc->cpu = alloc_percpu(struct crypt_cpu);
+	if (!cc->cpu) {
+		ti->error = "Cannot allocate per cpu state";
+		goto bad_percpu;
+	}
 
 	cc->page_pool = mempool_create_page_pool(MIN_POOL_PAGES, 0);
 	if (!cc->page_pool) {
@@ -1107,7 +1187,7 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 		goto bad_io_queue;
 	}
 
-	cc->crypt_queue = create_singlethread_workqueue("kcryptd");
+	cc->crypt_queue = create_workqueue("kcryptd");
 	if (!cc->crypt_queue) {
 		ti->error = "Couldn't create kcryptd queue";
 		goto bad_crypt_queue;
@@ -1127,6 +1207,8 @@ bad_device:
 bad_bs:
 	mempool_destroy(cc->page_pool);
 bad_page_pool:
+	free_percpu(cc->cpu);
+bad_percpu:
 	mempool_destroy(cc->req_pool);
 bad_req_pool:
 	mempool_destroy(cc->io_pool);
@@ -1145,12 +1227,18 @@ bad_cipher:
 static void crypt_dtr(struct dm_target *ti)
 {
 	struct crypt_config *cc = (struct crypt_config *) ti->private;
+	struct crypt_cpu *cs;
+	int cpu;
 
 	destroy_workqueue(cc->io_queue);
 	destroy_workqueue(cc->crypt_queue);
 
-	if (cc->req)
-		mempool_free(cc->req, cc->req_pool);
+	for_each_possible_cpu(cpu) {
+		cs = per_cpu_ptr(cc->cpu, cpu);
+		if (cs->req)
+			mempool_free(cs->req, cc->req_pool);
+	}
+	free_percpu(cc->cpu);
 
 	bioset_free(cc->bs);
 	mempool_destroy(cc->page_pool);
@@ -44,6 +44,8 @@
  */
 
 #include <linux/kthread.h>
+#include <linux/percpu.h>
+#include <linux/cpumask.h>
 #include "raid6.h"
 
 #include <linux/raid/bitmap.h>
@@ -886,6 +888,7 @@ static int grow_one_stripe(raid5_conf_t *conf)
 	atomic_set(&sh->count, 1);
 	atomic_inc(&conf->active_stripes);
 	INIT_LIST_HEAD(&sh->lru);
+	INIT_LIST_HEAD(&sh->worker_list);
 	release_stripe(sh);
 	return 1;
 }
@@ -967,6 +970,7 @@ static int resize_stripes(raid5_conf_t *conf, int newsize)
 
 		nsh->raid_conf = conf;
 		spin_lock_init(&nsh->lock);
+		INIT_LIST_HEAD(&nsh->worker_list);
 
 		list_add(&nsh->lru, &newstripes);
 	}
@@ -3823,12 +3827,119 @@ static int  retry_aligned_read(raid5_conf_t *conf, struct bio *raid_bio)
 
 
 
+/*
+ * Stripe handling workers.  Stripes are grouped by chunk, and a group
+ * is always handled on the same cpu, so that the stripes a sequential
+ * writer fills in one chunk share a cpu's cache while the parity of
+ * different chunks is computed on different cpus.  A stripe is only
+ * ever handled by one worker at a time: it holds a reference while it
+ * is queued or handled, and the stripe state is under sh->lock.  The
+ * worker queue has its own list_head, as get_active_stripe() expects
+ * sh->lru of a stripe in use to be empty.
+ */
+static void raid5_do_work(struct work_struct *work)
+{
+	struct raid5_worker *worker = container_of(work, struct raid5_worker,
+						   work);
+	raid5_conf_t *conf = worker->conf;
+	struct stripe_head *sh;
+
+	spin_lock_irq(&conf->device_lock);
+	while (!list_empty(&worker->list)) {
+		sh = list_entry(worker->list.next, struct stripe_head,
+				worker_list);
+		list_del_init(&sh->worker_list);
+		spin_unlock_irq(&conf->device_lock);
+
+		handle_stripe(sh, worker->spare_page);
+		release_stripe(sh);
+
+		spin_lock_irq(&conf->device_lock);
+	}
+	spin_unlock_irq(&conf->device_lock);
+
+	async_tx_issue_pending_all();
+	unplug_slaves(conf->mddev);
+}
+
+/*
+ * Hand a stripe to the worker of its group's cpu.  Returns 0 if raid5d
+ * should handle it itself.  device_lock is held.
+ */
+static int raid5_queue_stripe(raid5_conf_t *conf, struct stripe_head *sh)
+{
+	struct raid5_worker *worker;
+	sector_t group = sh->sector;
+	int nr, cpu;
+
+	nr = min_t(int, conf->nr_workers, num_online_cpus());
+	if (nr <= 1)
+		return 0;
+
+	sector_div(group, conf->chunk_size >> 9);
+	nr = sector_div(group, nr);
+	for_each_online_cpu(cpu)
+		if (!nr--)
+			break;
+	if (cpu >= nr_cpu_ids)
+		return 0;
+
+	worker = per_cpu_ptr(conf->workers, cpu);
+	list_add_tail(&sh->worker_list, &worker->list);
+	queue_work_on(cpu, conf->workqueue, &worker->work);
+	return 1;
+}
+
+static int raid5_alloc_workers(raid5_conf_t *conf)
+{
+	struct raid5_worker *worker;
+	int cpu;
+
+	conf->workers = alloc_percpu(struct raid5_worker);
+	if (!conf->workers)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		worker = per_cpu_ptr(conf->workers, cpu);
+		INIT_WORK(&worker->work, raid5_do_work);
+		INIT_LIST_HEAD(&worker->list);
+		worker->conf = conf;
+		if (conf->level == 6) {
+			worker->spare_page = alloc_page(GFP_KERNEL);
+			if (!worker->spare_page)
+				return -ENOMEM;
+		}
+	}
+
+	conf->workqueue = create_workqueue("md_raid5");
+	if (!conf->workqueue)
+		return -ENOMEM;
+
+	if (num_online_cpus() > 1)
+		conf->nr_workers = num_online_cpus();
+	return 0;
+}
+
+static void raid5_free_workers(raid5_conf_t *conf)
+{
+	int cpu;
+
+	if (conf->workqueue)
+		destroy_workqueue(conf->workqueue);
+	if (!conf->workers)
+		return;
+	for_each_possible_cpu(cpu)
+		safe_put_page(per_cpu_ptr(conf->workers, cpu)->spare_page);
+	free_percpu(conf->workers);
+}
+
 /*
  * This is our raid5 kernel thread.
  *
  * We scan the hash table for stripes which can be handled now.
  * During the scan, completed stripes are saved for us by the interrupt
  * handler, so that they will not have to wait for our next wakeup.
+ * When stripe workers are enabled we only pass the stripes on to them.
  */
 static void raid5d(mddev_t *mddev)
 {
@@ -3868,6 +3979,10 @@ static void raid5d(mddev_t *mddev)
 
 		if (!sh)
 			break;
+		if (raid5_queue_stripe(conf, sh)) {
+			handled++;
+			continue;
+		}
 		spin_unlock_irq(&conf->device_lock);
 		
 		handled++;
@@ -3981,10 +4096,46 @@ stripe_cache_active_show(mddev_t *mddev, char *page)
 static struct md_sysfs_entry
 raid5_stripecache_active = __ATTR_RO(stripe_cache_active);
 
+static ssize_t
+raid5_show_stripe_workers(mddev_t *mddev, char *page)
+{
+	raid5_conf_t *conf = mddev_to_conf(mddev);
+	if (conf)
+		return sprintf(page, "%d\n", conf->nr_workers);
+	else
+		return 0;
+}
+
+static ssize_t
+raid5_store_stripe_workers(mddev_t *mddev, const char *page, size_t len)
+{
+	raid5_conf_t *conf = mddev_to_conf(mddev);
+	unsigned long new;
+	if (len >= PAGE_SIZE)
+		return -EINVAL;
+	if (!conf)
+		return -ENODEV;
+
+	if (strict_strtoul(page, 10, &new))
+		return -EINVAL;
+	if (new > num_possible_cpus())
+		return -EINVAL;
+	spin_lock_irq(&conf->device_lock);
+	conf->nr_workers = new;
+	spin_unlock_irq(&conf->device_lock);
+	return len;
+}
+
+static struct md_sysfs_entry
+raid5_stripe_workers = __ATTR(stripe_workers, S_IRUGO | S_IWUSR,
+			      raid5_show_stripe_workers,
+			      raid5_store_stripe_workers);
+
 static struct attribute *raid5_attrs[] =  {
 	&raid5_stripecache_size.attr,
 	&raid5_stripecache_active.attr,
 	&raid5_preread_bypass_threshold.attr,
+	&raid5_stripe_workers.attr,
 	NULL,
 };
 static struct attribute_group raid5_attrs_group = {
@@ -4185,6 +4336,13 @@ static int run(mddev_t *mddev)
 		}
 	}
 
+	if (raid5_alloc_workers(conf)) {
+		printk(KERN_ERR
+			"raid5: couldn't allocate stripe workers for %s\n",
+			mdname(mddev));
+		goto abort;
+	}
+
 	{
 		mddev->thread = md_register_thread(raid5d, mddev, "%s_raid5");
 		if (!mddev->thread) {
@@ -4261,6 +4419,7 @@ static int run(mddev_t *mddev)
 abort:
 	if (conf) {
 		print_raid5_conf(conf);
+		raid5_free_workers(conf);
 		safe_put_page(conf->spare_page);
 		kfree(conf->disks);
 		kfree(conf->stripe_hashtbl);
@@ -4279,6 +4438,7 @@ static int stop(mddev_t *mddev)
 
 	md_unregister_thread(mddev->thread);
 	mddev->thread = NULL;
+	raid5_free_workers(conf);
 	shrink_stripes(conf);
 	kfree(conf->stripe_hashtbl);
 	mddev->queue->backing_dev_info.congested_fn = NULL;
@@ -31,6 +31,11 @@
 #include <linux/workqueue.h>
 #include <linux/security.h>
 #include <linux/eventfd.h>
+#include <linux/kthread.h>
+#include <linux/pagemap.h>
+#include <linux/writeback.h>
+#include <linux/backing-dev.h>
+#include <linux/iocontext.h>
 
 #include <asm/kmap_types.h>
 #include <asm/uaccess.h>
@@ -63,17 +68,42 @@ static LIST_HEAD(fput_head);
 static void aio_kick_handler(struct work_struct *);
 static void aio_queue_work(struct kioctx *);
 
+/*
+ * Buffered reads and writes are done synchronously by the filesystems,
+ * so those that would block are handed to a pool of worker threads and
+ * io_submit() only runs them itself when they can be served from the
+ * page cache.
+ */
+#define AIO_WORKERS_PER_CPU	4
+#define AIO_PROBE_PAGES		16	/* page cache lookup batch */
+
+static int aio_nr_workers;
+static DEFINE_SPINLOCK(aio_worker_lock);
+static LIST_HEAD(aio_worker_list);	/* of kiocbs, by ki_run_list */
+static DECLARE_WAIT_QUEUE_HEAD(aio_worker_wait);
+
+static int aio_worker(void *);
+
 /* aio_setup
  *	Creates the slab caches used by the aio routines, panic on
  *	failure as this is done early during the boot sequence.
  */
 static int __init aio_setup(void)
 {
+	int i;
+
 	kiocb_cachep = KMEM_CACHE(kiocb, SLAB_HWCACHE_ALIGN|SLAB_PANIC);
 	kioctx_cachep = KMEM_CACHE(kioctx,SLAB_HWCACHE_ALIGN|SLAB_PANIC);
 
 	aio_wq = create_workqueue("aio");
 
+	/* Without workers everything simply runs from io_submit() */
+	for (i = 0; i < AIO_WORKERS_PER_CPU * num_online_cpus(); i++) {
+		if (IS_ERR(kthread_run(aio_worker, NULL, "aio_worker/%d", i)))
+			break;
+		aio_nr_workers++;
+	}
+
 	pr_debug("aio_setup: sizeof(struct page) = %d\n", (int)sizeof(struct page));
 
 	return 0;
@@ -398,6 +428,48 @@ void exit_aio(struct mm_struct *mm)
 	}
 }
 
+/*
+ * aio_latency_report:
+ *	Format the completion latency statistics of the contexts of the mm
+ *	for /proc/<pid>/aio: one line per context with its id and size,
+ *	then the number, average and maximum latency (in microseconds) of
+ *	the requests run from io_submit() and of those run by the worker
+ *	pool.
+ */
+int aio_latency_report(struct mm_struct *mm, char *buf, int size)
+{
+	struct kioctx *ctx;
+	int len = 0;
+
+	read_lock(&mm->ioctx_list_lock);
+	for (ctx = mm->ioctx_list; ctx; ctx = ctx->next) {
+		struct aio_latency_stats lat[2];
+		int i;
+
+		spin_lock_irq(&ctx->ctx_lock);
+		memcpy(lat, ctx->latency, sizeof(lat));
+		spin_unlock_irq(&ctx->ctx_lock);
+
+		len += scnprintf(buf + len, size - len, "%lx %u",
+				 ctx->user_id, ctx->max_reqs);
+		for (i = 0; i < 2; i++) {
+			u64 avg = lat[i].nr ?
+				div64_u64(lat[i].total_ns, lat[i].nr) : 0;
+
+			len += scnprintf(buf + len, size - len,
+				" %s %lu %llu %llu",
+				i == AIO_LAT_WORKER ? "worker" : "inline",
+				lat[i].nr,
+				(unsigned long long)div_u64(avg, NSEC_PER_USEC),
+				(unsigned long long)div_u64(lat[i].max_ns,
+							    NSEC_PER_USEC));
+		}
+		len += scnprintf(buf + len, size - len, "\n");
+	}
+	read_unlock(&mm->ioctx_list_lock);
+	return len;
+}
+
 /* aio_get_req
  *	Allocate a slot for an aio request.  Increments the users count
  * of the kioctx so that the kioctx stays around until all requests are
@@ -908,6 +980,26 @@ void kick_iocb(struct kiocb *iocb)
 }
 EXPORT_SYMBOL(kick_iocb);
 
+/*
+ * aio_account_latency:
+ *	Add the time from submission to completion of the iocb to the
+ *	statistics of its context.  Called with ctx_lock held.
+ */
+static void aio_account_latency(struct kioctx *ctx, struct kiocb *iocb)
+{
+	struct aio_latency_stats *stats;
+	u64 ns = ktime_to_ns(ktime_sub(ktime_get(), iocb->ki_submit_time));
+
+	if (kiocbIsOffloaded(iocb))
+		stats = &ctx->latency[AIO_LAT_WORKER];
+	else
+		stats = &ctx->latency[AIO_LAT_INLINE];
+	stats->nr++;
+	stats->total_ns += ns;
+	if (ns > stats->max_ns)
+		stats->max_ns = ns;
+}
+
 /* aio_complete
  *	Called when the io request on the given iocb is complete.
  *	Returns true if this is the last user of the request.  The 
@@ -958,6 +1050,8 @@ int aio_complete(struct kiocb *iocb, long res, long res2)
 	if (kiocbIsCancelled(iocb))
 		goto put_rq;
 
+	aio_account_latency(ctx, iocb);
+
 	ring = kmap_atomic(info->ring_pages[0], KM_IRQ1);
 
 	tail = info->tail;
@@ -1553,6 +1647,229 @@ static int aio_wake_function(wait_queue_t *wait, unsigned mode,
 	return 1;
 }
 
+/*
+ * aio_range_cached:
+ *	Returns 1 if every page of the file range is uptodate in the page
+ *	cache, so that a buffered read of it does not wait for i/o.
+ */
+static int aio_range_cached(struct address_space *mapping, loff_t pos,
+			    size_t count)
+{
+	struct page *pages[AIO_PROBE_PAGES];
+	loff_t isize = i_size_read(mapping->host);
+	pgoff_t index, end;
+
+	if (!count || pos >= isize)
+		return 1;
+
+	index = pos >> PAGE_CACHE_SHIFT;
+	end = (min_t(loff_t, pos + count, isize) - 1) >> PAGE_CACHE_SHIFT;
+	while (index <= end) {
+		unsigned nr = min_t(pgoff_t, end - index + 1, AIO_PROBE_PAGES);
+		unsigned found, i;
+		int uptodate = 1;
+
+		found = find_get_pages_contig(mapping, index, nr, pages);
+		for (i = 0; i < found; i++) {
+			if (!PageUptodate(pages[i]))
+				uptodate = 0;
+			page_cache_release(pages[i]);
+		}
+		if (found < nr || !uptodate)
+			return 0;
+		index += nr;
+	}
+	return 1;
+}
+
+/*
+ * aio_write_would_block:
+ *	Guess whether a buffered write is going to block: the backing
+ *	device is congested, the amount of dirty memory is close to the
+ *	limit at which writers get throttled, or a partially written page
+ *	at either end has to be read in first.
+ */
+static int aio_write_would_block(struct address_space *mapping, loff_t pos,
+				 size_t count)
+{
+	struct backing_dev_info *bdi = mapping->backing_dev_info;
+	long background, dirty, bdi_dirty;
+	unsigned long nr_dirty;
+
+	if (bdi_write_congested(bdi))
+		return 1;
+
+	get_dirty_limits(&background, &dirty, &bdi_dirty, bdi);
+	nr_dirty = global_page_state(NR_FILE_DIRTY) +
+		   global_page_state(NR_UNSTABLE_NFS) +
+		   global_page_state(NR_WRITEBACK);
+	if (nr_dirty > (background + dirty) / 2)
+		return 1;
+
+	if ((pos & ~PAGE_CACHE_MASK) && !aio_range_cached(mapping, pos, 1))
+		return 1;
+	if (((pos + count) & ~PAGE_CACHE_MASK) &&
+	    !aio_range_cached(mapping, pos + count - 1, 1))
+		return 1;
+	return 0;
+}
+
+/*
+ * aio_should_offload:
+ *	Decide whether a buffered read or write of a regular file on a
+ *	block device backed filesystem is handed to the worker pool.
+ *	Writes that have to remove suid bits or are subject to the
+ *	submitter's file size limit are always run by the submitter
+ *	itself.
+ */
+static int aio_should_offload(struct kiocb *iocb)
+{
+	struct file *file = iocb->ki_filp;
+	struct address_space *mapping = file->f_mapping;
+	struct inode *inode = mapping->host;
+
+	if (!aio_nr_workers || iocb->ki_retry != aio_rw_vect_retry)
+		return 0;
+	if (!S_ISREG(inode->i_mode) || !inode->i_sb->s_bdev ||
+	    (file->f_flags & O_DIRECT))
+		return 0;
+
+	switch (iocb->ki_opcode) {
+	case IOCB_CMD_PREAD:
+	case IOCB_CMD_PREADV:
+		return !aio_range_cached(mapping, iocb->ki_pos, iocb->ki_left);
+	case IOCB_CMD_PWRITE:
+	case IOCB_CMD_PWRITEV:
+		if (should_remove_suid(file->f_path.dentry) ||
+		    current->signal->rlim[RLIMIT_FSIZE].rlim_cur !=
+		    RLIM_INFINITY)
+			return 0;
+		return aio_write_would_block(mapping, iocb->ki_pos,
+					     iocb->ki_left);
+	}
+	return 0;
+}
+
+/*
+ * aio_swap_identity:
+ *	Exchange the identity stored in the iocb with that of the current
+ *	task: the filesystem ids and capabilities, which decide about
+ *	permissions, reserved blocks and quota limits, the supplementary
+ *	groups, and the io_context, which carries the I/O priority and the
+ *	I/O scheduler's state.  Swapping twice restores both.
+ */
+static void aio_swap_identity(struct kiocb *iocb)
+{
+	struct group_info *group_info;
+	struct io_context *ioc;
+	kernel_cap_t cap;
+	uid_t fsuid;
+	gid_t fsgid;
+
+	fsuid = current->fsuid;
+	current->fsuid = iocb->ki_fsuid;
+	iocb->ki_fsuid = fsuid;
+	fsgid = current->fsgid;
+	current->fsgid = iocb->ki_fsgid;
+	iocb->ki_fsgid = fsgid;
+	cap = current->cap_effective;
+	current->cap_effective = iocb->ki_cap_effective;
+	iocb->ki_cap_effective = cap;
+
+	task_lock(current);
+	group_info = current->group_info;
+	current->group_info = iocb->ki_group_info;
+	iocb->ki_group_info = group_info;
+	ioc = current->io_context;
+	current->io_context = iocb->ki_ioc;
+	iocb->ki_ioc = ioc;
+	task_unlock(current);
+}
+
+/*
+ * aio_queue_worker:
+ *	Hand the iocb to the worker pool, along with the identity of the
+ *	submitter that the worker runs it with.  The worker drops the
+ *	extra reference of the submit path once it has run the iocb.
+ */
+static void aio_queue_worker(struct kiocb *iocb)
+{
+	iocb->ki_fsuid = current_fsuid();
+	iocb->ki_fsgid = current_fsgid();
+	iocb->ki_cap_effective = current_cap();
+	get_group_info(current->group_info);
+	iocb->ki_group_info = current->group_info;
+#ifdef CONFIG_BLOCK
+	iocb->ki_ioc = get_io_context(GFP_KERNEL, -1);
+#else
+	iocb->ki_ioc = NULL;
+#endif
+
+	kiocbSetOffloaded(iocb);
+	spin_lock(&aio_worker_lock);
+	list_add_tail(&iocb->ki_run_list, &aio_worker_list);
+	spin_unlock(&aio_worker_lock);
+	wake_up(&aio_worker_wait);
+}
+
+/*
+ * aio_worker:
+ *	Worker pool thread.  Runs offloaded iocbs in the submitter's mm
+ *	context, staying in that context as long as the next iocb comes
+ *	from the same process, and with the submitter's identity.
+ */
+static int aio_worker(void *unused)
+{
+	struct mm_struct *mm = NULL;
+
+	set_fs(USER_DS);
+	while (!kthread_should_stop()) {
+		struct kiocb *iocb = NULL;
+		struct kioctx *ctx;
+
+		spin_lock(&aio_worker_lock);
+		if (!list_empty(&aio_worker_list)) {
+			iocb = list_entry(aio_worker_list.next, struct kiocb,
+					  ki_run_list);
+			list_del_init(&iocb->ki_run_list);
+		}
+		spin_unlock(&aio_worker_lock);
+
+		if (!iocb) {
+			if (mm) {
+				unuse_mm(mm);
+				mm = NULL;
+			}
+			wait_event_interruptible_exclusive(aio_worker_wait,
+					!list_empty(&aio_worker_list) ||
+					kthread_should_stop());
+			continue;
+		}
+
+		ctx = iocb->ki_ctx;
+		if (mm != ctx->mm) {
+			if (mm)
+				unuse_mm(mm);
+			mm = ctx->mm;
+			use_mm(mm);
+		}
+		aio_swap_identity(iocb);
+		spin_lock_irq(&ctx->ctx_lock);
+		aio_run_iocb(iocb);
+		spin_unlock_irq(&ctx->ctx_lock);
+		aio_swap_identity(iocb);
+
+		put_group_info(iocb->ki_group_info);
+		if (iocb->ki_ioc)
+			put_io_context(iocb->ki_ioc);
+		aio_put_req(iocb);	/* drop extra ref to req */
+		cond_resched();
+	}
+	if (mm)
+		unuse_mm(mm);
+	return 0;
+}
+
 static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 			 struct iocb *iocb)
 {
@@ -1608,6 +1925,7 @@ static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 
 	req->ki_obj.user = user_iocb;
 	req->ki_user_data = iocb->aio_data;
+	req->ki_submit_time = ktime_get();
 	req->ki_pos = iocb->aio_offset;
 
 	req->ki_buf = (char __user *)(unsigned long)iocb->aio_buf;
@@ -1621,6 +1939,11 @@ static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 	if (ret)
 		goto out_put_req;
 
+	if (aio_should_offload(req)) {
+		aio_queue_worker(req);
+		return 0;
+	}
+
 	spin_lock_irq(&ctx->ctx_lock);
 	aio_run_iocb(req);
 	if (!list_empty(&ctx->run_list)) {
@@ -0,0 +1,266 @@
+/*
+ * cramfs2 - large block compressed read-only filesystem
+ *
+ * Reading from the image: uncompressed metadata goes straight through
+ * the block device page cache, compressed data blocks through a cache
+ * of decompressed blocks.
+ *
+ * This file is released under the GPL.
+ */
+
+#include <linux/fs.h>
+#include <linux/pagemap.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/sched.h>
+#include <linux/err.h>
+
+#include "cramfs2.h"
+
+#define CRAMFS2_INVALID_BLK	(~0ULL)
+
+/*
+ * Copy LEN bytes at byte offset POS of the image into BUF.
+ */
+int cramfs2_read_metadata(struct super_block *sb, void *buf, u64 pos, int len)
+{
+	struct address_space *mapping = sb->s_bdev->bd_inode->i_mapping;
+	struct cramfs2_sb_info *sbi = CRAMFS2_SB(sb);
+	u64 limit = sbi ? sbi->bytes_used : i_size_read(mapping->host);
+
+	if (pos > limit || len > limit - pos)
+		return -EIO;
+
+	while (len) {
+		unsigned int offset = pos & (PAGE_CACHE_SIZE - 1);
+		unsigned int bytes = min_t(unsigned int, len,
+					   PAGE_CACHE_SIZE - offset);
+		struct page *page;
+
+		page = read_mapping_page(mapping, pos >> PAGE_CACHE_SHIFT,
+					 NULL);
+		if (IS_ERR(page))
+			return PTR_ERR(page);
+		memcpy(buf, kmap(page) + offset, bytes);
+		kunmap(page);
+		page_cache_release(page);
+
+		buf += bytes;
+		pos += bytes;
+		len -= bytes;
+	}
+	return 0;
+}
+
+/*
+ * Read the compressed block at POS, whose block list entry is SIZE, and
+ * decompress it into DST.  PAGES must have room for all the device pages
+ * the block can span.  Returns the decompressed length or -errno.
+ */
+static int cramfs2_read_block(struct super_block *sb, void *dst,
+			struct page **pages, u64 pos, unsigned int size)
+{
+	struct address_space *mapping = sb->s_bdev->bd_inode->i_mapping;
+	struct cramfs2_sb_info *sbi = CRAMFS2_SB(sb);
+	unsigned int len = CRAMFS2_BLOCK_SIZE(size);
+	unsigned int offset = pos & (PAGE_CACHE_SIZE - 1);
+	pgoff_t first = pos >> PAGE_CACHE_SHIFT;
+	int i, nr, ret;
+	void *src;
+
+	if (!len || len > sbi->block_size || pos > sbi->bytes_used ||
+	    len > sbi->bytes_used - pos)
+		return -EIO;
+
+	nr = (offset + len + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
+
+	/* Start all the reads before waiting for any of them */
+	for (i = 0; i < nr; i++) {
+		pages[i] = read_mapping_page_async(mapping, first + i, NULL);
+		if (IS_ERR(pages[i])) {
+			ret = PTR_ERR(pages[i]);
+			goto release;
+		}
+	}
+	for (i = 0; i < nr; i++) {
+		wait_on_page_locked(pages[i]);
+		if (!PageUptodate(pages[i])) {
+			ret = -EIO;
+			i = nr;
+			goto release;
+		}
+	}
+
+	src = vmap(pages, nr, VM_MAP, PAGE_KERNEL);
+	if (!src) {
+		ret = -ENOMEM;
+		goto release;
+	}
+	if (size & CRAMFS2_BLOCK_UNCOMPRESSED) {
+		memcpy(dst, src + offset, len);
+		ret = len;
+	} else
+		ret = cramfs2_decompress(sb, dst, sbi->block_size,
+					 src + offset, len);
+	vunmap(src);
+	i = nr;
+
+release:
+	while (i--)
+		page_cache_release(pages[i]);
+	return ret;
+}
+
+struct cramfs2_cache *cramfs2_cache_init(const char *name, int entries,
+					int block_size)
+{
+	int nr_pages = (block_size >> PAGE_CACHE_SHIFT) + 1;
+	struct cramfs2_cache *cache;
+	int i;
+
+	cache = kzalloc(sizeof(*cache), GFP_KERNEL);
+	if (!cache)
+		return NULL;
+	cache->entry = kcalloc(entries, sizeof(*cache->entry), GFP_KERNEL);
+	if (!cache->entry) {
+		kfree(cache);
+		return NULL;
+	}
+
+	cache->name = name;
+	cache->entries = entries;
+	cache->unused = entries;
+	spin_lock_init(&cache->lock);
+	init_waitqueue_head(&cache->wait);
+
+	for (i = 0; i < entries; i++) {
+		struct cramfs2_cache_entry *entry = &cache->entry[i];
+
+		entry->block = CRAMFS2_INVALID_BLK;
+		init_waitqueue_head(&entry->wait);
+		entry->data = vmalloc(block_size);
+		entry->pages = kcalloc(nr_pages, sizeof(struct page *),
+				       GFP_KERNEL);
+		if (!entry->data || !entry->pages) {
+			cramfs2_cache_delete(cache);
+			return NULL;
+		}
+	}
+	return cache;
+}
+
+void cramfs2_cache_delete(struct cramfs2_cache *cache)
+{
+	int i;
+
+	if (!cache)
+		return;
+	for (i = 0; i < cache->entries; i++) {
+		vfree(cache->entry[i].data);
+		kfree(cache->entry[i].pages);
+	}
+	kfree(cache->entry);
+	kfree(cache);
+}
+
+/*
+ * Look up the decompressed contents of the block at image offset BLOCK
+ * with block list entry SIZE, reading it in if it isn't cached.  The
+ * entry is returned with a reference held; entry->length is negative if
+ * the block could not be read.
+ */
+struct cramfs2_cache_entry *cramfs2_cache_get(struct super_block *sb,
+		struct cramfs2_cache *cache, u64 block, unsigned int size)
+{
+	struct cramfs2_cache_entry *entry;
+	int i, length;
+
+	spin_lock(&cache->lock);
+	for (;;) {
+		for (i = 0; i < cache->entries; i++)
+			if (cache->entry[i].block == block)
+				break;
+
+		if (i < cache->entries) {
+			entry = &cache->entry[i];
+			if (entry->refcount++ == 0)
+				cache->unused--;
+			spin_unlock(&cache->lock);
+			wait_event(entry->wait, !entry->pending);
+			return entry;
+		}
+
+		if (cache->unused)
+			break;
+
+		/* Every entry is in use: wait for one to be released */
+		spin_unlock(&cache->lock);
+		wait_event(cache->wait, cache->unused);
+		spin_lock(&cache->lock);
+	}
+
+	i = cache->next;
+	while (cache->entry[i].refcount)
+		i = (i + 1) % cache->entries;
+	cache->next = (i + 1) % cache->entries;
+
+	entry = &cache->entry[i];
+	entry->block = block;
+	entry->refcount = 1;
+	entry->pending = 1;
+	cache->unused--;
+	spin_unlock(&cache->lock);
+
+	length = cramfs2_read_block(sb, entry->data, entry->pages, block, size);
+	if (length < 0)
+		printk(KERN_ERR "cramfs2: unable to read %s block at %llu\n",
+		       cache->name, (unsigned long long)block);
+
+	spin_lock(&cache->lock);
+	entry->length = length;
+	entry->pending = 0;
+	spin_unlock(&cache->lock);
+	wake_up_all(&entry->wait);
+	return entry;
+}
+
+void cramfs2_cache_put(struct cramfs2_cache *cache,
+			struct cramfs2_cache_entry *entry)
+{
+	int wake = 0;
+
+	spin_lock(&cache->lock);
+	if (--entry->refcount == 0) {
+		/* Let the next reader retry a block that failed */
+		if (entry->length < 0)
+			entry->block = CRAMFS2_INVALID_BLK;
+		cache->unused++;
+		wake = 1;
+	}
+	spin_unlock(&cache->lock);
+	if (wake)
+		wake_up(&cache->wait);
+}
+
+/*
+ * Look up fragment block FRAGMENT in the fragment cache.
+ */
+struct cramfs2_cache_entry *cramfs2_get_fragment(struct super_block *sb,
+						 unsigned int fragment)
+{
+	struct cramfs2_sb_info *sbi = CRAMFS2_SB(sb);
+	struct cramfs2_fragment frag;
+	int err;
+
+	if (fragment >= sbi->fragments)
+		return ERR_PTR(-EIO);
+
+	err = cramfs2_read_metadata(sb, &frag, sbi->fragment_table_start +
+				    (u64)fragment * sizeof(frag), sizeof(frag));
+	if (err)
+		return ERR_PTR(err);
+
+	return cramfs2_cache_get(sb, sbi->fragment_cache,
+				 le64_to_cpu(frag.start),
+				 le32_to_cpu(frag.size));
+}
@@ -0,0 +1,133 @@
+/*
+ * cramfs2 - large block compressed read-only filesystem
+ *
+ * In-memory data structures and internal interfaces.
+ *
+ * This file is released under the GPL.
+ */
+
+#ifndef _CRAMFS2_H
+#define _CRAMFS2_H
+
+#include <linux/fs.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/wait.h>
+#include <linux/cramfs2_fs.h>
+
+/*
+ * A decompressor turns one compressed block into at most one block of
+ * data.  decompress() is called with its stream's mutex held and may
+ * sleep.
+ */
+struct cramfs2_decompressor {
+	int id;
+	const char *name;
+	void *(*init)(struct super_block *sb);	/* ERR_PTR on failure */
+	void (*free)(void *stream);
+	/* Returns the decompressed length or a negative errno */
+	int (*decompress)(void *stream, void *dst, int dstlen,
+			  void *src, int srclen);
+};
+
+/*
+ * Cache of decompressed blocks.  An entry is looked up by the image
+ * offset of its compressed block; whoever misses fills it while later
+ * readers of the same block wait for it, so every block is read and
+ * decompressed only once however many pages and tasks want it.
+ */
+struct cramfs2_cache_entry {
+	u64 block;
+	int length;		/* decompressed bytes, or -errno */
+	int refcount;
+	int pending;		/* being read and decompressed */
+	wait_queue_head_t wait;
+	void *data;
+	struct page **pages;	/* device pages of the compressed block */
+};
+
+struct cramfs2_cache {
+	const char *name;
+	spinlock_t lock;
+	int entries;
+	int unused;		/* entries with a zero refcount */
+	int next;		/* where to look for a victim next */
+	wait_queue_head_t wait;	/* for an entry to become unused */
+	struct cramfs2_cache_entry *entry;
+};
+
+struct cramfs2_stream {
+	struct mutex mutex;
+	void *stream;
+};
+
+struct cramfs2_sb_info {
+	const struct cramfs2_decompressor *decompressor;
+	struct cramfs2_stream *stream;		/* per-cpu */
+	struct cramfs2_cache *block_cache;
+	struct cramfs2_cache *fragment_cache;
+	unsigned int block_log;
+	unsigned int block_size;
+	u64 bytes_used;
+	u64 devsize;
+	unsigned int inodes;
+	unsigned int fragments;
+	u64 block_list_start;
+	u64 fragment_table_start;
+	u64 inode_table_start;
+	u64 directory_table_start;
+};
+
+struct cramfs2_inode_info {
+	u64 start;
+	unsigned int block_list;
+	unsigned int fragment;
+	unsigned int frag_offset;
+	/*
+	 * Image offset of data block 'next_block', so that sequential reads
+	 * need not add up the block list from the start of the file.
+	 */
+	spinlock_t next_lock;
+	unsigned int next_block;
+	u64 next_start;
+	struct inode vfs_inode;
+};
+
+static inline struct cramfs2_sb_info *CRAMFS2_SB(struct super_block *sb)
+{
+	return sb->s_fs_info;
+}
+
+static inline struct cramfs2_inode_info *CRAMFS2_I(struct inode *inode)
+{
+	return container_of(inode, struct cramfs2_inode_info, vfs_inode);
+}
+
+/* cache.c */
+extern int cramfs2_read_metadata(struct super_block *, void *, u64, int);
+extern struct cramfs2_cache *cramfs2_cache_init(const char *, int, int);
+extern void cramfs2_cache_delete(struct cramfs2_cache *);
+extern struct cramfs2_cache_entry *cramfs2_cache_get(struct super_block *,
+				struct cramfs2_cache *, u64, unsigned int);
+extern void cramfs2_cache_put(struct cramfs2_cache *,
+				struct cramfs2_cache_entry *);
+extern struct cramfs2_cache_entry *cramfs2_get_fragment(struct super_block *,
+				unsigned int);
+
+/* decompressor.c */
+extern const struct cramfs2_decompressor *cramfs2_lookup_decompressor(int);
+extern int cramfs2_decompressor_init(struct super_block *);
+extern void cramfs2_decompressor_free(struct super_block *);
+extern int cramfs2_decompress(struct super_block *, void *, int, void *, int);
+
+/* dir.c */
+extern const struct file_operations cramfs2_dir_operations;
+extern const struct inode_operations cramfs2_dir_inode_operations;
+
+/* file.c */
+extern const struct address_space_operations cramfs2_aops;
+
+/* inode.c */
+extern struct inode *cramfs2_iget(struct super_block *, unsigned int);
+
+#endif
@@ -0,0 +1,184 @@
+/*
+ * cramfs2 - large block compressed read-only filesystem
+ *
+ * Decompressors.  The compressor is chosen per image when it is built;
+ * every CPU gets its own decompression stream so that readers of
+ * different blocks never serialise on a shared one.
+ *
+ * This file is released under the GPL.
+ */
+
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/percpu.h>
+#include <linux/err.h>
+#include <linux/zlib.h>
+#include <linux/lzo.h>
+
+#include "cramfs2.h"
+
+static void *zlib_init(struct super_block *sb)
+{
+	z_stream *stream;
+
+	stream = kmalloc(sizeof(z_stream), GFP_KERNEL);
+	if (!stream)
+		return ERR_PTR(-ENOMEM);
+	stream->workspace = vmalloc(zlib_inflate_workspacesize());
+	if (!stream->workspace) {
+		kfree(stream);
+		return ERR_PTR(-ENOMEM);
+	}
+	stream->next_in = NULL;
+	stream->avail_in = 0;
+	zlib_inflateInit(stream);
+	return stream;
+}
+
+static void zlib_free(void *strm)
+{
+	z_stream *stream = strm;
+
+	zlib_inflateEnd(stream);
+	vfree(stream->workspace);
+	kfree(stream);
+}
+
+static int zlib_decompress(void *strm, void *dst, int dstlen,
+			   void *src, int srclen)
+{
+	z_stream *stream = strm;
+	int err;
+
+	stream->next_in = src;
+	stream->avail_in = srclen;
+	stream->next_out = dst;
+	stream->avail_out = dstlen;
+
+	err = zlib_inflateReset(stream);
+	if (err != Z_OK)
+		return -EIO;
+	err = zlib_inflate(stream, Z_FINISH);
+	if (err != Z_STREAM_END)
+		return -EIO;
+	return stream->total_out;
+}
+
+static const struct cramfs2_decompressor cramfs2_zlib = {
+	.id		= CRAMFS2_COMPR_ZLIB,
+	.name		= "zlib",
+	.init		= zlib_init,
+	.free		= zlib_free,
+	.decompress	= zlib_decompress,
+};
+
+#ifdef CONFIG_CRAMFS2_LZO
+/* LZO decompression works in the output buffer and needs no state */
+static void *lzo_init(struct super_block *sb)
+{
+	return NULL;
+}
+
+static void lzo_free(void *stream)
+{
+}
+
+static int lzo_decompress(void *stream, void *dst, int dstlen,
+			  void *src, int srclen)
+{
+	size_t len = dstlen;
+
+	if (lzo1x_decompress_safe(src, srclen, dst, &len) != LZO_E_OK)
+		return -EIO;
+	return len;
+}
+
+static const struct cramfs2_decompressor cramfs2_lzo = {
+	.id		= CRAMFS2_COMPR_LZO,
+	.name		= "lzo",
+	.init		= lzo_init,
+	.free		= lzo_free,
+	.decompress	= lzo_decompress,
+};
+#endif
+
+static const struct cramfs2_decompressor *decompressors[] = {
+	&cramfs2_zlib,
+#ifdef CONFIG_CRAMFS2_LZO
+	&cramfs2_lzo,
+#endif
+};
+
+const struct cramfs2_decompressor *cramfs2_lookup_decompressor(int id)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(decompressors); i++)
+		if (decompressors[i]->id == id)
+			return decompressors[i];
+	return NULL;
+}
+
+int cramfs2_decompressor_init(struct super_block *sb)
+{
+	struct cramfs2_sb_info *sbi = CRAMFS2_SB(sb);
+	int cpu;
+
+	sbi->stream = alloc_percpu(struct cramfs2_stream);
+	if (!sbi->stream)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct cramfs2_stream *s = per_cpu_ptr(sbi->stream, cpu);
+		void *stream = sbi->decompressor->init(sb);
+
+		if (IS_ERR(stream)) {
+			cramfs2_decompressor_free(sb);
+			return PTR_ERR(stream);
+		}
+		mutex_init(&s->mutex);
+		s->stream = stream;
+	}
+	return 0;
+}
+
+void cramfs2_decompressor_free(struct super_block *sb)
+{
+	struct cramfs2_sb_info *sbi = CRAMFS2_SB(sb);
+	int cpu;
+
+	if (!sbi->stream)
+		return;
+	for_each_possible_cpu(cpu) {
+		struct cramfs2_stream *s = per_cpu_ptr(sbi->stream, cpu);
+
+		if (s->stream)
+			sbi->decompressor->free(s->stream);
+	}
+	free_percpu(sbi->stream);
+	sbi->stream = NULL;
+}
+
+/*
+ * Decompress SRCLEN bytes at SRC into DST using the stream of the CPU
+ * we start on.  Inflating a block of up to 1 MB takes too long to do
+ * with preemption off, so the stream is held by its mutex instead: a
+ * task preempted meanwhile only delays the next reader on that CPU.
+ * Returns the decompressed length or -errno.
+ */
+int cramfs2_decompress(struct super_block *sb, void *dst, int dstlen,
+		       void *src, int srclen)
+{
+	struct cramfs2_sb_info *sbi = CRAMFS2_SB(sb);
+	struct cramfs2_stream *s;
+	int ret;
+
+	s = per_cpu_ptr(sbi->stream, raw_smp_processor_id());
+	mutex_lock(&s->mutex);
+	ret = sbi->decompressor->decompress(s->stream, dst, dstlen,
+					    src, srclen);
+	mutex_unlock(&s->mutex);
+	return ret;
+}
@@ -0,0 +1,146 @@
+/*
+ * cramfs2 - large block compressed read-only filesystem
+ *
+ * Directories.  The entries of a directory are a sorted, contiguous run
+ * of struct cramfs2_dirent in the directory table.  f_pos 0 and 1 are
+ * "." and "..", after that it is the byte offset of the next entry
+ * plus two.
+ *
+ * This file is released under the GPL.
+ */
+
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/err.h>
+
+#include "cramfs2.h"
+
+#define DIRENT_BUF_SIZE	(sizeof(struct cramfs2_dirent) + CRAMFS2_MAX_NAMELEN)
+
+/*
+ * Read the directory entry at byte OFFSET of directory INODE into DE,
+ * which must have room for DIRENT_BUF_SIZE bytes.  Returns the offset of
+ * the next entry or -errno.
+ */
+static int cramfs2_read_dirent(struct inode *inode, unsigned int offset,
+			       struct cramfs2_dirent *de)
+{
+	struct super_block *sb = inode->i_sb;
+	unsigned int len, name_len;
+	int err;
+
+	len = min_t(u64, inode->i_size - offset, DIRENT_BUF_SIZE);
+	if (len < sizeof(*de))
+		return -EIO;
+	err = cramfs2_read_metadata(sb, de, CRAMFS2_SB(sb)->directory_table_start
+				    + CRAMFS2_I(inode)->start + offset, len);
+	if (err)
+		return err;
+
+	name_len = le16_to_cpu(de->name_len);
+	if (!name_len || name_len > CRAMFS2_MAX_NAMELEN ||
+	    sizeof(*de) + name_len > len)
+		return -EIO;
+	return offset + CRAMFS2_DIRENT_SIZE(name_len);
+}
+
+static int cramfs2_readdir(struct file *filp, void *dirent, filldir_t filldir)
+{
+	struct inode *inode = filp->f_path.dentry->d_inode;
+	struct cramfs2_dirent *de;
+	unsigned int offset;
+	int next = 0;
+
+	if (filp->f_pos == 0) {
+		if (filldir(dirent, ".", 1, 0, inode->i_ino, DT_DIR) < 0)
+			return 0;
+		filp->f_pos = 1;
+	}
+	if (filp->f_pos == 1) {
+		if (filldir(dirent, "..", 2, 1,
+			    parent_ino(filp->f_path.dentry), DT_DIR) < 0)
+			return 0;
+		filp->f_pos = 2;
+	}
+
+	de = kmalloc(DIRENT_BUF_SIZE, GFP_KERNEL);
+	if (!de)
+		return -ENOMEM;
+
+	offset = filp->f_pos - 2;
+	while (offset < inode->i_size) {
+		/* Directory entries are always 4-byte aligned */
+		if (offset & 3) {
+			next = -EIO;
+			break;
+		}
+		next = cramfs2_read_dirent(inode, offset, de);
+		if (next < 0)
+			break;
+		if (filldir(dirent, de->name, le16_to_cpu(de->name_len),
+			    filp->f_pos, le32_to_cpu(de->ino), de->type) < 0)
+			break;
+		offset = next;
+		filp->f_pos = offset + 2;
+	}
+	kfree(de);
+	return next < 0 ? next : 0;
+}
+
+static struct dentry *cramfs2_lookup(struct inode *dir, struct dentry *dentry,
+				     struct nameidata *nd)
+{
+	const unsigned char *name = dentry->d_name.name;
+	unsigned int len = dentry->d_name.len;
+	struct inode *inode = NULL;
+	struct cramfs2_dirent *de;
+	unsigned int offset = 0;
+	int next, cmp;
+
+	if (len > CRAMFS2_MAX_NAMELEN)
+		return ERR_PTR(-ENAMETOOLONG);
+
+	de = kmalloc(DIRENT_BUF_SIZE, GFP_KERNEL);
+	if (!de)
+		return ERR_PTR(-ENOMEM);
+
+	while (offset < dir->i_size) {
+		unsigned int de_len;
+
+		next = cramfs2_read_dirent(dir, offset, de);
+		if (next < 0) {
+			kfree(de);
+			return ERR_PTR(next);
+		}
+		de_len = le16_to_cpu(de->name_len);
+		cmp = memcmp(name, de->name, min(len, de_len));
+		if (!cmp)
+			cmp = (int)len - (int)de_len;
+		/* Entries are sorted, so we are past it */
+		if (cmp < 0)
+			break;
+		if (!cmp) {
+			inode = cramfs2_iget(dir->i_sb, le32_to_cpu(de->ino));
+			if (IS_ERR(inode)) {
+				kfree(de);
+				return ERR_CAST(inode);
+			}
+			break;
+		}
+		offset = next;
+	}
+	kfree(de);
+	d_add(dentry, inode);
+	return NULL;
+}
+
+const struct file_operations cramfs2_dir_operations = {
+	.llseek		= generic_file_llseek,
+	.read		= generic_read_dir,
+	.readdir	= cramfs2_readdir,
+};
+
+const struct inode_operations cramfs2_dir_inode_operations = {
+	.lookup		= cramfs2_lookup,
+};
@@ -0,0 +1,199 @@
+/*
+ * cramfs2 - large block compressed read-only filesystem
+ *
+ * Regular file and symlink data.
+ *
+ * A data block is usually many pages long.  Once a block has been
+ * decompressed to satisfy one page, every other page of the block that
+ * is not yet in the page cache is filled from it as well, rather than
+ * having each of them look the block up again.
+ *
+ * This file is released under the GPL.
+ */
+
+#include <linux/fs.h>
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
+#include <linux/err.h>
+
+#include "cramfs2.h"
+
+#define BLOCK_LIST_BATCH	32
+
+/*
+ * Find where data block BLOCK of INODE starts in the image and its
+ * block list entry.  The image offset is the sum of the compressed
+ * sizes of all the blocks before it; remember where the next block
+ * starts so that a sequential reader does not have to add them up again.
+ */
+static int cramfs2_block_location(struct inode *inode, unsigned int block,
+				  u64 *start, unsigned int *size)
+{
+	struct cramfs2_sb_info *sbi = CRAMFS2_SB(inode->i_sb);
+	struct cramfs2_inode_info *ei = CRAMFS2_I(inode);
+	__le32 sizes[BLOCK_LIST_BATCH];
+	unsigned int n, i, nr;
+	u64 pos;
+	int err;
+
+	spin_lock(&ei->next_lock);
+	if (block >= ei->next_block) {
+		n = ei->next_block;
+		pos = ei->next_start;
+	} else {
+		n = 0;
+		pos = ei->start;
+	}
+	spin_unlock(&ei->next_lock);
+
+	for (;;) {
+		nr = min_t(unsigned int, block + 1 - n, BLOCK_LIST_BATCH);
+		err = cramfs2_read_metadata(inode->i_sb, sizes,
+				sbi->block_list_start +
+				(u64)(ei->block_list + n) * sizeof(__le32),
+				nr * sizeof(__le32));
+		if (err)
+			return err;
+		for (i = 0; i < nr - 1; i++)
+			pos += CRAMFS2_BLOCK_SIZE(le32_to_cpu(sizes[i]));
+		n += nr - 1;
+		if (n == block)
+			break;
+		pos += CRAMFS2_BLOCK_SIZE(le32_to_cpu(sizes[nr - 1]));
+		n++;
+	}
+
+	*start = pos;
+	*size = le32_to_cpu(sizes[nr - 1]);
+
+	spin_lock(&ei->next_lock);
+	ei->next_block = block + 1;
+	ei->next_start = pos + CRAMFS2_BLOCK_SIZE(*size);
+	spin_unlock(&ei->next_lock);
+	return 0;
+}
+
+/*
+ * Fill the pages of the block starting at page FIRST from the AVAIL
+ * bytes at DATA (which may be NULL for a hole).  PAGE is the page the
+ * caller was asked to read; the others are only filled if they can be
+ * had without blocking and aren't uptodate already.
+ */
+static void cramfs2_fill_pages(struct page *page, pgoff_t first,
+			       pgoff_t last, void *data, int avail)
+{
+	struct address_space *mapping = page->mapping;
+	pgoff_t index;
+
+	for (index = first; index <= last; index++) {
+		int offset = (index - first) << PAGE_CACHE_SHIFT;
+		int bytes = 0;
+		struct page *p = page;
+		void *pgdata;
+
+		if (index != page->index) {
+			p = grab_cache_page_nowait(mapping, index);
+			if (!p)
+				continue;
+			if (PageUptodate(p)) {
+				unlock_page(p);
+				page_cache_release(p);
+				continue;
+			}
+		}
+
+		if (avail > offset)
+			bytes = min_t(int, avail - offset, PAGE_CACHE_SIZE);
+		pgdata = kmap_atomic(p, KM_USER0);
+		if (bytes)
+			memcpy(pgdata, data + offset, bytes);
+		memset(pgdata + bytes, 0, PAGE_CACHE_SIZE - bytes);
+		kunmap_atomic(pgdata, KM_USER0);
+		flush_dcache_page(p);
+		SetPageUptodate(p);
+		unlock_page(p);
+		if (p != page)
+			page_cache_release(p);
+	}
+}
+
+static int cramfs2_readpage(struct file *file, struct page *page)
+{
+	struct inode *inode = page->mapping->host;
+	struct super_block *sb = inode->i_sb;
+	struct cramfs2_sb_info *sbi = CRAMFS2_SB(sb);
+	struct cramfs2_inode_info *ei = CRAMFS2_I(inode);
+	int shift = sbi->block_log - PAGE_CACHE_SHIFT;
+	unsigned int block = page->index >> shift;
+	loff_t size = i_size_read(inode);
+	struct cramfs2_cache_entry *entry = NULL;
+	struct cramfs2_cache *cache = NULL;
+	pgoff_t first, last;
+	void *data = NULL;
+	int avail = 0;
+	int err;
+
+	if (!size || page->index > (size - 1) >> PAGE_CACHE_SHIFT) {
+		cramfs2_fill_pages(page, page->index, page->index, NULL, 0);
+		return 0;
+	}
+
+	if (block < size >> sbi->block_log ||
+	    ei->fragment == CRAMFS2_NO_FRAGMENT) {
+		unsigned int bsize;
+		u64 start;
+
+		err = cramfs2_block_location(inode, block, &start, &bsize);
+		if (err)
+			goto error;
+		if (bsize) {
+			cache = sbi->block_cache;
+			entry = cramfs2_cache_get(sb, cache, start, bsize);
+		}
+	} else {
+		cache = sbi->fragment_cache;
+		entry = cramfs2_get_fragment(sb, ei->fragment);
+		if (IS_ERR(entry)) {
+			err = PTR_ERR(entry);
+			goto error;
+		}
+	}
+
+	if (entry) {
+		int offset = 0;
+
+		if (entry->length < 0) {
+			err = entry->length;
+			goto put;
+		}
+		if (cache == sbi->fragment_cache)
+			offset = ei->frag_offset;
+		avail = min_t(loff_t, size - ((loff_t)block << sbi->block_log),
+			      sbi->block_size);
+		if (offset + avail > entry->length) {
+			err = -EIO;
+			goto put;
+		}
+		data = entry->data + offset;
+	}
+
+	first = (pgoff_t)block << shift;
+	last = min_t(pgoff_t, first + (1 << shift) - 1,
+		     (size - 1) >> PAGE_CACHE_SHIFT);
+	cramfs2_fill_pages(page, first, last, data, avail);
+
+	if (entry)
+		cramfs2_cache_put(cache, entry);
+	return 0;
+
+put:
+	cramfs2_cache_put(cache, entry);
+error:
+	SetPageError(page);
+	unlock_page(page);
+	return err;
+}
+
+const struct address_space_operations cramfs2_aops = {
+	.readpage	= cramfs2_readpage,
+};
@@ -0,0 +1,85 @@
+/*
+ * cramfs2 - large block compressed read-only filesystem
+ *
+ * Inodes are a flat table of struct cramfs2_inode indexed by inode
+ * number, so reading one in is a single lookup.
+ *
+ * This file is released under the GPL.
+ */
+
+#include <linux/fs.h>
+#include <linux/err.h>
+
+#include "cramfs2.h"
+
+struct inode *cramfs2_iget(struct super_block *sb, unsigned int ino)
+{
+	struct cramfs2_sb_info *sbi = CRAMFS2_SB(sb);
+	struct cramfs2_inode_info *ei;
+	struct cramfs2_inode di;
+	struct inode *inode;
+	int err = -EIO;
+
+	if (!ino || ino > sbi->inodes)
+		return ERR_PTR(-EIO);
+
+	inode = iget_locked(sb, ino);
+	if (!inode)
+		return ERR_PTR(-ENOMEM);
+	if (!(inode->i_state & I_NEW))
+		return inode;
+
+	err = cramfs2_read_metadata(sb, &di, sbi->inode_table_start +
+				    (u64)(ino - 1) * sizeof(di), sizeof(di));
+	if (err)
+		goto failed;
+
+	ei = CRAMFS2_I(inode);
+	ei->start = le64_to_cpu(di.start);
+	ei->block_list = le32_to_cpu(di.block_list);
+	ei->fragment = le32_to_cpu(di.fragment);
+	ei->frag_offset = le32_to_cpu(di.frag_offset);
+	ei->next_block = 0;
+	ei->next_start = ei->start;
+
+	inode->i_mode = le16_to_cpu(di.mode);
+	inode->i_nlink = le32_to_cpu(di.nlink);
+	inode->i_uid = le32_to_cpu(di.uid);
+	inode->i_gid = le32_to_cpu(di.gid);
+	inode->i_size = le64_to_cpu(di.size);
+	inode->i_blocks = (inode->i_size + 511) >> 9;
+	inode->i_mtime.tv_sec = le32_to_cpu(di.mtime);
+	inode->i_mtime.tv_nsec = 0;
+	inode->i_atime = inode->i_ctime = inode->i_mtime;
+
+	err = -EIO;
+	if (S_ISREG(inode->i_mode) || S_ISLNK(inode->i_mode)) {
+		if (ei->fragment != CRAMFS2_NO_FRAGMENT &&
+		    (ei->fragment >= sbi->fragments ||
+		     ei->frag_offset >= sbi->block_size))
+			goto failed;
+		if (S_ISREG(inode->i_mode))
+			inode->i_fop = &generic_ro_fops;
+		else
+			inode->i_op = &page_symlink_inode_operations;
+		inode->i_data.a_ops = &cramfs2_aops;
+	} else if (S_ISDIR(inode->i_mode)) {
+		inode->i_op = &cramfs2_dir_inode_operations;
+		inode->i_fop = &cramfs2_dir_operations;
+	} else if (S_ISCHR(inode->i_mode) || S_ISBLK(inode->i_mode) ||
+		   S_ISFIFO(inode->i_mode) || S_ISSOCK(inode->i_mode)) {
+		inode->i_size = 0;
+		inode->i_blocks = 0;
+		init_special_inode(inode, inode->i_mode,
+				   new_decode_dev(ei->start));
+	} else
+		goto failed;
+
+	unlock_new_inode(inode);
+	return inode;
+
+failed:
+	printk(KERN_ERR "cramfs2: bad inode %u\n", ino);
+	iget_failed(inode);
+	return ERR_PTR(err);
+}
@@ -0,0 +1,268 @@
+/*
+ * cramfs2 - large block compressed read-only filesystem
+ *
+ * This file is released under the GPL.
+ */
+
+/*
+ * Superblock handling and module glue.
+ *
+ * Compared to cramfs, file data is compressed in large blocks (64 or
+ * 128 KB are typical) with zlib or LZO, file tails are packed into
+ * shared fragment blocks, decompressed blocks are kept in a small
+ * per-mount cache and decompression runs on per-CPU streams instead of
+ * under a global mutex.  See Documentation/filesystems/cramfs2.txt.
+ */
+
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/blkdev.h>
+#include <linux/vfs.h>
+#include <linux/err.h>
+
+#include "cramfs2.h"
+
+/* Entries of the decompressed data and fragment block caches */
+#define CRAMFS2_CACHED_BLKS	8
+#define CRAMFS2_CACHED_FRAGMENTS	3
+
+static const struct super_operations cramfs2_ops;
+
+static struct kmem_cache *cramfs2_inode_cachep;
+
+static struct inode *cramfs2_alloc_inode(struct super_block *sb)
+{
+	struct cramfs2_inode_info *ei;
+
+	ei = kmem_cache_alloc(cramfs2_inode_cachep, GFP_KERNEL);
+	if (!ei)
+		return NULL;
+	return &ei->vfs_inode;
+}
+
+static void cramfs2_destroy_inode(struct inode *inode)
+{
+	kmem_cache_free(cramfs2_inode_cachep, CRAMFS2_I(inode));
+}
+
+static void init_once(void *foo)
+{
+	struct cramfs2_inode_info *ei = foo;
+
+	spin_lock_init(&ei->next_lock);
+	inode_init_once(&ei->vfs_inode);
+}
+
+static int init_inodecache(void)
+{
+	cramfs2_inode_cachep = kmem_cache_create("cramfs2_inode_cache",
+					sizeof(struct cramfs2_inode_info),
+					0, (SLAB_RECLAIM_ACCOUNT|
+					SLAB_MEM_SPREAD),
+					init_once);
+	if (cramfs2_inode_cachep == NULL)
+		return -ENOMEM;
+	return 0;
+}
+
+static void destroy_inodecache(void)
+{
+	kmem_cache_destroy(cramfs2_inode_cachep);
+}
+
+static void cramfs2_free_sb_info(struct super_block *sb)
+{
+	struct cramfs2_sb_info *sbi = CRAMFS2_SB(sb);
+
+	cramfs2_cache_delete(sbi->block_cache);
+	cramfs2_cache_delete(sbi->fragment_cache);
+	cramfs2_decompressor_free(sb);
+	kfree(sbi);
+	sb->s_fs_info = NULL;
+}
+
+static void cramfs2_put_super(struct super_block *sb)
+{
+	cramfs2_free_sb_info(sb);
+}
+
+static int cramfs2_remount(struct super_block *sb, int *flags, char *data)
+{
+	*flags |= MS_RDONLY;
+	return 0;
+}
+
+static int cramfs2_fill_super(struct super_block *sb, void *data, int silent)
+{
+	struct cramfs2_super super;
+	struct cramfs2_sb_info *sbi;
+	struct inode *root;
+	unsigned int block_log;
+	int err;
+
+	sb->s_flags |= MS_RDONLY;
+
+	if (cramfs2_read_metadata(sb, &super, 0, sizeof(super)))
+		return -EINVAL;
+
+	/* Do sanity checks on the superblock */
+	if (le32_to_cpu(super.magic) != CRAMFS2_MAGIC) {
+		if (!silent)
+			printk(KERN_ERR "cramfs2: wrong magic\n");
+		return -EINVAL;
+	}
+	if (le16_to_cpu(super.version) != CRAMFS2_VERSION ||
+	    le32_to_cpu(super.flags)) {
+		printk(KERN_ERR "cramfs2: unsupported filesystem version %u, "
+		       "flags %#x\n", le16_to_cpu(super.version),
+		       le32_to_cpu(super.flags));
+		return -EINVAL;
+	}
+	block_log = le32_to_cpu(super.block_log);
+	if (block_log < CRAMFS2_MIN_BLOCK_LOG ||
+	    block_log > CRAMFS2_MAX_BLOCK_LOG ||
+	    block_log < PAGE_CACHE_SHIFT) {
+		printk(KERN_ERR "cramfs2: unsupported block size %lu\n",
+		       1UL << min(block_log, 31U));
+		return -EINVAL;
+	}
+
+	sbi = kzalloc(sizeof(struct cramfs2_sb_info), GFP_KERNEL);
+	if (!sbi)
+		return -ENOMEM;
+
+	sbi->decompressor = cramfs2_lookup_decompressor(
+				le16_to_cpu(super.compression));
+	if (!sbi->decompressor) {
+		printk(KERN_ERR "cramfs2: unsupported compression type %u\n",
+		       le16_to_cpu(super.compression));
+		kfree(sbi);
+		return -EINVAL;
+	}
+
+	sbi->block_log = block_log;
+	sbi->block_size = 1 << block_log;
+	sbi->bytes_used = le64_to_cpu(super.bytes_used);
+	sbi->devsize = i_size_read(sb->s_bdev->bd_inode);
+	sbi->inodes = le32_to_cpu(super.inodes);
+	sbi->fragments = le32_to_cpu(super.fragments);
+	sbi->block_list_start = le64_to_cpu(super.block_list_start);
+	sbi->fragment_table_start = le64_to_cpu(super.fragment_table_start);
+	sbi->inode_table_start = le64_to_cpu(super.inode_table_start);
+	sbi->directory_table_start = le64_to_cpu(super.directory_table_start);
+	sb->s_fs_info = sbi;
+
+	err = -EINVAL;
+	if (sbi->bytes_used > sbi->devsize) {
+		printk(KERN_ERR "cramfs2: image is larger than the device\n");
+		goto failed;
+	}
+
+	err = cramfs2_decompressor_init(sb);
+	if (err)
+		goto failed;
+
+	err = -ENOMEM;
+	sbi->block_cache = cramfs2_cache_init("data", CRAMFS2_CACHED_BLKS,
+					      sbi->block_size);
+	sbi->fragment_cache = cramfs2_cache_init("fragment",
+						 CRAMFS2_CACHED_FRAGMENTS,
+						 sbi->block_size);
+	if (!sbi->block_cache || !sbi->fragment_cache)
+		goto failed;
+
+	sb->s_magic = CRAMFS2_MAGIC;
+	sb->s_maxbytes = MAX_LFS_FILESIZE;
+	sb->s_op = &cramfs2_ops;
+
+	root = cramfs2_iget(sb, CRAMFS2_ROOT_INO);
+	if (IS_ERR(root)) {
+		err = PTR_ERR(root);
+		goto failed;
+	}
+	if (!S_ISDIR(root->i_mode)) {
+		printk(KERN_ERR "cramfs2: root is not a directory\n");
+		iput(root);
+		err = -EINVAL;
+		goto failed;
+	}
+	sb->s_root = d_alloc_root(root);
+	if (!sb->s_root) {
+		iput(root);
+		err = -ENOMEM;
+		goto failed;
+	}
+
+	printk(KERN_INFO "cramfs2: mounted %s image, %u byte blocks\n",
+	       sbi->decompressor->name, sbi->block_size);
+	return 0;
+
+failed:
+	cramfs2_free_sb_info(sb);
+	return err;
+}
+
+static int cramfs2_statfs(struct dentry *dentry, struct kstatfs *buf)
+{
+	struct cramfs2_sb_info *sbi = CRAMFS2_SB(dentry->d_sb);
+
+	buf->f_type = CRAMFS2_MAGIC;
+	buf->f_bsize = sbi->block_size;
+	buf->f_blocks = (sbi->bytes_used + sbi->block_size - 1) >>
+			sbi->block_log;
+	buf->f_bfree = 0;
+	buf->f_bavail = 0;
+	buf->f_files = sbi->inodes;
+	buf->f_ffree = 0;
+	buf->f_namelen = CRAMFS2_MAX_NAMELEN;
+	return 0;
+}
+
+static const struct super_operations cramfs2_ops = {
+	.alloc_inode	= cramfs2_alloc_inode,
+	.destroy_inode	= cramfs2_destroy_inode,
+	.put_super	= cramfs2_put_super,
+	.remount_fs	= cramfs2_remount,
+	.statfs		= cramfs2_statfs,
+};
+
+static int cramfs2_get_sb(struct file_system_type *fs_type,
+	int flags, const char *dev_name, void *data, struct vfsmount *mnt)
+{
+	return get_sb_bdev(fs_type, flags, dev_name, data, cramfs2_fill_super,
+			   mnt);
+}
+
+static struct file_system_type cramfs2_fs_type = {
+	.owner		= THIS_MODULE,
+	.name		= "cramfs2",
+	.get_sb		= cramfs2_get_sb,
+	.kill_sb	= kill_block_super,
+	.fs_flags	= FS_REQUIRES_DEV,
+};
+
+static int __init init_cramfs2_fs(void)
+{
+	int err;
+
+	err = init_inodecache();
+	if (err)
+		return err;
+	err = register_filesystem(&cramfs2_fs_type);
+	if (err)
+		destroy_inodecache();
+	return err;
+}
+
+static void __exit exit_cramfs2_fs(void)
+{
+	unregister_filesystem(&cramfs2_fs_type);
+	destroy_inodecache();
+}
+
+module_init(init_cramfs2_fs)
+module_exit(exit_cramfs2_fs)
+MODULE_DESCRIPTION("Large block compressed read-only filesystem");
+MODULE_LICENSE("GPL");
@@ -106,7 +106,9 @@ static void dentry_iput(struct dentry * dentry)
 {
 	struct inode *inode = dentry->d_inode;
 	if (inode) {
+		write_seqcount_begin(&dentry->d_seq);
 		dentry->d_inode = NULL;
+		write_seqcount_end(&dentry->d_seq);
 		list_del_init(&dentry->d_alias);
 		spin_unlock(&dentry->d_lock);
 		spin_unlock(&dcache_lock);
@@ -942,6 +944,7 @@ struct dentry *d_alloc(struct dentry * parent, const struct qstr *name)
 	atomic_set(&dentry->d_count, 1);
 	dentry->d_flags = DCACHE_UNHASHED;
 	spin_lock_init(&dentry->d_lock);
+	seqcount_init(&dentry->d_seq);
 	dentry->d_inode = NULL;
 	dentry->d_parent = NULL;
 	dentry->d_sb = NULL;
@@ -1433,6 +1436,54 @@ next:
  	return found;
 }
 
+/**
+ * __d_lookup_rcu - search for a dentry without references or locks
+ * @parent: parent dentry
+ * @name: qstr of name we wish to find
+ * @seq: returns the d_seq count the match was made under
+ *
+ * For RCU path walk.  The caller holds rcu_read_lock() and must check
+ * @seq against the dentry's d_seq after reading whatever else it needs
+ * from the dentry, before relying on any of it.  Only the plain name
+ * comparison is done: a parent with its own d_compare is no use here.
+ */
+struct dentry *__d_lookup_rcu(struct dentry *parent, struct qstr *name,
+			      unsigned *seq)
+{
+	unsigned int len = name->len;
+	unsigned int hash = name->hash;
+	const unsigned char *str = name->name;
+	struct hlist_head *head = d_hash(parent, hash);
+	struct hlist_node *node;
+	struct dentry *dentry;
+
+	hlist_for_each_entry_rcu(dentry, node, head, d_hash) {
+		const unsigned char *tname;
+		unsigned int tlen;
+		unsigned s;
+
+		if (dentry->d_name.hash != hash)
+			continue;
+		s = read_seqcount_begin(&dentry->d_seq);
+		if (dentry->d_parent != parent || d_unhashed(dentry))
+			continue;
+		tlen = dentry->d_name.len;
+		tname = dentry->d_name.name;
+		/*
+		 * Once the length and the name buffer are known to belong
+		 * together, comparing cannot run off the end of it; if
+		 * d_move() rewrites the name meanwhile, d_seq says so.
+		 */
+		if (read_seqcount_retry(&dentry->d_seq, s))
+			continue;
+		if (tlen != len || memcmp(tname, str, len))
+			continue;
+		*seq = s;
+		return dentry;
+	}
+	return NULL;
+}
+
 /**
  * d_hash_and_lookup - hash the qstr then search for a dentry
  * @dir: Directory to search in
@@ -1666,6 +1717,8 @@ static void d_move_locked(struct dentry * dentry, struct dentry * target)
 		spin_lock_nested(&target->d_lock, DENTRY_D_LOCK_NESTED);
 	}
 
+	write_seqcount_begin(&dentry->d_seq);
+
 	/* Move the dentry to the target hash queue, if on different bucket */
 	if (d_unhashed(dentry))
 		goto already_unhashed;
@@ -1678,6 +1731,7 @@ already_unhashed:
 
 	/* Unhash the target: dput() will then get rid of it */
 	__d_drop(target);
+	write_seqcount_begin(&target->d_seq);
 
 	list_del(&dentry->d_u.d_child);
 	list_del(&target->d_u.d_child);
@@ -1699,6 +1753,8 @@ already_unhashed:
 	}
 
 	list_add(&dentry->d_u.d_child, &dentry->d_parent->d_subdirs);
+	write_seqcount_end(&target->d_seq);
+	write_seqcount_end(&dentry->d_seq);
 	spin_unlock(&target->d_lock);
 	fsnotify_d_move(dentry);
 	spin_unlock(&dentry->d_lock);
@@ -1792,6 +1848,8 @@ static void __d_materialise_dentry(struct dentry *dentry, struct dentry *anon)
 {
 	struct dentry *dparent, *aparent;
 
+	write_seqcount_begin(&dentry->d_seq);
+	write_seqcount_begin(&anon->d_seq);
 	switch_names(dentry, anon);
 	do_switch(dentry->d_name.hash, anon->d_name.hash);
 
@@ -1812,6 +1870,8 @@ static void __d_materialise_dentry(struct dentry *dentry, struct dentry *anon)
 	else
 		INIT_LIST_HEAD(&anon->d_u.d_child);
 
+	write_seqcount_end(&anon->d_seq);
+	write_seqcount_end(&dentry->d_seq);
 	anon->d_flags &= ~DCACHE_DISCONNECTED;
 }
 
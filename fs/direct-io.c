@@ -367,6 +367,15 @@ static struct bio *dio_await_one(struct dio *dio)
 {
 	unsigned long flags;
 	struct bio *bio = NULL;
+	struct request_queue *q = NULL;
+
+	/*
+	 * A synchronous submitter of a queue that can be polled reaps its
+	 * completions itself rather than sleeping until the interrupt, for
+	 * as long as nothing else wants the cpu.
+	 */
+	if (!dio->is_async && dio->map_bh.b_bdev)
+		q = bdev_get_queue(dio->map_bh.b_bdev);
 
 	spin_lock_irqsave(&dio->bio_lock, flags);
 
@@ -377,6 +386,13 @@ static struct bio *dio_await_one(struct dio *dio)
 	 * and can call it after testing our condition.
 	 */
 	while (dio->refcount > 1 && dio->bio_list == NULL) {
+		if (q && blk_queue_poll(q) && !need_resched()) {
+			spin_unlock_irqrestore(&dio->bio_lock, flags);
+			if (!blk_poll(q))
+				cpu_relax();
+			spin_lock_irqsave(&dio->bio_lock, flags);
+			continue;
+		}
 		__set_current_state(TASK_UNINTERRUPTIBLE);
 		dio->waiter = current;
 		spin_unlock_irqrestore(&dio->bio_lock, flags);
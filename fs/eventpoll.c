@@ -90,7 +90,11 @@
 #endif /* #if DEBUG_EPI != 0 */
 
 /* Epoll private bits inside the event mask */
-#define EP_PRIVATE_BITS (EPOLLONESHOT | EPOLLET)
+#define EP_PRIVATE_BITS (EPOLLEXCLUSIVE | EPOLLONESHOT | EPOLLET)
+
+/* Events that can be combined with EPOLLEXCLUSIVE */
+#define EP_EXCLUSIVE_OK_BITS (EPOLLEXCLUSIVE | EPOLLET | POLLIN | POLLOUT | \
+			      POLLERR | POLLHUP)
 
 /* Maximum number of poll wake up nests we are allowing */
 #define EP_MAX_POLLWAKE_NESTS 4
@@ -631,10 +635,15 @@ static struct epitem *ep_find(struct eventpoll *ep, struct file *file, int fd)
  * This is the callback that is passed to the wait queue wakeup
  * machanism. It is called by the stored file descriptors when they
  * have events to report.
+ *
+ * For an EPOLLEXCLUSIVE item the return value tells the wakeup code
+ * whether someone is going to look at the event: if no task is waiting
+ * on this epoll set, returning 0 lets the wakeup move on to the next
+ * exclusive waiter instead of the event sitting unnoticed.
  */
 static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *key)
 {
-	int pwake = 0;
+	int pwake = 0, ewake = 0;
 	unsigned long flags;
 	struct epitem *epi = ep_item_from_wait(wait);
 	struct eventpoll *ep = epi->ep;
@@ -664,6 +673,8 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 			epi->next = ep->ovflist;
 			ep->ovflist = epi;
 		}
+		/* Someone is collecting events right now and will see it */
+		ewake = 1;
 		goto out_unlock;
 	}
 
@@ -678,10 +689,14 @@ is_linked:
 	 * Wake up ( if active ) both the eventpoll wait list and the ->poll()
 	 * wait list.
 	 */
-	if (waitqueue_active(&ep->wq))
+	if (waitqueue_active(&ep->wq)) {
 		wake_up_locked(&ep->wq);
-	if (waitqueue_active(&ep->poll_wait))
+		ewake = 1;
+	}
+	if (waitqueue_active(&ep->poll_wait)) {
 		pwake++;
+		ewake = 1;
+	}
 
 out_unlock:
 	spin_unlock_irqrestore(&ep->lock, flags);
@@ -690,6 +705,8 @@ out_unlock:
 	if (pwake)
 		ep_poll_safewake(&psw, &ep->poll_wait);
 
+	if (epi->event.events & EPOLLEXCLUSIVE)
+		return ewake;
 	return 1;
 }
 
@@ -707,7 +724,10 @@ static void ep_ptable_queue_proc(struct file *file, wait_queue_head_t *whead,
 		init_waitqueue_func_entry(&pwq->wait, ep_poll_callback);
 		pwq->whead = whead;
 		pwq->base = epi;
-		add_wait_queue(whead, &pwq->wait);
+		if (epi->event.events & EPOLLEXCLUSIVE)
+			add_wait_queue_exclusive(whead, &pwq->wait);
+		else
+			add_wait_queue(whead, &pwq->wait);
 		list_add_tail(&pwq->llink, &epi->pwqlist);
 		epi->nwait++;
 	} else {
@@ -1195,6 +1215,19 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 	 */
 	ep = file->private_data;
 
+	/*
+	 * EPOLLEXCLUSIVE only makes sense for plain readiness events on a
+	 * file that is not itself an epoll set, and only when the wait
+	 * entry is created: it can't be changed by EPOLL_CTL_MOD.
+	 */
+	if (ep_op_has_event(op) && (epds.events & EPOLLEXCLUSIVE)) {
+		if (op == EPOLL_CTL_MOD)
+			goto error_tgt_fput;
+		if (is_file_epoll(tfile) ||
+		    (epds.events & ~EP_EXCLUSIVE_OK_BITS))
+			goto error_tgt_fput;
+	}
+
 	mutex_lock(&ep->mtx);
 
 	/*
@@ -1222,8 +1255,10 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 		break;
 	case EPOLL_CTL_MOD:
 		if (epi) {
-			epds.events |= POLLERR | POLLHUP;
-			error = ep_modify(ep, epi, &epds);
+			if (!(epi->event.events & EPOLLEXCLUSIVE)) {
+				epds.events |= POLLERR | POLLHUP;
+				error = ep_modify(ep, epi, &epds);
+			}
 		} else
 			error = -ENOENT;
 		break;
@@ -299,6 +299,18 @@ ext2_permission(struct inode *inode, int mask)
 	return generic_permission(inode, mask, ext2_check_acl);
 }
 
+/*
+ * Called under rcu_read_lock() by the RCU path walk, so we can only
+ * answer when the access ACL is cached as absent.
+ */
+int
+ext2_permission_rcu(struct inode *inode, int mask)
+{
+	if (IS_POSIXACL(inode) && EXT2_I(inode)->i_acl != NULL)
+		return -EAGAIN;
+	return generic_permission(inode, mask, NULL);
+}
+
 /*
  * Initialize the ACLs of a new inode. Called from ext2_new_inode.
  *
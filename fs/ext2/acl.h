@@ -59,12 +59,14 @@ static inline int ext2_acl_count(size_t size)
 
 /* acl.c */
 extern int ext2_permission (struct inode *, int);
+extern int ext2_permission_rcu (struct inode *, int);
 extern int ext2_acl_chmod (struct inode *);
 extern int ext2_init_acl (struct inode *, struct inode *);
 
 #else
 #include <linux/sched.h>
 #define ext2_permission NULL
+#define ext2_permission_rcu NULL
 #define ext2_get_acl	NULL
 #define ext2_set_acl	NULL
 
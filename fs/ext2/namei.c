@@ -375,6 +375,7 @@ const struct inode_operations ext2_dir_inode_operations = {
 #endif
 	.setattr	= ext2_setattr,
 	.permission	= ext2_permission,
+	.permission_rcu	= ext2_permission_rcu,
 };
 
 const struct inode_operations ext2_special_inode_operations = {
@@ -386,4 +387,5 @@ const struct inode_operations ext2_special_inode_operations = {
 #endif
 	.setattr	= ext2_setattr,
 	.permission	= ext2_permission,
+	.permission_rcu	= ext2_permission_rcu,
 };
@@ -304,6 +304,18 @@ ext3_permission(struct inode *inode, int mask)
 	return generic_permission(inode, mask, ext3_check_acl);
 }
 
+/*
+ * Called under rcu_read_lock() by the RCU path walk, so we can only
+ * answer when the access ACL is cached as absent.
+ */
+int
+ext3_permission_rcu(struct inode *inode, int mask)
+{
+	if (IS_POSIXACL(inode) && EXT3_I(inode)->i_acl != NULL)
+		return -EAGAIN;
+	return generic_permission(inode, mask, NULL);
+}
+
 /*
  * Initialize the ACLs of a new inode. Called from ext3_new_inode.
  *
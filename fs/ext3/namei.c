@@ -2417,6 +2417,7 @@ const struct inode_operations ext3_dir_inode_operations = {
 	.removexattr	= generic_removexattr,
 #endif
 	.permission	= ext3_permission,
+	.permission_rcu	= ext3_permission_rcu,
 };
 
 const struct inode_operations ext3_special_inode_operations = {
@@ -2428,4 +2429,5 @@ const struct inode_operations ext3_special_inode_operations = {
 	.removexattr	= generic_removexattr,
 #endif
 	.permission	= ext3_permission,
+	.permission_rcu	= ext3_permission_rcu,
 };
@@ -494,7 +494,8 @@ static int init_inodecache(void)
 	ext3_inode_cachep = kmem_cache_create("ext3_inode_cache",
 					     sizeof(struct ext3_inode_info),
 					     0, (SLAB_RECLAIM_ACCOUNT|
-						SLAB_MEM_SPREAD),
+						SLAB_MEM_SPREAD|
+						SLAB_DESTROY_BY_RCU),
 					     init_once);
 	if (ext3_inode_cachep == NULL)
 		return -ENOMEM;
@@ -2969,7 +2970,7 @@ static struct file_system_type ext3_fs_type = {
 	.name		= "ext3",
 	.get_sb		= ext3_get_sb,
 	.kill_sb	= kill_block_super,
-	.fs_flags	= FS_REQUIRES_DEV,
+	.fs_flags	= FS_REQUIRES_DEV | FS_RCU_INODES,
 };
 
 static int __init init_ext3_fs(void)
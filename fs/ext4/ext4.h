@@ -328,6 +328,7 @@ struct ext4_mount_options {
 	uid_t s_resuid;
 	gid_t s_resgid;
 	unsigned long s_commit_interval;
+	u32 s_min_batch_time, s_max_batch_time;
 #ifdef CONFIG_QUOTA
 	int s_jquota_fmt;
 	char *s_qf_names[MAXQUOTAS];
@@ -792,6 +793,12 @@ static inline int ext4_valid_inum(struct super_block *sb, unsigned long ino)
 
 #define EXT4_DEF_INODE_READAHEAD_BLKS	32
 
+/*
+ * Default bounds on synchronous commit batching, in microseconds
+ */
+#define EXT4_DEF_MIN_BATCH_TIME	JBD2_DEFAULT_MIN_BATCH_TIME
+#define EXT4_DEF_MAX_BATCH_TIME	JBD2_DEFAULT_MAX_BATCH_TIME
+
 /*
  * Default mount options
  */
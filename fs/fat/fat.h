@@ -6,6 +6,7 @@
 #include <linux/nls.h>
 #include <linux/fs.h>
 #include <linux/mutex.h>
+#include <linux/workqueue.h>
 #include <linux/msdos_fs.h>
 
 /*
@@ -65,6 +66,12 @@ struct msdos_sb_info {
 	unsigned int prev_free;      /* previously allocated cluster number */
 	unsigned int free_clusters;  /* -1 if undefined */
 	unsigned int free_clus_valid; /* is free_clusters valid? */
+	unsigned long *free_bitmap;  /* set bit = free cluster, or NULL */
+	unsigned long bitmap_scanned; /* FAT entries below are in free_bitmap */
+	unsigned long bitmap_free;   /* free clusters below bitmap_scanned */
+	int bitmap_stop;	     /* stop the background FAT scan */
+	struct work_struct bitmap_work;	/* background FAT scan */
+	struct super_block *sb;	     /* back pointer for bitmap_work */
 	struct fat_mount_options options;
 	struct nls_table *nls_disk;  /* Codepage used on disk */
 	struct nls_table *nls_io;    /* Charset used for input and display */
@@ -286,6 +293,8 @@ extern int fat_alloc_clusters(struct inode *inode, int *cluster,
 			      int nr_cluster);
 extern int fat_free_clusters(struct inode *inode, int cluster);
 extern int fat_count_free_clusters(struct super_block *sb);
+extern void fat_ent_start_scan(struct super_block *sb);
+extern void fat_ent_release(struct super_block *sb);
 
 /* fat/file.c */
 extern int fat_generic_ioctl(struct inode *inode, struct file *filp,
@@ -322,6 +331,8 @@ extern int fat_sync_bhs(struct buffer_head **bhs, int nr_bhs);
 
 int fat_cache_init(void);
 void fat_cache_destroy(void);
+int fat_bitmap_init(void);
+void fat_bitmap_destroy(void);
 
 /* helper for printk */
 typedef unsigned long long	llu;
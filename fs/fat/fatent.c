@@ -7,6 +7,7 @@
 #include <linux/fs.h>
 #include <linux/msdos_fs.h>
 #include <linux/blkdev.h>
+#include <linux/vmalloc.h>
 #include "fat.h"
 
 struct fatent_operations {
@@ -283,12 +284,29 @@ static inline void unlock_fat(struct msdos_sb_info *sbi)
 	mutex_unlock(&sbi->fat_lock);
 }
 
+static void fat_bitmap_work(struct work_struct *work);
+
 void fat_ent_access_init(struct super_block *sb)
 {
 	struct msdos_sb_info *sbi = MSDOS_SB(sb);
 
 	mutex_init(&sbi->fat_lock);
 
+	/*
+	 * The free cluster bitmap is filled in by the FAT scan, see
+	 * fat_ent_start_scan().  Without it we fall back to walking the
+	 * FAT for every allocation.
+	 */
+	sbi->sb = sb;
+	sbi->bitmap_scanned = FAT_START_ENT;
+	sbi->bitmap_free = 0;
+	sbi->free_bitmap = vmalloc(BITS_TO_LONGS(sbi->max_cluster) *
+				   sizeof(unsigned long));
+	if (sbi->free_bitmap)
+		memset(sbi->free_bitmap, 0, BITS_TO_LONGS(sbi->max_cluster) *
+		       sizeof(unsigned long));
+	INIT_WORK(&sbi->bitmap_work, fat_bitmap_work);
+
 	switch (sbi->fat_bits) {
 	case 32:
 		sbi->fatent_shift = 2;
@@ -449,6 +467,170 @@ static void fat_collect_bhs(struct buffer_head **bhs, int *nr_bhs,
 	}
 }
 
+/*
+ * The free cluster bitmap only covers the FAT entries the scan has
+ * already seen; changes to entries after that are picked up by the scan
+ * itself.  Caller must hold fat_lock.
+ */
+static inline int fat_bitmap_ready(struct msdos_sb_info *sbi)
+{
+	return sbi->free_bitmap && sbi->bitmap_scanned >= sbi->max_cluster;
+}
+
+static void fat_bitmap_update(struct msdos_sb_info *sbi, int entry, int free)
+{
+	if (entry >= sbi->bitmap_scanned)
+		return;
+	if (free) {
+		sbi->bitmap_free++;
+		if (sbi->free_bitmap)
+			__set_bit(entry, sbi->free_bitmap);
+	} else {
+		sbi->bitmap_free--;
+		if (sbi->free_bitmap)
+			__clear_bit(entry, sbi->free_bitmap);
+	}
+}
+
+/* A file that grows past its last cluster looks for a run this long */
+#define FAT_ALLOC_RUN		64
+
+/*
+ * Find the first free run of at least @run clusters in [@start, @end).
+ * The first free cluster seen at all is returned in @first_free.
+ */
+static int fat_bitmap_find_run(struct msdos_sb_info *sbi, int start, int end,
+			       int run, int *first_free)
+{
+	while (start < end) {
+		int next, last;
+
+		next = find_next_bit(sbi->free_bitmap, end, start);
+		if (next >= end)
+			break;
+		if (*first_free < 0)
+			*first_free = next;
+		last = find_next_zero_bit(sbi->free_bitmap, end, next);
+		if (last - next >= run)
+			return next;
+		start = last;
+	}
+	return -1;
+}
+
+/*
+ * Choose the first cluster of an allocation.  A file that is being
+ * extended gets the cluster after its last one if that is free, or else
+ * the start of a long free run, so that large writes end up contiguous.
+ * Anything else gets the next free cluster after the last allocation.
+ */
+static int fat_bitmap_first(struct msdos_sb_info *sbi, int goal)
+{
+	int start = sbi->prev_free + 1, first_free = -1, entry;
+
+	if (start >= sbi->max_cluster)
+		start = FAT_START_ENT;
+
+	if (goal) {
+		if (goal < sbi->max_cluster && test_bit(goal, sbi->free_bitmap))
+			return goal;
+		entry = fat_bitmap_find_run(sbi, start, sbi->max_cluster,
+					    FAT_ALLOC_RUN, &first_free);
+		if (entry < 0)
+			entry = fat_bitmap_find_run(sbi, FAT_START_ENT, start,
+						    FAT_ALLOC_RUN, &first_free);
+		if (entry >= 0)
+			return entry;
+		if (first_free >= 0)
+			return first_free;
+	}
+
+	entry = find_next_bit(sbi->free_bitmap, sbi->max_cluster, start);
+	if (entry < sbi->max_cluster)
+		return entry;
+	entry = find_next_bit(sbi->free_bitmap, start, FAT_START_ENT);
+	return entry < start ? entry : -1;
+}
+
+static int fat_bitmap_next(struct msdos_sb_info *sbi, int entry)
+{
+	int next = find_next_bit(sbi->free_bitmap, sbi->max_cluster, entry);
+
+	if (next >= sbi->max_cluster) {
+		next = find_next_bit(sbi->free_bitmap, entry, FAT_START_ENT);
+		if (next >= entry)
+			return -1;
+	}
+	return next;
+}
+
+/*
+ * Allocate clusters by looking them up in the free cluster bitmap rather
+ * than walking the FAT.  Caller must hold fat_lock.
+ */
+static int fat_alloc_clusters_bitmap(struct inode *inode, int goal,
+				     int *cluster, int nr_cluster,
+				     struct buffer_head **bhs, int *nr_bhs,
+				     int *idx_clus)
+{
+	struct super_block *sb = inode->i_sb;
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	struct fatent_operations *ops = sbi->fatent_ops;
+	struct fat_entry fatent, prev_ent;
+	int entry, err = 0;
+
+	fatent_init(&prev_ent);
+	fatent_init(&fatent);
+	entry = fat_bitmap_first(sbi, goal);
+	while (*idx_clus < nr_cluster) {
+		if (entry < 0) {
+			/* Couldn't allocate the free entries */
+			sbi->free_clusters = 0;
+			sbi->free_clus_valid = 1;
+			sb->s_dirt = 1;
+			err = -ENOSPC;
+			break;
+		}
+
+		err = fat_ent_read(inode, &fatent, entry);
+		if (err < 0)
+			break;
+		if (err != FAT_ENT_FREE) {
+			/* The bitmap is stale; drop it and carry on */
+			printk(KERN_WARNING "FAT: cluster %d in use but marked "
+			       "free\n", entry);
+			fat_bitmap_update(sbi, entry, 0);
+			entry = fat_bitmap_next(sbi, entry);
+			continue;
+		}
+		err = 0;
+
+		/* make the cluster chain */
+		ops->ent_put(&fatent, FAT_ENT_EOF);
+		if (prev_ent.nr_bhs)
+			ops->ent_put(&prev_ent, entry);
+
+		fat_collect_bhs(bhs, nr_bhs, &fatent);
+		fat_bitmap_update(sbi, entry, 0);
+
+		sbi->prev_free = entry;
+		if (sbi->free_clusters != -1)
+			sbi->free_clusters--;
+		sb->s_dirt = 1;
+
+		cluster[(*idx_clus)++] = entry;
+		/*
+		 * fat_collect_bhs() gets ref-count of bhs,
+		 * so we can still use the prev_ent.
+		 */
+		prev_ent = fatent;
+		if (*idx_clus < nr_cluster)
+			entry = fat_bitmap_next(sbi, entry + 1);
+	}
+	fatent_brelse(&fatent);
+	return err;
+}
+
 int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 {
 	struct super_block *sb = inode->i_sb;
@@ -456,10 +638,18 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 	struct fatent_operations *ops = sbi->fatent_ops;
 	struct fat_entry fatent, prev_ent;
 	struct buffer_head *bhs[MAX_BUF_PER_PAGE];
-	int i, count, err, nr_bhs, idx_clus;
+	int i, count, err, nr_bhs, idx_clus, goal = 0;
 
 	BUG_ON(nr_cluster > (MAX_BUF_PER_PAGE / 2));	/* fixed limit */
 
+	/* Try to continue right after the last cluster of the file */
+	if (sbi->free_bitmap && MSDOS_I(inode)->i_start) {
+		int fclus, dclus;
+
+		if (fat_get_cluster(inode, FAT_ENT_EOF, &fclus, &dclus) >= 0)
+			goal = dclus + 1;
+	}
+
 	lock_fat(sbi);
 	if (sbi->free_clusters != -1 && sbi->free_clus_valid &&
 	    sbi->free_clusters < nr_cluster) {
@@ -468,6 +658,14 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 	}
 
 	err = nr_bhs = idx_clus = 0;
+	if (fat_bitmap_ready(sbi)) {
+		err = fat_alloc_clusters_bitmap(inode, goal, cluster,
+						nr_cluster, bhs, &nr_bhs,
+						&idx_clus);
+		unlock_fat(sbi);
+		goto out_sync;
+	}
+
 	count = FAT_START_ENT;
 	fatent_init(&prev_ent);
 	fatent_init(&fatent);
@@ -491,6 +689,7 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 					ops->ent_put(&prev_ent, entry);
 
 				fat_collect_bhs(bhs, &nr_bhs, &fatent);
+				fat_bitmap_update(sbi, entry, 0);
 
 				sbi->prev_free = entry;
 				if (sbi->free_clusters != -1)
@@ -523,6 +722,7 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 out:
 	unlock_fat(sbi);
 	fatent_brelse(&fatent);
+out_sync:
 	if (!err) {
 		if (inode_needs_sync(inode))
 			err = fat_sync_bhs(bhs, nr_bhs);
@@ -576,6 +776,7 @@ int fat_free_clusters(struct inode *inode, int cluster)
 		}
 
 		ops->ent_put(&fatent, FAT_ENT_FREE);
+		fat_bitmap_update(sbi, fatent.entry, 1);
 		if (sbi->free_clusters != -1) {
 			sbi->free_clusters++;
 			sb->s_dirt = 1;
@@ -630,47 +831,133 @@ static void fat_ent_reada(struct super_block *sb, struct fat_entry *fatent,
 		sb_breadahead(sb, blocknr + i);
 }
 
-int fat_count_free_clusters(struct super_block *sb)
+/*
+ * Scan up to @nr_blocks blocks of the FAT from sbi->bitmap_scanned on,
+ * counting the free clusters and recording them in the free cluster
+ * bitmap.  Once the whole FAT has been seen, the count replaces
+ * free_clusters.  Caller must hold fat_lock.
+ */
+static int fat_bitmap_scan(struct super_block *sb, unsigned long nr_blocks)
 {
 	struct msdos_sb_info *sbi = MSDOS_SB(sb);
 	struct fatent_operations *ops = sbi->fatent_ops;
 	struct fat_entry fatent;
-	unsigned long reada_blocks, reada_mask, cur_block;
-	int err = 0, free;
-
-	lock_fat(sbi);
-	if (sbi->free_clusters != -1 && sbi->free_clus_valid)
-		goto out;
+	unsigned long reada_blocks, reada_mask;
+	int err = 0;
 
 	reada_blocks = FAT_READA_SIZE >> sb->s_blocksize_bits;
 	reada_mask = reada_blocks - 1;
-	cur_block = 0;
 
-	free = 0;
 	fatent_init(&fatent);
-	fatent_set_entry(&fatent, FAT_START_ENT);
-	while (fatent.entry < sbi->max_cluster) {
+	fatent_set_entry(&fatent, sbi->bitmap_scanned);
+	while (nr_blocks-- && fatent.entry < sbi->max_cluster) {
+		sector_t blocknr;
+		int offset;
+
 		/* readahead of fat blocks */
-		if ((cur_block & reada_mask) == 0) {
-			unsigned long rest = sbi->fat_length - cur_block;
+		ops->ent_blocknr(sb, fatent.entry, &offset, &blocknr);
+		blocknr -= sbi->fat_start;
+		if ((blocknr & reada_mask) == 0) {
+			unsigned long rest = sbi->fat_length - blocknr;
 			fat_ent_reada(sb, &fatent, min(reada_blocks, rest));
 		}
-		cur_block++;
 
 		err = fat_ent_read_block(sb, &fatent);
 		if (err)
-			goto out;
+			break;
 
 		do {
-			if (ops->ent_get(&fatent) == FAT_ENT_FREE)
-				free++;
+			if (ops->ent_get(&fatent) == FAT_ENT_FREE) {
+				if (sbi->free_bitmap)
+					__set_bit(fatent.entry,
+						  sbi->free_bitmap);
+				sbi->bitmap_free++;
+			}
 		} while (fat_ent_next(sbi, &fatent));
+		sbi->bitmap_scanned = fatent.entry;
 	}
-	sbi->free_clusters = free;
-	sbi->free_clus_valid = 1;
-	sb->s_dirt = 1;
 	fatent_brelse(&fatent);
+
+	if (!err && sbi->bitmap_scanned >= sbi->max_cluster) {
+		sbi->bitmap_scanned = sbi->max_cluster;
+		sbi->free_clusters = sbi->bitmap_free;
+		sbi->free_clus_valid = 1;
+		sb->s_dirt = 1;
+	}
+	return err;
+}
+
+int fat_count_free_clusters(struct super_block *sb)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	int err = 0;
+
+	lock_fat(sbi);
+	if (sbi->free_clusters != -1 && sbi->free_clus_valid)
+		goto out;
+
+	/* Finish whatever the background scan has left */
+	err = fat_bitmap_scan(sb, ULONG_MAX);
 out:
 	unlock_fat(sbi);
 	return err;
 }
+
+static struct workqueue_struct *fat_bitmap_wq;
+
+/* FAT blocks scanned per fat_lock hold by the background scan */
+#define FAT_SCAN_BLOCKS		16
+
+/*
+ * Build the free cluster bitmap in the background after mount, so that
+ * neither the first statfs() nor allocations on a nearly full volume
+ * have to walk the whole FAT.  fat_lock is dropped every few blocks to
+ * let allocations and frees in.
+ */
+static void fat_bitmap_work(struct work_struct *work)
+{
+	struct msdos_sb_info *sbi =
+		container_of(work, struct msdos_sb_info, bitmap_work);
+	int err = 0;
+
+	while (!sbi->bitmap_stop && !err) {
+		lock_fat(sbi);
+		if (sbi->bitmap_scanned >= sbi->max_cluster) {
+			unlock_fat(sbi);
+			break;
+		}
+		err = fat_bitmap_scan(sbi->sb, FAT_SCAN_BLOCKS);
+		unlock_fat(sbi);
+		cond_resched();
+	}
+}
+
+void fat_ent_start_scan(struct super_block *sb)
+{
+	queue_work(fat_bitmap_wq, &MSDOS_SB(sb)->bitmap_work);
+}
+
+void fat_ent_release(struct super_block *sb)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+
+	if (sbi->sb) {
+		sbi->bitmap_stop = 1;
+		cancel_work_sync(&sbi->bitmap_work);
+	}
+	vfree(sbi->free_bitmap);
+	sbi->free_bitmap = NULL;
+}
+
+int __init fat_bitmap_init(void)
+{
+	fat_bitmap_wq = create_singlethread_workqueue("fat_scan");
+	if (!fat_bitmap_wq)
+		return -ENOMEM;
+	return 0;
+}
+
+void fat_bitmap_destroy(void)
+{
+	destroy_workqueue(fat_bitmap_wq);
+}
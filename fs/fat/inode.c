@@ -451,6 +451,7 @@ static void fat_put_super(struct super_block *sb)
 {
 	struct msdos_sb_info *sbi = MSDOS_SB(sb);
 
+	fat_ent_release(sb);
 	if (sbi->nls_disk) {
 		unload_nls(sbi->nls_disk);
 		sbi->nls_disk = NULL;
@@ -1424,6 +1425,7 @@ int fat_fill_super(struct super_block *sb, void *data, int silent,
 		goto out_fail;
 	}
 
+	fat_ent_start_scan(sb);
 	return 0;
 
 out_invalid:
@@ -1435,6 +1437,7 @@ out_invalid:
 out_fail:
 	if (root_inode)
 		iput(root_inode);
+	fat_ent_release(sb);
 	if (sbi->nls_io)
 		unload_nls(sbi->nls_io);
 	if (sbi->nls_disk)
@@ -1510,8 +1513,14 @@ static int __init init_fat_fs(void)
 	if (err)
 		goto failed;
 
+	err = fat_bitmap_init();
+	if (err)
+		goto failed_inodecache;
+
 	return 0;
 
+failed_inodecache:
+	fat_destroy_inodecache();
 failed:
 	fat_cache_destroy();
 	return err;
@@ -1519,6 +1528,7 @@ failed:
 
 static void __exit exit_fat_fs(void)
 {
+	fat_bitmap_destroy();
 	fat_cache_destroy();
 	fat_destroy_inodecache();
 }
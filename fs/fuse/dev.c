@@ -14,22 +14,33 @@
 #include <linux/uio.h>
 #include <linux/miscdevice.h>
 #include <linux/pagemap.h>
+#include <linux/swap.h>
 #include <linux/file.h>
 #include <linux/slab.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/splice.h>
 
 MODULE_ALIAS_MISCDEV(FUSE_MINOR);
 
 static struct kmem_cache *fuse_req_cachep;
 
-static struct fuse_conn *fuse_get_conn(struct file *file)
+static struct fuse_dev *fuse_get_dev(struct file *file)
 {
 	/*
 	 * Lockless access is OK, because file->private data is set
-	 * once during mount and is valid until the file is released.
+	 * once during mount or clone and is valid until the file is
+	 * released.
 	 */
 	return file->private_data;
 }
 
+static struct fuse_conn *fuse_get_conn(struct file *file)
+{
+	struct fuse_dev *fud = fuse_get_dev(file);
+
+	return fud ? fud->fc : NULL;
+}
+
 static void fuse_request_init(struct fuse_req *req)
 {
 	memset(req, 0, sizeof(*req));
@@ -230,19 +241,69 @@ static u64 fuse_get_unique(struct fuse_conn *fc)
 	return fc->reqctr;
 }
 
+/*
+ * Wake up a reader of @fud, or of some other device of the connection
+ * if nobody is waiting on @fud or @fud already has more requests pending
+ * than the one just queued.  A reader woken for those may not have run
+ * yet and still be on the wait queue, so waking @fud again would leave
+ * the readers of idle devices asleep.  Whoever wakes up takes the
+ * request from whichever device it was queued on.
+ *
+ * Called with fc->lock held
+ */
+static void fuse_wake_reader(struct fuse_conn *fc, struct fuse_dev *fud)
+{
+	struct fuse_dev *d, *other = NULL;
+	int waiting = waitqueue_active(&fud->waitq);
+
+	if (!waiting || (!list_empty(&fud->pending) &&
+			 !list_is_singular(&fud->pending))) {
+		list_for_each_entry(d, &fc->devices, entry) {
+			if (d == fud || !waitqueue_active(&d->waitq))
+				continue;
+			if (list_empty(&d->pending)) {
+				other = d;
+				break;
+			}
+			if (!other)
+				other = d;
+		}
+		if (other && (!waiting || list_empty(&other->pending)))
+			fud = other;
+	}
+	wake_up(&fud->waitq);
+	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+}
+
+/* Called with fc->lock held */
+void fuse_wake_all_readers(struct fuse_conn *fc)
+{
+	struct fuse_dev *fud;
+
+	list_for_each_entry(fud, &fc->devices, entry)
+		wake_up_all(&fud->waitq);
+}
+
+/*
+ * Queue the request on the device serving the submitting CPU, so that
+ * requests from different CPUs are spread over the clones of the
+ * device instead of all going through a single list.
+ */
 static void queue_request(struct fuse_conn *fc, struct fuse_req *req)
 {
+	struct fuse_dev *fud = fc->cpu_dev[smp_processor_id()];
+
 	req->in.h.unique = fuse_get_unique(fc);
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
-	list_add_tail(&req->list, &fc->pending);
+	list_add_tail(&req->list, &fud->pending);
+	fc->num_pending++;
 	req->state = FUSE_REQ_PENDING;
 	if (!req->waiting) {
 		req->waiting = 1;
 		atomic_inc(&fc->num_waiting);
 	}
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	fuse_wake_reader(fc, fud);
 }
 
 static void flush_bg_queue(struct fuse_conn *fc)
@@ -275,6 +336,8 @@ static void request_end(struct fuse_conn *fc, struct fuse_req *req)
 	req->end = NULL;
 	list_del(&req->list);
 	list_del(&req->intr_entry);
+	if (req->state == FUSE_REQ_PENDING)
+		fc->num_pending--;
 	req->state = FUSE_REQ_FINISHED;
 	if (req->background) {
 		if (fc->num_background == FUSE_MAX_BACKGROUND) {
@@ -313,8 +376,7 @@ static void wait_answer_interruptible(struct fuse_conn *fc,
 static void queue_interrupt(struct fuse_conn *fc, struct fuse_req *req)
 {
 	list_add_tail(&req->intr_entry, &fc->interrupts);
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	fuse_wake_reader(fc, fc->cpu_dev[smp_processor_id()]);
 }
 
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
@@ -350,6 +412,7 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 		/* Request is not yet in userspace, bail out */
 		if (req->state == FUSE_REQ_PENDING) {
 			list_del(&req->list);
+			fc->num_pending--;
 			__fuse_put_request(req);
 			req->out.h.error = -EINTR;
 			return;
@@ -485,11 +548,25 @@ static void unlock_request(struct fuse_conn *fc, struct fuse_req *req)
 	}
 }
 
+/*
+ * The request is copied to or from one of three kinds of buffer: the
+ * userspace iovec of read()/write(), freshly allocated pages collected
+ * in @spd to be spliced into a pipe, or the pipe buffers taken off a
+ * pipe that is spliced to the device (@pipebufs, @nr_segs of them).
+ * With @move_pages, whole pipe pages replace page cache pages of the
+ * request instead of being copied into them.
+ */
 struct fuse_copy_state {
 	struct fuse_conn *fc;
 	int write;
+	int move_pages;
 	struct fuse_req *req;
 	const struct iovec *iov;
+	struct splice_pipe_desc *spd;
+	unsigned max_pages;
+	struct pipe_inode_info *pipe;
+	struct pipe_buffer *pipebufs;
+	struct pipe_buffer *currbuf;
 	unsigned long nr_segs;
 	unsigned long seglen;
 	unsigned long addr;
@@ -514,7 +591,20 @@ static void fuse_copy_init(struct fuse_copy_state *cs, struct fuse_conn *fc,
 /* Unmap and put previous page of userspace buffer */
 static void fuse_copy_finish(struct fuse_copy_state *cs)
 {
-	if (cs->mapaddr) {
+	if (cs->currbuf) {
+		struct pipe_buffer *buf = cs->currbuf;
+
+		buf->ops->unmap(cs->pipe, buf, cs->mapaddr);
+		cs->currbuf = NULL;
+		cs->mapaddr = NULL;
+	} else if (cs->spd) {
+		if (cs->mapaddr) {
+			kunmap_atomic(cs->mapaddr, KM_USER0);
+			cs->spd->partial[cs->spd->nr_pages - 1].len =
+				PAGE_SIZE - cs->len;
+			cs->mapaddr = NULL;
+		}
+	} else if (cs->mapaddr) {
 		kunmap_atomic(cs->mapaddr, KM_USER0);
 		if (cs->write) {
 			flush_dcache_page(cs->pg);
@@ -536,6 +626,41 @@ static int fuse_copy_fill(struct fuse_copy_state *cs)
 
 	unlock_request(cs->fc, cs->req);
 	fuse_copy_finish(cs);
+	if (cs->spd) {
+		struct splice_pipe_desc *spd = cs->spd;
+		struct page *page;
+
+		if (spd->nr_pages == cs->max_pages)
+			return -EIO;
+		page = alloc_page(GFP_HIGHUSER);
+		if (!page)
+			return -ENOMEM;
+		spd->pages[spd->nr_pages] = page;
+		spd->partial[spd->nr_pages].offset = 0;
+		spd->partial[spd->nr_pages].len = 0;
+		spd->partial[spd->nr_pages].private = 0;
+		spd->nr_pages++;
+
+		cs->mapaddr = kmap_atomic(page, KM_USER0);
+		cs->buf = cs->mapaddr;
+		cs->len = PAGE_SIZE;
+		return lock_request(cs->fc, cs->req);
+	}
+	if (cs->pipebufs) {
+		struct pipe_buffer *buf = cs->pipebufs;
+
+		BUG_ON(!cs->nr_segs);
+		err = buf->ops->confirm(cs->pipe, buf);
+		if (err)
+			return err;
+		cs->currbuf = buf;
+		cs->mapaddr = buf->ops->map(cs->pipe, buf, 1);
+		cs->buf = cs->mapaddr + buf->offset;
+		cs->len = buf->len;
+		cs->pipebufs++;
+		cs->nr_segs--;
+		return lock_request(cs->fc, cs->req);
+	}
 	if (!cs->seglen) {
 		BUG_ON(!cs->nr_segs);
 		cs->seglen = cs->iov[0].iov_len;
@@ -577,13 +702,122 @@ static int fuse_copy_do(struct fuse_copy_state *cs, void **val, unsigned *size)
 	return ncpy;
 }
 
+/*
+ * Splicing a reply from a pipe: instead of copying a whole page of
+ * data into a page cache page of the request, steal the pipe's page
+ * and put it in the page cache in place of the request's page.
+ * Returns 1 if the page can't be moved, with the pipe buffer mapped
+ * to be copied from instead.
+ */
+static int fuse_try_move_page(struct fuse_copy_state *cs, struct page **pagep)
+{
+	struct page *oldpage = *pagep;
+	struct page *newpage;
+	struct pipe_buffer *buf = cs->pipebufs;
+	int err;
+
+	unlock_request(cs->fc, cs->req);
+	fuse_copy_finish(cs);
+
+	BUG_ON(!cs->nr_segs);
+	err = buf->ops->confirm(cs->pipe, buf);
+	if (err)
+		return err;
+	cs->pipebufs++;
+	cs->nr_segs--;
+
+	if (buf->offset || buf->len != PAGE_SIZE)
+		goto out_fallback;
+	if (buf->ops->steal(cs->pipe, buf))
+		goto out_fallback;
+
+	/* a stolen page comes back locked */
+	newpage = buf->page;
+	if (newpage->mapping || page_mapped(newpage) ||
+	    PagePrivate(newpage) || PageDirty(newpage) ||
+	    PageWriteback(newpage) || PageMlocked(newpage))
+		goto out_fallback_unlock;
+	flush_dcache_page(newpage);
+	SetPageUptodate(newpage);
+	ClearPageMappedToDisk(newpage);
+
+	/* the request must not be ended while its page is replaced */
+	err = lock_request(cs->fc, cs->req);
+	if (err) {
+		unlock_page(newpage);
+		return err;
+	}
+
+	/* a page being read in is locked, so nobody else uses it */
+	if (WARN_ON(page_mapped(oldpage) || PagePrivate(oldpage) ||
+		    PageDirty(oldpage) || PageWriteback(oldpage)) ||
+	    replace_page_cache_page(oldpage, newpage, GFP_KERNEL)) {
+		unlock_page(newpage);
+		goto out_fallback_locked;
+	}
+
+	page_cache_get(newpage);
+	if (!(buf->flags & PIPE_BUF_FLAG_LRU))
+		lru_cache_add_file(newpage);
+	*pagep = newpage;
+
+	unlock_page(oldpage);
+	page_cache_release(oldpage);
+	cs->len = 0;
+	return 0;
+
+out_fallback_unlock:
+	unlock_page(newpage);
+out_fallback:
+	err = lock_request(cs->fc, cs->req);
+	if (err)
+		return err;
+out_fallback_locked:
+	cs->currbuf = buf;
+	cs->mapaddr = buf->ops->map(cs->pipe, buf, 1);
+	cs->buf = cs->mapaddr + buf->offset;
+	cs->len = buf->len;
+	return 1;
+}
+
+/*
+ * Splicing a request into a pipe: instead of copying a page of the
+ * request, put a reference to it in the pipe
+ */
+static int fuse_ref_page(struct fuse_copy_state *cs, struct page *page,
+			 unsigned offset, unsigned count)
+{
+	struct splice_pipe_desc *spd = cs->spd;
+
+	if (spd->nr_pages == cs->max_pages)
+		return -EIO;
+
+	unlock_request(cs->fc, cs->req);
+	fuse_copy_finish(cs);
+
+	page_cache_get(page);
+	spd->pages[spd->nr_pages] = page;
+	spd->partial[spd->nr_pages].offset = offset;
+	spd->partial[spd->nr_pages].len = count;
+	spd->partial[spd->nr_pages].private = 0;
+	spd->nr_pages++;
+	cs->len = 0;
+
+	return lock_request(cs->fc, cs->req);
+}
+
 /*
  * Copy a page in the request to/from the userspace buffer.  Must be
  * done atomically
  */
-static int fuse_copy_page(struct fuse_copy_state *cs, struct page *page,
+static int fuse_copy_page(struct fuse_copy_state *cs, struct page **pagep,
 			  unsigned offset, unsigned count, int zeroing)
 {
+	struct page *page = *pagep;
+
+	if (cs->spd && page && count)
+		return fuse_ref_page(cs, page, offset, count);
+
 	if (page && zeroing && count < PAGE_SIZE) {
 		void *mapaddr = kmap_atomic(page, KM_USER1);
 		memset(mapaddr, 0, PAGE_SIZE);
@@ -591,7 +825,12 @@ static int fuse_copy_page(struct fuse_copy_state *cs, struct page *page,
 	}
 	while (count) {
 		int err;
-		if (!cs->len && (err = fuse_copy_fill(cs)))
+		if (!cs->len && cs->move_pages && page &&
+		    offset == 0 && count == PAGE_SIZE) {
+			err = fuse_try_move_page(cs, pagep);
+			if (err <= 0)
+				return err;
+		} else if (!cs->len && (err = fuse_copy_fill(cs)))
 			return err;
 		if (page) {
 			void *mapaddr = kmap_atomic(page, KM_USER1);
@@ -616,8 +855,8 @@ static int fuse_copy_pages(struct fuse_copy_state *cs, unsigned nbytes,
 	unsigned count = min(nbytes, (unsigned) PAGE_SIZE - offset);
 
 	for (i = 0; i < req->num_pages && (nbytes || zeroing); i++) {
-		struct page *page = req->pages[i];
-		int err = fuse_copy_page(cs, page, offset, count, zeroing);
+		int err = fuse_copy_page(cs, &req->pages[i], offset, count,
+					 zeroing);
 		if (err)
 			return err;
 
@@ -660,15 +899,40 @@ static int fuse_copy_args(struct fuse_copy_state *cs, unsigned numargs,
 
 static int request_pending(struct fuse_conn *fc)
 {
-	return !list_empty(&fc->pending) || !list_empty(&fc->interrupts);
+	return fc->num_pending || !list_empty(&fc->interrupts);
+}
+
+/*
+ * Take the oldest request queued on @fud, or if there is none, on one
+ * of the other devices of the connection, so that a busy reader of
+ * another clone does not hold up requests queued there.
+ */
+static struct fuse_req *request_next(struct fuse_dev *fud)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct list_head *head = &fud->pending;
+	struct fuse_dev *d;
+
+	if (list_empty(head)) {
+		list_for_each_entry(d, &fc->devices, entry) {
+			if (!list_empty(&d->pending)) {
+				head = &d->pending;
+				break;
+			}
+		}
+	}
+	BUG_ON(list_empty(head));
+	fc->num_pending--;
+	return list_entry(head->next, struct fuse_req, list);
 }
 
 /* Wait until a request is available on the pending list */
-static void request_wait(struct fuse_conn *fc)
+static void request_wait(struct fuse_dev *fud)
 {
+	struct fuse_conn *fc = fud->fc;
 	DECLARE_WAITQUEUE(wait, current);
 
-	add_wait_queue_exclusive(&fc->waitq, &wait);
+	add_wait_queue_exclusive(&fud->waitq, &wait);
 	while (fc->connected && !request_pending(fc)) {
 		set_current_state(TASK_INTERRUPTIBLE);
 		if (signal_pending(current))
@@ -679,7 +943,7 @@ static void request_wait(struct fuse_conn *fc)
 		spin_lock(&fc->lock);
 	}
 	set_current_state(TASK_RUNNING);
-	remove_wait_queue(&fc->waitq, &wait);
+	remove_wait_queue(&fud->waitq, &wait);
 }
 
 /*
@@ -691,10 +955,9 @@ static void request_wait(struct fuse_conn *fc)
  * Called with fc->lock held, releases it
  */
 static int fuse_read_interrupt(struct fuse_conn *fc, struct fuse_req *req,
-			       const struct iovec *iov, unsigned long nr_segs)
+			       struct fuse_copy_state *cs, size_t nbytes)
 	__releases(fc->lock)
 {
-	struct fuse_copy_state cs;
 	struct fuse_in_header ih;
 	struct fuse_interrupt_in arg;
 	unsigned reqsize = sizeof(ih) + sizeof(arg);
@@ -710,14 +973,13 @@ static int fuse_read_interrupt(struct fuse_conn *fc, struct fuse_req *req,
 	arg.unique = req->in.h.unique;
 
 	spin_unlock(&fc->lock);
-	if (iov_length(iov, nr_segs) < reqsize)
+	if (nbytes < reqsize)
 		return -EINVAL;
 
-	fuse_copy_init(&cs, fc, 1, NULL, iov, nr_segs);
-	err = fuse_copy_one(&cs, &ih, sizeof(ih));
+	err = fuse_copy_one(cs, &ih, sizeof(ih));
 	if (!err)
-		err = fuse_copy_one(&cs, &arg, sizeof(arg));
-	fuse_copy_finish(&cs);
+		err = fuse_copy_one(cs, &arg, sizeof(arg));
+	fuse_copy_finish(cs);
 
 	return err ? err : reqsize;
 }
@@ -731,18 +993,14 @@ static int fuse_read_interrupt(struct fuse_conn *fc, struct fuse_req *req,
  * request_end().  Otherwise add it to the processing list, and set
  * the 'sent' flag.
  */
-static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
-			      unsigned long nr_segs, loff_t pos)
+static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
+				struct fuse_copy_state *cs, size_t nbytes)
 {
 	int err;
 	struct fuse_req *req;
 	struct fuse_in *in;
-	struct fuse_copy_state cs;
 	unsigned reqsize;
-	struct file *file = iocb->ki_filp;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
-		return -EPERM;
+	struct fuse_conn *fc = fud->fc;
 
  restart:
 	spin_lock(&fc->lock);
@@ -751,7 +1009,7 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
 	    !request_pending(fc))
 		goto err_unlock;
 
-	request_wait(fc);
+	request_wait(fud);
 	err = -ENODEV;
 	if (!fc->connected)
 		goto err_unlock;
@@ -762,17 +1020,17 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
 	if (!list_empty(&fc->interrupts)) {
 		req = list_entry(fc->interrupts.next, struct fuse_req,
 				 intr_entry);
-		return fuse_read_interrupt(fc, req, iov, nr_segs);
+		return fuse_read_interrupt(fc, req, cs, nbytes);
 	}
 
-	req = list_entry(fc->pending.next, struct fuse_req, list);
+	req = request_next(fud);
 	req->state = FUSE_REQ_READING;
 	list_move(&req->list, &fc->io);
 
 	in = &req->in;
 	reqsize = in->h.len;
 	/* If request is too large, reply with an error and restart the read */
-	if (iov_length(iov, nr_segs) < reqsize) {
+	if (nbytes < reqsize) {
 		req->out.h.error = -EIO;
 		/* SETXATTR is special, since it may contain too large data */
 		if (in->h.opcode == FUSE_SETXATTR)
@@ -781,12 +1039,12 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
 		goto restart;
 	}
 	spin_unlock(&fc->lock);
-	fuse_copy_init(&cs, fc, 1, req, iov, nr_segs);
-	err = fuse_copy_one(&cs, &in->h, sizeof(in->h));
+	cs->req = req;
+	err = fuse_copy_one(cs, &in->h, sizeof(in->h));
 	if (!err)
-		err = fuse_copy_args(&cs, in->numargs, in->argpages,
+		err = fuse_copy_args(cs, in->numargs, in->argpages,
 				     (struct fuse_arg *) in->args, 0);
-	fuse_copy_finish(&cs);
+	fuse_copy_finish(cs);
 	spin_lock(&fc->lock);
 	req->locked = 0;
 	if (req->aborted) {
@@ -802,7 +1060,7 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
 		request_end(fc, req);
 	else {
 		req->state = FUSE_REQ_SENT;
-		list_move_tail(&req->list, &fc->processing);
+		list_move_tail(&req->list, &fud->processing);
 		if (req->interrupted)
 			queue_interrupt(fc, req);
 		spin_unlock(&fc->lock);
@@ -814,12 +1072,139 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
 	return err;
 }
 
-/* Look up request on processing list by unique ID */
-static struct fuse_req *request_find(struct fuse_conn *fc, u64 unique)
+static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
+			      unsigned long nr_segs, loff_t pos)
+{
+	struct fuse_copy_state cs;
+	struct file *file = iocb->ki_filp;
+	struct fuse_dev *fud = fuse_get_dev(file);
+	if (!fud)
+		return -EPERM;
+
+	fuse_copy_init(&cs, fud->fc, 1, NULL, iov, nr_segs);
+	return fuse_dev_do_read(fud, file, &cs, iov_length(iov, nr_segs));
+}
+
+static void fuse_dev_pipe_buf_release(struct pipe_inode_info *pipe,
+				      struct pipe_buffer *buf)
+{
+	page_cache_release(buf->page);
+}
+
+/* Pages of the request may still be in use by the filesystem */
+static int fuse_dev_pipe_buf_steal(struct pipe_inode_info *pipe,
+				   struct pipe_buffer *buf)
+{
+	return 1;
+}
+
+static const struct pipe_buf_operations fuse_dev_pipe_buf_ops = {
+	.can_merge = 0,
+	.map = generic_pipe_buf_map,
+	.unmap = generic_pipe_buf_unmap,
+	.confirm = generic_pipe_buf_confirm,
+	.release = fuse_dev_pipe_buf_release,
+	.steal = fuse_dev_pipe_buf_steal,
+	.get = generic_pipe_buf_get,
+};
+
+static void fuse_dev_spd_release(struct splice_pipe_desc *spd, unsigned int i)
+{
+	page_cache_release(spd->pages[i]);
+}
+
+/*
+ * Wait for a free slot in the pipe and return the number of free
+ * slots.  A request taken off the pending list must not be left
+ * half-way in the pipe, so it is limited to what fits right now.
+ */
+static int fuse_dev_pipe_room(struct pipe_inode_info *pipe, unsigned flags)
+{
+	int ret;
+
+	if (pipe->inode)
+		mutex_lock(&pipe->inode->i_mutex);
+	for (;;) {
+		if (!pipe->readers) {
+			send_sig(SIGPIPE, current, 0);
+			ret = -EPIPE;
+			break;
+		}
+		ret = pipe->buffers - pipe->nrbufs;
+		if (ret)
+			break;
+		if (flags & SPLICE_F_NONBLOCK) {
+			ret = -EAGAIN;
+			break;
+		}
+		if (signal_pending(current)) {
+			ret = -ERESTARTSYS;
+			break;
+		}
+		pipe->waiting_writers++;
+		pipe_wait(pipe);
+		pipe->waiting_writers--;
+	}
+	if (pipe->inode)
+		mutex_unlock(&pipe->inode->i_mutex);
+	return ret;
+}
+
+/*
+ * Read a request into a pipe.  The header and arguments are copied
+ * into new pages, but the data pages of the request (e.g. of a WRITE)
+ * are spliced into the pipe by reference, so that the filesystem can
+ * splice them on to their destination without ever copying them.
+ */
+static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
+				    struct pipe_inode_info *pipe,
+				    size_t len, unsigned int flags)
+{
+	struct page *pages[PIPE_DEF_BUFFERS];
+	struct partial_page partial[PIPE_DEF_BUFFERS];
+	struct splice_pipe_desc spd = {
+		.pages = pages,
+		.partial = partial,
+		.flags = flags & ~SPLICE_F_NONBLOCK,
+		.ops = &fuse_dev_pipe_buf_ops,
+		.spd_release = fuse_dev_spd_release,
+	};
+	struct fuse_copy_state cs;
+	struct fuse_dev *fud = fuse_get_dev(in);
+	ssize_t ret;
+	int room;
+
+	if (!fud)
+		return -EPERM;
+
+	room = fuse_dev_pipe_room(pipe, flags);
+	if (room < 0)
+		return room;
+
+	if (splice_grow_spd(pipe, &spd))
+		return -ENOMEM;
+
+	fuse_copy_init(&cs, fud->fc, 1, NULL, NULL, 0);
+	cs.spd = &spd;
+	cs.max_pages = min_t(unsigned, room, spd.nr_pages_max);
+	ret = fuse_dev_do_read(fud, in, &cs, len);
+	if (ret > 0)
+		ret = splice_to_pipe(pipe, &spd);
+	else {
+		while (spd.nr_pages)
+			fuse_dev_spd_release(&spd, --spd.nr_pages);
+	}
+	splice_shrink_spd(&spd);
+
+	return ret;
+}
+
+/* Look up request on the processing list of @fud by unique ID */
+static struct fuse_req *__request_find(struct fuse_dev *fud, u64 unique)
 {
 	struct list_head *entry;
 
-	list_for_each(entry, &fc->processing) {
+	list_for_each(entry, &fud->processing) {
 		struct fuse_req *req;
 		req = list_entry(entry, struct fuse_req, list);
 		if (req->in.h.unique == unique || req->intr_unique == unique)
@@ -828,6 +1213,27 @@ static struct fuse_req *request_find(struct fuse_conn *fc, u64 unique)
 	return NULL;
 }
 
+/*
+ * Look up request on processing lists by unique ID.  The reply usually
+ * comes in on the device the request was read from, so that is
+ * searched first.
+ */
+static struct fuse_req *request_find(struct fuse_dev *fud, u64 unique)
+{
+	struct fuse_req *req;
+	struct fuse_dev *d;
+
+	req = __request_find(fud, unique);
+	if (req)
+		return req;
+
+	list_for_each_entry(d, &fud->fc->devices, entry) {
+		if (d != fud && (req = __request_find(d, unique)))
+			return req;
+	}
+	return NULL;
+}
+
 static int copy_out_args(struct fuse_copy_state *cs, struct fuse_out *out,
 			 unsigned nbytes)
 {
@@ -858,23 +1264,18 @@ static int copy_out_args(struct fuse_copy_state *cs, struct fuse_out *out,
  * it from the list and copy the rest of the buffer to the request.
  * The request is finished by calling request_end()
  */
-static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
-			       unsigned long nr_segs, loff_t pos)
+static ssize_t fuse_dev_do_write(struct fuse_dev *fud,
+				 struct fuse_copy_state *cs, size_t nbytes)
 {
 	int err;
-	unsigned nbytes = iov_length(iov, nr_segs);
 	struct fuse_req *req;
 	struct fuse_out_header oh;
-	struct fuse_copy_state cs;
-	struct fuse_conn *fc = fuse_get_conn(iocb->ki_filp);
-	if (!fc)
-		return -EPERM;
+	struct fuse_conn *fc = fud->fc;
 
-	fuse_copy_init(&cs, fc, 0, NULL, iov, nr_segs);
 	if (nbytes < sizeof(struct fuse_out_header))
 		return -EINVAL;
 
-	err = fuse_copy_one(&cs, &oh, sizeof(oh));
+	err = fuse_copy_one(cs, &oh, sizeof(oh));
 	if (err)
 		goto err_finish;
 	err = -EINVAL;
@@ -887,13 +1288,13 @@ static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
 	if (!fc->connected)
 		goto err_unlock;
 
-	req = request_find(fc, oh.unique);
+	req = request_find(fud, oh.unique);
 	if (!req)
 		goto err_unlock;
 
 	if (req->aborted) {
 		spin_unlock(&fc->lock);
-		fuse_copy_finish(&cs);
+		fuse_copy_finish(cs);
 		spin_lock(&fc->lock);
 		request_end(fc, req);
 		return -ENOENT;
@@ -910,7 +1311,7 @@ static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
 			queue_interrupt(fc, req);
 
 		spin_unlock(&fc->lock);
-		fuse_copy_finish(&cs);
+		fuse_copy_finish(cs);
 		return nbytes;
 	}
 
@@ -918,11 +1319,13 @@ static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
 	list_move(&req->list, &fc->io);
 	req->out.h = oh;
 	req->locked = 1;
-	cs.req = req;
+	cs->req = req;
+	if (!req->out.page_replace)
+		cs->move_pages = 0;
 	spin_unlock(&fc->lock);
 
-	err = copy_out_args(&cs, &req->out, nbytes);
-	fuse_copy_finish(&cs);
+	err = copy_out_args(cs, &req->out, nbytes);
+	fuse_copy_finish(cs);
 
 	spin_lock(&fc->lock);
 	req->locked = 0;
@@ -938,18 +1341,127 @@ static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
  err_unlock:
 	spin_unlock(&fc->lock);
  err_finish:
-	fuse_copy_finish(&cs);
+	fuse_copy_finish(cs);
 	return err;
 }
 
+static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
+			       unsigned long nr_segs, loff_t pos)
+{
+	struct fuse_copy_state cs;
+	struct fuse_dev *fud = fuse_get_dev(iocb->ki_filp);
+	if (!fud)
+		return -EPERM;
+
+	fuse_copy_init(&cs, fud->fc, 0, NULL, iov, nr_segs);
+	return fuse_dev_do_write(fud, &cs, iov_length(iov, nr_segs));
+}
+
+/*
+ * Write a reply from a pipe.  The pipe buffers making up the reply are
+ * taken off the pipe first, so that the pipe lock is not held while
+ * the reply is copied into the request.  With SPLICE_F_MOVE, whole
+ * pages of a reply to a page cache read are moved instead of copied.
+ */
+static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
+				     struct file *out, loff_t *ppos,
+				     size_t len, unsigned int flags)
+{
+	unsigned nbuf;
+	unsigned idx;
+	struct pipe_buffer *bufs;
+	struct fuse_copy_state cs;
+	struct fuse_dev *fud = fuse_get_dev(out);
+	size_t rem;
+	ssize_t ret;
+
+	if (!fud)
+		return -EPERM;
+
+	/* F_SETPIPE_SZ may resize the pipe until it is locked */
+	if (pipe->inode)
+		mutex_lock(&pipe->inode->i_mutex);
+
+	bufs = kmalloc(pipe->buffers * sizeof(struct pipe_buffer), GFP_KERNEL);
+	if (!bufs) {
+		if (pipe->inode)
+			mutex_unlock(&pipe->inode->i_mutex);
+		return -ENOMEM;
+	}
+
+	nbuf = 0;
+	rem = 0;
+	for (idx = 0; idx < pipe->nrbufs && rem < len; idx++)
+		rem += pipe->bufs[(pipe->curbuf + idx) &
+				  (pipe->buffers - 1)].len;
+
+	ret = -EINVAL;
+	if (rem < len) {
+		if (pipe->inode)
+			mutex_unlock(&pipe->inode->i_mutex);
+		goto out;
+	}
+
+	rem = len;
+	while (rem) {
+		struct pipe_buffer *ibuf;
+		struct pipe_buffer *obuf;
+
+		BUG_ON(nbuf >= pipe->buffers);
+		BUG_ON(!pipe->nrbufs);
+		ibuf = &pipe->bufs[pipe->curbuf];
+		obuf = &bufs[nbuf];
+
+		if (rem >= ibuf->len) {
+			*obuf = *ibuf;
+			ibuf->ops = NULL;
+			pipe->curbuf = (pipe->curbuf + 1) & (pipe->buffers - 1);
+			pipe->nrbufs--;
+		} else {
+			ibuf->ops->get(pipe, ibuf);
+			*obuf = *ibuf;
+			obuf->flags &= ~PIPE_BUF_FLAG_GIFT;
+			obuf->len = rem;
+			ibuf->offset += obuf->len;
+			ibuf->len -= obuf->len;
+		}
+		nbuf++;
+		rem -= obuf->len;
+	}
+	if (pipe->inode) {
+		mutex_unlock(&pipe->inode->i_mutex);
+		smp_mb();
+		if (waitqueue_active(&pipe->wait))
+			wake_up_interruptible(&pipe->wait);
+		kill_fasync(&pipe->fasync_writers, SIGIO, POLL_OUT);
+	}
+
+	fuse_copy_init(&cs, fud->fc, 0, NULL, NULL, nbuf);
+	cs.pipebufs = bufs;
+	cs.pipe = pipe;
+	if (flags & SPLICE_F_MOVE)
+		cs.move_pages = 1;
+	ret = fuse_dev_do_write(fud, &cs, len);
+
+	for (idx = 0; idx < nbuf; idx++) {
+		struct pipe_buffer *buf = &bufs[idx];
+		buf->ops->release(pipe, buf);
+	}
+ out:
+	kfree(bufs);
+	return ret;
+}
+
 static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 {
 	unsigned mask = POLLOUT | POLLWRNORM;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(file);
+	struct fuse_conn *fc;
+	if (!fud)
 		return POLLERR;
 
-	poll_wait(file, &fc->waitq, wait);
+	fc = fud->fc;
+	poll_wait(file, &fud->waitq, wait);
 
 	spin_lock(&fc->lock);
 	if (!fc->connected)
@@ -1036,33 +1548,146 @@ void fuse_abort_conn(struct fuse_conn *fc)
 {
 	spin_lock(&fc->lock);
 	if (fc->connected) {
+		struct fuse_dev *fud;
+
 		fc->connected = 0;
 		fc->blocked = 0;
 		end_io_requests(fc);
-		end_requests(fc, &fc->pending);
-		end_requests(fc, &fc->processing);
-		wake_up_all(&fc->waitq);
+		list_for_each_entry(fud, &fc->devices, entry) {
+			end_requests(fc, &fud->pending);
+			end_requests(fc, &fud->processing);
+		}
+		fuse_wake_all_readers(fc);
 		wake_up_all(&fc->blocked_waitq);
 		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 	}
 	spin_unlock(&fc->lock);
 }
 
-static int fuse_dev_release(struct inode *inode, struct file *file)
+/*
+ * Point each CPU at one of the devices, spreading the CPUs evenly over
+ * them.  Called with fc->lock held
+ */
+static void fuse_map_devices(struct fuse_conn *fc)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (fc) {
-		spin_lock(&fc->lock);
+	struct list_head *pos = &fc->devices;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		pos = pos->next;
+		if (pos == &fc->devices)
+			pos = pos->next;
+		if (pos == &fc->devices)
+			fc->cpu_dev[cpu] = NULL;
+		else
+			fc->cpu_dev[cpu] = list_entry(pos, struct fuse_dev,
+						      entry);
+	}
+}
+
+struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc)
+{
+	struct fuse_dev *fud;
+
+	fud = kzalloc(sizeof(struct fuse_dev), GFP_KERNEL);
+	if (!fud)
+		return NULL;
+
+	fud->fc = fuse_conn_get(fc);
+	INIT_LIST_HEAD(&fud->pending);
+	INIT_LIST_HEAD(&fud->processing);
+	init_waitqueue_head(&fud->waitq);
+
+	spin_lock(&fc->lock);
+	list_add_tail(&fud->entry, &fc->devices);
+	fuse_map_devices(fc);
+	spin_unlock(&fc->lock);
+
+	return fud;
+}
+
+/*
+ * When a clone is closed its queued requests are handed over to one of
+ * the remaining devices, and replies to the requests it has passed to
+ * userspace can still be written to any of them.  Closing the last
+ * device disconnects the filesystem.
+ */
+void fuse_dev_free(struct fuse_dev *fud)
+{
+	struct fuse_conn *fc = fud->fc;
+
+	spin_lock(&fc->lock);
+	if (list_is_singular(&fc->devices)) {
 		fc->connected = 0;
-		end_requests(fc, &fc->pending);
-		end_requests(fc, &fc->processing);
-		spin_unlock(&fc->lock);
-		fuse_conn_put(fc);
+		end_requests(fc, &fud->pending);
+		end_requests(fc, &fud->processing);
+		list_del(&fud->entry);
+	} else {
+		struct fuse_dev *next;
+
+		list_del(&fud->entry);
+		next = list_entry(fc->devices.next, struct fuse_dev, entry);
+		list_splice_init(&fud->pending, &next->pending);
+		list_splice_tail_init(&fud->processing, &next->processing);
+		if (fc->num_pending)
+			fuse_wake_reader(fc, next);
 	}
+	fuse_map_devices(fc);
+	spin_unlock(&fc->lock);
+
+	fuse_conn_put(fc);
+	kfree(fud);
+}
+
+static int fuse_dev_release(struct inode *inode, struct file *file)
+{
+	struct fuse_dev *fud = fuse_get_dev(file);
+	if (fud)
+		fuse_dev_free(fud);
 
 	return 0;
 }
 
+/*
+ * Attach this unmounted device file to the connection of an already
+ * mounted one, so that a multithreaded filesystem can give each thread
+ * its own request queue
+ */
+static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
+			   unsigned long arg)
+{
+	struct fuse_dev *fud;
+	struct file *old;
+	u32 oldfd;
+	int err;
+
+	if (cmd != FUSE_DEV_IOC_CLONE)
+		return -ENOTTY;
+
+	if (get_user(oldfd, (u32 __user *) arg))
+		return -EFAULT;
+
+	old = fget(oldfd);
+	if (!old)
+		return -EINVAL;
+
+	mutex_lock(&fuse_mutex);
+	err = -EINVAL;
+	if (old->f_op == &fuse_dev_operations && fuse_get_dev(old) &&
+	    !file->private_data) {
+		err = -ENOMEM;
+		fud = fuse_dev_alloc(fuse_get_conn(old));
+		if (fud) {
+			file->private_data = fud;
+			err = 0;
+		}
+	}
+	mutex_unlock(&fuse_mutex);
+	fput(old);
+
+	return err;
+}
+
 static int fuse_dev_fasync(int fd, struct file *file, int on)
 {
 	struct fuse_conn *fc = fuse_get_conn(file);
@@ -1080,9 +1705,13 @@ const struct file_operations fuse_dev_operations = {
 	.aio_read	= fuse_dev_read,
 	.write		= do_sync_write,
 	.aio_write	= fuse_dev_write,
+	.splice_read	= fuse_dev_splice_read,
+	.splice_write	= fuse_dev_splice_write,
 	.poll		= fuse_dev_poll,
 	.release	= fuse_dev_release,
 	.fasync		= fuse_dev_fasync,
+	.unlocked_ioctl	= fuse_dev_ioctl,
+	.compat_ioctl	= fuse_dev_ioctl,
 };
 
 static struct miscdevice fuse_miscdevice = {
@@ -157,6 +157,9 @@ struct fuse_out {
 	/** Zero partially or not copied pages */
 	unsigned page_zeroing:1;
 
+	/** Pages are page cache pages, which a spliced reply may replace */
+	unsigned page_replace:1;
+
 	/** Number or arguments */
 	unsigned numargs;
 
@@ -180,8 +183,8 @@ struct fuse_conn;
  * A request to the client
  */
 struct fuse_req {
-	/** This can be on either pending processing or io lists in
-	    fuse_conn */
+	/** This can be on either the pending or processing lists of a
+	    fuse_dev or on the io list of fuse_conn */
 	struct list_head list;
 
 	/** Entry on the interrupts list  */
@@ -278,6 +281,31 @@ struct fuse_req {
 	struct file *stolen_file;
 };
 
+/**
+ * An open /dev/fuse file attached to a connection
+ *
+ * The file the filesystem was mounted with has one, and so does every
+ * file cloned from it with FUSE_DEV_IOC_CLONE.  Each has its own queue
+ * of pending requests, so that daemon threads reading from different
+ * clones do not all contend for the same list and wait queue.
+ */
+struct fuse_dev {
+	/** The connection this device belongs to */
+	struct fuse_conn *fc;
+
+	/** Requests queued on this device, waiting to be read */
+	struct list_head pending;
+
+	/** Requests read from this device, waiting for a reply */
+	struct list_head processing;
+
+	/** Readers of this device are waiting on this */
+	wait_queue_head_t waitq;
+
+	/** Entry on fc->devices */
+	struct list_head entry;
+};
+
 /**
  * A Fuse connection.
  *
@@ -310,14 +338,15 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
-	/** Readers of the connection are waiting on this */
-	wait_queue_head_t waitq;
+	/** Devices attached to the connection (the mount fd and its
+	    clones) */
+	struct list_head devices;
 
-	/** The list of pending requests */
-	struct list_head pending;
+	/** Device whose queue new requests go on, indexed by CPU */
+	struct fuse_dev **cpu_dev;
 
-	/** The list of requests being processed */
-	struct list_head processing;
+	/** Number of requests on the pending lists of all devices */
+	unsigned num_pending;
 
 	/** The list of requests under I/O */
 	struct list_head io;
@@ -610,6 +639,21 @@ void request_send_background_locked(struct fuse_conn *fc, struct fuse_req *req);
 /* Abort all requests */
 void fuse_abort_conn(struct fuse_conn *fc);
 
+/**
+ * Attach a new device to the connection
+ */
+struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc);
+
+/**
+ * Detach a device from the connection and free it
+ */
+void fuse_dev_free(struct fuse_dev *fud);
+
+/**
+ * Wake up all readers of the connection's devices
+ */
+void fuse_wake_all_readers(struct fuse_conn *fc);
+
 /**
  * Invalidate inode attributes
  */
@@ -282,10 +282,10 @@ static void fuse_put_super(struct super_block *sb)
 	spin_lock(&fc->lock);
 	fc->connected = 0;
 	fc->blocked = 0;
-	spin_unlock(&fc->lock);
 	/* Flush all readers on this fs */
+	fuse_wake_all_readers(fc);
+	spin_unlock(&fc->lock);
 	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
-	wake_up_all(&fc->waitq);
 	wake_up_all(&fc->blocked_waitq);
 	wake_up_all(&fc->reserved_req_waitq);
 	mutex_lock(&fuse_mutex);
@@ -473,11 +473,9 @@ static struct fuse_conn *new_conn(struct super_block *sb)
 		spin_lock_init(&fc->lock);
 		mutex_init(&fc->inst_mutex);
 		atomic_set(&fc->count, 1);
-		init_waitqueue_head(&fc->waitq);
 		init_waitqueue_head(&fc->blocked_waitq);
 		init_waitqueue_head(&fc->reserved_req_waitq);
-		INIT_LIST_HEAD(&fc->pending);
-		INIT_LIST_HEAD(&fc->processing);
+		INIT_LIST_HEAD(&fc->devices);
 		INIT_LIST_HEAD(&fc->io);
 		INIT_LIST_HEAD(&fc->interrupts);
 		INIT_LIST_HEAD(&fc->bg_queue);
@@ -487,6 +485,10 @@ static struct fuse_conn *new_conn(struct super_block *sb)
 		/* fuse does it's own writeback accounting */
 		fc->bdi.capabilities = BDI_CAP_NO_ACCT_WB;
 		fc->dev = sb->s_dev;
+		fc->cpu_dev = kcalloc(nr_cpu_ids, sizeof(struct fuse_dev *),
+				      GFP_KERNEL);
+		if (!fc->cpu_dev)
+			goto error_kfree;
 		err = bdi_init(&fc->bdi);
 		if (err)
 			goto error_kfree;
@@ -522,6 +524,7 @@ error_bdi_destroy:
 	bdi_destroy(&fc->bdi);
 error_kfree:
 	mutex_destroy(&fc->inst_mutex);
+	kfree(fc->cpu_dev);
 	kfree(fc);
 	return NULL;
 }
@@ -532,6 +535,7 @@ void fuse_conn_put(struct fuse_conn *fc)
 		if (fc->destroy_req)
 			fuse_request_free(fc->destroy_req);
 		mutex_destroy(&fc->inst_mutex);
+		kfree(fc->cpu_dev);
 		kfree(fc);
 	}
 }
@@ -793,6 +797,7 @@ static void fuse_send_init(struct fuse_conn *fc, struct fuse_req *req)
 static int fuse_fill_super(struct super_block *sb, void *data, int silent)
 {
 	struct fuse_conn *fc;
+	struct fuse_dev *fud;
 	struct inode *root;
 	struct fuse_mount_data d;
 	struct file *file;
@@ -870,14 +875,19 @@ static int fuse_fill_super(struct super_block *sb, void *data, int silent)
 	if (file->private_data)
 		goto err_unlock;
 
+	err = -ENOMEM;
+	fud = fuse_dev_alloc(fc);
+	if (!fud)
+		goto err_unlock;
+
 	err = fuse_ctl_add_conn(fc);
 	if (err)
-		goto err_unlock;
+		goto err_free_dev;
 
 	list_add_tail(&fc->entry, &fuse_conn_list);
 	sb->s_root = root_dentry;
 	fc->connected = 1;
-	file->private_data = fuse_conn_get(fc);
+	file->private_data = fud;
 	mutex_unlock(&fuse_mutex);
 	/*
 	 * atomic_dec_and_test() in fput() provides the necessary
@@ -890,6 +900,8 @@ static int fuse_fill_super(struct super_block *sb, void *data, int silent)
 
 	return 0;
 
+ err_free_dev:
+	fuse_dev_free(fud);
  err_unlock:
 	mutex_unlock(&fuse_mutex);
  err_free_init_req:
@@ -259,6 +259,9 @@ void clear_inode(struct inode *inode)
 {
 	might_sleep();
 	invalidate_inode_buffers(inode);
+	/* Drop the shadow entries left behind by reclaim, if any */
+	if (inode->i_data.nrshadows)
+		truncate_inode_pages(&inode->i_data, 0);
        
 	BUG_ON(inode->i_data.nrpages);
 	BUG_ON(!(inode->i_state & I_FREEING));
@@ -1399,7 +1402,7 @@ void __init inode_init(void)
 					 sizeof(struct inode),
 					 0,
 					 (SLAB_RECLAIM_ACCOUNT|SLAB_PANIC|
-					 SLAB_MEM_SPREAD),
+					 SLAB_MEM_SPREAD|SLAB_DESTROY_BY_RCU),
 					 init_once);
 	register_shrinker(&icache_shrinker);
 
@@ -23,6 +23,8 @@
 #include <linux/marker.h>
 #include <linux/errno.h>
 #include <linux/slab.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 
 /*
  * Unlink a buffer from a transaction checkpoint list.
@@ -174,6 +176,81 @@ void __jbd2_log_wait_for_space(journal_t *journal)
 	}
 }
 
+/*
+ * Background checkpointing.
+ *
+ * Left alone, checkpointing only happens when a handle finds the log
+ * full in __jbd2_log_wait_for_space(), and then that process and every
+ * other one starting a handle waits for the checkpoint writeback.  The
+ * checkpoint thread instead starts writing back checkpoint buffers once
+ * less than a quarter of the log is free and keeps going until half of
+ * it is, so the foreground path normally finds enough space.
+ */
+static int jbd2_checkpoint_wanted(journal_t *journal, int fraction)
+{
+	int wanted;
+
+	assert_spin_locked(&journal->j_state_lock);
+	if (journal->j_flags & JBD2_ABORT)
+		return 0;
+	if (__jbd2_log_space_left(journal) >=
+	    (journal->j_last - journal->j_first) / fraction)
+		return 0;
+	spin_lock(&journal->j_list_lock);
+	wanted = journal->j_checkpoint_transactions != NULL;
+	spin_unlock(&journal->j_list_lock);
+	return wanted;
+}
+
+/*
+ * Kick the checkpoint thread if the log is getting full.
+ *
+ * Called under j_state_lock.
+ */
+void __jbd2_log_wake_checkpoint(journal_t *journal)
+{
+	if (journal->j_checkpoint_task && jbd2_checkpoint_wanted(journal, 4))
+		wake_up(&journal->j_wait_checkpoint);
+}
+
+static int jbd2_log_checkpoint_wanted(journal_t *journal)
+{
+	int wanted;
+
+	spin_lock(&journal->j_state_lock);
+	wanted = jbd2_checkpoint_wanted(journal, 4);
+	spin_unlock(&journal->j_state_lock);
+	return wanted;
+}
+
+int jbd2_checkpoint_thread(void *arg)
+{
+	journal_t *journal = arg;
+
+	set_freezable();
+	while (!kthread_should_stop()) {
+		spin_lock(&journal->j_state_lock);
+		while (jbd2_checkpoint_wanted(journal, 2) &&
+		       !kthread_should_stop()) {
+			int err;
+
+			spin_unlock(&journal->j_state_lock);
+			mutex_lock(&journal->j_checkpoint_mutex);
+			err = jbd2_log_do_checkpoint(journal);
+			mutex_unlock(&journal->j_checkpoint_mutex);
+			spin_lock(&journal->j_state_lock);
+			if (err < 0)
+				break;
+		}
+		spin_unlock(&journal->j_state_lock);
+
+		wait_event_freezable(journal->j_wait_checkpoint,
+				     kthread_should_stop() ||
+				     jbd2_log_checkpoint_wanted(journal));
+	}
+	return 0;
+}
+
 /*
  * We were unable to perform jbd_trylock_bh_state() inside j_list_lock.
  * The caller must restart a list walk.  Wait for someone else to run
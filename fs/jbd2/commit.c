@@ -25,6 +25,7 @@
 #include <linux/crc32.h>
 #include <linux/writeback.h>
 #include <linux/backing-dev.h>
+#include <linux/bitops.h>
 
 /*
  * Default IO end handler for temporary BJ_IO buffer_heads.
@@ -316,6 +317,14 @@ static void write_tag_block(int tag_bytes, journal_block_tag_t *tag,
 		tag->t_blocknr_high = cpu_to_be32((block >> 31) >> 1);
 }
 
+/*
+ * Histogram bucket for VALUE: 0 for zero, n for [2^(n-1), 2^n).
+ */
+static inline int jbd2_hist_bucket(unsigned long value)
+{
+	return min_t(int, fls_long(value), JBD2_HIST_BUCKETS - 1);
+}
+
 /*
  * jbd2_journal_commit_transaction
  *
@@ -342,6 +351,8 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	int tag_bytes = journal_tag_bytes(journal);
 	struct buffer_head *cbh = NULL; /* For transactional checksums */
 	__u32 crc32_sum = ~0;
+	ktime_t start_time;
+	u64 commit_time;
 
 	/*
 	 * First job: lock down the current transaction and wait for
@@ -373,6 +384,8 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	jbd_debug(1, "JBD: starting commit of transaction %d\n",
 			commit_transaction->t_tid);
 
+	start_time = ktime_get();
+
 	spin_lock(&journal->j_state_lock);
 	commit_transaction->t_state = T_LOCKED;
 
@@ -966,8 +979,24 @@ restart_loop:
 	journal->j_stats.u.run.rs_handle_count += stats.u.run.rs_handle_count;
 	journal->j_stats.u.run.rs_blocks += stats.u.run.rs_blocks;
 	journal->j_stats.u.run.rs_blocks_logged += stats.u.run.rs_blocks_logged;
+
+	commit_time = ktime_to_ns(ktime_sub(ktime_get(), start_time));
+	journal->j_histogram.h_commit_time[
+			jbd2_hist_bucket(div_u64(commit_time, NSEC_PER_MSEC))]++;
+	journal->j_histogram.h_batch_size[
+			jbd2_hist_bucket(commit_transaction->t_sync_count)]++;
 	spin_unlock(&journal->j_history_lock);
 
+	/*
+	 * Weight the new commit time 1/4 so that the batching heuristic in
+	 * jbd2_journal_stop() follows the device without jumping around.
+	 */
+	if (likely(journal->j_average_commit_time))
+		journal->j_average_commit_time = (commit_time +
+				journal->j_average_commit_time * 3) / 4;
+	else
+		journal->j_average_commit_time = commit_time;
+
 	commit_transaction->t_state = T_FINISHED;
 	J_ASSERT(commit_transaction == journal->j_committing_transaction);
 	journal->j_commit_sequence = commit_transaction->t_tid;
@@ -1005,4 +1034,8 @@ restart_loop:
 		  journal->j_commit_sequence, journal->j_tail_sequence);
 
 	wake_up(&journal->j_wait_done_commit);
+
+	spin_lock(&journal->j_state_lock);
+	__jbd2_log_wake_checkpoint(journal);
+	spin_unlock(&journal->j_state_lock);
 }
@@ -222,11 +222,24 @@ static int jbd2_journal_start_thread(journal_t *journal)
 		return PTR_ERR(t);
 
 	wait_event(journal->j_wait_done_commit, journal->j_task != NULL);
+
+	/*
+	 * The checkpoint thread only gets ahead of the log filling up;
+	 * without it __jbd2_log_wait_for_space() still does the work.
+	 */
+	t = kthread_run(jbd2_checkpoint_thread, journal, "jbd2_ckpt");
+	if (IS_ERR(t))
+		printk(KERN_WARNING "JBD: failed to start checkpoint thread "
+		       "for %s\n", journal->j_devname);
+	else
+		journal->j_checkpoint_task = t;
 	return 0;
 }
 
 static void journal_kill_thread(journal_t *journal)
 {
+	struct task_struct *t;
+
 	spin_lock(&journal->j_state_lock);
 	journal->j_flags |= JBD2_UNMOUNT;
 
@@ -236,7 +249,12 @@ static void journal_kill_thread(journal_t *journal)
 		wait_event(journal->j_wait_done_commit, journal->j_task == NULL);
 		spin_lock(&journal->j_state_lock);
 	}
+	t = journal->j_checkpoint_task;
+	journal->j_checkpoint_task = NULL;
 	spin_unlock(&journal->j_state_lock);
+
+	if (t)
+		kthread_stop(t);
 }
 
 /*
@@ -893,6 +911,61 @@ static struct file_operations jbd2_seq_info_fops = {
 	.release        = jbd2_seq_info_release,
 };
 
+static void jbd2_seq_histogram_bucket(struct seq_file *seq, int i,
+				      const char *unit)
+{
+	if (i == 0)
+		seq_printf(seq, "%9s%-3s", "0", unit);
+	else if (i == JBD2_HIST_BUCKETS - 1)
+		seq_printf(seq, "%8lu+%-3s", 1UL << (i - 1), unit);
+	else
+		seq_printf(seq, "%4lu-%-4lu%-3s", 1UL << (i - 1),
+			   (1UL << i) - 1, unit);
+}
+
+static int jbd2_seq_histogram_show(struct seq_file *seq, void *v)
+{
+	journal_t *journal = seq->private;
+	struct jbd2_histogram hist;
+	u64 average;
+	int i;
+
+	spin_lock(&journal->j_history_lock);
+	hist = journal->j_histogram;
+	spin_unlock(&journal->j_history_lock);
+	spin_lock(&journal->j_state_lock);
+	average = journal->j_average_commit_time;
+	spin_unlock(&journal->j_state_lock);
+
+	seq_printf(seq, "average commit time: %lluus\n",
+		   (unsigned long long)div_u64(average, NSEC_PER_USEC));
+	seq_printf(seq, "batch time: %u-%uus\n\n",
+		   journal->j_min_batch_time, journal->j_max_batch_time);
+
+	seq_printf(seq, "%12s %10s   %12s %10s\n", "commit time", "commits",
+		   "sync handles", "commits");
+	for (i = 0; i < JBD2_HIST_BUCKETS; i++) {
+		jbd2_seq_histogram_bucket(seq, i, "ms");
+		seq_printf(seq, " %10lu   ", hist.h_commit_time[i]);
+		jbd2_seq_histogram_bucket(seq, i, "");
+		seq_printf(seq, " %10lu\n", hist.h_batch_size[i]);
+	}
+	return 0;
+}
+
+static int jbd2_seq_histogram_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, jbd2_seq_histogram_show, PDE(inode)->data);
+}
+
+static struct file_operations jbd2_seq_histogram_fops = {
+	.owner		= THIS_MODULE,
+	.open           = jbd2_seq_histogram_open,
+	.read           = seq_read,
+	.llseek         = seq_lseek,
+	.release        = single_release,
+};
+
 static struct proc_dir_entry *proc_jbd2_stats;
 
 static void jbd2_stats_proc_init(journal_t *journal)
@@ -903,11 +976,14 @@ static void jbd2_stats_proc_init(journal_t *journal)
 				 &jbd2_seq_history_fops, journal);
 		proc_create_data("info", S_IRUGO, journal->j_proc_entry,
 				 &jbd2_seq_info_fops, journal);
+		proc_create_data("histogram", S_IRUGO, journal->j_proc_entry,
+				 &jbd2_seq_histogram_fops, journal);
 	}
 }
 
 static void jbd2_stats_proc_exit(journal_t *journal)
 {
+	remove_proc_entry("histogram", journal->j_proc_entry);
 	remove_proc_entry("info", journal->j_proc_entry);
 	remove_proc_entry("history", journal->j_proc_entry);
 	remove_proc_entry(journal->j_devname, proc_jbd2_stats);
@@ -961,6 +1037,8 @@ static journal_t * journal_init_common (void)
 	spin_lock_init(&journal->j_state_lock);
 
 	journal->j_commit_interval = (HZ * JBD2_DEFAULT_MAX_COMMIT_AGE);
+	journal->j_min_batch_time = JBD2_DEFAULT_MIN_BATCH_TIME;
+	journal->j_max_batch_time = JBD2_DEFAULT_MAX_BATCH_TIME;
 
 	/* The journal is marked for error until we succeed with recovery! */
 	journal->j_flags = JBD2_ABORT;
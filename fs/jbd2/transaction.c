@@ -25,6 +25,7 @@
 #include <linux/timer.h>
 #include <linux/mm.h>
 #include <linux/highmem.h>
+#include <linux/hrtimer.h>
 
 static void __jbd2_journal_temp_unlink_buffer(struct journal_head *jh);
 
@@ -62,6 +63,7 @@ jbd2_get_transaction(journal_t *journal, transaction_t *transaction)
 	journal->j_running_transaction = transaction;
 	transaction->t_max_wait = 0;
 	transaction->t_start = jiffies;
+	transaction->t_start_time = ktime_get();
 
 	return transaction;
 }
@@ -1222,18 +1224,53 @@ int jbd2_journal_stop(handle_t *handle)
 	 * on IO anyway.  Speeds up many-threaded, many-dir operations
 	 * by 30x or more...
 	 *
+	 * How long to wait is based on how long a commit takes: if the
+	 * transaction has already been open for longer than that, an
+	 * immediate commit costs less than the wait.  A jiffy is far too
+	 * long to hold every fsync on a fast device, so sleep on an hrtimer
+	 * in slices of the average commit time, bounded by j_min_batch_time
+	 * and j_max_batch_time.
+	 *
 	 * But don't do this if this process was the most recent one to
 	 * perform a synchronous write.  We do this to detect the case where a
 	 * single process is doing a stream of sync writes.  No point in waiting
 	 * for joiners in that case.
 	 */
 	pid = current->pid;
-	if (handle->h_sync && journal->j_last_sync_writer != pid) {
+	if (handle->h_sync && journal->j_last_sync_writer != pid &&
+	    journal->j_max_batch_time) {
+		u64 max_wait = 1000ULL * journal->j_max_batch_time;
+		u64 commit_time, trans_time;
+
 		journal->j_last_sync_writer = pid;
-		do {
-			old_handle_count = transaction->t_handle_count;
-			schedule_timeout_uninterruptible(1);
-		} while (old_handle_count != transaction->t_handle_count);
+
+		spin_lock(&journal->j_state_lock);
+		commit_time = journal->j_average_commit_time;
+		spin_unlock(&journal->j_state_lock);
+
+		commit_time = max_t(u64, commit_time,
+				    1000ULL * journal->j_min_batch_time);
+		commit_time = min_t(u64, commit_time, max_wait);
+		trans_time = ktime_to_ns(ktime_sub(ktime_get(),
+						   transaction->t_start_time));
+
+		if (trans_time < commit_time) {
+			u64 slice = commit_time - trans_time;
+			u64 waited = 0;
+
+			do {
+				ktime_t expires = ktime_add_ns(ktime_get(),
+							       slice);
+
+				old_handle_count = transaction->t_handle_count;
+				set_current_state(TASK_UNINTERRUPTIBLE);
+				schedule_hrtimeout(&expires, HRTIMER_MODE_ABS);
+				waited += slice;
+				slice = min_t(u64, commit_time,
+					      max_wait - min(waited, max_wait));
+			} while (slice &&
+				 old_handle_count != transaction->t_handle_count);
+		}
 	}
 
 	current->journal_info = NULL;
@@ -1241,6 +1278,8 @@ int jbd2_journal_stop(handle_t *handle)
 	spin_lock(&transaction->t_handle_lock);
 	transaction->t_outstanding_credits -= handle->h_buffer_credits;
 	transaction->t_updates--;
+	if (handle->h_sync)
+		transaction->t_sync_count++;
 	if (!transaction->t_updates) {
 		wake_up(&journal->j_wait_updates);
 		if (journal->j_barrier_count)
@@ -826,6 +826,162 @@ fail:
 	return PTR_ERR(dentry);
 }
 
+/*
+ * RCU path walk.
+ *
+ * Walking a path the ordinary way takes and drops a reference on every
+ * dentry along it, and on a multi-core box the counts of dentries that
+ * everyone walks through ("/usr", "/usr/lib") bounce between the cpus.
+ * When the leading components are all in the dcache we walk them under
+ * rcu_read_lock() instead, with no references, checking every step
+ * against the dentry's d_seq, and take a reference only on the
+ * directory we stop at.
+ *
+ * Anything out of the ordinary - "..", mountpoints, dentries that want
+ * revalidating or hash names their own way, directories with their own
+ * ->permission but no ->permission_rcu, misses, and races with rename
+ * or unlink - stops the walk right there and the ordinary walk carries on from that point.
+ * The last component is always left to the ordinary walk, which knows
+ * about intents, LOOKUP_PARENT and symlinks.
+ *
+ * Inodes are not RCU freed, so this is only done on filesystems whose
+ * inode cache is SLAB_DESTROY_BY_RCU (the generic one, or FS_RCU_INODES):
+ * an inode reached through a dentry that has just lost it is then still
+ * an inode, and d_seq tells us to throw away what we read from it.
+ */
+static inline int rcu_walk_inodes(struct super_block *sb)
+{
+	return !sb->s_op->alloc_inode ||
+		(sb->s_type->fs_flags & FS_RCU_INODES);
+}
+
+/*
+ * The easy case of exec_permission_lite(): -EAGAIN means ask again
+ * with a reference held.  A directory with its own ->permission can
+ * only be passed if its ->permission_rcu can decide without sleeping,
+ * which ACL filesystems can when no access ACL is cached.
+ */
+static int rcu_walk_permission(struct inode *inode)
+{
+	const struct inode_operations *iop = inode->i_op;
+	umode_t mode = inode->i_mode;
+
+	if (!iop || !iop->lookup)
+		return -EAGAIN;
+	if (iop->permission) {
+		if (!iop->permission_rcu || iop->permission_rcu(inode, MAY_EXEC))
+			return -EAGAIN;
+		return 0;
+	}
+
+	if (current->fsuid == inode->i_uid)
+		mode >>= 6;
+	else if (in_group_p(inode->i_gid))
+		mode >>= 3;
+
+	return (mode & MAY_EXEC) ? 0 : -EAGAIN;
+}
+
+/*
+ * Walk as many of the leading components of NAME as we can without
+ * taking references, and move nd->path down to the last directory
+ * reached.  Returns what is left of NAME for the ordinary walk.
+ */
+static const char *rcu_walk_path(const char *name, struct nameidata *nd)
+{
+	struct dentry *parent = nd->path.dentry;
+	const char *walked = name;
+	unsigned seq = 0;
+
+	if (!rcu_walk_inodes(parent->d_sb) ||
+	    !security_inode_permission_trivial())
+		return name;
+
+	rcu_read_lock();
+	if (rcu_walk_permission(parent->d_inode))
+		goto out;
+
+	for (;;) {
+		struct dentry *dentry;
+		struct inode *inode;
+		const char *p = walked;
+		unsigned long hash;
+		struct qstr this;
+		unsigned int c;
+		unsigned dseq;
+		int err;
+
+		this.name = p;
+		c = *(const unsigned char *)p;
+
+		hash = init_name_hash();
+		do {
+			p++;
+			hash = partial_name_hash(c, hash);
+			c = *(const unsigned char *)p;
+		} while (c && (c != '/'));
+		this.len = p - (const char *) this.name;
+		this.hash = end_name_hash(hash);
+
+		if (!c)
+			break;
+		while (*++p == '/');
+		if (!*p)
+			break;
+
+		if (this.name[0] == '.') {
+			if (this.len == 1) {
+				walked = p;
+				continue;
+			}
+			if (this.len == 2 && this.name[1] == '.')
+				break;
+		}
+		if (parent->d_op &&
+		    (parent->d_op->d_hash || parent->d_op->d_compare))
+			break;
+
+		dentry = __d_lookup_rcu(parent, &this, &dseq);
+		if (!dentry)
+			break;
+		if (dentry->d_op && dentry->d_op->d_revalidate)
+			break;
+		if (d_mountpoint(dentry))
+			break;
+		inode = dentry->d_inode;
+		if (!inode)
+			break;
+		err = rcu_walk_permission(inode);
+		if (read_seqcount_retry(&dentry->d_seq, dseq) || err)
+			break;
+
+		parent = dentry;
+		seq = dseq;
+		walked = p;
+	}
+
+	if (parent != nd->path.dentry) {
+		/* As in __d_lookup(): a hashed dentry can't be killed under d_lock */
+		spin_lock(&parent->d_lock);
+		if (d_unhashed(parent) ||
+		    read_seqcount_retry(&parent->d_seq, seq)) {
+			spin_unlock(&parent->d_lock);
+			walked = name;
+			goto out;
+		}
+		atomic_inc(&parent->d_count);
+		spin_unlock(&parent->d_lock);
+		rcu_read_unlock();
+
+		dput(nd->path.dentry);
+		nd->path.dentry = parent;
+		return walked;
+	}
+out:
+	rcu_read_unlock();
+	return walked;
+}
+
 /*
  * Name resolution.
  * This is the basic name resolution function, turning a pathname into
@@ -846,6 +1002,7 @@ static int __link_path_walk(const char *name, struct nameidata *nd)
 	if (!*name)
 		goto return_reval;
 
+	name = rcu_walk_path(name, nd);
 	inode = nd->path.dentry->d_inode;
 	if (nd->depth)
 		lookup_flags = LOOKUP_FOLLOW | (nd->flags & LOOKUP_CONTINUE);
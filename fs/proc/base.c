@@ -79,6 +79,7 @@
 #include <linux/oom.h>
 #include <linux/elf.h>
 #include <linux/pid_namespace.h>
+#include <linux/aio.h>
 #include "internal.h"
 
 /* NOTE:
@@ -320,6 +321,21 @@ static int proc_pid_auxv(struct task_struct *task, char *buffer)
 	return res;
 }
 
+#ifdef CONFIG_AIO
+/*
+ * Provides /proc/PID/aio
+ */
+static int proc_pid_aio(struct task_struct *task, char *buffer)
+{
+	int res = 0;
+	struct mm_struct *mm = get_task_mm(task);
+	if (mm) {
+		res = aio_latency_report(mm, buffer, PAGE_SIZE);
+		mmput(mm);
+	}
+	return res;
+}
+#endif
 
 #ifdef CONFIG_KALLSYMS
 /*
@@ -2460,6 +2476,9 @@ static const struct pid_entry tgid_base_stuff[] = {
 	ONE("status",     S_IRUGO, pid_status),
 	ONE("personality", S_IRUSR, pid_personality),
 	INF("limits",	  S_IRUSR, pid_limits),
+#ifdef CONFIG_AIO
+	INF("aio",	  S_IRUSR, pid_aio),
+#endif
 #ifdef CONFIG_SCHED_DEBUG
 	REG("sched",      S_IRUGO|S_IWUSR, pid_sched),
 #endif
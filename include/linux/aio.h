@@ -5,6 +5,8 @@
 #include <linux/workqueue.h>
 #include <linux/aio_abi.h>
 #include <linux/uio.h>
+#include <linux/ktime.h>
+#include <linux/capability.h>
 
 #include <asm/atomic.h>
 
@@ -12,6 +14,8 @@
 #define AIO_KIOGRP_NR_ATOMIC	8
 
 struct kioctx;
+struct group_info;
+struct io_context;
 
 /* Notes on cancelling a kiocb:
  *	If a kiocb is cancelled, aio_complete may return 0 to indicate 
@@ -33,6 +37,7 @@ struct kioctx;
 /* #define KIF_LOCKED		0 */
 #define KIF_KICKED		1
 #define KIF_CANCELLED		2
+#define KIF_OFFLOADED		3	/* run by an aio worker thread */
 
 #define kiocbTryLock(iocb)	test_and_set_bit(KIF_LOCKED, &(iocb)->ki_flags)
 #define kiocbTryKick(iocb)	test_and_set_bit(KIF_KICKED, &(iocb)->ki_flags)
@@ -40,6 +45,7 @@ struct kioctx;
 #define kiocbSetLocked(iocb)	set_bit(KIF_LOCKED, &(iocb)->ki_flags)
 #define kiocbSetKicked(iocb)	set_bit(KIF_KICKED, &(iocb)->ki_flags)
 #define kiocbSetCancelled(iocb)	set_bit(KIF_CANCELLED, &(iocb)->ki_flags)
+#define kiocbSetOffloaded(iocb)	set_bit(KIF_OFFLOADED, &(iocb)->ki_flags)
 
 #define kiocbClearLocked(iocb)	clear_bit(KIF_LOCKED, &(iocb)->ki_flags)
 #define kiocbClearKicked(iocb)	clear_bit(KIF_KICKED, &(iocb)->ki_flags)
@@ -48,6 +54,7 @@ struct kioctx;
 #define kiocbIsLocked(iocb)	test_bit(KIF_LOCKED, &(iocb)->ki_flags)
 #define kiocbIsKicked(iocb)	test_bit(KIF_KICKED, &(iocb)->ki_flags)
 #define kiocbIsCancelled(iocb)	test_bit(KIF_CANCELLED, &(iocb)->ki_flags)
+#define kiocbIsOffloaded(iocb)	test_bit(KIF_OFFLOADED, &(iocb)->ki_flags)
 
 /* is there a better place to document function pointer methods? */
 /**
@@ -117,6 +124,14 @@ struct kiocb {
 
 	struct list_head	ki_list;	/* the aio core uses this
 						 * for cancellation */
+	ktime_t			ki_submit_time;	/* for latency statistics */
+
+	/* Identity of the submitter, for iocbs run by an aio worker */
+	uid_t			ki_fsuid;
+	gid_t			ki_fsgid;
+	kernel_cap_t		ki_cap_effective;
+	struct group_info	*ki_group_info;
+	struct io_context	*ki_ioc;
 
 	/*
 	 * If the aio_resfd field of the userspace iocb is not zero,
@@ -176,6 +191,16 @@ struct aio_ring_info {
 	struct page		*internal_pages[AIO_RING_PAGES];
 };
 
+/* Completion latency of the requests of a context */
+struct aio_latency_stats {
+	unsigned long		nr;
+	u64			total_ns;
+	u64			max_ns;
+};
+
+#define AIO_LAT_INLINE		0	/* run from io_submit() */
+#define AIO_LAT_WORKER		1	/* handed to an aio worker thread */
+
 struct kioctx {
 	atomic_t		users;
 	int			dead;
@@ -199,6 +224,9 @@ struct kioctx {
 	struct aio_ring_info	ring_info;
 
 	struct delayed_work	wq;
+
+	/* protected by ctx_lock */
+	struct aio_latency_stats	latency[2];
 };
 
 /* prototypes */
@@ -211,6 +239,7 @@ extern void kick_iocb(struct kiocb *iocb);
 extern int aio_complete(struct kiocb *iocb, long res, long res2);
 struct mm_struct;
 extern void exit_aio(struct mm_struct *mm);
+extern int aio_latency_report(struct mm_struct *mm, char *buf, int size);
 #else
 static inline ssize_t wait_on_sync_kiocb(struct kiocb *iocb) { return 0; }
 static inline int aio_put_req(struct kiocb *iocb) { return 0; }
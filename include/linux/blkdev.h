@@ -29,6 +29,8 @@ struct elevator_queue;
 typedef struct elevator_queue elevator_t;
 struct request_pm_state;
 struct blk_trace;
+struct blk_mq_ctx;
+struct throtl_data;
 struct request;
 struct sg_io_hdr;
 
@@ -191,6 +193,9 @@ struct request {
 
 	struct gendisk *rq_disk;
 	unsigned long start_time;
+#ifdef CONFIG_BLK_DEV_IO_TRACE
+	u64 trace_issue;	/* ns, for the latency of fast traces */
+#endif
 
 	/* Number of scatter-gather DMA addr+len pairs after
 	 * physical address coalescing is performed.
@@ -272,6 +277,8 @@ typedef int (merge_bvec_fn) (struct request_queue *, struct bvec_merge_data *,
 			     struct bio_vec *);
 typedef void (prepare_flush_fn) (struct request_queue *, struct request *);
 typedef void (softirq_done_fn)(struct request *);
+typedef void (queue_rqs_fn)(struct request_queue *, struct list_head *);
+typedef int (poll_fn)(struct request_queue *);
 typedef int (dma_drain_needed_fn)(struct request *);
 typedef int (lld_busy_fn) (struct request_queue *q);
 
@@ -320,6 +327,18 @@ struct request_queue
 	 */
 	struct request_list	rq;
 
+	/*
+	 * per-cpu staging queues of a multi-queue device
+	 */
+	struct blk_mq_ctx	*mq_ctx;
+
+#ifdef CONFIG_BLK_DEV_THROTTLING
+	/*
+	 * bios held back by per-cgroup limits
+	 */
+	struct throtl_data	*td;
+#endif
+
 	request_fn_proc		*request_fn;
 	make_request_fn		*make_request_fn;
 	prep_rq_fn		*prep_rq_fn;
@@ -331,6 +350,8 @@ struct request_queue
 	rq_timed_out_fn		*rq_timed_out_fn;
 	dma_drain_needed_fn	*dma_drain_needed;
 	lld_busy_fn		*lld_busy_fn;
+	queue_rqs_fn		*queue_rqs_fn;
+	poll_fn			*poll_fn;
 
 	/*
 	 * Dispatch queue sorting
@@ -449,6 +470,7 @@ struct request_queue
 #define QUEUE_FLAG_FAIL_IO     12	/* fake timeout */
 #define QUEUE_FLAG_STACKABLE   13	/* supports request stacking */
 #define QUEUE_FLAG_NONROT      14	/* non-rotational device (SSD) */
+#define QUEUE_FLAG_POLL        15	/* sync direct I/O polls poll_fn */
 
 static inline int queue_is_locked(struct request_queue *q)
 {
@@ -555,6 +577,8 @@ enum {
 #define blk_queue_stopped(q)	test_bit(QUEUE_FLAG_STOPPED, &(q)->queue_flags)
 #define blk_queue_nomerges(q)	test_bit(QUEUE_FLAG_NOMERGES, &(q)->queue_flags)
 #define blk_queue_nonrot(q)	test_bit(QUEUE_FLAG_NONROT, &(q)->queue_flags)
+#define blk_queue_poll(q)	test_bit(QUEUE_FLAG_POLL, &(q)->queue_flags)
+#define blk_queue_mq(q)		((q)->mq_ctx != NULL)
 #define blk_queue_flushing(q)	((q)->ordseq)
 #define blk_queue_stackable(q)	\
 	test_bit(QUEUE_FLAG_STACKABLE, &(q)->queue_flags)
@@ -810,6 +834,8 @@ extern int blk_end_request_callback(struct request *rq, int error,
 				int (drv_callback)(struct request *));
 extern void blk_complete_request(struct request *);
 extern void __blk_complete_request(struct request *);
+extern void blk_complete_request_list(struct list_head *);
+extern int blk_poll(struct request_queue *);
 extern void blk_abort_request(struct request *);
 extern void blk_abort_queue(struct request_queue *);
 extern void blk_update_request(struct request *rq, int error,
@@ -829,6 +855,10 @@ extern unsigned int blk_rq_cur_bytes(struct request *rq);
 extern struct request_queue *blk_init_queue_node(request_fn_proc *rfn,
 					spinlock_t *lock, int node_id);
 extern struct request_queue *blk_init_queue(request_fn_proc *, spinlock_t *);
+extern struct request_queue *blk_init_queue_mq_node(queue_rqs_fn *qfn,
+					int node_id);
+extern struct request_queue *blk_init_queue_mq(queue_rqs_fn *);
+extern void blk_mq_end_request(struct request *, int);
 extern void blk_cleanup_queue(struct request_queue *);
 extern void blk_queue_make_request(struct request_queue *, make_request_fn *);
 extern void blk_queue_bounce_limit(struct request_queue *, u64);
@@ -850,6 +880,7 @@ extern void blk_queue_merge_bvec(struct request_queue *, merge_bvec_fn *);
 extern void blk_queue_dma_alignment(struct request_queue *, int);
 extern void blk_queue_update_dma_alignment(struct request_queue *, int);
 extern void blk_queue_softirq_done(struct request_queue *, softirq_done_fn *);
+extern void blk_queue_poll_fn(struct request_queue *, poll_fn *);
 extern void blk_queue_set_discard(struct request_queue *, prepare_discard_fn *);
 extern void blk_queue_rq_timed_out(struct request_queue *, rq_timed_out_fn *);
 extern void blk_queue_rq_timeout(struct request_queue *, unsigned int);
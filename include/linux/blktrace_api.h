@@ -4,6 +4,7 @@
 #ifdef __KERNEL__
 #include <linux/blkdev.h>
 #include <linux/relay.h>
+#include <linux/ring_buffer.h>
 #endif
 
 /*
@@ -119,12 +120,37 @@ struct blk_io_trace_remap {
 	__be64 sector;
 };
 
+/*
+ * The fixed size record of the fast trace modes, read from the "fast"
+ * file next to the relay files
+ */
+struct blk_fast_trace {
+	__u64 time;		/* in nanoseconds, per-cpu clock */
+	__u64 sector;		/* disk offset */
+	__u32 bytes;		/* transfer length */
+	__u32 action;		/* what happened */
+	__u32 pid;		/* who did it */
+	__u32 latency;		/* completions: microseconds since issue */
+	__u16 cpu;		/* on what cpu did it happen */
+	__u16 error;		/* completion error */
+	__u32 device;		/* device number */
+};
+
 enum {
 	Blktrace_setup = 1,
 	Blktrace_running,
 	Blktrace_stopped,
 };
 
+/*
+ * Trace modes, written to the "fast_mode" file
+ */
+enum {
+	Blktrace_relay = 0,	/* full events through relay */
+	Blktrace_fast,		/* all events as fast records */
+	Blktrace_fast_slow,	/* only completions over fast_threshold_us */
+};
+
 #define BLKTRACE_BDEV_SIZE	32
 
 /*
@@ -156,11 +182,20 @@ struct blk_trace {
 	struct dentry *dropped_file;
 	struct dentry *msg_file;
 	atomic_t dropped;
+	int fast_mode;
+	u32 fast_threshold;
+	unsigned long fast_size;
+	struct ring_buffer *fast_buffer;
+	struct mutex fast_mutex;
+	struct dentry *fast_file;
+	struct dentry *fast_mode_file;
+	struct dentry *fast_threshold_file;
 };
 
 extern int blk_trace_ioctl(struct block_device *, unsigned, char __user *);
 extern void blk_trace_shutdown(struct request_queue *);
 extern void __blk_add_trace(struct blk_trace *, sector_t, int, int, u32, int, int, void *);
+extern void __blk_add_trace_rq_fast(struct blk_trace *, struct request *, u32);
 extern int do_blk_trace_setup(struct request_queue *q,
 	char *name, dev_t dev, struct blk_user_trace_setup *buts);
 extern void __trace_note_message(struct blk_trace *, const char *fmt, ...);
@@ -205,6 +240,11 @@ static inline void blk_add_trace_rq(struct request_queue *q, struct request *rq,
 	if (likely(!bt))
 		return;
 
+	if (unlikely(bt->fast_mode)) {
+		__blk_add_trace_rq_fast(bt, rq, what);
+		return;
+	}
+
 	if (blk_discard_rq(rq))
 		rw |= (1 << BIO_RW_DISCARD);
 
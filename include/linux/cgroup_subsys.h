@@ -54,3 +54,9 @@ SUBSYS(freezer)
 #endif
 
 /* */
+
+#ifdef CONFIG_BLK_DEV_THROTTLING
+SUBSYS(blkio)
+#endif
+
+/* */
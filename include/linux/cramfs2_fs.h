@@ -0,0 +1,112 @@
+#ifndef __CRAMFS2_FS_H
+#define __CRAMFS2_FS_H
+
+/*
+ * On-disk format of cramfs2, the large block compressed read-only
+ * filesystem.  Shared with the mkcramfs2 userspace tool, so keep this
+ * free of kernel-only definitions.
+ *
+ * All fields are little-endian.  An image is laid out as
+ *
+ *	superblock | data and fragment blocks | block list |
+ *	fragment table | inode table | directory table
+ *
+ * File data is compressed in blocks of (1 << block_log) bytes.  The tail
+ * of a file that does not fill a whole block is packed together with the
+ * tails of other files into a shared fragment block.  All metadata is
+ * stored uncompressed.
+ */
+
+#include <linux/types.h>
+
+#define CRAMFS2_MAGIC		0x32534643	/* "CFS2" */
+#define CRAMFS2_VERSION		1
+
+#define CRAMFS2_MIN_BLOCK_LOG	12
+#define CRAMFS2_MAX_BLOCK_LOG	20
+#define CRAMFS2_MAX_NAMELEN	255
+
+#define CRAMFS2_ROOT_INO	1
+
+/* Compressors, recorded per image in super.compression */
+#define CRAMFS2_COMPR_ZLIB	1
+#define CRAMFS2_COMPR_LZO	2
+
+/*
+ * Block list and fragment table sizes carry a flag for blocks that did
+ * not compress and are stored as is.  A size of zero in the block list
+ * is a hole: the block reads back as zeroes.
+ */
+#define CRAMFS2_BLOCK_UNCOMPRESSED	(1 << 24)
+#define CRAMFS2_BLOCK_SIZE(x)		((x) & (CRAMFS2_BLOCK_UNCOMPRESSED - 1))
+
+/* inode.fragment of a file whose tail is not in a fragment block */
+#define CRAMFS2_NO_FRAGMENT	0xffffffffU
+
+struct cramfs2_super {
+	__le32 magic;			/* CRAMFS2_MAGIC */
+	__le16 version;			/* CRAMFS2_VERSION */
+	__le16 compression;		/* CRAMFS2_COMPR_* */
+	__le32 block_log;		/* log2 of the data block size */
+	__le32 flags;			/* none defined yet, must be zero */
+	__le64 bytes_used;		/* size of the image */
+	__le32 inodes;			/* number of inodes */
+	__le32 fragments;		/* number of fragment blocks */
+	__le32 mkfs_time;		/* image creation time */
+	__le32 reserved;
+	__le64 block_list_start;	/* __le32 sizes of all data blocks */
+	__le64 fragment_table_start;	/* struct cramfs2_fragment[] */
+	__le64 inode_table_start;	/* struct cramfs2_inode[] */
+	__le64 directory_table_start;	/* struct cramfs2_dirent lists */
+	__u8 name[16];			/* user-defined name */
+};
+
+/*
+ * Inode number N is entry N - 1 of the inode table.
+ *
+ * Regular files and symlinks: file data starts at byte offset 'start'
+ * of the image, with the sizes of its full blocks at entry 'block_list'
+ * of the block list.  If 'fragment' is not CRAMFS2_NO_FRAGMENT, the last
+ * (size % block size) bytes are at 'frag_offset' of that fragment block.
+ *
+ * Directories: 'start' is the byte offset of the entries within the
+ * directory table, 'size' their total length.
+ *
+ * Device nodes: 'start' is the new_encode_dev() device number.
+ */
+struct cramfs2_inode {
+	__le16 mode;
+	__le16 reserved;
+	__le32 nlink;
+	__le32 uid;
+	__le32 gid;
+	__le32 mtime;
+	__le32 block_list;
+	__le64 size;
+	__le64 start;
+	__le32 fragment;
+	__le32 frag_offset;
+};
+
+/*
+ * Directory entries are sorted by name and padded to a multiple of four
+ * bytes.  The name is not NUL-terminated.
+ */
+struct cramfs2_dirent {
+	__le32 ino;
+	__le16 name_len;
+	__u8 type;			/* DT_* */
+	__u8 reserved;
+	char name[0];
+};
+
+#define CRAMFS2_DIRENT_SIZE(len) \
+	((sizeof(struct cramfs2_dirent) + (len) + 3) & ~3)
+
+struct cramfs2_fragment {
+	__le64 start;
+	__le32 size;
+	__le32 reserved;
+};
+
+#endif
@@ -7,6 +7,7 @@
 #include <linux/spinlock.h>
 #include <linux/cache.h>
 #include <linux/rcupdate.h>
+#include <linux/seqlock.h>
 
 struct nameidata;
 struct path;
@@ -92,6 +93,7 @@ struct dentry {
 	struct hlist_node d_hash;	/* lookup hash list */
 	struct dentry *d_parent;	/* parent directory */
 	struct qstr d_name;
+	seqcount_t d_seq;		/* per dentry seqlock, for RCU walk */
 
 	struct list_head d_lru;		/* LRU list */
 	/*
@@ -199,8 +201,10 @@ extern seqlock_t rename_lock;
 static inline void __d_drop(struct dentry *dentry)
 {
 	if (!(dentry->d_flags & DCACHE_UNHASHED)) {
+		write_seqcount_begin(&dentry->d_seq);
 		dentry->d_flags |= DCACHE_UNHASHED;
 		hlist_del_rcu(&dentry->d_hash);
+		write_seqcount_end(&dentry->d_seq);
 	}
 }
 
@@ -292,6 +296,7 @@ extern struct dentry *d_ancestor(struct dentry *, struct dentry *);
 /* appendix may either be NULL or be used for transname suffixes */
 extern struct dentry * d_lookup(struct dentry *, struct qstr *);
 extern struct dentry * __d_lookup(struct dentry *, struct qstr *);
+extern struct dentry *__d_lookup_rcu(struct dentry *, struct qstr *, unsigned *);
 extern struct dentry * d_hash_and_lookup(struct dentry *, struct qstr *);
 
 /* validate "insecure" dentry pointer */
@@ -26,6 +26,13 @@
 #define EPOLL_CTL_DEL 2
 #define EPOLL_CTL_MOD 3
 
+/*
+ * Add the epoll wait entry to the target's wait queue as an exclusive
+ * waiter, so that an event wakes only one of several epoll sets
+ * watching the same file (EPOLL_CTL_ADD only)
+ */
+#define EPOLLEXCLUSIVE (1 << 28)
+
 /* Set the One Shot behaviour for the target file descriptor */
 #define EPOLLONESHOT (1 << 30)
 
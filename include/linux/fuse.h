@@ -27,6 +27,7 @@
 
 #include <asm/types.h>
 #include <linux/major.h>
+#include <linux/ioctl.h>
 
 /** Version number of this interface */
 #define FUSE_KERNEL_VERSION 7
@@ -43,6 +44,10 @@
 /** The minor number of the fuse character device */
 #define FUSE_MINOR 229
 
+/** Attach an unmounted fuse device file to the connection of the fuse
+    device file whose descriptor is passed in */
+#define FUSE_DEV_IOC_CLONE _IOR(229, 0, __u32)
+
 /* Make sure all structures are padded to 64bit boundary, so 32bit
    userspace works under 64bit kernels */
 
@@ -30,6 +30,7 @@
 #include <linux/bit_spinlock.h>
 #include <linux/mutex.h>
 #include <linux/timer.h>
+#include <linux/ktime.h>
 #endif
 
 #define journal_oom_retry 1
@@ -48,6 +49,13 @@
  */
 #define JBD2_DEFAULT_MAX_COMMIT_AGE 5
 
+/*
+ * Default bounds, in microseconds, on how long a synchronous handle is
+ * held back so that other synchronous handles can join its commit.
+ */
+#define JBD2_DEFAULT_MIN_BATCH_TIME 0
+#define JBD2_DEFAULT_MAX_BATCH_TIME 15000	/* 15ms */
+
 #ifdef CONFIG_JBD2_DEBUG
 /*
  * Define JBD2_EXPENSIVE_CHECKING to enable more expensive internal
@@ -607,6 +615,11 @@ struct transaction_s
 	 */
 	unsigned long		t_start;
 
+	/*
+	 * When transaction started, for the commit batching heuristic
+	 */
+	ktime_t			t_start_time;
+
 	/*
 	 * Checkpointing stats [j_checkpoint_sem]
 	 */
@@ -641,6 +654,11 @@ struct transaction_s
 	 */
 	int t_handle_count;
 
+	/*
+	 * How many synchronous handles used this transaction? [t_handle_lock]
+	 */
+	int t_sync_count;
+
 	/*
 	 * For use by the filesystem to store fs-specific data
 	 * structures associated with the transaction
@@ -672,6 +690,18 @@ struct transaction_stats_s {
 #define JBD2_STATS_RUN		1
 #define JBD2_STATS_CHECKPOINT	2
 
+/*
+ * Histograms of commit time (in milliseconds) and of the number of
+ * synchronous handles batched into each commit.  Bucket 0 counts values
+ * of zero, bucket n values in [2^(n-1), 2^n), the last bucket the rest.
+ */
+#define JBD2_HIST_BUCKETS	12
+
+struct jbd2_histogram {
+	unsigned long		h_commit_time[JBD2_HIST_BUCKETS];
+	unsigned long		h_batch_size[JBD2_HIST_BUCKETS];
+};
+
 static inline unsigned long
 jbd2_time_diff(unsigned long start, unsigned long end)
 {
@@ -734,6 +764,12 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_commit_interval: What is the maximum transaction lifetime before we begin
  *  a commit?
  * @j_commit_timer:  The timer used to wakeup the commit thread
+ * @j_checkpoint_task: Pointer to the background checkpoint thread
+ * @j_min_batch_time: Minimum time a synchronous handle waits for others to
+ *  join its commit, in microseconds
+ * @j_max_batch_time: Maximum time a synchronous handle waits for others to
+ *  join its commit, in microseconds
+ * @j_average_commit_time: Average time a commit takes, in nanoseconds
  * @j_revoke_lock: Protect the revoke table
  * @j_revoke: The revoke table - maintains the list of revoked blocks in the
  *     current transaction.
@@ -748,6 +784,7 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_history_lock: Protect the transactions statistics history
  * @j_proc_entry: procfs entry for the jbd statistics directory
  * @j_stats: Overall statistics
+ * @j_histogram: Commit time and batch size histograms
  * @j_private: An opaque pointer to fs-private information.
  */
 
@@ -924,6 +961,19 @@ struct journal_s
 	/* The timer used to wakeup the commit thread: */
 	struct timer_list	j_commit_timer;
 
+	/* Thread writing back checkpoint buffers ahead of need */
+	struct task_struct	*j_checkpoint_task;
+
+	/*
+	 * Bounds on how long a synchronous handle is held back to batch
+	 * other handles into its commit, in microseconds
+	 */
+	u32			j_min_batch_time;
+	u32			j_max_batch_time;
+
+	/* Running average of commit time, in nanoseconds [j_state_lock] */
+	u64			j_average_commit_time;
+
 	/*
 	 * The revoke table: maintains the list of revoked blocks in the
 	 * current transaction.  [j_revoke_lock]
@@ -956,6 +1006,7 @@ struct journal_s
 	spinlock_t		j_history_lock;
 	struct proc_dir_entry	*j_proc_entry;
 	struct transaction_stats_s j_stats;
+	struct jbd2_histogram	j_histogram;
 
 	/* Failed journal commit ID */
 	unsigned int		j_failed_commit;
@@ -1145,6 +1196,8 @@ int jbd2_log_wait_commit(journal_t *journal, tid_t tid);
 int jbd2_log_do_checkpoint(journal_t *journal);
 
 void __jbd2_log_wait_for_space(journal_t *journal);
+void __jbd2_log_wake_checkpoint(journal_t *journal);
+int jbd2_checkpoint_thread(void *arg);
 extern void	__jbd2_journal_drop_transaction(journal_t *, transaction_t *);
 extern int	jbd2_cleanup_journal_tail(journal_t *);
 
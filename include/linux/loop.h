@@ -62,6 +62,7 @@ struct loop_device {
 	struct mutex		lo_ctl_mutex;
 	struct task_struct	*lo_thread;
 	wait_queue_head_t	lo_event;
+	atomic_t		lo_dio_pending;	/* direct I/O bios in flight */
 
 	struct request_queue	*lo_queue;
 	struct gendisk		*lo_disk;
@@ -77,6 +78,7 @@ enum {
 	LO_FLAGS_READ_ONLY	= 1,
 	LO_FLAGS_USE_AOPS	= 2,
 	LO_FLAGS_AUTOCLEAR	= 4,
+	LO_FLAGS_DIRECT_IO	= 8,
 };
 
 #include <asm/posix_types.h>	/* for __kernel_old_dev_t */
@@ -27,6 +27,7 @@ extern unsigned long max_mapnr;
 extern unsigned long num_physpages;
 extern void * high_memory;
 extern int page_cluster;
+extern int sysctl_fault_around_bytes;
 
 #ifdef CONFIG_SYSCTL
 extern int sysctl_legacy_va_layout;
@@ -165,6 +166,10 @@ struct vm_fault {
 					 * is set (which is also implied by
 					 * VM_FAULT_ERROR).
 					 */
+	/* for ->map_pages() only */
+	pgoff_t max_pgoff;		/* map pages for offset from pgoff till
+					 * max_pgoff inclusive */
+	pte_t *pte;			/* pte entry associated with ->pgoff */
 };
 
 /*
@@ -177,6 +182,13 @@ struct vm_operations_struct {
 	void (*close)(struct vm_area_struct * area);
 	int (*fault)(struct vm_area_struct *vma, struct vm_fault *vmf);
 
+	/*
+	 * Map already cached, uptodate pages around a read fault without
+	 * sleeping.  Called with the page table lock held.  Returns the
+	 * number of pages mapped.
+	 */
+	int (*map_pages)(struct vm_area_struct *vma, struct vm_fault *vmf);
+
 	/* notification that a previously read-only page is about to become
 	 * writable, if an error is returned it will cause a SIGBUS */
 	int (*page_mkwrite)(struct vm_area_struct *vma, struct page *page);
@@ -1139,6 +1151,9 @@ extern void truncate_inode_pages_range(struct address_space *,
 
 /* generic vm_area_ops exported for stackable file systems */
 extern int filemap_fault(struct vm_area_struct *, struct vm_fault *);
+extern int filemap_map_pages(struct vm_area_struct *, struct vm_fault *);
+extern void do_set_pte(struct vm_area_struct *vma, unsigned long address,
+		       struct page *page, pte_t *pte);
 
 /* mm/page-writeback.c */
 int write_one_page(struct page *page, int wait);
@@ -157,6 +157,9 @@ struct vm_area_struct {
 #ifdef CONFIG_NUMA
 	struct mempolicy *vm_policy;	/* NUMA policy for the VMA */
 #endif
+#ifdef CONFIG_SWAP
+	atomic_long_t swap_readahead_info; /* last swap fault and window */
+#endif
 };
 
 struct core_thread {
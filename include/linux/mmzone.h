@@ -107,6 +107,8 @@ enum zone_stat_item {
 	NR_VMSCAN_WRITE,
 	/* Second 128 byte cacheline */
 	NR_WRITEBACK_TEMP,	/* Writeback using temporary buffers */
+	WORKINGSET_REFAULT,	/* evicted file pages faulted back in */
+	WORKINGSET_ACTIVATE,	/* refaults that were activated directly */
 #ifdef CONFIG_NUMA
 	NUMA_HIT,		/* allocated in intended node */
 	NUMA_MISS,		/* allocated in non intended node */
@@ -353,6 +355,12 @@ struct zone {
 	 */
 	unsigned int inactive_ratio;
 
+	/*
+	 * Aging clock of the file LRU, advanced on every eviction and
+	 * activation.  Used to compute refault distances, see
+	 * mm/workingset.c.
+	 */
+	atomic_long_t		inactive_age;
 
 	ZONE_PADDING(_pad2_)
 	/* Rarely used or read-mostly fields */
@@ -106,6 +106,16 @@ enum pageflags {
 	/* Filesystems */
 	PG_checked = PG_owner_priv_1,
 
+	/* Anonymous pages given up with MADV_FREE */
+	PG_lazyfree = PG_owner_priv_1,
+
+	/*
+	 * Swap cache pages read ahead and not used yet.  Reclaim clears
+	 * PG_lazyfree before a page goes into the swap cache, and this
+	 * is cleared when it leaves.
+	 */
+	PG_swap_readahead = PG_owner_priv_1,
+
 	/* XEN */
 	PG_pinned = PG_owner_priv_1,
 	PG_savepinned = PG_dirty,
@@ -189,6 +199,9 @@ PAGEFLAG(Active, active) __CLEARPAGEFLAG(Active, active)
 	TESTCLEARFLAG(Active, active)
 __PAGEFLAG(Slab, slab)
 PAGEFLAG(Checked, checked)		/* Used by some filesystems */
+PAGEFLAG(LazyFree, lazyfree)		/* Anonymous, MADV_FREE */
+PAGEFLAG(SwapReadahead, swap_readahead)	/* Swap cache */
+	TESTCLEARFLAG(SwapReadahead, swap_readahead)
 PAGEFLAG(Pinned, pinned) TESTSCFLAG(Pinned, pinned)	/* Xen */
 PAGEFLAG(SavePinned, savepinned);			/* Xen */
 PAGEFLAG(Reserved, reserved) __CLEARPAGEFLAG(Reserved, reserved)
@@ -53,6 +53,21 @@ static inline int radix_tree_is_indirect_ptr(void *ptr)
 	return (int)((unsigned long)ptr & RADIX_TREE_INDIRECT_PTR);
 }
 
+/*
+ * An exceptional entry is a value stored in a slot that is not a pointer
+ * to a data item.  It has the second lowest bit set (the lowest bit is
+ * reserved for indirect pointers), so users can pack up to
+ * BITS_PER_LONG - RADIX_TREE_EXCEPTIONAL_SHIFT bits of information in it.
+ * The page cache uses these to remember evicted pages (see mm/workingset.c).
+ */
+#define RADIX_TREE_EXCEPTIONAL_ENTRY	2
+#define RADIX_TREE_EXCEPTIONAL_SHIFT	2
+
+static inline int radix_tree_exceptional_entry(void *arg)
+{
+	return (unsigned long)arg & RADIX_TREE_EXCEPTIONAL_ENTRY;
+}
+
 /*** radix-tree API starts here ***/
 
 #define RADIX_TREE_MAX_TAGS 2
@@ -164,7 +179,8 @@ radix_tree_gang_lookup(struct radix_tree_root *root, void **results,
 			unsigned long first_index, unsigned int max_items);
 unsigned int
 radix_tree_gang_lookup_slot(struct radix_tree_root *root, void ***results,
-			unsigned long first_index, unsigned int max_items);
+			unsigned long *indices, unsigned long first_index,
+			unsigned int max_items);
 unsigned long radix_tree_next_hole(struct radix_tree_root *root,
 				unsigned long index, unsigned long max_scan);
 int radix_tree_preload(gfp_t gfp_mask);
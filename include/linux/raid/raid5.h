@@ -3,6 +3,7 @@
 
 #include <linux/raid/md.h>
 #include <linux/raid/xor.h>
+#include <linux/workqueue.h>
 
 /*
  *
@@ -198,6 +199,7 @@ enum reconstruct_states {
 struct stripe_head {
 	struct hlist_node	hash;
 	struct list_head	lru;			/* inactive_list or handle_list */
+	struct list_head	worker_list;		/* raid5_worker list */
 	struct raid5_private_data	*raid_conf;
 	sector_t		sector;			/* sector of this row */
 	int			pd_idx;			/* parity disk index */
@@ -325,6 +327,18 @@ struct disk_info {
 	mdk_rdev_t	*rdev;
 };
 
+/*
+ * Stripe handling worker, one per cpu.  raid5d hands it stripes on
+ * 'list', linked through sh->worker_list under device_lock, and it
+ * handles them on its own cpu.
+ */
+struct raid5_worker {
+	struct work_struct	work;
+	struct raid5_private_data *conf;
+	struct list_head	list;
+	struct page		*spare_page; /* raid6 P/Q check */
+};
+
 struct raid5_private_data {
 	struct hlist_head	*stripe_hashtbl;
 	mddev_t			*mddev;
@@ -385,6 +399,14 @@ struct raid5_private_data {
 	int			pool_size; /* number of disks in stripeheads in pool */
 	spinlock_t		device_lock;
 	struct disk_info	*disks;
+
+	/*
+	 * Stripe handling workers.  With nr_workers set, raid5d only
+	 * dispatches stripes, to the workers of up to that many cpus.
+	 */
+	struct workqueue_struct	*workqueue;
+	struct raid5_worker	*workers; /* per cpu */
+	int			nr_workers;
 };
 
 typedef struct raid5_private_data raid5_conf_t;
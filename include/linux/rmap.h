@@ -87,7 +87,7 @@ static inline void page_dup_rmap(struct page *page, struct vm_area_struct *vma,
  * Called from mm/vmscan.c to handle paging out
  */
 int page_referenced(struct page *, int is_locked, struct mem_cgroup *cnt);
-int try_to_unmap(struct page *, int ignore_refs);
+int try_to_unmap(struct page *, int mode);
 
 /*
  * Called from mm/filemap_xip.c to unmap empty zero page
@@ -128,7 +128,7 @@ static inline int try_to_munlock(struct page *page)
 #define anon_vma_link(vma)	do {} while (0)
 
 #define page_referenced(page,l,cnt) TestClearPageReferenced(page)
-#define try_to_unmap(page, refs) SWAP_FAIL
+#define try_to_unmap(page, mode) SWAP_FAIL
 
 static inline int page_mkclean(struct page *page)
 {
@@ -146,4 +146,11 @@ static inline int page_mkclean(struct page *page)
 #define SWAP_FAIL	2
 #define SWAP_MLOCK	3
 
+/*
+ * Modes of try_to_unmap
+ */
+#define TTU_UNMAP	0	/* pageout: replace with swap entries */
+#define TTU_MIGRATION	1	/* replace with migration entries */
+#define TTU_DISCARD	2	/* drop clean MADV_FREE pages outright */
+
 #endif	/* _LINUX_RMAP_H */
@@ -177,6 +177,7 @@ extern void lru_cache_add_lru(struct page *, enum lru_list lru);
 extern void lru_cache_add_active_or_unevictable(struct page *,
 					struct vm_area_struct *);
 extern void activate_page(struct page *);
+extern void deactivate_page(struct page *);
 extern void mark_page_accessed(struct page *);
 extern void lru_add_drain(void);
 extern int lru_add_drain_all(void);
@@ -209,6 +210,12 @@ static inline void lru_cache_add_active_file(struct page *page)
 	__lru_cache_add(page, LRU_ACTIVE_FILE);
 }
 
+/* linux/mm/workingset.c */
+extern atomic_long_t workingset_shadows;
+void *workingset_eviction(struct address_space *mapping, struct page *page);
+int workingset_refault(void *shadow);
+void workingset_activation(struct page *page);
+
 /* linux/mm/vmscan.c */
 extern unsigned long try_to_free_pages(struct zonelist *zonelist, int order,
 					gfp_t gfp_mask);
@@ -286,11 +293,16 @@ extern void __delete_from_swap_cache(struct page *);
 extern void delete_from_swap_cache(struct page *);
 extern void free_page_and_swap_cache(struct page *);
 extern void free_pages_and_swap_cache(struct page **, int);
-extern struct page *lookup_swap_cache(swp_entry_t);
+extern struct page *lookup_swap_cache(swp_entry_t,
+			struct vm_area_struct *vma, unsigned long addr);
 extern struct page *read_swap_cache_async(swp_entry_t, gfp_t,
 			struct vm_area_struct *vma, unsigned long addr);
 extern struct page *swapin_readahead(swp_entry_t, gfp_t,
 			struct vm_area_struct *vma, unsigned long addr);
+extern struct page *swap_vma_readahead(swp_entry_t, gfp_t,
+			struct vm_area_struct *vma, unsigned long addr,
+			pmd_t *pmd);
+extern int sysctl_swap_vma_readahead;
 
 /* linux/mm/swapfile.c */
 extern long total_swap_pages;
@@ -369,7 +381,15 @@ static inline struct page *swapin_readahead(swp_entry_t swp, gfp_t gfp_mask,
 	return NULL;
 }
 
-static inline struct page *lookup_swap_cache(swp_entry_t swp)
+static inline struct page *swap_vma_readahead(swp_entry_t swp,
+			gfp_t gfp_mask, struct vm_area_struct *vma,
+			unsigned long addr, pmd_t *pmd)
+{
+	return NULL;
+}
+
+static inline struct page *lookup_swap_cache(swp_entry_t swp,
+			struct vm_area_struct *vma, unsigned long addr)
 {
 	return NULL;
 }
@@ -107,16 +107,38 @@
  *    ->dcache_lock		(proc_pid_lookup)
  */
 
+static void page_cache_tree_delete(struct address_space *mapping,
+				   struct page *page, void *shadow)
+{
+	void **slot;
+
+	if (!shadow) {
+		radix_tree_delete(&mapping->page_tree, page->index);
+		return;
+	}
+
+	/*
+	 * Leave the shadow entry of the evicted page behind, so that a
+	 * refault can be recognised (see mm/workingset.c).
+	 */
+	slot = radix_tree_lookup_slot(&mapping->page_tree, page->index);
+	radix_tree_replace_slot(slot, shadow);
+	mapping->nrshadows++;
+	atomic_long_inc(&workingset_shadows);
+}
+
 /*
  * Remove a page from the page cache and free it. Caller has to make
  * sure the page is locked and that nobody else uses it - or that usage
  * is safe.  The caller must hold the mapping's tree_lock.
+ *
+ * If @shadow is not NULL, it is stored in place of the page.
  */
-void __remove_from_page_cache(struct page *page)
+void __remove_from_page_cache(struct page *page, void *shadow)
 {
 	struct address_space *mapping = page->mapping;
 
-	radix_tree_delete(&mapping->page_tree, page->index);
+	page_cache_tree_delete(mapping, page, shadow);
 	page->mapping = NULL;
 	mapping->nrpages--;
 	__dec_zone_page_state(page, NR_FILE_PAGES);
@@ -143,7 +165,7 @@ void remove_from_page_cache(struct page *page)
 	BUG_ON(!PageLocked(page));
 
 	spin_lock_irq(&mapping->tree_lock);
-	__remove_from_page_cache(page);
+	__remove_from_page_cache(page, NULL);
 	spin_unlock_irq(&mapping->tree_lock);
 }
 
@@ -442,18 +464,30 @@ int filemap_write_and_wait_range(struct address_space *mapping,
 	return err;
 }
 
-/**
- * add_to_page_cache_locked - add a locked page to the pagecache
- * @page:	page to add
- * @mapping:	the page's address_space
- * @offset:	page index
- * @gfp_mask:	page allocation mode
- *
- * This function is used to add a page to the pagecache. It must be locked.
- * This function does not add the page to the LRU.  The caller must do that.
- */
-int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
-		pgoff_t offset, gfp_t gfp_mask)
+static int page_cache_tree_insert(struct address_space *mapping,
+				  struct page *page, void **shadowp)
+{
+	void **slot;
+	void *p;
+
+	slot = radix_tree_lookup_slot(&mapping->page_tree, page->index);
+	if (slot) {
+		p = radix_tree_deref_slot(slot);
+		if (!radix_tree_exceptional_entry(p))
+			return -EEXIST;
+		if (shadowp)
+			*shadowp = p;
+		mapping->nrshadows--;
+		atomic_long_dec(&workingset_shadows);
+		radix_tree_replace_slot(slot, page);
+		return 0;
+	}
+	return radix_tree_insert(&mapping->page_tree, page->index, page);
+}
+
+static int __add_to_page_cache_locked(struct page *page,
+		struct address_space *mapping, pgoff_t offset,
+		gfp_t gfp_mask, void **shadowp)
 {
 	int error;
 
@@ -471,7 +505,7 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 		page->index = offset;
 
 		spin_lock_irq(&mapping->tree_lock);
-		error = radix_tree_insert(&mapping->page_tree, offset, page);
+		error = page_cache_tree_insert(mapping, page, shadowp);
 		if (likely(!error)) {
 			mapping->nrpages++;
 			__inc_zone_page_state(page, NR_FILE_PAGES);
@@ -488,11 +522,75 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 out:
 	return error;
 }
+
+/**
+ * add_to_page_cache_locked - add a locked page to the pagecache
+ * @page:	page to add
+ * @mapping:	the page's address_space
+ * @offset:	page index
+ * @gfp_mask:	page allocation mode
+ *
+ * This function is used to add a page to the pagecache. It must be locked.
+ * This function does not add the page to the LRU.  The caller must do that.
+ */
+int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
+		pgoff_t offset, gfp_t gfp_mask)
+{
+	return __add_to_page_cache_locked(page, mapping, offset,
+					  gfp_mask, NULL);
+}
 EXPORT_SYMBOL(add_to_page_cache_locked);
 
+/**
+ * replace_page_cache_page - put a new page in place of a pagecache page
+ * @old:	page to be replaced
+ * @new:	page to put in its place
+ * @gfp_mask:	allocation mode for charging @new
+ *
+ * The slot of @old is reused, so nothing is allocated and the index is
+ * never empty.  Both pages must be locked, @old must be clean and not
+ * mapped, and @new must not be in any mapping.  On success the page
+ * cache reference moves from @old to @new.  @new is not added to the
+ * LRU, the caller must do that.
+ */
+int replace_page_cache_page(struct page *old, struct page *new, gfp_t gfp_mask)
+{
+	struct address_space *mapping = old->mapping;
+	void **slot;
+	int error;
+
+	VM_BUG_ON(!PageLocked(old));
+	VM_BUG_ON(!PageLocked(new));
+	VM_BUG_ON(new->mapping);
+
+	error = mem_cgroup_cache_charge(new, current->mm,
+					gfp_mask & ~__GFP_HIGHMEM);
+	if (error)
+		return error;
+
+	page_cache_get(new);
+	new->mapping = mapping;
+	new->index = old->index;
+
+	spin_lock_irq(&mapping->tree_lock);
+	slot = radix_tree_lookup_slot(&mapping->page_tree, old->index);
+	VM_BUG_ON(!slot || radix_tree_deref_slot(slot) != old);
+	radix_tree_replace_slot(slot, new);
+	old->mapping = NULL;
+	__dec_zone_page_state(old, NR_FILE_PAGES);
+	__inc_zone_page_state(new, NR_FILE_PAGES);
+	spin_unlock_irq(&mapping->tree_lock);
+
+	mem_cgroup_uncharge_cache_page(old);
+	page_cache_release(old);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(replace_page_cache_page);
+
 int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 				pgoff_t offset, gfp_t gfp_mask)
 {
+	void *shadow = NULL;
 	int ret;
 
 	/*
@@ -504,14 +602,27 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 	if (mapping_cap_swap_backed(mapping))
 		SetPageSwapBacked(page);
 
-	ret = add_to_page_cache(page, mapping, offset, gfp_mask);
-	if (ret == 0) {
-		if (page_is_file_cache(page))
-			lru_cache_add_file(page);
-		else
-			lru_cache_add_active_anon(page);
+	__set_page_locked(page);
+	ret = __add_to_page_cache_locked(page, mapping, offset,
+					 gfp_mask, &shadow);
+	if (unlikely(ret)) {
+		__clear_page_locked(page);
+		return ret;
 	}
-	return ret;
+
+	if (page_is_file_cache(page)) {
+		/*
+		 * A page that was evicted recently enough to have been
+		 * activated, had it stayed, is part of the working set.
+		 */
+		if (shadow && workingset_refault(shadow)) {
+			lru_cache_add_active_file(page);
+			workingset_activation(page);
+		} else
+			lru_cache_add_file(page);
+	} else
+		lru_cache_add_active_anon(page);
+	return 0;
 }
 
 #ifdef CONFIG_NUMA
@@ -664,6 +775,12 @@ repeat:
 		if (unlikely(!page || page == RADIX_TREE_RETRY))
 			goto repeat;
 
+		/* A shadow entry of a recently evicted page */
+		if (radix_tree_exceptional_entry(page)) {
+			page = NULL;
+			goto out;
+		}
+
 		if (!page_cache_get_speculative(page))
 			goto repeat;
 
@@ -677,6 +794,7 @@ repeat:
 			goto repeat;
 		}
 	}
+out:
 	rcu_read_unlock();
 
 	return page;
@@ -753,6 +871,34 @@ repeat:
 }
 EXPORT_SYMBOL(find_or_create_page);
 
+/**
+ * page_cache_next_hole - find the next hole (not-present page)
+ * @mapping:	The address_space to search
+ * @index:	The starting page index
+ * @max_scan:	Maximum range to search
+ *
+ * Like radix_tree_next_hole(), except that the shadow entries of
+ * evicted pages count as holes.  May be called under rcu_read_lock.
+ */
+pgoff_t page_cache_next_hole(struct address_space *mapping,
+			     pgoff_t index, unsigned long max_scan)
+{
+	unsigned long i;
+
+	for (i = 0; i < max_scan; i++) {
+		void *entry = radix_tree_lookup(&mapping->page_tree, index);
+
+		if (!entry || radix_tree_exceptional_entry(entry))
+			break;
+		index++;
+		if (index == 0)
+			break;
+	}
+
+	return index;
+}
+EXPORT_SYMBOL(page_cache_next_hole);
+
 /**
  * find_get_pages - gang pagecache lookup
  * @mapping:	The address_space to search
@@ -772,39 +918,63 @@ EXPORT_SYMBOL(find_or_create_page);
 unsigned find_get_pages(struct address_space *mapping, pgoff_t start,
 			    unsigned int nr_pages, struct page **pages)
 {
-	unsigned int i;
+	unsigned long indices[PAGEVEC_SIZE];
+	unsigned int i, base;
 	unsigned int ret;
 	unsigned int nr_found;
+	pgoff_t index;
 
 	rcu_read_lock();
 restart:
-	nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
-				(void ***)pages, start, nr_pages);
 	ret = 0;
-	for (i = 0; i < nr_found; i++) {
-		struct page *page;
+	index = start;
+	/*
+	 * The slots of shadow entries are looked up but not returned, so
+	 * keep looking until we have @nr_pages pages or the tree is done
+	 * with: callers take a short count for the end of the mapping.
+	 */
+	while (ret < nr_pages) {
+		base = ret;
+		nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
+				(void ***)(pages + base), indices, index,
+				min_t(unsigned int, nr_pages - base,
+				      PAGEVEC_SIZE));
+		if (!nr_found)
+			break;
+		index = indices[nr_found - 1] + 1;
+
+		for (i = 0; i < nr_found; i++) {
+			void **slot = (void **)pages[base + i];
+			struct page *page;
 repeat:
-		page = radix_tree_deref_slot((void **)pages[i]);
-		if (unlikely(!page))
-			continue;
-		/*
-		 * this can only trigger if nr_found == 1, making livelock
-		 * a non issue.
-		 */
-		if (unlikely(page == RADIX_TREE_RETRY))
-			goto restart;
+			page = radix_tree_deref_slot(slot);
+			if (unlikely(!page))
+				continue;
+			/*
+			 * this can only trigger if nr_found == 1, making
+			 * livelock a non issue.
+			 */
+			if (unlikely(page == RADIX_TREE_RETRY))
+				goto restart;
 
-		if (!page_cache_get_speculative(page))
-			goto repeat;
+			/* Skip over shadow entries of evicted pages */
+			if (radix_tree_exceptional_entry(page))
+				continue;
 
-		/* Has the page moved? */
-		if (unlikely(page != *((void **)pages[i]))) {
-			page_cache_release(page);
-			goto repeat;
-		}
+			if (!page_cache_get_speculative(page))
+				goto repeat;
 
-		pages[ret] = page;
-		ret++;
+			/* Has the page moved? */
+			if (unlikely(page != *slot)) {
+				page_cache_release(page);
+				goto repeat;
+			}
+
+			pages[ret] = page;
+			ret++;
+		}
+		if (!index)
+			break;
 	}
 	rcu_read_unlock();
 	return ret;
@@ -832,7 +1002,7 @@ unsigned find_get_pages_contig(struct address_space *mapping, pgoff_t index,
 	rcu_read_lock();
 restart:
 	nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
-				(void ***)pages, index, nr_pages);
+				(void ***)pages, NULL, index, nr_pages);
 	ret = 0;
 	for (i = 0; i < nr_found; i++) {
 		struct page *page;
@@ -847,6 +1017,10 @@ repeat:
 		if (unlikely(page == RADIX_TREE_RETRY))
 			goto restart;
 
+		/* A shadow entry is a hole as far as we are concerned */
+		if (radix_tree_exceptional_entry(page))
+			break;
+
 		if (page->mapping == NULL || page->index != index)
 			break;
 
@@ -1598,8 +1772,100 @@ page_not_uptodate:
 }
 EXPORT_SYMBOL(filemap_fault);
 
+/**
+ * filemap_map_pages - map cached pages around a read fault
+ * @vma:	vma in which the fault was taken
+ * @vmf:	struct vm_fault describing the range to map
+ *
+ * Installs ptes for the pages between @vmf->pgoff and @vmf->max_pgoff that
+ * are already uptodate in the page cache, so that neighbouring accesses
+ * don't have to take a fault of their own.  Pages that are locked, under
+ * readahead or not uptodate are left for ->fault to deal with.
+ *
+ * Called with the page table lock held, so this must not sleep.
+ */
+int filemap_map_pages(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+	struct file *file = vma->vm_file;
+	struct address_space *mapping = file->f_mapping;
+	void **slots[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
+	unsigned long address = (unsigned long)vmf->virtual_address;
+	pgoff_t next = vmf->pgoff;
+	pgoff_t size;
+	unsigned int i, nr;
+	int mapped = 0;
+	struct page *page;
+	pte_t *pte;
+
+	rcu_read_lock();
+	while (next <= vmf->max_pgoff) {
+		nr = radix_tree_gang_lookup_slot(&mapping->page_tree, slots,
+						 indices, next, PAGEVEC_SIZE);
+		if (!nr)
+			break;
+		for (i = 0; i < nr; i++) {
+			if (indices[i] > vmf->max_pgoff)
+				goto out;
+repeat:
+			page = radix_tree_deref_slot(slots[i]);
+			if (unlikely(!page))
+				continue;
+			/* RETRY has the exceptional bit set, test it first */
+			if (unlikely(page == RADIX_TREE_RETRY))
+				goto out;
+			if (radix_tree_exceptional_entry(page))
+				continue;
+			if (!page_cache_get_speculative(page))
+				goto repeat;
+
+			/* Has the page moved? */
+			if (unlikely(page != *slots[i])) {
+				page_cache_release(page);
+				goto repeat;
+			}
+
+			if (!PageUptodate(page) || PageReadahead(page))
+				goto skip;
+			if (!trylock_page(page))
+				goto skip;
+			if (page->mapping != mapping || !PageUptodate(page))
+				goto unlock;
+
+			size = (i_size_read(mapping->host) + PAGE_CACHE_SIZE - 1)
+							>> PAGE_CACHE_SHIFT;
+			if (page->index >= size)
+				goto unlock;
+
+			pte = vmf->pte + page->index - vmf->pgoff;
+			if (!pte_none(*pte))
+				goto unlock;
+
+			if (file->f_ra.mmap_miss > 0)
+				file->f_ra.mmap_miss--;
+			do_set_pte(vma, address + ((page->index - vmf->pgoff)
+						   << PAGE_SHIFT), page, pte);
+			unlock_page(page);
+			mapped++;
+			continue;
+unlock:
+			unlock_page(page);
+skip:
+			page_cache_release(page);
+		}
+		if (indices[nr - 1] >= vmf->max_pgoff)
+			break;
+		next = indices[nr - 1] + 1;
+	}
+out:
+	rcu_read_unlock();
+	return mapped;
+}
+EXPORT_SYMBOL(filemap_map_pages);
+
 struct vm_operations_struct generic_file_vm_ops = {
 	.fault		= filemap_fault,
+	.map_pages	= filemap_map_pages,
 };
 
 /* This is used for a general mmap of a disk file */
@@ -11,6 +11,10 @@
 #include <linux/mempolicy.h>
 #include <linux/hugetlb.h>
 #include <linux/sched.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/highmem.h>
+#include <asm/tlbflush.h>
 
 /*
  * Any behaviour which results in changes to the vma->vm_flags needs to
@@ -23,6 +27,7 @@ static int madvise_need_mmap_write(int behavior)
 	case MADV_REMOVE:
 	case MADV_WILLNEED:
 	case MADV_DONTNEED:
+	case MADV_FREE:
 		return 0;
 	default:
 		/* be safe, default to 1. list exceptions explicitly */
@@ -166,6 +171,111 @@ static long madvise_dontneed(struct vm_area_struct * vma,
 	return 0;
 }
 
+/*
+ * Application no longer needs the contents of an anonymous range, but
+ * will likely reuse the memory (a malloc arena, say).  Rather than
+ * zapping the pages now and faulting fresh zeroed ones in later, mark
+ * them clean and lazily freeable: reclaim drops them without swapping
+ * them out if they are still clean by then, and a write before that
+ * simply redirties the pte and cancels the free.
+ *
+ * Pages we cannot take over this way (shared with another mm, or with
+ * a copy in swap) are left alone.  Swap entries in the range are freed.
+ */
+static void madvise_free_pte_range(struct vm_area_struct *vma, pmd_t *pmd,
+				   unsigned long addr, unsigned long end)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	spinlock_t *ptl;
+	pte_t *pte, ptent;
+	struct page *page;
+
+	pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
+	arch_enter_lazy_mmu_mode();
+	do {
+		ptent = *pte;
+		if (pte_none(ptent))
+			continue;
+		if (!pte_present(ptent)) {
+			swp_entry_t entry;
+
+			if (pte_file(ptent))
+				continue;
+			entry = pte_to_swp_entry(ptent);
+			if (is_migration_entry(entry))
+				continue;
+			free_swap_and_cache(entry);
+			pte_clear_not_present_full(mm, addr, pte, 0);
+			continue;
+		}
+
+		page = vm_normal_page(vma, addr, ptent);
+		if (!page || !PageAnon(page) || page_mapcount(page) != 1)
+			continue;
+		if (PageSwapCache(page) || !trylock_page(page))
+			continue;
+		/* Only reclaim adds it to swap, and that needs the page lock */
+		if (PageSwapCache(page)) {
+			unlock_page(page);
+			continue;
+		}
+		ClearPageDirty(page);
+		ClearPageReferenced(page);
+		SetPageLazyFree(page);
+		unlock_page(page);
+
+		if (pte_dirty(ptent) || pte_young(ptent)) {
+			ptent = ptep_modify_prot_start(mm, addr, pte);
+			ptent = pte_mkold(pte_mkclean(ptent));
+			ptep_modify_prot_commit(mm, addr, pte, ptent);
+		}
+		deactivate_page(page);
+		count_vm_event(PGLAZYFREE);
+	} while (pte++, addr += PAGE_SIZE, addr != end);
+	arch_leave_lazy_mmu_mode();
+	pte_unmap_unlock(pte - 1, ptl);
+}
+
+static long madvise_free(struct vm_area_struct *vma,
+			 struct vm_area_struct **prev,
+			 unsigned long start, unsigned long end)
+{
+	unsigned long addr, next;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	*prev = vma;
+	if (vma->vm_file || vma->vm_ops ||
+	    (vma->vm_flags & (VM_SHARED|VM_LOCKED|VM_HUGETLB|VM_PFNMAP)))
+		return -EINVAL;
+
+	/*
+	 * Without swap the anonymous LRU lists are not scanned at all,
+	 * so the pages would never be freed: do it right away instead.
+	 */
+	if (nr_swap_pages <= 0)
+		return madvise_dontneed(vma, prev, start, end);
+
+	for (addr = start; addr != end; addr = next) {
+		next = pgd_addr_end(addr, end);
+		pgd = pgd_offset(vma->vm_mm, addr);
+		if (pgd_none_or_clear_bad(pgd))
+			continue;
+		pud = pud_offset(pgd, addr);
+		next = pud_addr_end(addr, next);
+		if (pud_none_or_clear_bad(pud))
+			continue;
+		pmd = pmd_offset(pud, addr);
+		next = pmd_addr_end(addr, next);
+		if (pmd_none_or_clear_bad(pmd))
+			continue;
+		madvise_free_pte_range(vma, pmd, addr, next);
+	}
+	flush_tlb_range(vma, start, end);
+	return 0;
+}
+
 /*
  * Application wants to free up the pages and associated backing store.
  * This is effectively punching a hole into the middle of a file.
@@ -238,6 +348,10 @@ madvise_vma(struct vm_area_struct *vma, struct vm_area_struct **prev,
 		error = madvise_dontneed(vma, prev, start, end);
 		break;
 
+	case MADV_FREE:
+		error = madvise_free(vma, prev, start, end);
+		break;
+
 	default:
 		error = -EINVAL;
 		break;
@@ -267,6 +381,9 @@ madvise_vma(struct vm_area_struct *vma, struct vm_area_struct **prev,
  *		some pages ahead.
  *  MADV_DONTNEED - the application is finished with the given range,
  *		so the kernel can free resources associated with it.
+ *  MADV_FREE - the application no longer needs the contents of the
+ *		given anonymous range; the kernel may free the pages
+ *		under memory pressure unless they are written to first.
  *  MADV_REMOVE - the application wants to free up the given range of
  *		pages and associated backing store.
  *
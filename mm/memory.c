@@ -2296,11 +2296,11 @@ static int do_swap_page(struct mm_struct *mm, struct vm_area_struct *vma,
 		goto out;
 	}
 	delayacct_set_flag(DELAYACCT_PF_SWAPIN);
-	page = lookup_swap_cache(entry);
+	page = lookup_swap_cache(entry, vma, address);
 	if (!page) {
 		grab_swap_token(); /* Contend for token _before_ read-in */
-		page = swapin_readahead(entry,
-					GFP_HIGHUSER_MOVABLE, vma, address);
+		page = swap_vma_readahead(entry, GFP_HIGHUSER_MOVABLE,
+					  vma, address, pmd);
 		if (!page) {
 			/*
 			 * Back out if somebody else faulted in this pte
@@ -2605,6 +2605,100 @@ out_unlocked:
 	return ret;
 }
 
+/**
+ * do_set_pte - install a read-only pte for a page cache page
+ * @vma:	virtual memory area
+ * @address:	user virtual address
+ * @page:	page to map, locked, with a reference that the pte takes over
+ * @pte:	pointer to the target pte, which must be none
+ *
+ * Caller must hold the page table lock.
+ */
+void do_set_pte(struct vm_area_struct *vma, unsigned long address,
+		struct page *page, pte_t *pte)
+{
+	pte_t entry;
+
+	flush_icache_page(vma, page);
+	entry = mk_pte(page, vma->vm_page_prot);
+	inc_mm_counter(vma->vm_mm, file_rss);
+	page_add_file_rmap(page);
+	set_pte_at(vma->vm_mm, address, pte, entry);
+
+	/* no need to invalidate: a not-present page won't be cached */
+	update_mmu_cache(vma, address, entry);
+}
+
+/*
+ * Size of the window that a read fault on a file mapping tries to
+ * populate from the page cache in one go.  Rounded down to a power of
+ * two number of pages; values of a page or less disable fault-around.
+ */
+int sysctl_fault_around_bytes __read_mostly = 65536;
+
+static unsigned long fault_around_pages(void)
+{
+	unsigned long nr_pages;
+
+	nr_pages = sysctl_fault_around_bytes >> PAGE_SHIFT;
+	if (nr_pages <= 1)
+		return 1;
+	nr_pages = rounddown_pow_of_two(nr_pages);
+	return min_t(unsigned long, nr_pages, PTRS_PER_PTE);
+}
+
+/*
+ * Map the uptodate page cache pages surrounding a read fault, as far as
+ * they lie within the vma and the page table that @pte belongs to.
+ * Returns the number of pages mapped, the faulting one included.
+ * Called with the page table lock held.
+ */
+static int do_fault_around(struct vm_area_struct *vma, unsigned long address,
+		pte_t *pte, pgoff_t pgoff, unsigned int flags)
+{
+	unsigned long start_addr, nr_pages, mask;
+	pgoff_t max_pgoff;
+	struct vm_fault vmf;
+	int off;
+
+	nr_pages = fault_around_pages();
+	mask = ~(nr_pages * PAGE_SIZE - 1) & PAGE_MASK;
+
+	start_addr = max(address & mask, vma->vm_start);
+	off = ((address - start_addr) >> PAGE_SHIFT) & (PTRS_PER_PTE - 1);
+	pte -= off;
+	pgoff -= off;
+
+	/*
+	 * Stop at the end of the page table, the end of the vma or the
+	 * end of the window, whichever comes first.
+	 */
+	max_pgoff = pgoff - ((start_addr >> PAGE_SHIFT) & (PTRS_PER_PTE - 1)) +
+		PTRS_PER_PTE - 1;
+	max_pgoff = min_t(pgoff_t, max_pgoff,
+			  vma_pages(vma) + vma->vm_pgoff - 1);
+	max_pgoff = min_t(pgoff_t, max_pgoff, pgoff + nr_pages - 1);
+
+	/* Skip the leading ptes that are already populated */
+	while (!pte_none(*pte)) {
+		if (++pgoff > max_pgoff)
+			return 0;
+		start_addr += PAGE_SIZE;
+		if (start_addr >= vma->vm_end)
+			return 0;
+		pte++;
+	}
+
+	vmf.virtual_address = (void __user *)start_addr;
+	vmf.pte = pte;
+	vmf.pgoff = pgoff;
+	vmf.max_pgoff = max_pgoff;
+	vmf.flags = flags;
+	vmf.page = NULL;
+	count_vm_event(PGFAULTAROUND);
+	return vma->vm_ops->map_pages(vma, &vmf);
+}
+
 static int do_linear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 		unsigned long address, pte_t *page_table, pmd_t *pmd,
 		int write_access, pte_t orig_pte)
@@ -2613,7 +2707,33 @@ static int do_linear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 			- vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff;
 	unsigned int flags = (write_access ? FAULT_FLAG_WRITE : 0);
 
-	pte_unmap(page_table);
+	/*
+	 * On a read fault, first try to map the faulting page and its
+	 * neighbours straight from the page cache.  If that populated
+	 * the faulting pte, we are done.
+	 */
+	if (!write_access && vma->vm_ops->map_pages &&
+	    fault_around_pages() > 1) {
+		spinlock_t *ptl = pte_lockptr(mm, pmd);
+		int mapped = 0, done;
+
+		spin_lock(ptl);
+		/* Somebody else may have populated it meanwhile */
+		done = !pte_same(*page_table, orig_pte);
+		if (!done) {
+			mapped = do_fault_around(vma, address, page_table,
+						 pgoff, flags);
+			done = !pte_same(*page_table, orig_pte);
+		}
+		pte_unmap_unlock(page_table, ptl);
+		/* Only count the neighbours, not the faulting page */
+		if (mapped > done)
+			count_vm_events(PGFAULTAROUND_MAPPED, mapped - done);
+		if (done)
+			return 0;
+	} else
+		pte_unmap(page_table);
+
 	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
 }
 
@@ -687,7 +687,7 @@ static int unmap_and_move(new_page_t get_new_page, unsigned long private,
 	}
 
 	/* Establish migration ptes or remove ptes */
-	try_to_unmap(page, 1);
+	try_to_unmap(page, TTU_MIGRATION);
 
 	if (!page_mapped(page))
 		rc = move_to_new_page(newpage, page);
@@ -758,7 +758,7 @@ void page_remove_rmap(struct page *page, struct vm_area_struct *vma)
  * repeatedly from either try_to_unmap_anon or try_to_unmap_file.
  */
 static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
-				int migration)
+				int mode)
 {
 	struct mm_struct *mm = vma->vm_mm;
 	unsigned long address;
@@ -780,7 +780,7 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	 * If it's recently referenced (perhaps page_referenced
 	 * skipped over this mm) then we should reactivate it.
 	 */
-	if (!migration) {
+	if (mode != TTU_MIGRATION) {
 		if (vma->vm_flags & VM_LOCKED) {
 			ret = SWAP_MLOCK;
 			goto out_unmap;
@@ -795,6 +795,22 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	flush_cache_page(vma, address, page_to_pfn(page));
 	pteval = ptep_clear_flush_notify(vma, address, pte);
 
+	if (mode == TTU_DISCARD) {
+		/*
+		 * Written to since madvise(MADV_FREE): the contents are
+		 * wanted after all, put the mapping back.  The pte lock
+		 * holds off anyone faulting on the cleared entry meanwhile.
+		 */
+		if (pte_dirty(pteval) || PageDirty(page)) {
+			set_pte_at(mm, address, pte, pteval);
+			ret = SWAP_FAIL;
+			goto out_unmap;
+		}
+		update_hiwater_rss(mm);
+		dec_mm_counter(mm, anon_rss);
+		goto discard;
+	}
+
 	/* Move the dirty bit to the physical page now the pte is gone. */
 	if (pte_dirty(pteval))
 		set_page_dirty(page);
@@ -825,7 +841,7 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 			 * pte. do_swap_page() will wait until the migration
 			 * pte is removed and then restart fault handling.
 			 */
-			BUG_ON(!migration);
+			BUG_ON(mode != TTU_MIGRATION);
 			entry = make_migration_entry(page, pte_write(pteval));
 #endif
 		}
@@ -833,7 +849,7 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 		BUG_ON(pte_file(*pte));
 	} else
 #ifdef CONFIG_MIGRATION
-	if (migration) {
+	if (mode == TTU_MIGRATION) {
 		/* Establish migration entry for a file page */
 		swp_entry_t entry;
 		entry = make_migration_entry(page, pte_write(pteval));
@@ -842,7 +858,7 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 #endif
 		dec_mm_counter(mm, file_rss);
 
-
+discard:
 	page_remove_rmap(page, vma);
 	page_cache_release(page);
 
@@ -991,7 +1007,7 @@ static int try_to_mlock_page(struct page *page, struct vm_area_struct *vma)
  * rmap method
  * @page: the page to unmap/unlock
  * @unlock:  request for unlock rather than unmap [unlikely]
- * @migration:  unmapping for migration - ignored if @unlock
+ * @mode:       TTU_* unmapping mode - ignored if @unlock
  *
  * Find all the mappings of a page using the mapping pointer and the vma chains
  * contained in the anon_vma struct it points to.
@@ -1003,7 +1019,7 @@ static int try_to_mlock_page(struct page *page, struct vm_area_struct *vma)
  * vm_flags for that VMA.  That should be OK, because that vma shouldn't be
  * 'LOCKED.
  */
-static int try_to_unmap_anon(struct page *page, int unlock, int migration)
+static int try_to_unmap_anon(struct page *page, int unlock, int mode)
 {
 	struct anon_vma *anon_vma;
 	struct vm_area_struct *vma;
@@ -1024,7 +1040,7 @@ static int try_to_unmap_anon(struct page *page, int unlock, int migration)
 				continue;  /* must visit all unlocked vmas */
 			ret = SWAP_MLOCK;  /* saw at least one mlocked vma */
 		} else {
-			ret = try_to_unmap_one(page, vma, migration);
+			ret = try_to_unmap_one(page, vma, mode);
 			if (ret == SWAP_FAIL || !page_mapped(page))
 				break;
 		}
@@ -1049,7 +1065,7 @@ static int try_to_unmap_anon(struct page *page, int unlock, int migration)
  * try_to_unmap_file - unmap/unlock file page using the object-based rmap method
  * @page: the page to unmap/unlock
  * @unlock:  request for unlock rather than unmap [unlikely]
- * @migration:  unmapping for migration - ignored if @unlock
+ * @mode:       TTU_* unmapping mode - ignored if @unlock
  *
  * Find all the mappings of a page using the mapping pointer and the vma chains
  * contained in the address_space struct it points to.
@@ -1061,7 +1077,7 @@ static int try_to_unmap_anon(struct page *page, int unlock, int migration)
  * vm_flags for that VMA.  That should be OK, because that vma shouldn't be
  * 'LOCKED.
  */
-static int try_to_unmap_file(struct page *page, int unlock, int migration)
+static int try_to_unmap_file(struct page *page, int unlock, int mode)
 {
 	struct address_space *mapping = page->mapping;
 	pgoff_t pgoff = page->index << (PAGE_CACHE_SHIFT - PAGE_SHIFT);
@@ -1084,7 +1100,7 @@ static int try_to_unmap_file(struct page *page, int unlock, int migration)
 				continue;	/* must visit all vmas */
 			ret = SWAP_MLOCK;
 		} else {
-			ret = try_to_unmap_one(page, vma, migration);
+			ret = try_to_unmap_one(page, vma, mode);
 			if (ret == SWAP_FAIL || !page_mapped(page))
 				goto out;
 		}
@@ -1109,7 +1125,8 @@ static int try_to_unmap_file(struct page *page, int unlock, int migration)
 			ret = SWAP_MLOCK;	/* leave mlocked == 0 */
 			goto out;		/* no need to look further */
 		}
-		if (!MLOCK_PAGES && !migration && (vma->vm_flags & VM_LOCKED))
+		if (!MLOCK_PAGES && mode != TTU_MIGRATION &&
+		    (vma->vm_flags & VM_LOCKED))
 			continue;
 		cursor = (unsigned long) vma->vm_private_data;
 		if (cursor > max_nl_cursor)
@@ -1143,7 +1160,7 @@ static int try_to_unmap_file(struct page *page, int unlock, int migration)
 	do {
 		list_for_each_entry(vma, &mapping->i_mmap_nonlinear,
 						shared.vm_set.list) {
-			if (!MLOCK_PAGES && !migration &&
+			if (!MLOCK_PAGES && mode != TTU_MIGRATION &&
 			    (vma->vm_flags & VM_LOCKED))
 				continue;
 			cursor = (unsigned long) vma->vm_private_data;
@@ -1183,7 +1200,8 @@ out:
 /**
  * try_to_unmap - try to remove all page table mappings to a page
  * @page: the page to get unmapped
- * @migration: migration flag
+ * @mode: TTU_UNMAP for pageout, TTU_MIGRATION to install migration
+ *        entries, TTU_DISCARD to drop a clean MADV_FREE anonymous page
  *
  * Tries to remove all the page table entries which are mapping this
  * page, used in the pageout path.  Caller must hold the page lock.
@@ -1194,16 +1212,16 @@ out:
  * SWAP_FAIL	- the page is unswappable
  * SWAP_MLOCK	- page is mlocked.
  */
-int try_to_unmap(struct page *page, int migration)
+int try_to_unmap(struct page *page, int mode)
 {
 	int ret;
 
 	BUG_ON(!PageLocked(page));
 
 	if (PageAnon(page))
-		ret = try_to_unmap_anon(page, 0, migration);
+		ret = try_to_unmap_anon(page, 0, mode);
 	else
-		ret = try_to_unmap_file(page, 0, migration);
+		ret = try_to_unmap_file(page, 0, mode);
 	if (ret != SWAP_MLOCK && !page_mapped(page))
 		ret = SWAP_SUCCESS;
 	return ret;
@@ -206,40 +206,70 @@ static struct backing_dev_info shmem_backing_dev_info  __read_mostly = {
 static LIST_HEAD(shmem_swaplist);
 static DEFINE_MUTEX(shmem_swaplist_mutex);
 
+#ifdef CONFIG_SMP
+/* How far percpu_counter_read() may stray from the exact count */
+#define SHMEM_COUNTER_SLACK	((s64)FBC_BATCH * num_possible_cpus())
+#else
+#define SHMEM_COUNTER_SLACK	0
+#endif
+
+/*
+ * Account one more block or inode in USED against the mount's LIMIT,
+ * leaving at least RESERVE more available.  The count is taken first
+ * and checked after, so concurrent chargers all see each other: while
+ * the approximate count is well below the limit that is all there is
+ * to it, only near the limit do we pay for an exact sum.  The limit is
+ * never exceeded, though a racing charger may briefly fail at it.
+ */
+static int shmem_charge(struct percpu_counter *used, unsigned long limit,
+			long reserve)
+{
+	percpu_counter_inc(used);
+	if (percpu_counter_read(used) + SHMEM_COUNTER_SLACK + reserve <= limit)
+		return 0;
+	if (percpu_counter_sum(used) + reserve <= limit)
+		return 0;
+	percpu_counter_dec(used);
+	return -ENOSPC;
+}
+
+static int shmem_charge_block(struct inode *inode, long reserve)
+{
+	struct shmem_sb_info *sbinfo = SHMEM_SB(inode->i_sb);
+
+	if (shmem_charge(&sbinfo->used_blocks, sbinfo->max_blocks, reserve))
+		return -ENOSPC;
+	spin_lock(&inode->i_lock);
+	inode->i_blocks += BLOCKS_PER_PAGE;
+	spin_unlock(&inode->i_lock);
+	return 0;
+}
+
 static void shmem_free_blocks(struct inode *inode, long pages)
 {
 	struct shmem_sb_info *sbinfo = SHMEM_SB(inode->i_sb);
 	if (sbinfo->max_blocks) {
-		spin_lock(&sbinfo->stat_lock);
-		sbinfo->free_blocks += pages;
+		percpu_counter_add(&sbinfo->used_blocks, -pages);
+		spin_lock(&inode->i_lock);
 		inode->i_blocks -= pages*BLOCKS_PER_PAGE;
-		spin_unlock(&sbinfo->stat_lock);
+		spin_unlock(&inode->i_lock);
 	}
 }
 
 static int shmem_reserve_inode(struct super_block *sb)
 {
 	struct shmem_sb_info *sbinfo = SHMEM_SB(sb);
-	if (sbinfo->max_inodes) {
-		spin_lock(&sbinfo->stat_lock);
-		if (!sbinfo->free_inodes) {
-			spin_unlock(&sbinfo->stat_lock);
-			return -ENOSPC;
-		}
-		sbinfo->free_inodes--;
-		spin_unlock(&sbinfo->stat_lock);
-	}
+	if (sbinfo->max_inodes)
+		return shmem_charge(&sbinfo->used_inodes,
+				    sbinfo->max_inodes, 0);
 	return 0;
 }
 
 static void shmem_free_inode(struct super_block *sb)
 {
 	struct shmem_sb_info *sbinfo = SHMEM_SB(sb);
-	if (sbinfo->max_inodes) {
-		spin_lock(&sbinfo->stat_lock);
-		sbinfo->free_inodes++;
-		spin_unlock(&sbinfo->stat_lock);
-	}
+	if (sbinfo->max_inodes)
+		percpu_counter_dec(&sbinfo->used_inodes);
 }
 
 /**
@@ -393,20 +423,12 @@ static swp_entry_t *shmem_swp_alloc(struct shmem_inode_info *info, unsigned long
 		if (sgp == SGP_READ)
 			return shmem_swp_map(ZERO_PAGE(0));
 		/*
-		 * Test free_blocks against 1 not 0, since we have 1 data
-		 * page (and perhaps indirect index pages) yet to allocate:
+		 * Leave 1 block free, not 0, since we have 1 data page
+		 * (and perhaps indirect index pages) yet to allocate:
 		 * a waste to allocate index if we cannot allocate data.
 		 */
-		if (sbinfo->max_blocks) {
-			spin_lock(&sbinfo->stat_lock);
-			if (sbinfo->free_blocks <= 1) {
-				spin_unlock(&sbinfo->stat_lock);
-				return ERR_PTR(-ENOSPC);
-			}
-			sbinfo->free_blocks--;
-			inode->i_blocks += BLOCKS_PER_PAGE;
-			spin_unlock(&sbinfo->stat_lock);
-		}
+		if (sbinfo->max_blocks && shmem_charge_block(inode, 1))
+			return ERR_PTR(-ENOSPC);
 
 		spin_unlock(&info->lock);
 		page = shmem_dir_alloc(mapping_gfp_mask(inode->i_mapping));
@@ -1232,7 +1254,7 @@ repeat:
 
 	if (swap.val) {
 		/* Look it up and read it in.. */
-		swappage = lookup_swap_cache(swap);
+		swappage = lookup_swap_cache(swap, NULL, 0);
 		if (!swappage) {
 			shmem_swp_unmap(entry);
 			/* here we actually do the io */
@@ -1339,17 +1361,17 @@ repeat:
 		shmem_swp_unmap(entry);
 		sbinfo = SHMEM_SB(inode->i_sb);
 		if (sbinfo->max_blocks) {
-			spin_lock(&sbinfo->stat_lock);
-			if (sbinfo->free_blocks == 0 ||
-			    shmem_acct_block(info->flags)) {
-				spin_unlock(&sbinfo->stat_lock);
+			if (shmem_charge_block(inode, 0)) {
+				spin_unlock(&info->lock);
+				error = -ENOSPC;
+				goto failed;
+			}
+			if (shmem_acct_block(info->flags)) {
+				shmem_free_blocks(inode, 1);
 				spin_unlock(&info->lock);
 				error = -ENOSPC;
 				goto failed;
 			}
-			sbinfo->free_blocks--;
-			inode->i_blocks += BLOCKS_PER_PAGE;
-			spin_unlock(&sbinfo->stat_lock);
 		} else if (shmem_acct_block(info->flags)) {
 			spin_unlock(&info->lock);
 			error = -ENOSPC;
@@ -1744,17 +1766,19 @@ static int shmem_statfs(struct dentry *dentry, struct kstatfs *buf)
 	buf->f_type = TMPFS_MAGIC;
 	buf->f_bsize = PAGE_CACHE_SIZE;
 	buf->f_namelen = NAME_MAX;
-	spin_lock(&sbinfo->stat_lock);
 	if (sbinfo->max_blocks) {
 		buf->f_blocks = sbinfo->max_blocks;
-		buf->f_bavail = buf->f_bfree = sbinfo->free_blocks;
+		buf->f_bavail = buf->f_bfree = sbinfo->max_blocks -
+			min_t(s64, sbinfo->max_blocks,
+			      percpu_counter_sum_positive(&sbinfo->used_blocks));
 	}
 	if (sbinfo->max_inodes) {
 		buf->f_files = sbinfo->max_inodes;
-		buf->f_ffree = sbinfo->free_inodes;
+		buf->f_ffree = sbinfo->max_inodes -
+			min_t(s64, sbinfo->max_inodes,
+			      percpu_counter_sum_positive(&sbinfo->used_inodes));
 	}
 	/* else leave those fields 0 like simple_statfs */
-	spin_unlock(&sbinfo->stat_lock);
 	return 0;
 }
 
@@ -2205,8 +2229,8 @@ static int shmem_remount_fs(struct super_block *sb, int *flags, char *data)
 		return error;
 
 	spin_lock(&sbinfo->stat_lock);
-	blocks = sbinfo->max_blocks - sbinfo->free_blocks;
-	inodes = sbinfo->max_inodes - sbinfo->free_inodes;
+	blocks = percpu_counter_sum(&sbinfo->used_blocks);
+	inodes = percpu_counter_sum(&sbinfo->used_inodes);
 	if (config.max_blocks < blocks)
 		goto out;
 	if (config.max_inodes < inodes)
@@ -2224,9 +2248,7 @@ static int shmem_remount_fs(struct super_block *sb, int *flags, char *data)
 
 	error = 0;
 	sbinfo->max_blocks  = config.max_blocks;
-	sbinfo->free_blocks = config.max_blocks - blocks;
 	sbinfo->max_inodes  = config.max_inodes;
-	sbinfo->free_inodes = config.max_inodes - inodes;
 
 	mpol_put(sbinfo->mpol);
 	sbinfo->mpol        = config.mpol;	/* transfers initial ref */
@@ -2257,7 +2279,11 @@ static int shmem_show_options(struct seq_file *seq, struct vfsmount *vfs)
 
 static void shmem_put_super(struct super_block *sb)
 {
-	kfree(sb->s_fs_info);
+	struct shmem_sb_info *sbinfo = SHMEM_SB(sb);
+
+	percpu_counter_destroy(&sbinfo->used_blocks);
+	percpu_counter_destroy(&sbinfo->used_inodes);
+	kfree(sbinfo);
 	sb->s_fs_info = NULL;
 }
 
@@ -2270,7 +2296,7 @@ static int shmem_fill_super(struct super_block *sb,
 	int err = -ENOMEM;
 
 	/* Round up to L1_CACHE_BYTES to resist false sharing */
-	sbinfo = kmalloc(max((int)sizeof(struct shmem_sb_info),
+	sbinfo = kzalloc(max((int)sizeof(struct shmem_sb_info),
 				L1_CACHE_BYTES), GFP_KERNEL);
 	if (!sbinfo)
 		return -ENOMEM;
@@ -2283,6 +2309,10 @@ static int shmem_fill_super(struct super_block *sb,
 	sbinfo->mpol = NULL;
 	sb->s_fs_info = sbinfo;
 
+	if (percpu_counter_init(&sbinfo->used_blocks, 0) ||
+	    percpu_counter_init(&sbinfo->used_inodes, 0))
+		goto failed;
+
 #ifdef CONFIG_TMPFS
 	/*
 	 * Per default we only allow half of the physical ram per
@@ -2303,8 +2333,6 @@ static int shmem_fill_super(struct super_block *sb,
 #endif
 
 	spin_lock_init(&sbinfo->stat_lock);
-	sbinfo->free_blocks = sbinfo->max_blocks;
-	sbinfo->free_inodes = sbinfo->max_inodes;
 
 	sb->s_maxbytes = SHMEM_MAX_BYTES;
 	sb->s_blocksize = PAGE_CACHE_SIZE;
@@ -2371,7 +2399,7 @@ static int init_inodecache(void)
 {
 	shmem_inode_cachep = kmem_cache_create("shmem_inode_cache",
 				sizeof(struct shmem_inode_info),
-				0, SLAB_PANIC, init_once);
+				0, SLAB_PANIC|SLAB_DESTROY_BY_RCU, init_once);
 	return 0;
 }
 
@@ -2415,6 +2443,7 @@ static const struct inode_operations shmem_inode_operations = {
 	.listxattr	= generic_listxattr,
 	.removexattr	= generic_removexattr,
 	.permission	= shmem_permission,
+	.permission_rcu	= shmem_permission_rcu,
 #endif
 
 };
@@ -2438,6 +2467,7 @@ static const struct inode_operations shmem_dir_inode_operations = {
 	.listxattr	= generic_listxattr,
 	.removexattr	= generic_removexattr,
 	.permission	= shmem_permission,
+	.permission_rcu	= shmem_permission_rcu,
 #endif
 };
 
@@ -2449,6 +2479,7 @@ static const struct inode_operations shmem_special_inode_operations = {
 	.listxattr	= generic_listxattr,
 	.removexattr	= generic_removexattr,
 	.permission	= shmem_permission,
+	.permission_rcu	= shmem_permission_rcu,
 #endif
 };
 
@@ -2485,6 +2516,7 @@ static struct file_system_type tmpfs_fs_type = {
 	.name		= "tmpfs",
 	.get_sb		= shmem_get_sb,
 	.kill_sb	= kill_litter_super,
+	.fs_flags	= FS_RCU_INODES,
 };
 static struct vfsmount *shm_mnt;
 
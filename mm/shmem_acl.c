@@ -195,3 +195,17 @@ shmem_permission(struct inode *inode, int mask)
 {
 	return generic_permission(inode, mask, shmem_check_acl);
 }
+
+/**
+ * shmem_permission_rcu  -  permission_rcu() inode operation
+ *
+ * Our ACLs are always in memory, so without an access ACL this is
+ * just the mode check.
+ */
+int
+shmem_permission_rcu(struct inode *inode, int mask)
+{
+	if (SHMEM_I(inode)->i_acl)
+		return -EAGAIN;
+	return generic_permission(inode, mask, NULL);
+}
@@ -3617,6 +3617,51 @@ void *kmem_cache_alloc(struct kmem_cache *cachep, gfp_t flags)
 }
 EXPORT_SYMBOL(kmem_cache_alloc);
 
+/**
+ * kmem_cache_alloc_bulk - Allocate a batch of objects
+ * @cachep: The cache to allocate from.
+ * @flags: See kmalloc().
+ * @size: Number of objects to allocate.
+ * @p: Array the objects are returned in.
+ *
+ * Takes the objects from the per-cpu array cache, refilling it as needed,
+ * with interrupts disabled only once for the whole batch.  Either all
+ * @size objects are allocated and @size is returned, or none are and 0
+ * is returned.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *cachep, gfp_t flags, size_t size,
+			  void **p)
+{
+	unsigned long save_flags;
+	size_t i, nr;
+
+	if (should_failslab(cachep, flags))
+		return 0;
+
+	cache_alloc_debugcheck_before(cachep, flags);
+	local_irq_save(save_flags);
+	for (nr = 0; nr < size; nr++) {
+		p[nr] = __do_cache_alloc(cachep, flags);
+		if (unlikely(!p[nr]))
+			break;
+	}
+	local_irq_restore(save_flags);
+
+	for (i = 0; i < nr; i++) {
+		p[i] = cache_alloc_debugcheck_after(cachep, flags, p[i],
+					__builtin_return_address(0));
+		if (unlikely(flags & __GFP_ZERO))
+			memset(p[i], 0, obj_size(cachep));
+	}
+
+	if (unlikely(nr < size)) {
+		kmem_cache_free_bulk(cachep, nr, p);
+		return 0;
+	}
+	return size;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
 /**
  * kmem_ptr_validate - check if an untrusted pointer might be a slab entry.
  * @cachep: the cache we're checking against
@@ -3765,6 +3810,31 @@ void kmem_cache_free(struct kmem_cache *cachep, void *objp)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+/**
+ * kmem_cache_free_bulk - Deallocate a batch of objects
+ * @cachep: The cache the objects were allocated from.
+ * @size: Number of objects in @p.
+ * @p: Array of objects to free.
+ *
+ * Like kmem_cache_free() for every object in @p, but with interrupts
+ * disabled only once for the whole batch.
+ */
+void kmem_cache_free_bulk(struct kmem_cache *cachep, size_t size, void **p)
+{
+	unsigned long flags;
+	size_t i;
+
+	local_irq_save(flags);
+	for (i = 0; i < size; i++) {
+		debug_check_no_locks_freed(p[i], obj_size(cachep));
+		if (!(cachep->flags & SLAB_DEBUG_OBJECTS))
+			debug_check_no_obj_freed(p[i], obj_size(cachep));
+		__cache_free(cachep, p[i]);
+	}
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
 /**
  * kfree - free previously allocated memory
  * @objp: pointer returned by kmalloc.
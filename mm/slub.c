@@ -1617,6 +1617,63 @@ void *kmem_cache_alloc(struct kmem_cache *s, gfp_t gfpflags)
 }
 EXPORT_SYMBOL(kmem_cache_alloc);
 
+/**
+ * kmem_cache_alloc_bulk - allocate a batch of objects
+ * @s: the cache to allocate from
+ * @gfpflags: see kmalloc()
+ * @size: number of objects to allocate
+ * @p: array the objects are returned in
+ *
+ * Takes the objects off the cpu slab's lockless freelist in a single
+ * interrupts-off section, falling back to the slow path only when the
+ * freelist runs dry.  Either all @size objects are allocated and @size
+ * is returned, or none are and 0 is returned.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t gfpflags, size_t size,
+			  void **p)
+{
+	struct kmem_cache_cpu *c;
+	unsigned long flags;
+	unsigned int objsize;
+	size_t i;
+
+	local_irq_save(flags);
+	c = get_cpu_slab(s, smp_processor_id());
+	objsize = c->objsize;
+	for (i = 0; i < size; i++) {
+		void **object = c->freelist;
+
+		if (unlikely(!object)) {
+			/*
+			 * The slow path may enable interrupts to allocate a
+			 * new slab, so we may be on another cpu afterwards.
+			 */
+			object = __slab_alloc(s, gfpflags, -1,
+					      __builtin_return_address(0), c);
+			if (unlikely(!object))
+				goto error;
+			c = get_cpu_slab(s, smp_processor_id());
+		} else {
+			c->freelist = object[c->offset];
+			stat(c, ALLOC_FASTPATH);
+		}
+		p[i] = object;
+	}
+	local_irq_restore(flags);
+
+	if (unlikely(gfpflags & __GFP_ZERO))
+		for (i = 0; i < size; i++)
+			memset(p[i], 0, objsize);
+
+	return size;
+
+error:
+	local_irq_restore(flags);
+	kmem_cache_free_bulk(s, i, p);
+	return 0;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
 #ifdef CONFIG_NUMA
 void *kmem_cache_alloc_node(struct kmem_cache *s, gfp_t gfpflags, int node)
 {
@@ -1735,6 +1792,42 @@ void kmem_cache_free(struct kmem_cache *s, void *x)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+/**
+ * kmem_cache_free_bulk - free a batch of objects
+ * @s: the cache the objects belong to
+ * @size: number of objects in @p
+ * @p: array of objects to free
+ *
+ * Like kmem_cache_free() for every object in @p, but with interrupts
+ * disabled only once for the whole batch.
+ */
+void kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
+{
+	struct kmem_cache_cpu *c;
+	unsigned long flags;
+	size_t i;
+
+	local_irq_save(flags);
+	c = get_cpu_slab(s, smp_processor_id());
+	for (i = 0; i < size; i++) {
+		void **object = p[i];
+		struct page *page = virt_to_head_page(object);
+
+		debug_check_no_locks_freed(object, c->objsize);
+		if (!(s->flags & SLAB_DEBUG_OBJECTS))
+			debug_check_no_obj_freed(object, s->objsize);
+		if (likely(page == c->page && c->node >= 0)) {
+			object[c->offset] = c->freelist;
+			c->freelist = object;
+			stat(c, FREE_FASTPATH);
+		} else
+			__slab_free(s, page, object,
+				    __builtin_return_address(0), c->offset);
+	}
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
 /* Figure out on which slab object the object resides */
 static struct page *get_object_page(const void *x)
 {
@@ -116,6 +116,7 @@ void __delete_from_swap_cache(struct page *page)
 	radix_tree_delete(&swapper_space.page_tree, page_private(page));
 	set_page_private(page, 0);
 	ClearPageSwapCache(page);
+	ClearPageSwapReadahead(page);
 	total_swapcache_pages--;
 	__dec_zone_page_state(page, NR_FILE_PAGES);
 	INC_CACHE_INFO(del_total);
@@ -239,20 +240,71 @@ void free_pages_and_swap_cache(struct page **pages, int nr)
 	}
 }
 
+/*
+ * State of the VMA based swap readahead, packed into
+ * vma->swap_readahead_info: the page aligned address of the last swap
+ * fault, the readahead window used for it, and the number of pages of
+ * that window that were hit since.
+ */
+#define SWAP_RA_WIN_SHIFT	(PAGE_SHIFT / 2)
+#define SWAP_RA_HITS_MASK	((1UL << SWAP_RA_WIN_SHIFT) - 1)
+#define SWAP_RA_HITS_MAX	SWAP_RA_HITS_MASK
+#define SWAP_RA_WIN_MASK	(~PAGE_MASK & ~SWAP_RA_HITS_MASK)
+
+#define SWAP_RA_HITS(v)		((v) & SWAP_RA_HITS_MASK)
+#define SWAP_RA_WIN(v)		(((v) & SWAP_RA_WIN_MASK) >> SWAP_RA_WIN_SHIFT)
+#define SWAP_RA_ADDR(v)		((v) & PAGE_MASK)
+
+#define SWAP_RA_VAL(addr, win, hits)				\
+	(((addr) & PAGE_MASK) |					\
+	 (((win) << SWAP_RA_WIN_SHIFT) & SWAP_RA_WIN_MASK) |	\
+	 ((hits) & SWAP_RA_HITS_MASK))
+
+/* Upper bound of the VMA readahead window, as an order of pages */
+#define SWAP_RA_ORDER_CEILING	(BITS_PER_LONG == 64 ? 5 : 3)
+
+/*
+ * Read ahead the swap entries of the ptes around a swap fault rather than
+ * the swap slots next to the faulting one.
+ */
+int sysctl_swap_vma_readahead __read_mostly = 1;
+
 /*
  * Lookup a swap entry in the swap cache. A found page will be returned
  * unlocked and with its refcount incremented - we rely on the kernel
  * lock getting page table operations atomic even if we drop the page
  * lock before returning.
+ *
+ * @vma and @addr describe the faulting user mapping, if any; they are
+ * used to account readahead hits to the VMA readahead window.
  */
-struct page * lookup_swap_cache(swp_entry_t entry)
+struct page * lookup_swap_cache(swp_entry_t entry,
+			struct vm_area_struct *vma, unsigned long addr)
 {
 	struct page *page;
+	int readahead = 0;
 
 	page = find_get_page(&swapper_space, entry.val);
 
-	if (page)
+	if (page) {
 		INC_CACHE_INFO(find_success);
+		if (TestClearPageSwapReadahead(page)) {
+			count_vm_event(SWAP_RA_HIT);
+			readahead = 1;
+		}
+		if (vma) {
+			unsigned long ra_val, win, hits;
+
+			ra_val = atomic_long_read(&vma->swap_readahead_info);
+			win = SWAP_RA_WIN(ra_val);
+			hits = SWAP_RA_HITS(ra_val);
+			if (readahead)
+				hits = min_t(unsigned long, hits + 1,
+					     SWAP_RA_HITS_MAX);
+			atomic_long_set(&vma->swap_readahead_info,
+					SWAP_RA_VAL(addr, win, hits));
+		}
+	}
 
 	INC_CACHE_INFO(find_total);
 	return page;
@@ -264,12 +316,15 @@ struct page * lookup_swap_cache(swp_entry_t entry)
  * A failure return means that either the page allocation failed or that
  * the swap entry is no longer in use.
  */
-struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
-			struct vm_area_struct *vma, unsigned long addr)
+static struct page *__read_swap_cache_async(swp_entry_t entry,
+			gfp_t gfp_mask, struct vm_area_struct *vma,
+			unsigned long addr, int *allocated)
 {
 	struct page *found_page, *new_page = NULL;
 	int err;
 
+	*allocated = 0;
+
 	do {
 		/*
 		 * First check the swap cache.  Since this is normally
@@ -312,6 +367,7 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 			 */
 			lru_cache_add_anon(new_page);
 			swap_readpage(NULL, new_page);
+			*allocated = 1;
 			return new_page;
 		}
 		ClearPageSwapBacked(new_page);
@@ -324,6 +380,35 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 	return found_page;
 }
 
+struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	int allocated;
+
+	return __read_swap_cache_async(entry, gfp_mask, vma, addr, &allocated);
+}
+
+/*
+ * Start reading @entry into the swap cache on behalf of readahead, and
+ * mark the page so that a later hit on it can be accounted.
+ */
+static int swap_readahead_page(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	struct page *page;
+	int allocated;
+
+	page = __read_swap_cache_async(entry, gfp_mask, vma, addr, &allocated);
+	if (!page)
+		return -ENOMEM;
+	if (allocated) {
+		SetPageSwapReadahead(page);
+		count_vm_event(SWAP_RA);
+	}
+	page_cache_release(page);
+	return 0;
+}
+
 /**
  * swapin_readahead - swap in pages in hope we need them soon
  * @entry: swap entry of this memory
@@ -347,7 +432,6 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 			struct vm_area_struct *vma, unsigned long addr)
 {
 	int nr_pages;
-	struct page *page;
 	unsigned long offset;
 	unsigned long end_offset;
 
@@ -360,13 +444,136 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	 */
 	nr_pages = valid_swaphandles(entry, &offset);
 	for (end_offset = offset + nr_pages; offset < end_offset; offset++) {
+		swp_entry_t ra_entry = swp_entry(swp_type(entry), offset);
+
+		if (ra_entry.val == entry.val)
+			continue;
 		/* Ok, do the async read-ahead now */
-		page = read_swap_cache_async(swp_entry(swp_type(entry), offset),
-						gfp_mask, vma, addr);
-		if (!page)
+		if (swap_readahead_page(ra_entry, gfp_mask, vma, addr))
+			break;
+	}
+	lru_add_drain();	/* Push any new pages onto the LRU now */
+	return read_swap_cache_async(entry, gfp_mask, vma, addr);
+}
+
+/*
+ * Size the readahead window from the hits on the previous window: grow
+ * it while readahead pages get used, and shrink it at most by half per
+ * fault so a single miss does not collapse a sequential stream.
+ */
+static unsigned long swap_ra_window(unsigned long prev_pfn, unsigned long pfn,
+			unsigned long hits, unsigned long max_win,
+			unsigned long prev_win)
+{
+	unsigned long win;
+
+	win = hits + 2;
+	if (win == 2) {
+		/*
+		 * No hits to judge by, but don't get stuck doing single
+		 * pages if the faults are sequential.
+		 */
+		if (pfn != prev_pfn + 1 && pfn != prev_pfn - 1)
+			win = 1;
+	} else
+		win = roundup_pow_of_two(max_t(unsigned long, win, 4));
+
+	if (win > max_win)
+		win = max_win;
+	if (win < prev_win / 2)
+		win = prev_win / 2;
+	return win;
+}
+
+/**
+ * swap_vma_readahead - swap in pages around a fault in virtual order
+ * @entry: swap entry of the faulting pte
+ * @gfp_mask: memory allocation flags
+ * @vma: user vma the fault is in
+ * @addr: faulting address
+ * @pmd: pmd that maps @addr
+ *
+ * Returns the struct page for @entry after queueing swapin.
+ *
+ * Once swap slots are fragmented, the slots next to the faulting one have
+ * little to do with the pages the process will touch next.  Instead read
+ * the swap entries of the ptes around @addr, in the direction the faults
+ * are moving.  The window adapts to the readahead hits recorded by
+ * lookup_swap_cache() and is bounded by (1 << page_cluster) pages.
+ *
+ * Falls back to swapin_readahead() if VMA readahead is disabled.
+ *
+ * Caller must hold down_read on the vma->vm_mm.
+ */
+struct page *swap_vma_readahead(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr,
+			pmd_t *pmd)
+{
+	pte_t ptes[1 << SWAP_RA_ORDER_CEILING];
+	unsigned long ra_val, prev_pfn, pfn, start, end;
+	unsigned long hits, prev_win, max_win, win, left;
+	unsigned long lower, upper, ra_addr;
+	pte_t *pte;
+	int i, nr;
+
+	if (!sysctl_swap_vma_readahead)
+		return swapin_readahead(entry, gfp_mask, vma, addr);
+
+	ra_val = atomic_long_read(&vma->swap_readahead_info);
+	prev_pfn = SWAP_RA_ADDR(ra_val) >> PAGE_SHIFT;
+	prev_win = SWAP_RA_WIN(ra_val);
+	hits = SWAP_RA_HITS(ra_val);
+	pfn = addr >> PAGE_SHIFT;
+
+	max_win = 1UL << min(page_cluster, SWAP_RA_ORDER_CEILING);
+	win = swap_ra_window(prev_pfn, pfn, hits, max_win, prev_win);
+	atomic_long_set(&vma->swap_readahead_info, SWAP_RA_VAL(addr, win, 0));
+
+	if (win == 1)
+		goto out;
+
+	/* Stay within the vma and the page table that maps @addr */
+	lower = (addr & PMD_MASK) >> PAGE_SHIFT;
+	upper = lower + PTRS_PER_PTE;
+	lower = max(lower, vma->vm_start >> PAGE_SHIFT);
+	upper = min(upper, vma->vm_end >> PAGE_SHIFT);
+
+	/* Read in the direction the faults are moving */
+	if (pfn == prev_pfn + 1)
+		left = 0;
+	else if (pfn == prev_pfn - 1)
+		left = win - 1;
+	else
+		left = (win - 1) / 2;
+	start = pfn - min(left, pfn - lower);
+	end = min(start + win, upper);
+
+	/*
+	 * Copy the ptes out, as reading in the entries may sleep.  The
+	 * page table cannot go away under us while mmap_sem is held, and
+	 * read_swap_cache_async() copes with entries that were freed in
+	 * the meantime.
+	 */
+	nr = end - start;
+	pte = pte_offset_map(pmd, start << PAGE_SHIFT);
+	for (i = 0; i < nr; i++)
+		ptes[i] = pte[i];
+	pte_unmap(pte);
+
+	for (i = 0; i < nr; i++) {
+		swp_entry_t ra_entry;
+
+		if (pte_none(ptes[i]) || pte_present(ptes[i]) ||
+		    pte_file(ptes[i]))
+			continue;
+		ra_entry = pte_to_swp_entry(ptes[i]);
+		if (is_migration_entry(ra_entry) || ra_entry.val == entry.val)
+			continue;
+		ra_addr = (start + i) << PAGE_SHIFT;
+		if (swap_readahead_page(ra_entry, gfp_mask, vma, ra_addr))
 			break;
-		page_cache_release(page);
 	}
 	lru_add_drain();	/* Push any new pages onto the LRU now */
+out:
 	return read_swap_cache_async(entry, gfp_mask, vma, addr);
 }
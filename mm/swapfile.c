@@ -28,6 +28,7 @@
 #include <linux/capability.h>
 #include <linux/syscalls.h>
 #include <linux/memcontrol.h>
+#include <linux/cpu.h>
 
 #include <asm/pgtable.h>
 #include <asm/tlbflush.h>
@@ -173,17 +174,25 @@ no_page:
 	return 0;
 }
 
-swp_entry_t get_swap_page(void)
+/*
+ * Allocate up to @n swap slots into @entries, all under one hold of
+ * swap_lock.  Consecutive slots come from the same cluster of the same
+ * device as long as it has room, so a batch is mostly contiguous on disk.
+ * Returns the number of slots allocated.
+ */
+static int get_swap_pages(int n, swp_entry_t *entries)
 {
 	struct swap_info_struct *si;
 	pgoff_t offset;
 	int type, next;
 	int wrapped = 0;
+	int got = 0;
 
 	spin_lock(&swap_lock);
 	if (nr_swap_pages <= 0)
 		goto noswap;
-	nr_swap_pages--;
+	n = min_t(long, n, nr_swap_pages);
+	nr_swap_pages -= n;
 
 	for (type = swap_list.next; type >= 0 && wrapped < 2; type = next) {
 		si = swap_info + type;
@@ -200,18 +209,21 @@ swp_entry_t get_swap_page(void)
 			continue;
 
 		swap_list.next = next;
-		offset = scan_swap_map(si);
-		if (offset) {
-			spin_unlock(&swap_lock);
-			return swp_entry(type, offset);
+		while (got < n) {
+			offset = scan_swap_map(si);
+			if (!offset)
+				break;
+			entries[got++] = swp_entry(type, offset);
 		}
+		if (got == n)
+			break;
 		next = swap_list.next;
 	}
 
-	nr_swap_pages++;
+	nr_swap_pages += n - got;
 noswap:
 	spin_unlock(&swap_lock);
-	return (swp_entry_t) {0};
+	return got;
 }
 
 swp_entry_t get_swap_page_of_type(int type)
@@ -306,6 +318,184 @@ void swap_free(swp_entry_t entry)
 	}
 }
 
+/*
+ * Per-cpu swap slot caches.
+ *
+ * With fast swap devices, taking swap_lock for every slot that is
+ * allocated or freed limits swap throughput on SMP.  Each cpu therefore
+ * keeps a small stock of slots that it allocates in one batch, and a
+ * buffer of slots whose last reference was dropped, which it frees in
+ * one batch.
+ *
+ * Slots in the allocation cache are accounted as in use, just as if
+ * get_swap_page() had handed them out.  Deferred frees are only taken
+ * for slots that have a single user and no swap cache page, so nobody
+ * can observe the stale count.  swapoff drains both caches of all cpus
+ * once the device is no longer SWP_WRITEOK.
+ */
+#define SWAP_SLOTS_CACHE_SIZE	64
+
+struct swap_slots_cache {
+	struct mutex	alloc_lock;	/* protects slots, cur and nr */
+	swp_entry_t	slots[SWAP_SLOTS_CACHE_SIZE];
+	int		cur;
+	int		nr;
+	spinlock_t	free_lock;	/* protects slots_ret and n_ret */
+	swp_entry_t	slots_ret[SWAP_SLOTS_CACHE_SIZE];
+	int		n_ret;
+};
+
+static DEFINE_PER_CPU(struct swap_slots_cache, swp_slots);
+
+/* Give back the entries to their devices.  Called with swap_lock held. */
+static void swap_entries_free(swp_entry_t *entries, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		swap_entry_free(&swap_info[swp_type(entries[i])],
+				swp_offset(entries[i]));
+}
+
+static void flush_swap_slots_ret(struct swap_slots_cache *cache)
+{
+	spin_lock(&cache->free_lock);
+	if (cache->n_ret) {
+		spin_lock(&swap_lock);
+		swap_entries_free(cache->slots_ret, cache->n_ret);
+		spin_unlock(&swap_lock);
+		cache->n_ret = 0;
+	}
+	spin_unlock(&cache->free_lock);
+}
+
+static void drain_swap_slots_cache(struct swap_slots_cache *cache)
+{
+	mutex_lock(&cache->alloc_lock);
+	if (cache->nr) {
+		spin_lock(&swap_lock);
+		swap_entries_free(cache->slots + cache->cur, cache->nr);
+		spin_unlock(&swap_lock);
+		cache->cur = 0;
+		cache->nr = 0;
+	}
+	mutex_unlock(&cache->alloc_lock);
+
+	flush_swap_slots_ret(cache);
+}
+
+static void drain_swap_slots_caches(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		drain_swap_slots_cache(&per_cpu(swp_slots, cpu));
+}
+
+/*
+ * Defer freeing the last reference to @entry to the local cpu's batch.
+ * Returns 0 if the entry must be freed the normal way.
+ */
+static int free_swap_slot(swp_entry_t entry)
+{
+	struct swap_slots_cache *cache;
+	struct swap_info_struct *p;
+	unsigned long offset, type;
+	int ret = 0;
+
+	type = swp_type(entry);
+	offset = swp_offset(entry);
+	if (type >= nr_swapfiles)
+		return 0;
+	p = &swap_info[type];
+	if (offset >= p->max || p->swap_map[offset] != 1)
+		return 0;
+	/* The count may belong to a swap cache page instead */
+	rcu_read_lock();
+	if (radix_tree_lookup(&swapper_space.page_tree, entry.val))
+		ret = -EEXIST;
+	rcu_read_unlock();
+	if (ret)
+		return 0;
+
+	cache = &get_cpu_var(swp_slots);
+	spin_lock(&cache->free_lock);
+	if (p->flags & SWP_WRITEOK) {
+		if (cache->n_ret >= SWAP_SLOTS_CACHE_SIZE) {
+			spin_lock(&swap_lock);
+			swap_entries_free(cache->slots_ret, cache->n_ret);
+			spin_unlock(&swap_lock);
+			cache->n_ret = 0;
+		}
+		cache->slots_ret[cache->n_ret++] = entry;
+		ret = 1;
+	}
+	spin_unlock(&cache->free_lock);
+	put_cpu_var(swp_slots);
+	return ret;
+}
+
+swp_entry_t get_swap_page(void)
+{
+	struct swap_slots_cache *cache;
+	swp_entry_t entry = { 0 };
+	int cpu;
+
+	/*
+	 * The cache is only protected by its mutex, so it does not matter
+	 * if we are migrated to another cpu in the meantime.
+	 */
+	cache = &per_cpu(swp_slots, raw_smp_processor_id());
+	mutex_lock(&cache->alloc_lock);
+	if (!cache->nr) {
+		cache->cur = 0;
+		cache->nr = get_swap_pages(SWAP_SLOTS_CACHE_SIZE, cache->slots);
+	}
+	if (cache->nr) {
+		entry = cache->slots[cache->cur++];
+		cache->nr--;
+	}
+	mutex_unlock(&cache->alloc_lock);
+	if (entry.val)
+		return entry;
+
+	/* Out of swap: maybe some is still sitting in the free batches */
+	for_each_online_cpu(cpu)
+		flush_swap_slots_ret(&per_cpu(swp_slots, cpu));
+	if (get_swap_pages(1, &entry))
+		return entry;
+	return (swp_entry_t) {0};
+}
+
+static int __cpuinit swap_slots_cpu_callback(struct notifier_block *nfb,
+					     unsigned long action, void *hcpu)
+{
+	long cpu = (long)hcpu;
+
+	switch (action) {
+	case CPU_DEAD:
+	case CPU_DEAD_FROZEN:
+		drain_swap_slots_cache(&per_cpu(swp_slots, cpu));
+		break;
+	}
+	return NOTIFY_OK;
+}
+
+static int __init swap_slots_cache_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct swap_slots_cache *cache = &per_cpu(swp_slots, cpu);
+
+		mutex_init(&cache->alloc_lock);
+		spin_lock_init(&cache->free_lock);
+	}
+	hotcpu_notifier(swap_slots_cpu_callback, 0);
+	return 0;
+}
+__initcall(swap_slots_cache_init);
+
 /*
  * How many references to page are currently swapped out?
  */
@@ -418,6 +608,9 @@ void free_swap_and_cache(swp_entry_t entry)
 	if (is_migration_entry(entry))
 		return;
 
+	if (free_swap_slot(entry))
+		return;
+
 	p = swap_info_get(entry);
 	if (p) {
 		if (swap_entry_free(p, swp_offset(entry)) == 1) {
@@ -1290,6 +1483,9 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	p->flags &= ~SWP_WRITEOK;
 	spin_unlock(&swap_lock);
 
+	/* Return the slots that the per-cpu caches hold on to */
+	drain_swap_slots_caches();
+
 	current->flags |= PF_SWAPOFF;
 	err = try_to_unuse(type);
 	current->flags &= ~PF_SWAPOFF;
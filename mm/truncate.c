@@ -135,6 +135,42 @@ invalidate_complete_page(struct address_space *mapping, struct page *page)
 	return ret;
 }
 
+/*
+ * Remove the shadow entries of evicted pages in the range [start, end].
+ * The pagevec based lookups skip them, so this is done separately once
+ * the pages themselves are gone.
+ */
+static void clear_shadow_entries(struct address_space *mapping,
+				 pgoff_t start, pgoff_t end)
+{
+	void **slots[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
+	pgoff_t next = start;
+	unsigned int i, nr;
+
+	while (next <= end) {
+		cond_resched();
+		spin_lock_irq(&mapping->tree_lock);
+		nr = radix_tree_gang_lookup_slot(&mapping->page_tree, slots,
+						 indices, next, PAGEVEC_SIZE);
+		for (i = 0; i < nr; i++) {
+			void *entry = radix_tree_deref_slot(slots[i]);
+
+			if (indices[i] > end)
+				break;
+			if (!radix_tree_exceptional_entry(entry))
+				continue;
+			radix_tree_delete(&mapping->page_tree, indices[i]);
+			mapping->nrshadows--;
+			atomic_long_dec(&workingset_shadows);
+		}
+		spin_unlock_irq(&mapping->tree_lock);
+		if (nr == 0 || i < nr || indices[nr - 1] == end)
+			break;
+		next = indices[nr - 1] + 1;
+	}
+}
+
 /**
  * truncate_inode_pages - truncate range of pages specified by start & end byte offsets
  * @mapping: mapping to truncate
@@ -168,12 +204,15 @@ void truncate_inode_pages_range(struct address_space *mapping,
 	pgoff_t next;
 	int i;
 
-	if (mapping->nrpages == 0)
+	if (mapping->nrpages == 0 && mapping->nrshadows == 0)
 		return;
 
 	BUG_ON((lend & (PAGE_CACHE_SIZE - 1)) != (PAGE_CACHE_SIZE - 1));
 	end = (lend >> PAGE_CACHE_SHIFT);
 
+	if (mapping->nrpages == 0)
+		goto shadows;
+
 	pagevec_init(&pvec, 0);
 	next = start;
 	while (next <= end &&
@@ -251,6 +290,9 @@ void truncate_inode_pages_range(struct address_space *mapping,
 		}
 		pagevec_release(&pvec);
 	}
+shadows:
+	if (mapping->nrshadows)
+		clear_shadow_entries(mapping, start, end);
 }
 EXPORT_SYMBOL(truncate_inode_pages_range);
 
@@ -357,7 +399,7 @@ invalidate_complete_page2(struct address_space *mapping, struct page *page)
 
 	clear_page_mlock(page);
 	BUG_ON(PagePrivate(page));
-	__remove_from_page_cache(page);
+	__remove_from_page_cache(page, NULL);
 	spin_unlock_irq(&mapping->tree_lock);
 	page_cache_release(page);	/* pagecache ref */
 	return 1;
@@ -395,7 +395,8 @@ static pageout_t pageout(struct page *page, struct address_space *mapping,
  * Same as remove_mapping, but if the page is removed from the mapping, it
  * gets returned with a refcount of 0.
  */
-static int __remove_mapping(struct address_space *mapping, struct page *page)
+static int __remove_mapping(struct address_space *mapping, struct page *page,
+			    int reclaimed)
 {
 	BUG_ON(!PageLocked(page));
 	BUG_ON(mapping != page_mapping(page));
@@ -440,7 +441,15 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 		spin_unlock_irq(&mapping->tree_lock);
 		swap_free(swap);
 	} else {
-		__remove_from_page_cache(page);
+		void *shadow = NULL;
+
+		/*
+		 * Remember when a reclaimed file page was evicted, so that
+		 * its refault can be told apart from a first access.
+		 */
+		if (reclaimed && page_is_file_cache(page))
+			shadow = workingset_eviction(mapping, page);
+		__remove_from_page_cache(page, shadow);
 		spin_unlock_irq(&mapping->tree_lock);
 	}
 
@@ -459,7 +468,7 @@ cannot_free:
  */
 int remove_mapping(struct address_space *mapping, struct page *page)
 {
-	if (__remove_mapping(mapping, page)) {
+	if (__remove_mapping(mapping, page, 0)) {
 		/*
 		 * Unfreezing the refcount with 1 rather than 2 effectively
 		 * drops the pagecache ref for us without requiring another
@@ -634,6 +643,25 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			case SWAP_SUCCESS:
 				; /* fall thru'; add to swap cache */
 			}
+			/*
+			 * Given up with madvise(MADV_FREE) and not written
+			 * to since?  Then it needs no swap space, just drop
+			 * its mappings.  Otherwise it is an ordinary page
+			 * again and is swapped out as usual.
+			 */
+			if (PageLazyFree(page)) {
+				ClearPageLazyFree(page);
+				if (!PageDirty(page) &&
+				    try_to_unmap(page, TTU_DISCARD) == SWAP_SUCCESS) {
+					count_vm_event(PGLAZYFREED);
+					unlock_page(page);
+					if (put_page_testzero(page))
+						goto free_it;
+					/* see the speculative reference below */
+					nr_reclaimed++;
+					continue;
+				}
+			}
 			if (!add_to_swap(page, GFP_ATOMIC))
 				goto activate_locked;
 			may_enter_fs = 1;
@@ -647,7 +675,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		 * processes. Try to unmap it here.
 		 */
 		if (page_mapped(page) && mapping) {
-			switch (try_to_unmap(page, 0)) {
+			switch (try_to_unmap(page, TTU_UNMAP)) {
 			case SWAP_FAIL:
 				goto activate_locked;
 			case SWAP_AGAIN:
@@ -732,7 +760,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
-		if (!mapping || !__remove_mapping(mapping, page))
+		if (!mapping || !__remove_mapping(mapping, page, 1))
 			goto keep_locked;
 
 		/*
@@ -663,6 +663,8 @@ static const char * const vmstat_text[] = {
 	"nr_bounce",
 	"nr_vmscan_write",
 	"nr_writeback_temp",
+	"workingset_refault",
+	"workingset_activate",
 
 #ifdef CONFIG_NUMA
 	"numa_hit",
@@ -687,6 +689,8 @@ static const char * const vmstat_text[] = {
 
 	"pgfault",
 	"pgmajfault",
+	"pgfault_around",
+	"pgfault_around_mapped",
 
 	TEXTS_FOR_ZONES("pgrefill")
 	TEXTS_FOR_ZONES("pgsteal")
@@ -701,6 +705,10 @@ static const char * const vmstat_text[] = {
 	"allocstall",
 
 	"pgrotated",
+	"swap_ra",
+	"swap_ra_hit",
+	"pglazyfree",
+	"pglazyfreed",
 #ifdef CONFIG_HUGETLB_PAGE
 	"htlb_buddy_alloc_success",
 	"htlb_buddy_alloc_fail",
@@ -0,0 +1,267 @@
+/*
+ * linux/mm/workingset.c
+ *
+ * Workingset detection for the page cache.
+ *
+ * Page reclaim cannot tell a page that was evicted and immediately read
+ * again from a page that is used once by a streaming reader: both start
+ * out on the inactive file list and both are gone from it by the time
+ * they are accessed a second time.  A large sequential read can thus
+ * push out the frequently used pages of a smaller working set, which
+ * then have to be re-read from disk again and again.
+ *
+ * To tell the two apart, each zone keeps an aging clock (inactive_age)
+ * that is advanced whenever a file page leaves the inactive list, either
+ * through eviction or through activation.  When a page is reclaimed,
+ * the current clock value is stored in a shadow entry that takes the
+ * page's place in the page cache radix tree.
+ *
+ * When the page is faulted in again, the difference between the clock
+ * and the value in the shadow entry -- the refault distance -- is the
+ * minimum number of inactive list slots the page would have needed in
+ * order to be accessed a second time while still resident.  If that
+ * distance is no bigger than the active list, the page would have
+ * been activated had the inactive list been given the active list's
+ * share of memory, so it is part of the working set and is activated
+ * straight away.  Pages of a streaming reader refault with distances
+ * larger than memory and stay on the inactive list.
+ *
+ * Shadow entries are removed when the page is faulted back in and when
+ * the mapping is truncated.  A refault distance bigger than the zone can
+ * never lead to an activation, so once there are more shadow entries
+ * than pages of memory, the oldest ones are pruned by a shrinker and the
+ * radix tree nodes that held only them are freed.
+ */
+
+#include <linux/mm.h>
+#include <linux/mm_inline.h>
+#include <linux/mmzone.h>
+#include <linux/fs.h>
+#include <linux/pagemap.h>
+#include <linux/pagevec.h>
+#include <linux/radix-tree.h>
+#include <linux/swap.h>
+#include <linux/vmstat.h>
+#include <linux/writeback.h>
+#include <linux/init.h>
+
+#define EVICTION_SHIFT	(RADIX_TREE_EXCEPTIONAL_SHIFT + \
+			 ZONES_SHIFT + NODES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+/* Shadow entries in all page cache radix trees */
+atomic_long_t workingset_shadows = ATOMIC_LONG_INIT(0);
+
+static void *pack_shadow(unsigned long eviction, struct zone *zone)
+{
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	eviction = (eviction << RADIX_TREE_EXCEPTIONAL_SHIFT);
+
+	return (void *)(eviction | RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static void unpack_shadow(void *shadow, struct zone **zone,
+			  unsigned long *distance)
+{
+	unsigned long entry = (unsigned long)shadow;
+	unsigned long eviction;
+	unsigned long refault;
+	int zid, nid;
+
+	entry >>= RADIX_TREE_EXCEPTIONAL_SHIFT;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	nid = entry & ((1UL << NODES_SHIFT) - 1);
+	entry >>= NODES_SHIFT;
+	eviction = entry;
+
+	*zone = NODE_DATA(nid)->node_zones + zid;
+
+	refault = atomic_long_read(&(*zone)->inactive_age);
+
+	/*
+	 * The clock may have wrapped around since the eviction; the
+	 * distance is only meaningful modulo the bits we could store.
+	 */
+	*distance = (refault - eviction) & EVICTION_MASK;
+}
+
+/**
+ * workingset_eviction - note the eviction of a page from memory
+ * @mapping: address space the page was backing
+ * @page: the page being evicted
+ *
+ * Returns a shadow entry to be stored in @mapping->page_tree in place
+ * of the evicted @page so that a later refault can be detected.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	return pack_shadow(eviction, zone);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Calculates and evaluates the refault distance of the previously
+ * evicted page in the context of the zone it was allocated in.
+ *
+ * Returns 1 if the page should be activated, 0 otherwise.
+ */
+int workingset_refault(void *shadow)
+{
+	unsigned long refault_distance;
+	struct zone *zone;
+
+	unpack_shadow(shadow, &zone, &refault_distance);
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+
+	if (refault_distance <= zone_page_state(zone, NR_ACTIVE_FILE)) {
+		inc_zone_state(zone, WORKINGSET_ACTIVATE);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
+
+/*
+ * Delete the shadow entries of @mapping that are too old to ever cause
+ * an activation, adding the number of entries looked at to @scanned.
+ */
+static void prune_mapping_shadows(struct address_space *mapping,
+				  unsigned long *scanned)
+{
+	void **slots[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
+	unsigned long next = 0;
+	unsigned int i, nr;
+
+	do {
+		cond_resched();
+		spin_lock_irq(&mapping->tree_lock);
+		nr = radix_tree_gang_lookup_slot(&mapping->page_tree, slots,
+						 indices, next, PAGEVEC_SIZE);
+		for (i = 0; i < nr; i++) {
+			void *entry = radix_tree_deref_slot(slots[i]);
+			unsigned long distance;
+			struct zone *zone;
+
+			if (!radix_tree_exceptional_entry(entry))
+				continue;
+			(*scanned)++;
+			unpack_shadow(entry, &zone, &distance);
+			if (distance <= zone->present_pages)
+				continue;
+			radix_tree_delete(&mapping->page_tree, indices[i]);
+			mapping->nrshadows--;
+			atomic_long_dec(&workingset_shadows);
+		}
+		spin_unlock_irq(&mapping->tree_lock);
+		if (nr)
+			next = indices[nr - 1] + 1;
+	} while (nr == PAGEVEC_SIZE && next);
+}
+
+/*
+ * Walk the inodes of @sb until @nr_to_scan inodes and shadow entries
+ * have been looked at.  The list head is then moved behind the last
+ * inode looked at, so that the next call carries on from there instead
+ * of looking at the same young entries again.
+ */
+static void prune_sb_shadows(struct super_block *sb,
+			     unsigned long nr_to_scan, unsigned long *scanned)
+{
+	struct inode *inode, *toput_inode = NULL;
+
+	spin_lock(&inode_lock);
+	list_for_each_entry(inode, &sb->s_inodes, i_sb_list) {
+		(*scanned)++;
+		if (!(inode->i_state & (I_FREEING|I_WILL_FREE|I_NEW)) &&
+		    inode->i_mapping->nrshadows) {
+			__iget(inode);
+			spin_unlock(&inode_lock);
+			prune_mapping_shadows(inode->i_mapping, scanned);
+			iput(toput_inode);
+			toput_inode = inode;
+			spin_lock(&inode_lock);
+		}
+		if (*scanned >= nr_to_scan) {
+			list_move(&sb->s_inodes, &inode->i_sb_list);
+			break;
+		}
+	}
+	spin_unlock(&inode_lock);
+	iput(toput_inode);
+}
+
+static void prune_shadows(unsigned long nr_to_scan)
+{
+	struct super_block *sb;
+	unsigned long scanned = 0;
+
+	spin_lock(&sb_lock);
+restart:
+	list_for_each_entry(sb, &super_blocks, s_list) {
+		sb->s_count++;
+		spin_unlock(&sb_lock);
+		/* Don't wait for an unmount, the inodes will go anyway */
+		if (down_read_trylock(&sb->s_umount)) {
+			if (sb->s_root)
+				prune_sb_shadows(sb, nr_to_scan, &scanned);
+			up_read(&sb->s_umount);
+		}
+		spin_lock(&sb_lock);
+		if (__put_super_and_need_restart(sb))
+			goto restart;
+		if (scanned >= nr_to_scan)
+			break;
+	}
+	spin_unlock(&sb_lock);
+}
+
+/*
+ * A zone has at most as many shadow entries young enough to be of use
+ * as it has pages, so only the entries beyond the number of pages in
+ * memory are known to be prunable.  Those are what we report.
+ */
+static int shrink_shadows(int nr, gfp_t gfp_mask)
+{
+	struct zone *zone;
+	long excess;
+
+	if (nr) {
+		/* iput() may end up in the filesystem */
+		if (!(gfp_mask & __GFP_FS))
+			return -1;
+		prune_shadows(nr);
+	}
+	excess = atomic_long_read(&workingset_shadows);
+	for_each_zone(zone)
+		excess -= zone->present_pages;
+	return excess > 0 ? min_t(long, excess, INT_MAX) : 0;
+}
+
+static struct shrinker shadow_shrinker = {
+	.shrink = shrink_shadows,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static int __init workingset_init(void)
+{
+	register_shrinker(&shadow_shrinker);
+	return 0;
+}
+module_init(workingset_init);
@@ -0,0 +1,621 @@
+/*
+ * mkcramfs2 - make a cramfs2 file system image
+ *
+ * Builds an image of a directory tree in the format described in
+ * include/linux/cramfs2_fs.h and Documentation/filesystems/cramfs2.txt.
+ *
+ * Build with
+ *
+ *	gcc -O2 -o mkcramfs2 mkcramfs2.c -lz
+ *
+ * or, to be able to write LZO compressed images,
+ *
+ *	gcc -O2 -DWITH_LZO -o mkcramfs2 mkcramfs2.c -lz -llzo2
+ *
+ * This file is released under the GPL.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <endian.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#ifdef WITH_LZO
+#include <lzo/lzo1x.h>
+#endif
+
+#include "../../include/linux/cramfs2_fs.h"
+
+#define DEFAULT_BLOCK_LOG	17	/* 128 KB */
+
+struct entry {
+	char *name;
+	char *path;
+	struct stat st;
+	unsigned int ino;
+	struct entry **children;
+	int nr_children;
+
+	/* Filled in when the data or directory is written */
+	uint64_t size;
+	uint64_t start;
+	uint32_t block_list;
+	uint32_t fragment;
+	uint32_t frag_offset;
+	uint32_t nlink;
+};
+
+static const char *progname = "mkcramfs2";
+static int verbose;
+static int compression = CRAMFS2_COMPR_ZLIB;
+static int no_fragments;
+static unsigned int block_log = DEFAULT_BLOCK_LOG;
+static unsigned int block_size;
+
+static int outfd;
+static uint64_t outpos;
+
+/* Inodes in inode number order; hard links share one entry */
+static struct entry **inodes;
+static unsigned int nr_inodes, max_inodes;
+
+static uint32_t *block_list;
+static uint32_t nr_blocks, max_blocks;
+
+static struct cramfs2_fragment *fragments;
+static uint32_t nr_fragments, max_fragments;
+static unsigned char *frag_buf;
+static unsigned int frag_used;
+
+static unsigned char *read_buf, *compr_buf;
+static size_t compr_buf_size;
+#ifdef WITH_LZO
+static void *lzo_wrkmem;
+#endif
+
+static uint64_t stat_blocks, stat_holes, stat_raw;
+
+static void usage(int status)
+{
+	FILE *stream = status ? stderr : stdout;
+
+	fprintf(stream,
+		"usage: %s [-h] [-v] [-b blocksize] [-c zlib|lzo] [-N] "
+		"[-n name] dirname outfile\n"
+		" -h          print this help\n"
+		" -v          be verbose\n"
+		" -b size     data block size in bytes, a power of two from "
+		"%u to %u (default %u)\n"
+		" -c method   compression method (default zlib)\n"
+		" -N          do not pack file tails into fragment blocks\n"
+		" -n name     set name of the file system\n"
+		" dirname     root of the directory tree to be compressed\n"
+		" outfile     output file\n",
+		progname, 1 << CRAMFS2_MIN_BLOCK_LOG,
+		1 << CRAMFS2_MAX_BLOCK_LOG, 1 << DEFAULT_BLOCK_LOG);
+	exit(status);
+}
+
+static void die(const char *fmt, const char *arg)
+{
+	int err = errno;
+
+	fprintf(stderr, "%s: ", progname);
+	fprintf(stderr, fmt, arg);
+	if (err)
+		fprintf(stderr, ": %s", strerror(err));
+	fputc('\n', stderr);
+	exit(1);
+}
+
+static void *xmalloc(size_t size)
+{
+	void *p = malloc(size);
+
+	if (!p)
+		die("out of memory%s", "");
+	return p;
+}
+
+static void *xrealloc(void *p, size_t size)
+{
+	p = realloc(p, size);
+	if (!p)
+		die("out of memory%s", "");
+	return p;
+}
+
+static void write_out(const void *buf, size_t len)
+{
+	const char *p = buf;
+
+	while (len) {
+		ssize_t n = write(outfd, p, len);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			die("write failed%s", "");
+		}
+		p += n;
+		len -= n;
+		outpos += n;
+	}
+}
+
+/*
+ * Scanning the source tree
+ */
+
+static int cmp_entry(const void *a, const void *b)
+{
+	const struct entry *ea = *(const struct entry **)a;
+	const struct entry *eb = *(const struct entry **)b;
+
+	return strcmp(ea->name, eb->name);
+}
+
+static struct entry *scan(const char *path, const char *name)
+{
+	struct entry *e = xmalloc(sizeof(*e));
+	DIR *dir;
+	struct dirent *de;
+
+	memset(e, 0, sizeof(*e));
+	e->fragment = CRAMFS2_NO_FRAGMENT;
+	e->name = strdup(name);
+	e->path = strdup(path);
+	if (!e->name || !e->path)
+		die("out of memory%s", "");
+	if (lstat(path, &e->st) < 0)
+		die("cannot stat %s", path);
+	if (strlen(name) > CRAMFS2_MAX_NAMELEN) {
+		errno = 0;
+		die("name too long: %s", path);
+	}
+
+	if (!S_ISDIR(e->st.st_mode))
+		return e;
+
+	dir = opendir(path);
+	if (!dir)
+		die("cannot open directory %s", path);
+	while ((de = readdir(dir)) != NULL) {
+		char *child;
+
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+			continue;
+		child = xmalloc(strlen(path) + strlen(de->d_name) + 2);
+		sprintf(child, "%s/%s", path, de->d_name);
+		e->children = xrealloc(e->children,
+				(e->nr_children + 1) * sizeof(*e->children));
+		e->children[e->nr_children++] = scan(child, de->d_name);
+		free(child);
+	}
+	closedir(dir);
+
+	qsort(e->children, e->nr_children, sizeof(*e->children), cmp_entry);
+	return e;
+}
+
+/*
+ * Number the inodes breadth first, so that the entries of a directory
+ * are close together in the inode table.  Files that are hard linked
+ * within the tree get a single inode.
+ */
+static void number_inodes(struct entry *root)
+{
+	struct entry **queue;
+	unsigned int head = 0, tail = 0, max = 16;
+	int i;
+
+	queue = xmalloc(max * sizeof(*queue));
+	queue[tail++] = root;
+	while (head < tail) {
+		struct entry *e = queue[head++];
+
+		if (!S_ISDIR(e->st.st_mode) && e->st.st_nlink > 1) {
+			unsigned int n;
+
+			for (n = 0; n < nr_inodes; n++) {
+				struct entry *o = inodes[n];
+
+				if (o->st.st_dev == e->st.st_dev &&
+				    o->st.st_ino == e->st.st_ino)
+					break;
+			}
+			if (n < nr_inodes) {
+				e->ino = n + 1;
+				inodes[n]->nlink++;
+				continue;
+			}
+		}
+
+		if (nr_inodes == max_inodes) {
+			max_inodes = max_inodes ? max_inodes * 2 : 64;
+			inodes = xrealloc(inodes, max_inodes * sizeof(*inodes));
+		}
+		inodes[nr_inodes++] = e;
+		e->ino = nr_inodes;
+		e->nlink = S_ISDIR(e->st.st_mode) ? 2 : 1;
+
+		for (i = 0; i < e->nr_children; i++) {
+			if (S_ISDIR(e->children[i]->st.st_mode))
+				e->nlink++;
+			if (tail == max) {
+				max *= 2;
+				queue = xrealloc(queue, max * sizeof(*queue));
+			}
+			queue[tail++] = e->children[i];
+		}
+	}
+	free(queue);
+}
+
+/*
+ * Writing file data
+ */
+
+static size_t compress_block(const unsigned char *src, size_t len)
+{
+	if (compression == CRAMFS2_COMPR_ZLIB) {
+		uLongf out = compr_buf_size;
+
+		if (compress2(compr_buf, &out, src, len, Z_BEST_COMPRESSION)
+		    != Z_OK)
+			return len;
+		return out;
+	}
+#ifdef WITH_LZO
+	if (compression == CRAMFS2_COMPR_LZO) {
+		lzo_uint out = compr_buf_size;
+
+		if (lzo1x_999_compress(src, len, compr_buf, &out, lzo_wrkmem)
+		    != LZO_E_OK)
+			return len;
+		return out;
+	}
+#endif
+	return len;
+}
+
+/*
+ * Write one block of data, compressed unless that doesn't make it any
+ * smaller.  Returns its block list entry.
+ */
+static uint32_t write_block(const unsigned char *data, size_t len)
+{
+	size_t clen = compress_block(data, len);
+
+	if (clen >= len) {
+		stat_raw++;
+		write_out(data, len);
+		return len | CRAMFS2_BLOCK_UNCOMPRESSED;
+	}
+	write_out(compr_buf, clen);
+	return clen;
+}
+
+static void add_block(uint32_t size)
+{
+	if (nr_blocks == max_blocks) {
+		max_blocks = max_blocks ? max_blocks * 2 : 1024;
+		block_list = xrealloc(block_list,
+				      max_blocks * sizeof(*block_list));
+	}
+	block_list[nr_blocks++] = htole32(size);
+	stat_blocks++;
+}
+
+static void flush_fragment(void)
+{
+	struct cramfs2_fragment *frag;
+
+	if (!frag_used)
+		return;
+	if (nr_fragments == max_fragments) {
+		max_fragments = max_fragments ? max_fragments * 2 : 64;
+		fragments = xrealloc(fragments,
+				     max_fragments * sizeof(*fragments));
+	}
+	frag = &fragments[nr_fragments++];
+	memset(frag, 0, sizeof(*frag));
+	frag->start = htole64(outpos);
+	frag->size = htole32(write_block(frag_buf, frag_used));
+	frag_used = 0;
+}
+
+static int is_zero(const unsigned char *buf, size_t len)
+{
+	while (len--)
+		if (*buf++)
+			return 0;
+	return 1;
+}
+
+static size_t read_full(int fd, unsigned char *buf, size_t len,
+			const char *path)
+{
+	size_t done = 0;
+
+	while (done < len) {
+		ssize_t n = read(fd, buf + done, len - done);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			die("read failed on %s", path);
+		}
+		if (!n)
+			break;
+		done += n;
+	}
+	return done;
+}
+
+static void write_data(struct entry *e)
+{
+	size_t len;
+	int fd = -1;
+
+	e->start = outpos;
+	e->block_list = nr_blocks;
+	e->fragment = CRAMFS2_NO_FRAGMENT;
+	e->size = 0;
+
+	if (S_ISLNK(e->st.st_mode)) {
+		ssize_t n = readlink(e->path, (char *)read_buf, block_size);
+
+		if (n < 0)
+			die("cannot read link %s", e->path);
+		len = n;
+	} else {
+		fd = open(e->path, O_RDONLY);
+		if (fd < 0)
+			die("cannot open %s", e->path);
+		len = read_full(fd, read_buf, block_size, e->path);
+	}
+
+	while (len) {
+		e->size += len;
+		if (len < block_size && !no_fragments) {
+			/* The tail goes into a fragment block */
+			if (frag_used + len > block_size)
+				flush_fragment();
+			e->fragment = nr_fragments;
+			e->frag_offset = frag_used;
+			memcpy(frag_buf + frag_used, read_buf, len);
+			frag_used += len;
+			break;
+		}
+		if (len == block_size && is_zero(read_buf, len)) {
+			stat_holes++;
+			add_block(0);
+		} else
+			add_block(write_block(read_buf, len));
+		if (fd < 0 || len < block_size)
+			break;
+		len = read_full(fd, read_buf, block_size, e->path);
+	}
+
+	if (fd >= 0)
+		close(fd);
+	if (verbose)
+		printf("%s (%llu bytes)\n", e->path,
+		       (unsigned long long)e->size);
+}
+
+/*
+ * Writing metadata
+ */
+
+static unsigned char *build_directories(size_t *len)
+{
+	unsigned char *buf = NULL;
+	size_t size = 0, used = 0;
+	unsigned int n;
+	int i;
+
+	for (n = 0; n < nr_inodes; n++) {
+		struct entry *e = inodes[n];
+
+		if (!S_ISDIR(e->st.st_mode))
+			continue;
+		e->start = used;
+		for (i = 0; i < e->nr_children; i++) {
+			struct entry *c = e->children[i];
+			size_t name_len = strlen(c->name);
+			size_t de_len = CRAMFS2_DIRENT_SIZE(name_len);
+			struct cramfs2_dirent *de;
+
+			if (used + de_len > size) {
+				size = size ? size * 2 : 65536;
+				buf = xrealloc(buf, size);
+			}
+			de = (struct cramfs2_dirent *)(buf + used);
+			memset(de, 0, de_len);
+			de->ino = htole32(c->ino);
+			de->name_len = htole16(name_len);
+			de->type = (c->st.st_mode >> 12) & 15;
+			memcpy(de->name, c->name, name_len);
+			used += de_len;
+		}
+		e->size = used - e->start;
+	}
+	*len = used;
+	return buf;
+}
+
+static uint64_t encode_dev(dev_t dev)
+{
+	unsigned int major = (dev >> 8) & 0xfff;
+	unsigned int minor = (dev & 0xff) | ((dev >> 12) & 0xfff00);
+
+	return (minor & 0xff) | (major << 8) | ((minor & ~0xff) << 12);
+}
+
+static void write_inodes(void)
+{
+	unsigned int n;
+
+	for (n = 0; n < nr_inodes; n++) {
+		struct entry *e = inodes[n];
+		struct cramfs2_inode di;
+
+		memset(&di, 0, sizeof(di));
+		di.mode = htole16(e->st.st_mode);
+		di.nlink = htole32(e->nlink);
+		di.uid = htole32(e->st.st_uid);
+		di.gid = htole32(e->st.st_gid);
+		di.mtime = htole32(e->st.st_mtime);
+		di.block_list = htole32(e->block_list);
+		di.size = htole64(e->size);
+		di.start = htole64(e->start);
+		di.fragment = htole32(e->fragment);
+		di.frag_offset = htole32(e->frag_offset);
+		if (S_ISCHR(e->st.st_mode) || S_ISBLK(e->st.st_mode))
+			di.start = htole64(encode_dev(e->st.st_rdev));
+		write_out(&di, sizeof(di));
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct cramfs2_super super;
+	const char *name = "cramfs2";
+	unsigned char *dirs;
+	size_t dirs_len;
+	struct entry *root;
+	unsigned int n;
+	int c;
+
+	if (argc)
+		progname = argv[0];
+
+	while ((c = getopt(argc, argv, "hvb:c:Nn:")) != -1) {
+		switch (c) {
+		case 'h':
+			usage(0);
+		case 'v':
+			verbose = 1;
+			break;
+		case 'b': {
+			unsigned long size = strtoul(optarg, NULL, 0);
+
+			for (block_log = CRAMFS2_MIN_BLOCK_LOG;
+			     block_log <= CRAMFS2_MAX_BLOCK_LOG; block_log++)
+				if ((1UL << block_log) == size)
+					break;
+			if (block_log > CRAMFS2_MAX_BLOCK_LOG)
+				usage(1);
+			break;
+		}
+		case 'c':
+			if (!strcmp(optarg, "zlib"))
+				compression = CRAMFS2_COMPR_ZLIB;
+#ifdef WITH_LZO
+			else if (!strcmp(optarg, "lzo"))
+				compression = CRAMFS2_COMPR_LZO;
+#endif
+			else {
+				errno = 0;
+				die("unsupported compression method %s",
+				    optarg);
+			}
+			break;
+		case 'N':
+			no_fragments = 1;
+			break;
+		case 'n':
+			name = optarg;
+			break;
+		default:
+			usage(1);
+		}
+	}
+	if (argc - optind != 2)
+		usage(1);
+
+	block_size = 1 << block_log;
+	read_buf = xmalloc(block_size);
+	frag_buf = xmalloc(block_size);
+	compr_buf_size = block_size + block_size / 16 + 64 + 3;
+	compr_buf = xmalloc(compr_buf_size);
+#ifdef WITH_LZO
+	if (lzo_init() != LZO_E_OK) {
+		errno = 0;
+		die("lzo_init failed%s", "");
+	}
+	lzo_wrkmem = xmalloc(LZO1X_999_MEM_COMPRESS);
+#endif
+
+	root = scan(argv[optind], "");
+	if (!S_ISDIR(root->st.st_mode)) {
+		errno = ENOTDIR;
+		die("%s", argv[optind]);
+	}
+	number_inodes(root);
+
+	outfd = open(argv[optind + 1], O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (outfd < 0)
+		die("cannot create %s", argv[optind + 1]);
+
+	/* Leave room for the superblock; it is written last */
+	memset(&super, 0, sizeof(super));
+	write_out(&super, sizeof(super));
+
+	for (n = 0; n < nr_inodes; n++)
+		if (S_ISREG(inodes[n]->st.st_mode) ||
+		    S_ISLNK(inodes[n]->st.st_mode))
+			write_data(inodes[n]);
+	flush_fragment();
+
+	super.block_list_start = htole64(outpos);
+	write_out(block_list, nr_blocks * sizeof(*block_list));
+	super.fragment_table_start = htole64(outpos);
+	write_out(fragments, nr_fragments * sizeof(*fragments));
+
+	dirs = build_directories(&dirs_len);
+	super.inode_table_start = htole64(outpos);
+	write_inodes();
+	super.directory_table_start = htole64(outpos);
+	write_out(dirs, dirs_len);
+
+	super.magic = htole32(CRAMFS2_MAGIC);
+	super.version = htole16(CRAMFS2_VERSION);
+	super.compression = htole16(compression);
+	super.block_log = htole32(block_log);
+	super.bytes_used = htole64(outpos);
+	super.inodes = htole32(nr_inodes);
+	super.fragments = htole32(nr_fragments);
+	super.mkfs_time = htole32(time(NULL));
+	strncpy((char *)super.name, name, sizeof(super.name));
+
+	printf("%u inodes, %llu data blocks (%llu holes, %llu stored "
+	       "uncompressed), %u fragment blocks, %llu bytes\n",
+	       nr_inodes, (unsigned long long)stat_blocks,
+	       (unsigned long long)stat_holes, (unsigned long long)stat_raw,
+	       nr_fragments, (unsigned long long)outpos);
+
+	/* Pad to a whole page so the image can be used through a loop device */
+	if (outpos & 4095) {
+		static const unsigned char zero[4096];
+
+		write_out(zero, 4096 - (outpos & 4095));
+	}
+
+	if (pwrite(outfd, &super, sizeof(super), 0) != sizeof(super))
+		die("write failed%s", "");
+	if (close(outfd) < 0)
+		die("write failed%s", "");
+	return 0;
+}
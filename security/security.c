@@ -449,6 +449,15 @@ int security_inode_permission(struct inode *inode, int mask)
 	return security_ops->inode_permission(inode, mask);
 }
 
+/*
+ * Nonzero if security_inode_permission() allows everything, so that a
+ * caller which cannot pin the inode (RCU path walk) may leave it out.
+ */
+int security_inode_permission_trivial(void)
+{
+	return security_ops == &default_security_ops;
+}
+
 int security_inode_setattr(struct dentry *dentry, struct iattr *attr)
 {
 	if (unlikely(IS_PRIVATE(dentry->d_inode)))